@@ -0,0 +1,131 @@
+/*
+ * Host benchmark of the console parser and FTMS encoder.
+ *
+ * Usage: fdf_bench [--iterations N] [--chunk BYTES] <session.txt>
+ *
+ * The session file is a capture of the console's serial output. It is fed
+ * through the parser in USB-sized chunks, then every parsed snapshot is
+ * encoded as an FTMS Indoor Rower Data packet.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+#include "ftms_encoder.h"
+#include "host_util.h"
+
+#define DEFAULT_ITERATIONS 200
+#define DEFAULT_CHUNK_SIZE 64
+#define ENCODE_ROUNDS 100
+
+static uint64_t lines_parsed = 0;
+static fdf_rowing_data_t *snapshots = NULL;
+static size_t num_snapshots = 0;
+static size_t max_snapshots = 0;
+
+static void count_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    lines_parsed++;
+}
+
+static void collect_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    if (num_snapshots < max_snapshots) {
+        snapshots[num_snapshots++] = *data;
+    }
+}
+
+static void feed(fdf_parser_t *parser, const uint8_t *data, size_t size, size_t chunk)
+{
+    int64_t timestamp_us = 0;
+    for (size_t pos = 0; pos < size; pos += chunk) {
+        size_t len = size - pos < chunk ? size - pos : chunk;
+        fdf_parser_process_chunk(parser, data + pos, len, timestamp_us);
+        timestamp_us += 1000;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    size_t chunk = DEFAULT_CHUNK_SIZE;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            chunk = (size_t)atoi(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL || iterations <= 0 || chunk == 0) {
+        fprintf(stderr, "usage: %s [--iterations N] [--chunk BYTES] <session.txt>\n", argv[0]);
+        return 2;
+    }
+
+    size_t size = 0;
+    uint8_t *data = host_load_file(path, &size);
+    if (data == NULL) {
+        return 1;
+    }
+
+    static fdf_parser_t parser;
+
+    // Parse throughput
+    fdf_parser_init(&parser, 0);
+    fdf_parser_register_callback(&parser, count_callback);
+    int64_t start = fdf_port_time_us();
+    for (int i = 0; i < iterations; i++) {
+        fdf_parser_reset_session(&parser);
+        feed(&parser, data, size, chunk);
+    }
+    int64_t parse_us = fdf_port_time_us() - start;
+    if (parse_us <= 0) {
+        parse_us = 1;
+    }
+
+    // Collect one snapshot per line for the encoder
+    max_snapshots = (size_t)(lines_parsed / (uint64_t)iterations) + 1;
+    snapshots = calloc(max_snapshots, sizeof(fdf_rowing_data_t));
+    if (snapshots == NULL) {
+        free(data);
+        return 1;
+    }
+    fdf_parser_init(&parser, 0);
+    fdf_parser_register_callback(&parser, collect_callback);
+    feed(&parser, data, size, chunk);
+
+    // Encode throughput
+    ftms_packet_t encoded[FTMS_INDOOR_ROWER_MAX_PACKETS];
+    uint64_t packets = 0;
+    volatile uint32_t sink = 0;
+    start = fdf_port_time_us();
+    for (int round = 0; round < ENCODE_ROUNDS; round++) {
+        for (size_t i = 0; i < num_snapshots; i++) {
+            size_t count = ftms_encode_indoor_rower_data(&snapshots[i], FTMS_DEFAULT_PAYLOAD_LEN,
+                                                         encoded);
+            sink += encoded[count - 1].data[encoded[count - 1].len - 1];
+            packets += count;
+        }
+    }
+    int64_t encode_us = fdf_port_time_us() - start;
+
+    double parse_s = parse_us / 1e6;
+    printf("session:        %s (%zu bytes, %zu lines)\n", path, size, num_snapshots);
+    printf("parse:          %d iterations, %zu byte chunks, %.3f s\n", iterations, chunk, parse_s);
+    printf("  lines/sec:    %.0f\n", lines_parsed / parse_s);
+    printf("  bytes/sec:    %.0f\n", (double)size * iterations / parse_s);
+    printf("  ns/line:      %.1f\n", parse_us * 1000.0 / (double)lines_parsed);
+    printf("encode:         %" PRIu64 " packets, %.3f s\n", packets, encode_us / 1e6);
+    printf("  ns/packet:    %.1f\n", packets ? encode_us * 1000.0 / (double)packets : 0.0);
+
+    free(snapshots);
+    free(data);
+    return (lines_parsed > 0 && sink != 0xFFFFFFFF) ? 0 : 1;
+}
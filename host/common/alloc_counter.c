@@ -0,0 +1,45 @@
+#include <stddef.h>
+
+#include "alloc_counter.h"
+
+// glibc's allocator, which the wrappers below forward to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static volatile bool counting = false;
+static volatile uint64_t allocations = 0;
+
+void alloc_counter_enable(bool enable)
+{
+    counting = enable;
+}
+
+uint64_t alloc_counter_get(void)
+{
+    return allocations;
+}
+
+void *malloc(size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,24 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Heap allocation counter for the host programs
+ *
+ * Linking alloc_counter.c replaces malloc, calloc and realloc of the whole
+ * process (glibc) with wrappers that count calls while counting is enabled.
+ */
+
+/**
+ * @brief Start or stop counting allocations
+ */
+void alloc_counter_enable(bool enable);
+
+/**
+ * @brief Number of allocations counted so far
+ */
+uint64_t alloc_counter_get(void);
+
+#endif // ALLOC_COUNTER_H
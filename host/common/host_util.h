@@ -0,0 +1,22 @@
+#ifndef HOST_UTIL_H
+#define HOST_UTIL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Read a whole file into a malloc'd buffer
+ * @param path File to read
+ * @param size Filled with the file size
+ * @return Buffer to free(), or NULL on error
+ */
+uint8_t *host_load_file(const char *path, size_t *size);
+
+/**
+ * @brief Write a buffer to a file
+ * @return true on success
+ */
+bool host_save_file(const char *path, const uint8_t *data, size_t size);
+
+#endif // HOST_UTIL_H
@@ -0,0 +1,8 @@
+#include <stdbool.h>
+
+bool test_fdf_protocol(void);
+
+int main(void)
+{
+    return test_fdf_protocol() ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+/*
+ * Replay a recorded console session through the parser, the metrics stage and
+ * the FTMS encoder.
+ *
+ * Usage: fdf_replay [--speed N|max] [--expect-lines N] [--write out.fdfr] [--audit-heap]
+ *                   [--from-text capture.txt [--interval-ms N] | --from-hex dump.txt | session.fdfr]
+ *
+ * The session is either a raw stream log written by the device recorder, the
+ * same log as printed by the diagnostics command "record dump" (the device
+ * monitor output can be saved as is, lines outside the dump are skipped), or
+ * a plain text capture of a console that is turned into a log with one line
+ * every --interval-ms. Chunks are replayed with their recorded timing scaled
+ * by --speed, or back to back with --speed max. With --audit-heap the run
+ * fails if the parser or the encoder allocate while replaying.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+#include "fdf_metrics.h"
+#include "ftms_encoder.h"
+#include "session_log.h"
+#include "host_util.h"
+#include "alloc_counter.h"
+
+#define DEFAULT_INTERVAL_MS 1000
+#define HEX_DUMP_MARKER "FDFR-HEX "
+#define FNV_OFFSET_BASIS 0x811C9DC5u
+#define FNV_PRIME 0x01000193u
+
+typedef struct {
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t lines;
+    uint64_t updates;
+    uint64_t packets;
+    uint32_t checksum;            // FNV-1a over every encoded packet
+    uint32_t last_seq[CONFIG_FDF_MAX_CONSOLES];
+} replay_stats_t;
+
+static fdf_parser_t parsers[CONFIG_FDF_MAX_CONSOLES];
+static fdf_metrics_t metrics[CONFIG_FDF_MAX_CONSOLES];
+static replay_stats_t stats;
+
+static void update_checksum(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        stats.checksum = (stats.checksum ^ data[i]) * FNV_PRIME;
+    }
+}
+
+static void data_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    stats.lines++;
+
+    // Only changed snapshots are forwarded, as on the device
+    if (data->seq == stats.last_seq[console_id]) {
+        return;
+    }
+    stats.last_seq[console_id] = data->seq;
+    stats.updates++;
+
+    fdf_rowing_data_t snapshot = *data;
+    fdf_metrics_update(&metrics[console_id], &snapshot);
+
+    ftms_packet_t packets[FTMS_INDOOR_ROWER_MAX_PACKETS];
+    size_t count = ftms_encode_indoor_rower_data(&snapshot, FTMS_DEFAULT_PAYLOAD_LEN, packets);
+    update_checksum(&console_id, 1);
+    for (size_t i = 0; i < count; i++) {
+        update_checksum(packets[i].data, packets[i].len);
+    }
+    stats.packets += count;
+}
+
+static void chunk_callback(const session_log_chunk_t *chunk, void *ctx)
+{
+    if (chunk->console_id >= CONFIG_FDF_MAX_CONSOLES) {
+        return;
+    }
+    stats.chunks++;
+    stats.bytes += chunk->length;
+    fdf_parser_process_chunk(&parsers[chunk->console_id], chunk->data, chunk->length,
+                             chunk->timestamp_us);
+}
+
+// Build a log from a text capture, one line per interval
+static uint8_t *log_from_text(const uint8_t *text, size_t size, uint32_t interval_ms,
+                              size_t *log_size)
+{
+    session_log_buffer_t buf = {
+        .size = SESSION_LOG_HEADER_SIZE + size * 2 + SESSION_LOG_RECORD_OVERHEAD,
+    };
+    buf.buffer = malloc(buf.size);
+    if (buf.buffer == NULL) {
+        return NULL;
+    }
+
+    session_log_writer_t writer;
+    session_log_writer_init(&writer, session_log_buffer_sink, &buf);
+
+    int64_t timestamp_us = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (text[i] == '\n' || i == size - 1) {
+            if (!session_log_write_chunk(&writer, 0, timestamp_us, text + start, i + 1 - start)) {
+                free(buf.buffer);
+                return NULL;
+            }
+            timestamp_us += (int64_t)interval_ms * 1000;
+            start = i + 1;
+        }
+    }
+
+    *log_size = buf.used;
+    return buf.buffer;
+}
+
+static int hex_digit(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Decode the log printed by "record dump": a marker with the size, hex lines, an end marker
+static uint8_t *log_from_hex(const uint8_t *text, size_t size, size_t *log_size)
+{
+    size_t marker_len = strlen(HEX_DUMP_MARKER);
+    size_t pos = 0;
+    while (pos + marker_len <= size && memcmp(text + pos, HEX_DUMP_MARKER, marker_len) != 0) {
+        const uint8_t *newline = memchr(text + pos, '\n', size - pos);
+        pos = newline != NULL ? (size_t)(newline - text) + 1 : size;
+    }
+    if (pos + marker_len > size) {
+        fprintf(stderr, "no record dump found\n");
+        return NULL;
+    }
+    size_t expected = strtoul((const char *)text + pos + marker_len, NULL, 10);
+    uint8_t *log = malloc(expected > 0 ? expected : 1);
+    if (log == NULL) {
+        return NULL;
+    }
+
+    size_t used = 0;
+    bool ended = false;
+    const uint8_t *newline = memchr(text + pos, '\n', size - pos);
+    pos = newline != NULL ? (size_t)(newline - text) + 1 : size;
+    while (pos < size && !ended) {
+        newline = memchr(text + pos, '\n', size - pos);
+        size_t end = newline != NULL ? (size_t)(newline - text) : size;
+        if (end - pos >= marker_len && memcmp(text + pos, HEX_DUMP_MARKER, marker_len) == 0) {
+            ended = true;
+        }
+        for (size_t i = pos; !ended && i + 1 < end; i += 2) {
+            int high = hex_digit(text[i]);
+            int low = hex_digit(text[i + 1]);
+            if (high < 0 || low < 0 || used == expected) {
+                // Carriage returns and trailing spaces end a line, anything else is damage
+                if (high < 0 && (text[i] == '\r' || text[i] == ' ')) {
+                    break;
+                }
+                fprintf(stderr, "bad record dump line at offset %zu\n", i);
+                free(log);
+                return NULL;
+            }
+            log[used++] = (uint8_t)(high << 4 | low);
+        }
+        pos = end + 1;
+    }
+    if (!ended || used != expected) {
+        fprintf(stderr, "record dump holds %zu of %zu bytes\n", used, expected);
+        free(log);
+        return NULL;
+    }
+
+    *log_size = used;
+    return log;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--speed N|max] [--expect-lines N] [--write out.fdfr] [--audit-heap]\n"
+                    "       [--from-text capture.txt [--interval-ms N] | --from-hex dump.txt | session.fdfr]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t speed = SESSION_LOG_SPEED_MAX;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    long expect_lines = -1;
+    bool audit_heap = false;
+    const char *text_path = NULL;
+    const char *hex_path = NULL;
+    const char *write_path = NULL;
+    const char *log_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            i++;
+            speed = strcmp(argv[i], "max") == 0 ? SESSION_LOG_SPEED_MAX : (uint32_t)atoi(argv[i]);
+        } else if (strcmp(argv[i], "--interval-ms") == 0 && i + 1 < argc) {
+            interval_ms = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--expect-lines") == 0 && i + 1 < argc) {
+            expect_lines = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--from-text") == 0 && i + 1 < argc) {
+            text_path = argv[++i];
+        } else if (strcmp(argv[i], "--from-hex") == 0 && i + 1 < argc) {
+            hex_path = argv[++i];
+        } else if (strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+            write_path = argv[++i];
+        } else if (strcmp(argv[i], "--audit-heap") == 0) {
+            audit_heap = true;
+        } else if (argv[i][0] != '-') {
+            log_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if ((text_path != NULL) + (hex_path != NULL) + (log_path != NULL) != 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    size_t size = 0;
+    uint8_t *log = NULL;
+    if (text_path != NULL) {
+        uint8_t *text = host_load_file(text_path, &size);
+        if (text == NULL) {
+            return 1;
+        }
+        log = log_from_text(text, size, interval_ms, &size);
+        free(text);
+    } else if (hex_path != NULL) {
+        uint8_t *text = host_load_file(hex_path, &size);
+        if (text == NULL) {
+            return 1;
+        }
+        log = log_from_hex(text, size, &size);
+        free(text);
+    } else {
+        log = host_load_file(log_path, &size);
+    }
+    if (log == NULL) {
+        fprintf(stderr, "failed to load session\n");
+        return 1;
+    }
+
+    if (write_path != NULL && !host_save_file(write_path, log, size)) {
+        free(log);
+        return 1;
+    }
+
+    for (int i = 0; i < CONFIG_FDF_MAX_CONSOLES; i++) {
+        fdf_parser_init(&parsers[i], (uint8_t)i);
+        fdf_parser_register_callback(&parsers[i], data_callback);
+        fdf_metrics_init(&metrics[i]);
+    }
+    memset(&stats, 0, sizeof(stats));
+    stats.checksum = FNV_OFFSET_BASIS;
+
+    int64_t start = fdf_port_time_us();
+    alloc_counter_enable(true);
+    int replayed = session_log_replay(log, size, speed, chunk_callback, NULL);
+    alloc_counter_enable(false);
+    int64_t elapsed_us = fdf_port_time_us() - start;
+    uint64_t allocations = alloc_counter_get();
+    free(log);
+    if (replayed < 0) {
+        return 1;
+    }
+    if (elapsed_us <= 0) {
+        elapsed_us = 1;
+    }
+
+    printf("chunks:         %" PRIu64 " (%" PRIu64 " bytes)\n", stats.chunks, stats.bytes);
+    printf("lines:          %" PRIu64 "\n", stats.lines);
+    printf("updates:        %" PRIu64 "\n", stats.updates);
+    printf("packets:        %" PRIu64 "\n", stats.packets);
+    printf("checksum:       %08" PRIx32 "\n", stats.checksum);
+    printf("allocations:    %" PRIu64 " (%.3f per update)\n", allocations,
+           stats.updates ? (double)allocations / (double)stats.updates : 0.0);
+    printf("replay time:    %.3f s (%.0f lines/sec)\n", elapsed_us / 1e6,
+           stats.lines * 1e6 / (double)elapsed_us);
+
+    if (expect_lines >= 0 && stats.lines != (uint64_t)expect_lines) {
+        fprintf(stderr, "expected %ld lines, replayed %" PRIu64 "\n", expect_lines, stats.lines);
+        return 1;
+    }
+    if (audit_heap && allocations > 0) {
+        fprintf(stderr, "replay allocated %" PRIu64 " times\n", allocations);
+        return 1;
+    }
+    return 0;
+}
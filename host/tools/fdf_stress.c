@@ -0,0 +1,234 @@
+/*
+ * Drive the parser and FTMS encoder with synthetic console sessions.
+ *
+ * Usage: fdf_stress [--lines N] [--consoles N] [--chunk BYTES] [--rate LINES_PER_SEC]
+ *                   [--malformed PERMILLE] [--seed N] [--step-ms N]
+ *                   [--write out.fdfr] [--text out.txt]
+ *
+ * Every console runs its own generator (seed + console id). The byte stream
+ * is cut into chunks and fed to the parsers exactly like USB data; with
+ * --rate 0 (default) as fast as possible. The run fails if a line or a value
+ * change is lost. --write records the stream as a session log for fdf_replay,
+ * --text saves console 0's lines as a text capture.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+#include "fdf_synth.h"
+#include "ftms_encoder.h"
+#include "session_log.h"
+
+#define DEFAULT_LINES 100000
+#define DEFAULT_CHUNK_SIZE 64
+// Timestamp increment per line when running faster than real time
+#define LINE_INTERVAL_US 1000
+
+typedef struct {
+    fdf_synth_t synth;
+    fdf_parser_t parser;
+    uint64_t lines;
+    uint64_t updates;
+    uint32_t last_seq;
+} console_t;
+
+static console_t consoles[CONFIG_FDF_MAX_CONSOLES];
+static session_log_writer_t log_writer;
+static FILE *log_file = NULL;
+static FILE *text_file = NULL;
+static uint64_t chunks = 0;
+static int64_t chunk_time_total_ns = 0;
+static int64_t chunk_time_max_ns = 0;
+static uint32_t packet_sink = 0;
+
+// Chunks take well under a microsecond: time them with the full clock resolution
+static int64_t time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void data_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    console_t *console = &consoles[console_id];
+    console->lines++;
+    if (data->seq == console->last_seq) {
+        return;
+    }
+    console->last_seq = data->seq;
+    console->updates++;
+
+    ftms_packet_t packets[FTMS_INDOOR_ROWER_MAX_PACKETS];
+    size_t count = ftms_encode_indoor_rower_data(data, FTMS_DEFAULT_PAYLOAD_LEN, packets);
+    packet_sink += packets[count - 1].data[packets[count - 1].len - 1];
+}
+
+static void chunk_callback(const uint8_t *data, size_t length, int64_t timestamp_us, void *ctx)
+{
+    console_t *console = (console_t *)ctx;
+
+    if (log_file != NULL) {
+        session_log_write_chunk(&log_writer, console->parser.console_id, timestamp_us,
+                                data, length);
+    }
+    if (text_file != NULL && console == &consoles[0]) {
+        fwrite(data, 1, length, text_file);
+    }
+
+    int64_t start = time_ns();
+    fdf_parser_process_chunk(&console->parser, data, length, timestamp_us);
+    int64_t elapsed_ns = time_ns() - start;
+
+    chunks++;
+    chunk_time_total_ns += elapsed_ns;
+    if (elapsed_ns > chunk_time_max_ns) {
+        chunk_time_max_ns = elapsed_ns;
+    }
+}
+
+static bool file_sink(const uint8_t *head, size_t head_len, const uint8_t *data, size_t len,
+                      void *ctx)
+{
+    FILE *f = (FILE *)ctx;
+    return fwrite(head, 1, head_len, f) == head_len &&
+           (len == 0 || fwrite(data, 1, len, f) == len);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t num_lines = DEFAULT_LINES;
+    int num_consoles = 1;
+    size_t chunk = DEFAULT_CHUNK_SIZE;
+    uint32_t rate = 0;
+    const char *log_path = NULL;
+    const char *text_path = NULL;
+    fdf_synth_config_t config;
+
+    fdf_synth_default_config(&config);
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--lines") == 0) {
+            num_lines = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--consoles") == 0) {
+            num_consoles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0) {
+            chunk = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            rate = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--malformed") == 0) {
+            config.malformed_permille = (uint16_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--step-ms") == 0) {
+            config.step_ms = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--write") == 0) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "--text") == 0) {
+            text_path = argv[++i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (num_consoles < 1 || num_consoles > CONFIG_FDF_MAX_CONSOLES ||
+        chunk == 0 || chunk > FDF_SYNTH_MAX_CHUNK) {
+        fprintf(stderr, "consoles must be 1..%d, chunk 1..%d bytes\n",
+                CONFIG_FDF_MAX_CONSOLES, FDF_SYNTH_MAX_CHUNK);
+        return 2;
+    }
+
+    if (log_path != NULL) {
+        log_file = fopen(log_path, "wb");
+        if (log_file == NULL || !session_log_writer_init(&log_writer, file_sink, log_file)) {
+            perror(log_path);
+            return 1;
+        }
+    }
+    if (text_path != NULL) {
+        text_file = fopen(text_path, "wb");
+        if (text_file == NULL) {
+            perror(text_path);
+            return 1;
+        }
+    }
+
+    for (int c = 0; c < num_consoles; c++) {
+        fdf_synth_config_t console_config = config;
+        console_config.seed = config.seed + (uint32_t)c;
+        fdf_synth_init(&consoles[c].synth, &console_config);
+        fdf_parser_init(&consoles[c].parser, (uint8_t)c);
+        fdf_parser_register_callback(&consoles[c].parser, data_callback);
+    }
+
+    int64_t start = fdf_port_time_us();
+    uint32_t generated = 0;
+    int64_t timestamp_us = 0;
+    while (generated < num_lines) {
+        uint32_t batch = num_lines - generated;
+        if (rate > 0) {
+            // Emit the lines that are due by now
+            int64_t due = (fdf_port_time_us() - start) * rate / 1000000 + 1;
+            if (due <= generated) {
+                fdf_port_sleep_us(100);
+                continue;
+            }
+            if ((uint32_t)due - generated < batch) {
+                batch = (uint32_t)due - generated;
+            }
+            timestamp_us = fdf_port_time_us() - start;
+        }
+        for (int c = 0; c < num_consoles; c++) {
+            fdf_synth_emit(&consoles[c].synth, batch, chunk, timestamp_us,
+                           LINE_INTERVAL_US, chunk_callback, &consoles[c]);
+        }
+        generated += batch;
+        timestamp_us += (int64_t)batch * LINE_INTERVAL_US;
+    }
+    for (int c = 0; c < num_consoles; c++) {
+        fdf_synth_flush(&consoles[c].synth, timestamp_us, chunk_callback, &consoles[c]);
+    }
+    int64_t elapsed_us = fdf_port_time_us() - start;
+    if (elapsed_us <= 0) {
+        elapsed_us = 1;
+    }
+
+    if (log_file != NULL) {
+        fclose(log_file);
+    }
+    if (text_file != NULL) {
+        fclose(text_file);
+    }
+
+    int failures = 0;
+    uint64_t total_lines = 0;
+    for (int c = 0; c < num_consoles; c++) {
+        const console_t *console = &consoles[c];
+        const fdf_synth_stats_t *stats = &console->synth.stats;
+        total_lines += console->lines;
+        printf("console %d:      %" PRIu32 " lines (%" PRIu32 " malformed), %" PRIu64
+               " parsed, %" PRIu64 "/%" PRIu32 " updates\n",
+               c, stats->lines, stats->malformed, console->lines, console->updates,
+               stats->changed);
+        if (console->lines != stats->lines || console->updates != stats->changed) {
+            fprintf(stderr, "console %d lost data\n", c);
+            failures++;
+        }
+    }
+    printf("chunks:         %" PRIu64 " of %zu bytes\n", chunks, chunk);
+    printf("elapsed:        %.3f s (%.0f lines/sec)\n", elapsed_us / 1e6,
+           total_lines * 1e6 / (double)elapsed_us);
+    printf("chunk latency:  avg %.0f ns, max %" PRId64 " ns\n",
+           chunks ? (double)chunk_time_total_ns / (double)chunks : 0.0, chunk_time_max_ns);
+
+    return (failures == 0 && packet_sink != 0xFFFFFFFF) ? 0 : 1;
+}
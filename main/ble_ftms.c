@@ -15,16 +15,21 @@
 #include "esp_gatt_common_api.h"
 
 #include "ble_ftms.h"
+#include "fdf_trace.h"
+#include "session_export.h"
+#include "fdf_boot.h"
+#include "fdf_supervisor.h"
+#include "fdf_power.h"
+#include "fdf_config.h"
 
 static const char *TAG = "BLE_FTMS";
 
 // Bluetooth connection state
-static bool is_connected = false;
 static bool bt_initialized = false;
 
-// Current rowing data
-static fdf_rowing_data_t current_rowing_data = {0};
+// Data mutex protecting the per-instance rowing data
 static SemaphoreHandle_t data_mutex = NULL;
+static StaticSemaphore_t data_mutex_buffer;
 
 // Forward declarations
 static void gatts_event_handler(esp_gatts_cb_event_t event,
@@ -34,13 +39,118 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
 // FTMS Service UUIDs
 #define FTMS_SERVICE_UUID    0x1826
 #define INDOOR_ROWER_DATA_UUID 0x2AD1
+#define FITNESS_MACHINE_STATUS_UUID 0x2ADA
+#define FITNESS_MACHINE_CONTROL_POINT_UUID 0x2AD9
+#define FITNESS_MACHINE_FEATURE_UUID 0x2ACC
 
-// GATT interface
-static esp_gatt_if_t gatts_if = ESP_GATT_IF_NONE;
-static uint16_t service_handle = 0;
-static uint16_t char_handle = 0;
-static uint16_t conn_id = ESP_GATT_ILLEGAL_UUID;
-static bool notifications_enabled = false;
+// Attribute handles per FTMS service (service, 3 characteristics with values
+// and CCCDs, the feature characteristic with its value)
+#define FTMS_SERVICE_NUM_HANDLES 12
+
+// Data the bridge reports, and the targets a workout takes
+#define FTMS_MACHINE_FEATURES (FTMS_FEATURE_CADENCE | FTMS_FEATURE_TOTAL_DISTANCE | FTMS_FEATURE_PACE | \
+                               FTMS_FEATURE_EXPENDED_ENERGY | FTMS_FEATURE_ELAPSED_TIME | \
+                               FTMS_FEATURE_POWER_MEASUREMENT)
+#if CONFIG_FDF_WORKOUT
+#define FTMS_WORKOUT_FEATURES FTMS_FEATURE_REMAINING_TIME
+#define FTMS_TARGET_FEATURES (FTMS_TARGET_DISTANCE | FTMS_TARGET_TRAINING_TIME)
+#else
+#define FTMS_WORKOUT_FEATURES 0
+#define FTMS_TARGET_FEATURES 0
+#endif
+
+// Fitness Machine Feature value: machine features, then target setting features
+static uint8_t feature_value[8] = {
+    (FTMS_MACHINE_FEATURES | FTMS_WORKOUT_FEATURES) & 0xFF,
+    ((FTMS_MACHINE_FEATURES | FTMS_WORKOUT_FEATURES) >> 8) & 0xFF,
+    ((FTMS_MACHINE_FEATURES | FTMS_WORKOUT_FEATURES) >> 16) & 0xFF,
+    0,
+    FTMS_TARGET_FEATURES & 0xFF,
+    (FTMS_TARGET_FEATURES >> 8) & 0xFF,
+    (FTMS_TARGET_FEATURES >> 16) & 0xFF,
+    0,
+};
+
+// Control Point response: response op code, request op code, result
+#define CONTROL_RESPONSE_LEN 3
+
+// Connection supervision timeout; the interval bounds are settings (fdf_config.h),
+// whose ranges keep it above two intervals
+#define CONN_SUPERVISION_TIMEOUT 400    // 4 s, in 10 ms units
+
+// ATT MTU before the central negotiates, and the MTU offered: one that fits
+// a whole record, or the largest for bulk session export
+#define ATT_DEFAULT_MTU 23
+#if CONFIG_FDF_SESSION_EXPORT
+#define ATT_LOCAL_MTU (BLE_FTMS_MAX_EXPORT_PAYLOAD + 3)
+#else
+#define ATT_LOCAL_MTU (FTMS_INDOOR_ROWER_DATA_MAX_LEN + 3)
+#endif
+
+#if CONFIG_FDF_SESSION_EXPORT
+// Session export service and characteristics, F0DFxxxx-5E55-4A5B-9C3D-8E7F6A5B4C3D
+#define EXPORT_UUID(id) {0x3D, 0x4C, 0x5B, 0x6A, 0x7F, 0x8E, 0x3D, 0x9C, \
+                         0x5B, 0x4A, 0x55, 0x5E, (id) & 0xFF, (id) >> 8, 0xDF, 0xF0}
+#define EXPORT_SERVICE_ID 0x1000
+#define EXPORT_CONTROL_ID 0x1001
+#define EXPORT_DATA_ID 0x1002
+
+// Attribute handles of the export service (service, 2 characteristics with values, CCCD)
+#define EXPORT_SERVICE_NUM_HANDLES 6
+
+// Link layer payload and connection interval (1.25 ms units) while exporting
+#define EXPORT_DATA_LEN 251
+#define EXPORT_INTERVAL_MIN 6           // 7.5 ms
+#define EXPORT_INTERVAL_MAX 12          // 15 ms
+
+static struct {
+    uint16_t service_handle;
+    uint16_t control_handle;
+    uint16_t data_handle;
+    uint16_t cccd_handle;
+    ble_ftms_export_callback_t callback;
+} export_service;
+#endif
+
+// One FTMS service instance per console
+typedef struct {
+    uint16_t service_handle;
+    uint16_t char_handle;
+    uint16_t cccd_handle;
+    uint16_t status_handle;          // Fitness Machine Status value
+    uint16_t status_cccd_handle;
+    uint16_t control_handle;         // Fitness Machine Control Point value
+    uint16_t control_cccd_handle;
+    uint16_t feature_handle;         // Fitness Machine Feature value
+    bool controlled;                 // A central was granted control
+    uint16_t control_conn_id;        // The central in control
+    fdf_rowing_data_t rowing_data;   // Latest data, protected by data_mutex
+} ftms_instance_t;
+
+// One entry per connected central
+typedef struct {
+    bool in_use;
+    uint16_t conn_id;
+    uint8_t instance;                // FTMS instance bound at connection, the one advertised
+    uint32_t subscribed;             // Bit per FTMS instance with notifications enabled
+    uint32_t status_subscribed;      // Bit per FTMS instance with Machine Status notifications enabled
+    uint32_t control_subscribed;     // Bit per FTMS instance with Control Point indications enabled
+    esp_bd_addr_t remote_bda;        // Peer address, for connection parameter updates
+    uint16_t requested_interval;     // Last connection interval requested (1.25 ms units)
+    uint16_t mtu;                    // Negotiated ATT MTU
+    uint16_t interval;               // Current connection interval (1.25 ms units), 0 until known
+    bool export_subscribed;          // Notifications enabled on the export data characteristic
+    bool exporting;                  // An export runs, the link is set up for throughput
+    bool congested;                  // The stack is out of buffers for this link
+} ftms_connection_t;
+
+static ftms_instance_t instances[BLE_FTMS_MAX_INSTANCES];
+static ftms_connection_t connections[BLE_FTMS_MAX_CONNECTIONS];
+static int num_connections = 0;
+static volatile bool advertising = false;
+static uint8_t advertised_instance = 0;  // Instance a central connecting now is bound to
+static ble_ftms_stats_t stats;
+static ble_ftms_control_callback_t control_callback = NULL;
 
 // Application profile structure
 struct gatts_profile_inst {
@@ -56,6 +166,290 @@ static struct gatts_profile_inst profile_tab = {
     .gatts_if = ESP_GATT_IF_NONE,
 };
 
+/**
+ * @brief Configure advertising data and start advertising
+ */
+static esp_err_t start_advertising(void)
+{
+    fdf_config_t config;
+    fdf_config_read(&config);
+    
+    // Advertise the first instance no central is bound to
+    uint32_t bound = 0;
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use) {
+            bound |= 1u << connections[i].instance;
+        }
+    }
+    advertised_instance = 0;
+    while (advertised_instance < BLE_FTMS_MAX_INSTANCES && (bound & (1u << advertised_instance))) {
+        advertised_instance++;
+    }
+    if (advertised_instance == BLE_FTMS_MAX_INSTANCES) {
+        return ESP_OK;
+    }
+    
+    // Each console has its own name, the configured one with its number
+    char name[FDF_CONFIG_NAME_MAX + 1];
+    if (BLE_FTMS_MAX_INSTANCES > 1) {
+        snprintf(name, sizeof(name), "%.*s %d", FDF_CONFIG_NAME_MAX - 2, config.device_name,
+                 advertised_instance + 1);
+    } else {
+        snprintf(name, sizeof(name), "%s", config.device_name);
+    }
+    
+    esp_ble_adv_data_t adv_data = {0};
+    adv_data.set_scan_rsp = false;
+    adv_data.include_name = true;
+    adv_data.include_txpower = true;
+    adv_data.service_uuid_len = 2;
+    uint8_t service_uuid[2] = {0x26, 0x18}; // FTMS UUID in little-endian
+    adv_data.p_service_uuid = service_uuid;
+    
+    esp_ble_gap_set_device_name(name);
+    esp_ble_gap_config_adv_data(&adv_data);
+    
+    esp_ble_adv_params_t adv_params = {
+        .adv_int_min = config.adv_interval_min,
+        .adv_int_max = config.adv_interval_max,
+        .adv_type = ADV_TYPE_IND,
+        .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+        .channel_map = ADV_CHNL_ALL,
+        .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+    };
+    return esp_ble_gap_start_advertising(&adv_params);
+}
+
+/**
+ * @brief Create the FTMS service of a given instance
+ */
+static void create_ftms_service(esp_gatt_if_t gatts_if, uint8_t inst)
+{
+    esp_gatt_srvc_id_t service_id = {
+        .is_primary = true,
+        .id = {
+            .uuid = {
+                .len = ESP_UUID_LEN_16,
+                .uuid = {.uuid16 = FTMS_SERVICE_UUID}
+            },
+            .inst_id = inst
+        }
+    };
+    
+    esp_ble_gatts_create_service(gatts_if, &service_id, FTMS_SERVICE_NUM_HANDLES);
+}
+
+#if CONFIG_FDF_SESSION_EXPORT
+/**
+ * @brief Create the session export service
+ */
+static void create_export_service(esp_gatt_if_t gatts_if)
+{
+    esp_gatt_srvc_id_t service_id = {
+        .is_primary = true,
+        .id = {
+            .uuid = {
+                .len = ESP_UUID_LEN_128,
+                .uuid = {.uuid128 = EXPORT_UUID(EXPORT_SERVICE_ID)}
+            },
+            .inst_id = 0
+        }
+    };
+    
+    esp_ble_gatts_create_service(gatts_if, &service_id, EXPORT_SERVICE_NUM_HANDLES);
+}
+
+/**
+ * @brief Set a central's link up for bulk transfer, or hand it back to the cadence
+ */
+static void set_export_link(ftms_connection_t *conn, bool exporting)
+{
+    if (conn->exporting == exporting) {
+        return;
+    }
+    conn->exporting = exporting;
+    
+    if (exporting) {
+        // Longest link layer packets on the 2M PHY, several per short interval
+        esp_ble_gap_set_pkt_data_len(conn->remote_bda, EXPORT_DATA_LEN);
+        esp_ble_gap_set_preferred_phy(conn->remote_bda, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                      ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+        esp_ble_conn_update_params_t conn_params = {
+            .min_int = EXPORT_INTERVAL_MIN,
+            .max_int = EXPORT_INTERVAL_MAX,
+            .latency = 0,
+            .timeout = CONN_SUPERVISION_TIMEOUT,
+        };
+        memcpy(conn_params.bda, conn->remote_bda, sizeof(esp_bd_addr_t));
+        esp_ble_gap_update_conn_params(&conn_params);
+    }
+    
+    // The next console update renegotiates the interval
+    conn->requested_interval = 0;
+}
+#endif
+
+/**
+ * @brief Start a complete FTMS service, then create the next one
+ */
+static void start_ftms_service(esp_gatt_if_t gatts_if, ftms_instance_t *instance)
+{
+    esp_ble_gatts_start_service(instance->service_handle);
+    int inst = instance - instances;
+    ESP_LOGI(TAG, "FTMS service %d started", inst);
+    
+    // Create the next instance, or advertise once all are up
+    if (inst + 1 < BLE_FTMS_MAX_INSTANCES) {
+        create_ftms_service(gatts_if, inst + 1);
+    } else {
+#if CONFIG_FDF_SESSION_EXPORT
+        create_export_service(gatts_if);
+#else
+        start_advertising();
+#endif
+    }
+}
+
+/**
+ * @brief Find the FTMS instance owning a service handle
+ */
+static ftms_instance_t *find_instance(uint16_t service_handle)
+{
+    for (int i = 0; i < BLE_FTMS_MAX_INSTANCES; i++) {
+        if (instances[i].service_handle == service_handle) {
+            return &instances[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the connection entry of a connection id
+ */
+static ftms_connection_t *find_connection(uint16_t id)
+{
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use && connections[i].conn_id == id) {
+            return &connections[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the FTMS instance of a handle a central writes: Control Point or a CCCD
+ * @return Instance index, -1 for another handle
+ */
+static int find_written_instance(uint16_t handle)
+{
+    for (int i = 0; i < BLE_FTMS_MAX_INSTANCES && handle != 0; i++) {
+        if (handle == instances[i].control_handle || handle == instances[i].cccd_handle ||
+            handle == instances[i].status_cccd_handle || handle == instances[i].control_cccd_handle) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Find the FTMS instance of a Control Point value handle
+ * @return Instance index, -1 if the handle is not a Control Point
+ */
+static int find_control_instance(uint16_t handle)
+{
+    for (int i = 0; i < BLE_FTMS_MAX_INSTANCES; i++) {
+        if (instances[i].control_handle != 0 && instances[i].control_handle == handle) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Notify a Fitness Machine Status to the centrals subscribed to an instance
+ */
+static void notify_status(uint8_t instance, uint8_t *status, uint16_t len)
+{
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use && (connections[i].status_subscribed & (1u << instance))) {
+            esp_ble_gatts_send_indicate(profile_tab.gatts_if, connections[i].conn_id,
+                                        instances[instance].status_handle, len, status, false);
+        }
+    }
+}
+
+/**
+ * @brief Handle a Control Point request and indicate the response
+ */
+static void handle_control_point(int inst, ftms_connection_t *conn, const uint8_t *request, uint16_t len)
+{
+    ftms_instance_t *instance = &instances[inst];
+    uint8_t op = request[0];
+    uint8_t result;
+    
+    if (op == FTMS_CONTROL_REQUEST_CONTROL) {
+        // One central at a time; it keeps control until it disconnects
+        if (!instance->controlled || instance->control_conn_id == conn->conn_id) {
+            instance->controlled = true;
+            instance->control_conn_id = conn->conn_id;
+            result = FTMS_RESULT_SUCCESS;
+        } else {
+            result = FTMS_RESULT_CONTROL_NOT_PERMITTED;
+        }
+    } else if (!instance->controlled || instance->control_conn_id != conn->conn_id) {
+        result = FTMS_RESULT_CONTROL_NOT_PERMITTED;
+    } else if (control_callback == NULL) {
+        result = FTMS_RESULT_NOT_SUPPORTED;
+    } else {
+        result = control_callback((uint8_t)inst, request, len);
+    }
+    
+    uint8_t response[CONTROL_RESPONSE_LEN] = {FTMS_CONTROL_RESPONSE, op, result};
+    esp_ble_gatts_send_indicate(profile_tab.gatts_if, conn->conn_id, instance->control_handle,
+                                sizeof(response), response, true);
+    ESP_LOGI(TAG, "FTMS service %d: control op 0x%02x, result %d", inst, op, result);
+    if (result != FTMS_RESULT_SUCCESS) {
+        return;
+    }
+    
+    // Every central learns what changed
+    uint8_t status[4];
+    uint16_t status_len = 0;
+    switch (op) {
+        case FTMS_CONTROL_RESET:
+            status[status_len++] = FTMS_STATUS_RESET;
+            break;
+        case FTMS_CONTROL_START_OR_RESUME:
+            status[status_len++] = FTMS_STATUS_STARTED_OR_RESUMED;
+            break;
+        case FTMS_CONTROL_STOP_OR_PAUSE:
+            if (len >= 2) {
+                status[status_len++] = FTMS_STATUS_STOPPED_OR_PAUSED;
+                status[status_len++] = request[1];
+            }
+            break;
+        case FTMS_CONTROL_SET_TARGETED_DISTANCE:
+            if (len >= 4) {
+                status[status_len++] = FTMS_STATUS_TARGETED_DISTANCE_CHANGED;
+                memcpy(&status[status_len], &request[1], 3);
+                status_len += 3;
+            }
+            break;
+        case FTMS_CONTROL_SET_TARGETED_TIME:
+            if (len >= 3) {
+                status[status_len++] = FTMS_STATUS_TARGETED_TIME_CHANGED;
+                memcpy(&status[status_len], &request[1], 2);
+                status_len += 2;
+            }
+            break;
+        default:
+            break;
+    }
+    if (status_len > 0) {
+        notify_status(inst, status, status_len);
+    }
+}
+
 /**
  * @brief GAP event handler
  */
@@ -72,13 +466,30 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event,
                 ESP_LOGE(TAG, "Advertising start failed");
             } else {
                 ESP_LOGI(TAG, "Advertising started successfully");
+                advertising = true;
+                fdf_boot_mark(FDF_BOOT_ADVERTISING);
             }
             break;
         
         case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+            advertising = false;
             ESP_LOGI(TAG, "Advertisement stopped");
             break;
         
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            ESP_LOGI(TAG, "Connection parameters updated: status %d, interval %d, latency %d, timeout %d",
+                     param->update_conn_params.status, param->update_conn_params.conn_int,
+                     param->update_conn_params.latency, param->update_conn_params.timeout);
+            if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+                for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+                    if (connections[i].in_use &&
+                        memcmp(connections[i].remote_bda, param->update_conn_params.bda, sizeof(esp_bd_addr_t)) == 0) {
+                        connections[i].interval = param->update_conn_params.conn_int;
+                    }
+                }
+            }
+            break;
+        
         default:
             break;
     }
@@ -95,31 +506,42 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
         case ESP_GATTS_REG_EVT:
             if (param->reg.status == ESP_GATT_OK) {
                 profile_tab.gatts_if = gatts_if;
-                gatts_if = gatts_if;
                 ESP_LOGI(TAG, "GATTS registered successfully, interface: %d", gatts_if);
                 
-                // Create FTMS service
-                esp_gatt_srvc_id_t service_id = {
-                    .is_primary = true,
-                    .id = {
-                        .uuid = {
-                            .len = ESP_UUID_LEN_16,
-                            .uuid = {.uuid16 = FTMS_SERVICE_UUID}
-                        },
-                        .inst_id = 0
-                    }
-                };
-                
-                esp_ble_gatts_create_service(gatts_if, &service_id, 5);
+                // Services are created one after the other, starting with instance 0
+                create_ftms_service(gatts_if, 0);
             } else {
                 ESP_LOGE(TAG, "GATTS registration failed");
             }
             break;
         
-        case ESP_GATTS_CREATE_EVT:
-            if (param->create.status == ESP_GATT_OK) {
-                service_handle = param->create.service_handle;
-                ESP_LOGI(TAG, "FTMS service created, handle: %d", service_handle);
+        case ESP_GATTS_CREATE_EVT: {
+#if CONFIG_FDF_SESSION_EXPORT
+            if (param->create.service_id.id.uuid.len == ESP_UUID_LEN_128) {
+                if (param->create.status != ESP_GATT_OK) {
+                    ESP_LOGE(TAG, "Export service creation failed");
+                    start_advertising();
+                    break;
+                }
+                export_service.service_handle = param->create.service_handle;
+                
+                // Control point, written by the client without response
+                esp_bt_uuid_t char_uuid = {
+                    .len = ESP_UUID_LEN_128,
+                    .uuid = {.uuid128 = EXPORT_UUID(EXPORT_CONTROL_ID)}
+                };
+                esp_attr_control_t control = {0};
+                esp_ble_gatts_add_char(export_service.service_handle, &char_uuid,
+                                       ESP_GATT_PERM_WRITE,
+                                       ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR,
+                                       NULL, &control);
+                break;
+            }
+#endif
+            uint8_t inst = param->create.service_id.id.inst_id;
+            if (param->create.status == ESP_GATT_OK && inst < BLE_FTMS_MAX_INSTANCES) {
+                instances[inst].service_handle = param->create.service_handle;
+                ESP_LOGI(TAG, "FTMS service %d created, handle: %d", inst, param->create.service_handle);
                 
                 // Create Indoor Rower Data characteristic
                 esp_bt_uuid_t char_uuid = {
@@ -128,14 +550,14 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
                 };
                 
                 esp_attr_value_t char_val = {
-                    .attr_max_len = 20,
+                    .attr_max_len = FTMS_INDOOR_ROWER_DATA_MAX_LEN,
                     .attr_len = 0,
                     .attr_value = NULL
                 };
                 
                 esp_attr_control_t control = {0};
                 
-                esp_ble_gatts_add_char(service_handle, &char_uuid,
+                esp_ble_gatts_add_char(param->create.service_handle, &char_uuid,
                                      ESP_GATT_PERM_READ,
                                      ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_NOTIFY,
                                      &char_val, &control);
@@ -143,71 +565,306 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
                 ESP_LOGE(TAG, "Service creation failed");
             }
             break;
+        }
         
-        case ESP_GATTS_ADD_CHAR_EVT:
-            if (param->add_char.status == ESP_GATT_OK) {
-                char_handle = param->add_char.attr_handle;
-                ESP_LOGI(TAG, "Indoor Rower Data characteristic added, handle: %d", char_handle);
+        case ESP_GATTS_ADD_CHAR_EVT: {
+#if CONFIG_FDF_SESSION_EXPORT
+            if (param->add_char.service_handle == export_service.service_handle &&
+                export_service.service_handle != 0) {
+                if (param->add_char.status != ESP_GATT_OK) {
+                    ESP_LOGE(TAG, "Export characteristic addition failed");
+                    start_advertising();
+                } else if (export_service.control_handle == 0) {
+                    export_service.control_handle = param->add_char.attr_handle;
+                    
+                    // Data, notified without confirmation
+                    esp_bt_uuid_t char_uuid = {
+                        .len = ESP_UUID_LEN_128,
+                        .uuid = {.uuid128 = EXPORT_UUID(EXPORT_DATA_ID)}
+                    };
+                    esp_attr_control_t control = {0};
+                    esp_ble_gatts_add_char(export_service.service_handle, &char_uuid,
+                                           ESP_GATT_PERM_READ, ESP_GATT_CHAR_PROP_BIT_NOTIFY,
+                                           NULL, &control);
+                } else {
+                    export_service.data_handle = param->add_char.attr_handle;
+                    esp_bt_uuid_t cccd_uuid = {
+                        .len = ESP_UUID_LEN_16,
+                        .uuid = {.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG}
+                    };
+                    esp_ble_gatts_add_char_descr(export_service.service_handle, &cccd_uuid,
+                                                 ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                                 NULL, NULL);
+                }
+                break;
+            }
+#endif
+            ftms_instance_t *instance = find_instance(param->add_char.service_handle);
+            if (param->add_char.status == ESP_GATT_OK && instance != NULL) {
+                if (instance->char_handle == 0) {
+                    instance->char_handle = param->add_char.attr_handle;
+                    ESP_LOGI(TAG, "Indoor Rower Data characteristic added, handle: %d", instance->char_handle);
+                } else if (instance->status_handle == 0) {
+                    instance->status_handle = param->add_char.attr_handle;
+                } else if (instance->control_handle == 0) {
+                    instance->control_handle = param->add_char.attr_handle;
+                } else {
+                    // Fitness Machine Feature, the last one, has no descriptor
+                    instance->feature_handle = param->add_char.attr_handle;
+                    start_ftms_service(gatts_if, instance);
+                    break;
+                }
                 
-                // Start the service
-                esp_ble_gatts_start_service(service_handle);
-                ESP_LOGI(TAG, "FTMS service started");
+                // Add Client Characteristic Configuration Descriptor for notifications
+                esp_bt_uuid_t cccd_uuid = {
+                    .len = ESP_UUID_LEN_16,
+                    .uuid = {.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG}
+                };
+                esp_ble_gatts_add_char_descr(instance->service_handle, &cccd_uuid,
+                                             ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                             NULL, NULL);
+            } else {
+                ESP_LOGE(TAG, "Characteristic addition failed");
+            }
+            break;
+        }
+        
+        case ESP_GATTS_ADD_CHAR_DESCR_EVT: {
+#if CONFIG_FDF_SESSION_EXPORT
+            if (param->add_char_descr.service_handle == export_service.service_handle &&
+                export_service.service_handle != 0) {
+                if (param->add_char_descr.status == ESP_GATT_OK) {
+                    export_service.cccd_handle = param->add_char_descr.attr_handle;
+                    esp_ble_gatts_start_service(export_service.service_handle);
+                    ESP_LOGI(TAG, "Session export service started");
+                } else {
+                    ESP_LOGE(TAG, "Export descriptor addition failed");
+                }
+                start_advertising();
+                break;
+            }
+#endif
+            ftms_instance_t *instance = find_instance(param->add_char_descr.service_handle);
+            if (param->add_char_descr.status == ESP_GATT_OK && instance != NULL && instance->cccd_handle == 0) {
+                instance->cccd_handle = param->add_char_descr.attr_handle;
                 
-                // Start advertising
-                esp_ble_adv_data_t adv_data = {0};
-                adv_data.set_scan_rsp = false;
-                adv_data.include_name = true;
-                adv_data.include_txpower = true;
-                adv_data.service_uuid_len = 2;
-                uint8_t service_uuid[2] = {0x26, 0x18}; // FTMS UUID in little-endian
-                adv_data.p_service_uuid = service_uuid;
+                // Then Fitness Machine Status, notified when the console's data goes stale or fresh
+                esp_bt_uuid_t char_uuid = {
+                    .len = ESP_UUID_LEN_16,
+                    .uuid = {.uuid16 = FITNESS_MACHINE_STATUS_UUID}
+                };
+                esp_attr_control_t control = {0};
+                esp_ble_gatts_add_char(instance->service_handle, &char_uuid,
+                                       ESP_GATT_PERM_READ, ESP_GATT_CHAR_PROP_BIT_NOTIFY,
+                                       NULL, &control);
+            } else if (param->add_char_descr.status == ESP_GATT_OK && instance != NULL &&
+                       instance->status_cccd_handle == 0) {
+                instance->status_cccd_handle = param->add_char_descr.attr_handle;
                 
-                esp_ble_gap_set_device_name("FDF Rower");
-                esp_ble_gap_config_adv_data(&adv_data);
+                // Then the Control Point, written by the central in control and answered by indication
+                esp_bt_uuid_t char_uuid = {
+                    .len = ESP_UUID_LEN_16,
+                    .uuid = {.uuid16 = FITNESS_MACHINE_CONTROL_POINT_UUID}
+                };
+                esp_attr_control_t control = {0};
+                esp_ble_gatts_add_char(instance->service_handle, &char_uuid,
+                                       ESP_GATT_PERM_WRITE,
+                                       ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_INDICATE,
+                                       NULL, &control);
+            } else if (param->add_char_descr.status == ESP_GATT_OK && instance != NULL) {
+                instance->control_cccd_handle = param->add_char_descr.attr_handle;
                 
-                esp_ble_adv_params_t adv_params = {
-                    .adv_int_min = 0x20,
-                    .adv_int_max = 0x40,
-                    .adv_type = ADV_TYPE_IND,
-                    .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
-                    .channel_map = ADV_CHNL_ALL,
-                    .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+                // Then Fitness Machine Feature, a constant the stack answers reads of
+                esp_bt_uuid_t char_uuid = {
+                    .len = ESP_UUID_LEN_16,
+                    .uuid = {.uuid16 = FITNESS_MACHINE_FEATURE_UUID}
+                };
+                esp_attr_value_t char_val = {
+                    .attr_max_len = sizeof(feature_value),
+                    .attr_len = sizeof(feature_value),
+                    .attr_value = feature_value
                 };
-                esp_ble_gap_start_advertising(&adv_params);
+                esp_attr_control_t control = {.auto_rsp = ESP_GATT_AUTO_RSP};
+                esp_ble_gatts_add_char(instance->service_handle, &char_uuid,
+                                       ESP_GATT_PERM_READ, ESP_GATT_CHAR_PROP_BIT_READ,
+                                       &char_val, &control);
             } else {
-                ESP_LOGE(TAG, "Characteristic addition failed");
+                ESP_LOGE(TAG, "Descriptor addition failed");
             }
             break;
+        }
         
-        case ESP_GATTS_CONNECT_EVT:
-            is_connected = true;
-            conn_id = param->connect.conn_id;
-            notifications_enabled = false;
-            ESP_LOGI(TAG, "Client connected, conn_id: %d", conn_id);
+        case ESP_GATTS_CONNECT_EVT: {
+            advertising = false;
+            ftms_connection_t *conn = NULL;
+            for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS && conn == NULL; i++) {
+                if (!connections[i].in_use) {
+                    conn = &connections[i];
+                }
+            }
+            if (conn != NULL) {
+                conn->in_use = true;
+                conn->conn_id = param->connect.conn_id;
+                conn->instance = advertised_instance;
+                conn->subscribed = 0;
+                conn->status_subscribed = 0;
+                conn->control_subscribed = 0;
+                conn->requested_interval = 0;
+                conn->mtu = ATT_DEFAULT_MTU;
+                conn->interval = 0;
+                conn->export_subscribed = false;
+                conn->exporting = false;
+                conn->congested = false;
+                memcpy(conn->remote_bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+                num_connections++;
+#if CONFIG_FDF_POWER_MANAGEMENT
+                // Full CPU clock while a central may be subscribed
+                fdf_power_acquire(FDF_POWER_STAGE_BLE);
+#endif
+            }
+            ESP_LOGI(TAG, "Client connected, conn_id: %d, FTMS service %d (%d/%d)",
+                     param->connect.conn_id, conn != NULL ? conn->instance : -1,
+                     num_connections, BLE_FTMS_MAX_CONNECTIONS);
+            fdf_supervisor_post(FDF_SUP_BLE_CONNECTED, param->connect.conn_id);
+            
+            // A connection ends advertising; keep advertising so the next rower's app can connect
+            if (num_connections < BLE_FTMS_MAX_CONNECTIONS) {
+                start_advertising();
+            }
             break;
+        }
         
-        case ESP_GATTS_DISCONNECT_EVT:
-            is_connected = false;
-            conn_id = ESP_GATT_ILLEGAL_UUID;
-            notifications_enabled = false;
-            ESP_LOGI(TAG, "Client disconnected");
+        case ESP_GATTS_DISCONNECT_EVT: {
+            ftms_connection_t *conn = find_connection(param->disconnect.conn_id);
+            if (conn != NULL) {
+                conn->in_use = false;
+                conn->subscribed = 0;
+                num_connections--;
+                
+                // The next central may take control
+                for (int i = 0; i < BLE_FTMS_MAX_INSTANCES; i++) {
+                    if (instances[i].controlled && instances[i].control_conn_id == conn->conn_id) {
+                        instances[i].controlled = false;
+                    }
+                }
+#if CONFIG_FDF_POWER_MANAGEMENT
+                fdf_power_release(FDF_POWER_STAGE_BLE);
+#endif
+            }
+            ESP_LOGI(TAG, "Client disconnected, conn_id: %d", param->disconnect.conn_id);
+            fdf_supervisor_post(FDF_SUP_BLE_DISCONNECTED, param->disconnect.conn_id);
             break;
+        }
         
-        case ESP_GATTS_WRITE_EVT:
+        case ESP_GATTS_MTU_EVT: {
+            ftms_connection_t *conn = find_connection(param->mtu.conn_id);
+            if (conn != NULL) {
+                conn->mtu = param->mtu.mtu;
+            }
+            ESP_LOGI(TAG, "MTU %d negotiated, conn_id: %d", param->mtu.mtu, param->mtu.conn_id);
+            break;
+        }
+        
+        case ESP_GATTS_CONGEST_EVT: {
+            ftms_connection_t *conn = find_connection(param->congest.conn_id);
+            if (conn != NULL) {
+                conn->congested = param->congest.congested;
+            }
+            if (param->congest.congested) {
+                stats.congestion_events++;
+                fdf_supervisor_post(FDF_SUP_BLE_CONGESTED, param->congest.conn_id);
+            }
+            break;
+        }
+        
+        case ESP_GATTS_WRITE_EVT: {
+            // Control Point requests are answered by indication, which the central must have enabled
+            int control_inst = find_control_instance(param->write.handle);
+            int written_inst = find_written_instance(param->write.handle);
+            ftms_connection_t *writer = find_connection(param->write.conn_id);
+            esp_gatt_status_t write_status = ESP_GATT_OK;
+            if (written_inst >= 0 && (writer == NULL || writer->instance != written_inst)) {
+                // A central only subscribes to and controls the console it is bound to
+                write_status = ESP_GATT_WRITE_NOT_PERMIT;
+            } else if (control_inst >= 0 && !(writer->control_subscribed & (1u << control_inst))) {
+                write_status = ESP_GATT_CCC_CFG_ERR;
+            }
+            
             // Handle CCCD (Client Characteristic Configuration Descriptor) writes
             if (param->write.need_rsp) {
                 esp_gatt_rsp_t rsp = {0};
                 rsp.attr_value.len = 0;
                 rsp.attr_value.handle = param->write.handle;
-                esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, ESP_GATT_OK, &rsp);
+                esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, write_status, &rsp);
+            }
+            if (write_status == ESP_GATT_WRITE_NOT_PERMIT) {
+                break;
+            }
+            if (control_inst >= 0) {
+                if (write_status == ESP_GATT_OK && param->write.len > 0) {
+                    handle_control_point(control_inst, writer, param->write.value, param->write.len);
+                }
+                break;
+            }
+#if CONFIG_FDF_SESSION_EXPORT
+            if (param->write.handle == export_service.control_handle) {
+                ftms_connection_t *conn = find_connection(param->write.conn_id);
+                if (conn != NULL && param->write.len > 0) {
+                    if (param->write.value[0] == SESSION_EXPORT_OP_START) {
+                        set_export_link(conn, true);
+                    } else if (param->write.value[0] == SESSION_EXPORT_OP_STOP) {
+                        set_export_link(conn, false);
+                    }
+                }
+                if (export_service.callback != NULL) {
+                    export_service.callback(param->write.conn_id, param->write.value, param->write.len);
+                }
+                break;
             }
+            if (param->write.handle == export_service.cccd_handle && param->write.len == 2) {
+                ftms_connection_t *conn = find_connection(param->write.conn_id);
+                if (conn != NULL) {
+                    conn->export_subscribed = param->write.value[0] & 0x01;
+                }
+                break;
+            }
+#endif
             // Check if this is a CCCD write (notifications enable/disable)
-            if (param->write.handle == char_handle + 1 && param->write.len == 2) {
-                uint16_t cccd_value = param->write.value[0] | (param->write.value[1] << 8);
-                notifications_enabled = (cccd_value & 0x01); // Check bit 0 for notifications
-                ESP_LOGI(TAG, "Notifications %s", notifications_enabled ? "enabled" : "disabled");
+            if (param->write.len == 2) {
+                ftms_connection_t *conn = find_connection(param->write.conn_id);
+                for (int i = 0; i < BLE_FTMS_MAX_INSTANCES && conn != NULL; i++) {
+                    uint16_t cccd_value = param->write.value[0] | (param->write.value[1] << 8);
+                    bool enabled = (cccd_value & 0x01); // Check bit 0 for notifications
+                    if (param->write.handle == instances[i].control_cccd_handle) {
+                        // Bit 1 for indications
+                        if (cccd_value & 0x02) {
+                            conn->control_subscribed |= (1u << i);
+                        } else {
+                            conn->control_subscribed &= ~(1u << i);
+                        }
+                        continue;
+                    }
+                    if (param->write.handle == instances[i].status_cccd_handle) {
+                        if (enabled) {
+                            conn->status_subscribed |= (1u << i);
+                        } else {
+                            conn->status_subscribed &= ~(1u << i);
+                        }
+                        continue;
+                    }
+                    if (param->write.handle != instances[i].cccd_handle) {
+                        continue;
+                    }
+                    if (enabled) {
+                        conn->subscribed |= (1u << i);
+                    } else {
+                        conn->subscribed &= ~(1u << i);
+                    }
+                    ESP_LOGI(TAG, "Notifications %s for FTMS service %d", enabled ? "enabled" : "disabled", i);
+                }
             }
             break;
+        }
         
         default:
             break;
@@ -224,7 +881,7 @@ bool ble_ftms_init(void)
     ESP_LOGI(TAG, "Initializing Bluetooth FTMS service");
     
     // Create mutex for data access
-    data_mutex = xSemaphoreCreateMutex();
+    data_mutex = xSemaphoreCreateMutexStatic(&data_mutex_buffer);
     if (data_mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create mutex");
         return false;
@@ -322,6 +979,12 @@ bool ble_ftms_init(void)
     }
     ESP_LOGI(TAG, "Application profile registered successfully");
     
+    // Let centrals negotiate an MTU that takes a whole record in one notification
+    ret = esp_ble_gatt_set_local_mtu(ATT_LOCAL_MTU);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set local MTU: %s", esp_err_to_name(ret));
+    }
+    
     // Service creation and advertising will happen in GATTS event callbacks
     
     bt_initialized = true;
@@ -331,114 +994,231 @@ bool ble_ftms_init(void)
 }
 
 /**
- * @brief Format Indoor Rower Data packet according to FTMS specification
+ * @brief Update FTMS data with new rowing metrics
  */
-static void format_indoor_rower_data(const fdf_rowing_data_t *data, uint8_t *packet, size_t *packet_len)
+void ble_ftms_update_data(const fdf_rowing_data_t *data)
 {
-    size_t idx = 0;
-    
-    // Flags (2 bytes) - indicate which fields are present
-    uint16_t flags = 0;
-    flags |= FTMS_FLAG_TOTAL_DISTANCE_PRESENT;
-    flags |= FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT;
-    flags |= FTMS_FLAG_AVERAGE_PACE_PRESENT;
-    flags |= FTMS_FLAG_EXPANDED_ENERGY_PRESENT;
-    flags |= FTMS_FLAG_ELAPSED_TIME_PRESENT;
-    flags |= FTMS_FLAG_POWER_OUTPUT_PRESENT;
-    flags |= FTMS_FLAG_STEP_RATE_PRESENT;
-    
-    packet[idx++] = flags & 0xFF;
-    packet[idx++] = (flags >> 8) & 0xFF;
-    
-    // Stroke Rate (2 bytes) - strokes per minute
-    uint16_t stroke_rate = data->stroke_rate;
-    packet[idx++] = stroke_rate & 0xFF;
-    packet[idx++] = (stroke_rate >> 8) & 0xFF;
-    
-    // Stroke Count (2 bytes)
-    uint16_t stroke_count = data->stroke_count;
-    packet[idx++] = stroke_count & 0xFF;
-    packet[idx++] = (stroke_count >> 8) & 0xFF;
-    
-    // Average Stroke Rate (2 bytes)
-    uint16_t avg_stroke_rate = data->avg_stroke_rate;
-    packet[idx++] = avg_stroke_rate & 0xFF;
-    packet[idx++] = (avg_stroke_rate >> 8) & 0xFF;
-    
-    // Total Distance (3 bytes) - in meters
-    uint32_t distance = data->distance_m;
-    packet[idx++] = distance & 0xFF;
-    packet[idx++] = (distance >> 8) & 0xFF;
-    packet[idx++] = (distance >> 16) & 0xFF;
-    
-    // Instantaneous Pace (2 bytes) - 1/100th seconds per 500m
-    uint16_t pace = data->pace_500m_ms / 10; // convert ms to 1/100th seconds
-    packet[idx++] = pace & 0xFF;
-    packet[idx++] = (pace >> 8) & 0xFF;
-    
-    // Average Pace (2 bytes)
-    uint16_t avg_pace = data->avg_pace_500m_ms / 10;
-    packet[idx++] = avg_pace & 0xFF;
-    packet[idx++] = (avg_pace >> 8) & 0xFF;
-    
-    // Instantaneous Power (2 bytes) - watts
-    uint16_t power = data->power_watts;
-    packet[idx++] = power & 0xFF;
-    packet[idx++] = (power >> 8) & 0xFF;
-    
-    // Average Power (2 bytes)
-    uint16_t avg_power = data->avg_power_watts;
-    packet[idx++] = avg_power & 0xFF;
-    packet[idx++] = (avg_power >> 8) & 0xFF;
-    
-    // Total Energy (2 bytes) - calories
-    uint16_t calories = data->calories;
-    packet[idx++] = calories & 0xFF;
-    packet[idx++] = (calories >> 8) & 0xFF;
-    
-    // Energy Per Hour (2 bytes) - calories per hour
-    uint16_t energy_per_hr = calories; // Simplified - use total calories
-    packet[idx++] = energy_per_hr & 0xFF;
-    packet[idx++] = (energy_per_hr >> 8) & 0xFF;
-    
-    // Elapsed Time (2 bytes) - seconds
-    uint16_t elapsed_time = data->elapsed_time_ms / 1000;
-    packet[idx++] = elapsed_time & 0xFF;
-    packet[idx++] = (elapsed_time >> 8) & 0xFF;
-    
-    *packet_len = idx;
+    ble_ftms_update_instance(0, data);
 }
 
 /**
- * @brief Update FTMS data with new rowing metrics
+ * @brief Update the FTMS service instance of a console with new rowing metrics
  */
-void ble_ftms_update_data(const fdf_rowing_data_t *data)
+void ble_ftms_update_instance(uint8_t instance, const fdf_rowing_data_t *data)
 {
-    if (!data || data_mutex == NULL) {
+    if (!data || data_mutex == NULL || instance >= BLE_FTMS_MAX_INSTANCES) {
         return;
     }
     
     // Update data with mutex protection
     if (xSemaphoreTake(data_mutex, portMAX_DELAY) == pdTRUE) {
-        memcpy(&current_rowing_data, data, sizeof(fdf_rowing_data_t));
+        // Until ble_ftms_set_stale() clears it, the data stays marked stale and is not sent
+        bool stale = instances[instance].rowing_data.stale;
+        memcpy(&instances[instance].rowing_data, data, sizeof(fdf_rowing_data_t));
+        instances[instance].rowing_data.stale = stale;
         xSemaphoreGive(data_mutex);
         
-        ESP_LOGI(TAG, "FTMS data updated - Strokes: %" PRIu16 ", Distance: %" PRIu32 " m, Rate: %" PRIu16 " spm, Power: %" PRIu16 " W", 
-                 data->stroke_count, data->distance_m, data->stroke_rate, data->power_watts);
+        if (num_connections == 0 || stale) {
+            return;
+        }
         
-        // Send GATT notification if client is connected and subscribed
-        if (is_connected && notifications_enabled && conn_id != ESP_GATT_ILLEGAL_UUID) {
-            uint8_t packet[20]; // FTMS Indoor Rower Data packet is max 20 bytes
-            size_t packet_len;
-            
-            format_indoor_rower_data(data, packet, &packet_len);
+        // Encoded per payload size, so centrals sharing an MTU share the packets
+        ftms_packet_t packets[FTMS_INDOOR_ROWER_MAX_PACKETS];
+        size_t num_packets = 0;
+        size_t encoded_len = 0;
+        uint32_t record_len = 0;
+        
+        // Send GATT notifications to every client subscribed to this instance
+        uint32_t sent = 0;
+        for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+            if (!connections[i].in_use || !(connections[i].subscribed & (1u << instance))) {
+                continue;
+            }
+            size_t payload_len = connections[i].mtu - 3;
+            if (num_packets == 0 || payload_len != encoded_len) {
+                num_packets = ftms_encode_indoor_rower_data(data, payload_len, packets);
+                encoded_len = payload_len;
+                record_len = 0;
+                for (size_t p = 0; p < num_packets; p++) {
+                    record_len += packets[p].len;
+                }
+            }
             
-            esp_err_t ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, char_handle, packet_len, packet, false);
+            esp_err_t ret = ESP_OK;
+            for (size_t p = 0; p < num_packets && ret == ESP_OK; p++) {
+                ret = esp_ble_gatts_send_indicate(profile_tab.gatts_if, connections[i].conn_id,
+                                                  instances[instance].char_handle,
+                                                  packets[p].len, packets[p].data, false);
+            }
             if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send notification: %s", esp_err_to_name(ret));
+                FDF_TRACE(FDF_TRACE_NOTIFY_ERROR, instance, connections[i].conn_id, (uint32_t)ret, 0, 0);
+                stats.notifications_failed++;
+            } else {
+                sent++;
+                stats.notifications_sent++;
             }
         }
+        if (sent > 0) {
+            FDF_TRACE(FDF_TRACE_NOTIFY, instance, record_len, sent, 0, 0);
+            fdf_boot_mark(FDF_BOOT_FIRST_NOTIFY);
+        }
+    }
+}
+
+/**
+ * @brief Mark the data of an instance as stale or fresh, and tell the centrals
+ */
+void ble_ftms_set_stale(uint8_t instance, bool stale)
+{
+    if (instance >= BLE_FTMS_MAX_INSTANCES || data_mutex == NULL) {
+        return;
+    }
+    
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    bool changed = instances[instance].rowing_data.stale != stale;
+    instances[instance].rowing_data.stale = stale;
+    xSemaphoreGive(data_mutex);
+    if (!changed) {
+        return;
+    }
+    
+    // FTMS has no status for lost sensor data; a pause is what apps show best
+    uint8_t status[2] = {FTMS_STATUS_STOPPED_OR_PAUSED, FTMS_STATUS_PARAM_PAUSE};
+    uint16_t status_len = 2;
+    if (!stale) {
+        status[0] = FTMS_STATUS_STARTED_OR_RESUMED;
+        status_len = 1;
+    }
+    notify_status(instance, status, status_len);
+    ESP_LOGI(TAG, "FTMS service %d: data %s", instance, stale ? "stale, paused" : "fresh, resumed");
+}
+
+/**
+ * @brief Register the handler of Fitness Machine Control Point requests
+ */
+void ble_ftms_register_control_callback(ble_ftms_control_callback_t callback)
+{
+    control_callback = callback;
+}
+
+/**
+ * @brief Match connection intervals to the update cadence of a console
+ */
+void ble_ftms_set_update_interval(uint8_t instance, uint32_t interval_us)
+{
+    if (instance >= BLE_FTMS_MAX_INSTANCES || interval_us == 0) {
+        return;
+    }
+    
+    // Two connection events per console update keep latency below one update
+    fdf_config_t config;
+    fdf_config_read(&config);
+    uint32_t target = interval_us / 2 / 1250;
+    if (target < config.conn_interval_min) {
+        target = config.conn_interval_min;
+    } else if (target > config.conn_interval_max) {
+        target = config.conn_interval_max;
+    }
+    
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+        ftms_connection_t *conn = &connections[i];
+        if (!conn->in_use || !(conn->subscribed & (1u << instance)) || conn->exporting) {
+            continue;
+        }
+        
+        // Only renegotiate when the cadence moved by more than 25%
+        uint32_t current = conn->requested_interval;
+        uint32_t delta = target > current ? target - current : current - target;
+        if (current != 0 && delta * 4 <= current) {
+            continue;
+        }
+        
+        esp_ble_conn_update_params_t conn_params = {
+            .min_int = (uint16_t)(target * 3 / 4),
+            .max_int = (uint16_t)target,
+            .latency = 0,
+            .timeout = CONN_SUPERVISION_TIMEOUT,
+        };
+        memcpy(conn_params.bda, conn->remote_bda, sizeof(esp_bd_addr_t));
+        
+        if (esp_ble_gap_update_conn_params(&conn_params) == ESP_OK) {
+            conn->requested_interval = (uint16_t)target;
+            FDF_TRACE(FDF_TRACE_CONN_INTERVAL, instance, target * 5 / 4, interval_us / 1000, 0, 0);
+        }
+    }
+}
+
+#if CONFIG_FDF_SESSION_EXPORT
+/**
+ * @brief Register the handler of the session export service
+ */
+void ble_ftms_register_export_callback(ble_ftms_export_callback_t callback)
+{
+    export_service.callback = callback;
+}
+
+/**
+ * @brief Largest export packet a central takes
+ */
+size_t ble_ftms_export_payload_len(uint16_t conn_id)
+{
+    ftms_connection_t *conn = find_connection(conn_id);
+    if (conn == NULL || !conn->export_subscribed) {
+        return 0;
+    }
+    return conn->mtu - 3;
+}
+
+/**
+ * @brief Send an export data packet as a notification
+ */
+bool ble_ftms_send_export(uint16_t conn_id, const uint8_t *data, size_t len)
+{
+    ftms_connection_t *conn = find_connection(conn_id);
+    if (conn == NULL || !conn->export_subscribed || conn->congested) {
+        return false;
+    }
+    return esp_ble_gatts_send_indicate(profile_tab.gatts_if, conn_id, export_service.data_handle,
+                                       len, (uint8_t *)data, false) == ESP_OK;
+}
+#endif
+
+/**
+ * @brief Get the notification counters
+ */
+void ble_ftms_get_stats(ble_ftms_stats_t *out)
+{
+    memcpy(out, &stats, sizeof(ble_ftms_stats_t));
+}
+
+/**
+ * @brief Clear the notification counters
+ */
+void ble_ftms_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(ble_ftms_stats_t));
+}
+
+/**
+ * @brief List the connected centrals
+ */
+size_t ble_ftms_get_connections(ble_ftms_conn_info_t *info, size_t max_count)
+{
+    size_t count = 0;
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS && count < max_count; i++) {
+        const ftms_connection_t *conn = &connections[i];
+        if (!conn->in_use) {
+            continue;
+        }
+        info[count].conn_id = conn->conn_id;
+        info[count].mtu = conn->mtu;
+        info[count].interval = conn->interval;
+        info[count].subscribed = conn->subscribed;
+        info[count].congested = conn->congested;
+        info[count].exporting = conn->exporting;
+        count++;
     }
+    return count;
 }
 
 /**
@@ -446,7 +1226,7 @@ void ble_ftms_update_data(const fdf_rowing_data_t *data)
  */
 bool ble_ftms_is_connected(void)
 {
-    return is_connected && bt_initialized;
+    return num_connections > 0 && bt_initialized;
 }
 
 /**
@@ -458,30 +1238,13 @@ void ble_ftms_start_advertising(void)
         ESP_LOGW(TAG, "Bluetooth not initialized, cannot advertise");
         return;
     }
+    if (advertising) {
+        return;
+    }
     
     ESP_LOGI(TAG, "Starting advertising...");
     
-    esp_ble_adv_data_t adv_data = {0};
-    adv_data.set_scan_rsp = false;
-    adv_data.include_name = true;
-    adv_data.include_txpower = true;
-    adv_data.service_uuid_len = 2;
-    uint8_t service_uuid[2] = {0x26, 0x18}; // FTMS UUID in little-endian
-    adv_data.p_service_uuid = service_uuid;
-    
-    esp_ble_gap_set_device_name("FDF Rower");
-    esp_ble_gap_config_adv_data(&adv_data);
-    
-    esp_ble_adv_params_t adv_params = {
-        .adv_int_min = 0x20,
-        .adv_int_max = 0x40,
-        .adv_type = ADV_TYPE_IND,
-        .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
-        .channel_map = ADV_CHNL_ALL,
-        .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
-    };
-    
-    esp_err_t ret = esp_ble_gap_start_advertising(&adv_params);
+    esp_err_t ret = start_advertising();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start advertising: %s", esp_err_to_name(ret));
     } else {
@@ -550,6 +1313,17 @@ void ble_ftms_deinit(void)
         ESP_LOGE(TAG, "Failed to deinit BT controller: %s", esp_err_to_name(ret));
     }
     
+    // The stack is gone without reporting the open connections as closed
+    for (int i = 0; i < BLE_FTMS_MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use) {
+            connections[i].in_use = false;
+#if CONFIG_FDF_POWER_MANAGEMENT
+            fdf_power_release(FDF_POWER_STAGE_BLE);
+#endif
+        }
+    }
+    num_connections = 0;
+    
     // Delete mutex
     if (data_mutex != NULL) {
         vSemaphoreDelete(data_mutex);
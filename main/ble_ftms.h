@@ -3,38 +3,20 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
 #include "fdf_protocol.h"
+#include "ftms_encoder.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// FTMS Indoor Rower Data flags
-#define FTMS_FLAG_MORE_DATA                   0x01
-#define FTMS_FLAG_AVG_SPEED_PRESENT           0x02
-#define FTMS_FLAG_TOTAL_DISTANCE_PRESENT       0x04
-#define FTMS_FLAG_INCLINATION_PRESENT          0x08
-#define FTMS_FLAG_ELEVATION_GAIN_PRESENT       0x10
-#define FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT   0x20
-#define FTMS_FLAG_AVERAGE_PACE_PRESENT         0x40
-#define FTMS_FLAG_EXPANDED_ENERGY_PRESENT      0x80
-#define FTMS_FLAG_HEART_RATE_PRESENT           0x100
-#define FTMS_FLAG_METABOLIC_EQUIVALENT_PRESENT 0x200
-#define FTMS_FLAG_ELAPSED_TIME_PRESENT         0x400
-#define FTMS_FLAG_REMAINING_TIME_PRESENT       0x800
-#define FTMS_FLAG_FORCE_ON_BELT_PRESENT        0x1000
-#define FTMS_FLAG_POWER_OUTPUT_PRESENT         0x2000
-#define FTMS_FLAG_SPEED_PRESENT                0x4000
-#define FTMS_FLAG_STEP_RATE_PRESENT            0x8000
-
-// FTMS Indoor Rower Data flags for rowing
-#define FTMS_INDOOR_ROWER_FLAGS (FTMS_FLAG_TOTAL_DISTANCE_PRESENT | \
-                                 FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT | \
-                                 FTMS_FLAG_AVERAGE_PACE_PRESENT | \
-                                 FTMS_FLAG_EXPANDED_ENERGY_PRESENT | \
-                                 FTMS_FLAG_ELAPSED_TIME_PRESENT | \
-                                 FTMS_FLAG_POWER_OUTPUT_PRESENT | \
-                                 FTMS_FLAG_STEP_RATE_PRESENT)
+// One FTMS service instance per console
+#define BLE_FTMS_MAX_INSTANCES CONFIG_FDF_MAX_CONSOLES
+
+// One central (rowing app) per console
+#define BLE_FTMS_MAX_CONNECTIONS CONFIG_FDF_MAX_CONSOLES
 
 /**
  * @brief Initialize Bluetooth FTMS service
@@ -48,6 +30,131 @@ bool ble_ftms_init(void);
  */
 void ble_ftms_update_data(const fdf_rowing_data_t *data);
 
+/**
+ * @brief Update the FTMS service instance of a console with new rowing metrics
+ * @param instance FTMS instance (console id)
+ * @param data Pointer to rowing data structure
+ */
+void ble_ftms_update_instance(uint8_t instance, const fdf_rowing_data_t *data);
+
+/**
+ * @brief Mark the data of an FTMS service instance as stale, or fresh again
+ *
+ * Subscribed centrals get a Fitness Machine Status notification on every
+ * change: paused when the data goes stale, resumed when it is fresh again.
+ * No Indoor Rower Data is notified for a stale instance.
+ *
+ * @param instance Service instance (console slot)
+ * @param stale Whether the console stopped sending
+ */
+void ble_ftms_set_stale(uint8_t instance, bool stale);
+
+/**
+ * @brief Handler of Fitness Machine Control Point requests
+ *
+ * Called from the Bluetooth task with the requests of the central in
+ * control of an instance; Request Control is answered by the service
+ * itself. The result goes back to the central in the response indication,
+ * and successful standard requests are also notified as Fitness Machine
+ * Status. Must not block.
+ *
+ * @param instance FTMS instance (console id)
+ * @param data Request: op code and parameters
+ * @param len Request length, at least 1
+ * @return FTMS_RESULT_* code
+ */
+typedef uint8_t (*ble_ftms_control_callback_t)(uint8_t instance, const uint8_t *data, size_t len);
+
+/**
+ * @brief Register the handler of Fitness Machine Control Point requests
+ *
+ * Without one, every request but Request Control is answered as not
+ * supported.
+ *
+ * @param callback Function handling the requests
+ */
+void ble_ftms_register_control_callback(ble_ftms_control_callback_t callback);
+
+/**
+ * @brief Match connection intervals to the update cadence of a console
+ *
+ * Centrals subscribed to the instance are asked for a connection interval
+ * of about half the console update interval, so notifications go out
+ * without waiting while the radio stays idle between updates.
+ *
+ * @param instance FTMS instance (console id)
+ * @param interval_us Estimated console update interval in microseconds
+ */
+void ble_ftms_set_update_interval(uint8_t instance, uint32_t interval_us);
+
+// Notification counters, all instances
+typedef struct {
+    uint32_t notifications_sent;    // Records sent to a central, in one or more packets
+    uint32_t notifications_failed;  // Records the stack did not take
+    uint32_t congestion_events;     // Times a link ran out of buffers
+} ble_ftms_stats_t;
+
+// State of a connected central
+typedef struct {
+    uint16_t conn_id;
+    uint16_t mtu;                   // Negotiated ATT MTU
+    uint16_t interval;              // Connection interval (1.25 ms units), 0 until known
+    uint32_t subscribed;            // Bit per FTMS instance with notifications enabled
+    bool congested;
+    bool exporting;
+} ble_ftms_conn_info_t;
+
+// Largest export packet: the largest ATT MTU (517) - 3
+#define BLE_FTMS_MAX_EXPORT_PAYLOAD 514
+
+// Called with every write to the session export control point
+typedef void (*ble_ftms_export_callback_t)(uint16_t conn_id, const uint8_t *data, size_t len);
+
+/**
+ * @brief Register the handler of the session export service
+ *
+ * The export service sits next to the FTMS services when
+ * CONFIG_FDF_SESSION_EXPORT is enabled (see session_export.h).
+ *
+ * @param callback Function receiving control point writes
+ */
+void ble_ftms_register_export_callback(ble_ftms_export_callback_t callback);
+
+/**
+ * @brief Largest export packet a central takes
+ * @param conn_id Connection of the central
+ * @return ATT MTU - 3, or 0 if the central is gone or not subscribed
+ */
+size_t ble_ftms_export_payload_len(uint16_t conn_id);
+
+/**
+ * @brief Send an export data packet as a notification
+ * @param conn_id Connection of the central
+ * @param data Packet
+ * @param len Packet length, at most ble_ftms_export_payload_len()
+ * @return true if the packet was queued, false if the link is congested or gone
+ */
+bool ble_ftms_send_export(uint16_t conn_id, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get the notification counters
+ * @param stats Pointer to structure to fill
+ */
+void ble_ftms_get_stats(ble_ftms_stats_t *stats);
+
+/**
+ * @brief Clear the notification counters
+ */
+void ble_ftms_reset_stats(void);
+
+/**
+ * @brief List the connected centrals
+ * @param info Filled with one entry per central
+ * @param max_count Entries info holds
+ * @return Number of entries filled
+ */
+size_t ble_ftms_get_connections(ble_ftms_conn_info_t *info, size_t max_count);
+
 /**
  * @brief Check if any clients are connected
  * @return true if connected, false otherwise
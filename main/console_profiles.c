@@ -0,0 +1,77 @@
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#include "console_profiles.h"
+
+// CDC line coding constants (USB CDC PSTN 1.2, table 17)
+#define STOP_BITS_1   0
+#define PARITY_NONE   0
+#define DATA_BITS_8   8
+
+// Serial settings of FDF consoles, whichever adapter is in the cable: 9600 8N1
+static const cdc_acm_line_coding_t fdf_line_coding = {
+    .dwDTERate = 9600,
+    .bCharFormat = STOP_BITS_1,
+    .bParityType = PARITY_NONE,
+    .bDataBits = DATA_BITS_8,
+};
+
+// Known CDC-ACM class adapters found in console USB cables, by the control lines they need
+static const console_profile_t known_profiles[] = {
+    {
+        .name = "WCH CH9102",
+        .vid = 0x1a86, .pid = 0x55d4,
+        .dtr = true, .rts = true,
+    },
+    {
+        .name = "STMicroelectronics Virtual COM Port",
+        .vid = 0x0483, .pid = 0x5740,
+        .dtr = true, .rts = false,
+    },
+    {
+        .name = "Microchip MCP2200",
+        .vid = 0x04d8, .pid = 0x00df,
+        .dtr = true, .rts = true,
+    },
+    {
+        .name = "Microchip MCP2221",
+        .vid = 0x04d8, .pid = 0x00dd,
+        .dtr = true, .rts = true,
+    },
+};
+
+// Applied to any other CDC-ACM device
+static const console_profile_t fallback_profile = {
+    .name = "Generic CDC-ACM",
+    .vid = CDC_HOST_ANY_VID, .pid = CDC_HOST_ANY_PID,
+    .dtr = true, .rts = true,
+};
+
+const console_profile_t *console_profile_find(uint16_t vid, uint16_t pid)
+{
+    for (size_t i = 0; i < sizeof(known_profiles) / sizeof(known_profiles[0]); i++) {
+        if (known_profiles[i].vid == vid && known_profiles[i].pid == pid) {
+            return &known_profiles[i];
+        }
+    }
+    return &fallback_profile;
+}
+
+bool console_profile_is_known(uint16_t vid, uint16_t pid)
+{
+    return console_profile_find(vid, pid) != &fallback_profile;
+}
+
+const cdc_acm_line_coding_t *console_line_coding(void)
+{
+    return &fdf_line_coding;
+}
+
+console_dialect_t console_dialect(void)
+{
+#if CONFIG_FDF_CONSOLE_POLL_ENABLE
+    return CONSOLE_DIALECT_POLLED;
+#else
+    return CONSOLE_DIALECT_STREAMING;
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef CONSOLE_PROFILES_H
+#define CONSOLE_PROFILES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb/cdc_acm_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How a console delivers its data
+typedef enum {
+    CONSOLE_DIALECT_STREAMING,    // Console pushes KEY:VALUE lines on its own
+    CONSOLE_DIALECT_POLLED        // Console answers status requests with KEY:VALUE lines
+} console_dialect_t;
+
+// Known console adapter; the line coding and dialect belong to the console, not the adapter
+typedef struct {
+    const char *name;                   // Human readable adapter name
+    uint16_t vid;                       // USB Vendor ID (CDC_HOST_ANY_VID matches any)
+    uint16_t pid;                       // USB Product ID (CDC_HOST_ANY_PID matches any)
+    bool dtr;                           // DTR state after open
+    bool rts;                           // RTS state after open
+} console_profile_t;
+
+/**
+ * @brief Find the profile of a console adapter
+ *
+ * Exact VID/PID matches win over the generic fallback profile, so this
+ * never returns NULL.
+ *
+ * @param vid USB Vendor ID
+ * @param pid USB Product ID
+ * @return Matching profile
+ */
+const console_profile_t *console_profile_find(uint16_t vid, uint16_t pid);
+
+/**
+ * @brief Check if a VID/PID is in the allowlist of known adapters
+ * @param vid USB Vendor ID
+ * @param pid USB Product ID
+ * @return true if an exact entry exists, false if only the fallback matches
+ */
+bool console_profile_is_known(uint16_t vid, uint16_t pid);
+
+/**
+ * @brief Line coding of FDF consoles, applied whatever the adapter
+ * @return Baud rate, stop bits, parity, data bits
+ */
+const cdc_acm_line_coding_t *console_line_coding(void);
+
+/**
+ * @brief Protocol dialect spoken by the consoles
+ * @return CONSOLE_DIALECT_POLLED with CONFIG_FDF_CONSOLE_POLL_ENABLE, streaming otherwise
+ */
+console_dialect_t console_dialect(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONSOLE_PROFILES_H
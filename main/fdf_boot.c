@@ -0,0 +1,74 @@
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "fdf_boot.h"
+
+static const char *TAG = "BOOT";
+
+static const char *const phase_names[FDF_BOOT_PHASE_COUNT] = {
+    [FDF_BOOT_NVS] = "nvs",
+    [FDF_BOOT_BLE_STACK] = "ble stack",
+    [FDF_BOOT_ADVERTISING] = "advertising",
+    [FDF_BOOT_USB_HOST] = "usb host",
+    [FDF_BOOT_STORAGE] = "storage",
+    [FDF_BOOT_FIRST_DATA] = "first data",
+    [FDF_BOOT_FIRST_NOTIFY] = "first notify",
+};
+
+static EventGroupHandle_t boot_events = NULL;
+static StaticEventGroup_t boot_events_buffer;
+
+// Time each phase was reached, 0 until then
+static volatile int64_t phase_time_us[FDF_BOOT_PHASE_COUNT];
+
+void fdf_boot_init(void)
+{
+    if (boot_events == NULL) {
+        boot_events = xEventGroupCreateStatic(&boot_events_buffer);
+    }
+}
+
+void fdf_boot_mark(fdf_boot_phase_t phase)
+{
+    if (phase >= FDF_BOOT_PHASE_COUNT || phase_time_us[phase] != 0 || boot_events == NULL) {
+        return;
+    }
+
+    // Two tasks racing on the first mark both land here; the later time wins
+    int64_t now = esp_timer_get_time();
+    phase_time_us[phase] = now;
+    xEventGroupSetBits(boot_events, FDF_BOOT_BIT(phase));
+    ESP_LOGI(TAG, "%s at %" PRId64 " ms", phase_names[phase], now / 1000);
+}
+
+bool fdf_boot_wait(uint32_t bits, uint32_t timeout_ms)
+{
+    if (boot_events == NULL) {
+        return false;
+    }
+    EventBits_t set = xEventGroupWaitBits(boot_events, bits, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (set & bits) == bits;
+}
+
+int64_t fdf_boot_time_us(fdf_boot_phase_t phase)
+{
+    if (phase >= FDF_BOOT_PHASE_COUNT || phase_time_us[phase] == 0) {
+        return -1;
+    }
+    return phase_time_us[phase];
+}
+
+void fdf_boot_report(void)
+{
+    for (int i = 0; i < FDF_BOOT_PHASE_COUNT; i++) {
+        int64_t t = fdf_boot_time_us(i);
+        if (t >= 0) {
+            ESP_LOGI(TAG, "  %-13s %6" PRId64 " ms", phase_names[i], t / 1000);
+        } else {
+            ESP_LOGI(TAG, "  %-13s      -", phase_names[i]);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef FDF_BOOT_H
+#define FDF_BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Boot phases
+ *
+ * Subsystems come up concurrently and mark the phases they reach. Each mark
+ * sets a bit of a FreeRTOS event group, so a task can wait for the
+ * subsystems it depends on, and records the time since reset (esp_timer's
+ * clock, which includes the ROM and second stage bootloaders).
+ */
+
+typedef enum {
+    FDF_BOOT_NVS,                 // NVS ready
+    FDF_BOOT_BLE_STACK,           // BT controller and Bluedroid enabled
+    FDF_BOOT_ADVERTISING,         // FTMS services registered, advertising
+    FDF_BOOT_USB_HOST,            // USB host library and CDC-ACM driver installed
+    FDF_BOOT_STORAGE,             // Session store opened (or not configured)
+    FDF_BOOT_FIRST_DATA,          // First chunk received from a console
+    FDF_BOOT_FIRST_NOTIFY,        // First FTMS notification sent to a central
+    FDF_BOOT_PHASE_COUNT
+} fdf_boot_phase_t;
+
+// Event group bit of a phase
+#define FDF_BOOT_BIT(phase) (1u << (phase))
+
+/**
+ * @brief Create the event group; call first thing in app_main()
+ */
+void fdf_boot_init(void);
+
+/**
+ * @brief Mark a phase as reached
+ *
+ * Only the first mark of a phase counts. Cheap once the phase is marked,
+ * so data paths may call it on every packet.
+ *
+ * @param phase Phase reached
+ */
+void fdf_boot_mark(fdf_boot_phase_t phase);
+
+/**
+ * @brief Wait until all the given phases are reached
+ * @param bits FDF_BOOT_BIT() of each phase
+ * @param timeout_ms Longest wait
+ * @return true if all phases were reached
+ */
+bool fdf_boot_wait(uint32_t bits, uint32_t timeout_ms);
+
+/**
+ * @brief Time a phase was reached
+ * @param phase Phase
+ * @return Microseconds since reset, or -1 if the phase was not reached
+ */
+int64_t fdf_boot_time_us(fdf_boot_phase_t phase);
+
+/**
+ * @brief Log the time of every phase reached
+ */
+void fdf_boot_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_BOOT_H
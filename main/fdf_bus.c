@@ -0,0 +1,214 @@
+#include <string.h>
+#include <stdatomic.h>
+
+#include "fdf_bus.h"
+
+// Latest-value slot of one subscriber and console; seq is odd while written
+typedef struct {
+    atomic_uint_least32_t seq;
+    atomic_uint_least32_t read_seq;  // seq of the last snapshot read
+    fdf_bus_topic_t topic;
+    fdf_rowing_data_t data;
+} bus_slot_t;
+
+typedef struct {
+    fdf_bus_subscription_t sub;
+    atomic_bool ready;
+    fdf_bus_stats_t stats;
+    bus_slot_t slots[FDF_BUS_MAX_CONSOLES];
+} bus_subscriber_t;
+
+static bus_subscriber_t subscribers[FDF_BUS_MAX_SUBSCRIBERS];
+static atomic_uint subscriber_count = 0;
+
+// Publisher side, one task per console
+static fdf_rowing_data_t last_message[FDF_BUS_TOPIC_COUNT][FDF_BUS_MAX_CONSOLES];
+static bool has_last[FDF_BUS_TOPIC_COUNT][FDF_BUS_MAX_CONSOLES];
+
+uint16_t fdf_bus_changed_fields(const fdf_rowing_data_t *a, const fdf_rowing_data_t *b)
+{
+    if (a->session_active != b->session_active) {
+        return a->present | b->present;
+    }
+
+    uint16_t changed = a->present ^ b->present;
+    if (a->stroke_count != b->stroke_count) {
+        changed |= FDF_FIELD_STROKE_COUNT;
+    }
+    if (a->elapsed_time_ms != b->elapsed_time_ms) {
+        changed |= FDF_FIELD_ELAPSED_TIME;
+    }
+    if (a->distance_m != b->distance_m) {
+        changed |= FDF_FIELD_DISTANCE;
+    }
+    if (a->stroke_rate != b->stroke_rate) {
+        changed |= FDF_FIELD_STROKE_RATE;
+    }
+    if (a->avg_stroke_rate != b->avg_stroke_rate) {
+        changed |= FDF_FIELD_AVG_STROKE_RATE;
+    }
+    if (a->power_watts != b->power_watts) {
+        changed |= FDF_FIELD_POWER;
+    }
+    if (a->avg_power_watts != b->avg_power_watts) {
+        changed |= FDF_FIELD_AVG_POWER;
+    }
+    if (a->calories != b->calories) {
+        changed |= FDF_FIELD_CALORIES;
+    }
+    if (a->pace_500m_ms != b->pace_500m_ms) {
+        changed |= FDF_FIELD_PACE;
+    }
+    if (a->avg_pace_500m_ms != b->avg_pace_500m_ms) {
+        changed |= FDF_FIELD_AVG_PACE;
+    }
+    if (a->energy_per_hour != b->energy_per_hour || a->energy_per_minute != b->energy_per_minute) {
+        changed |= FDF_FIELD_ENERGY_RATE;
+    }
+    if (a->remaining_time_s != b->remaining_time_s) {
+        changed |= FDF_FIELD_REMAINING_TIME;
+    }
+    return changed;
+}
+
+int fdf_bus_subscribe(const fdf_bus_subscription_t *subscription)
+{
+    if (subscription == NULL || subscription->topics == 0 ||
+        (subscription->delivery == FDF_BUS_DIRECT && subscription->handler == NULL)) {
+        return -1;
+    }
+
+    unsigned int id = atomic_fetch_add(&subscriber_count, 1);
+    if (id >= FDF_BUS_MAX_SUBSCRIBERS) {
+        atomic_fetch_sub(&subscriber_count, 1);
+        return -1;
+    }
+    bus_subscriber_t *subscriber = &subscribers[id];
+    subscriber->sub = *subscription;
+    memset(&subscriber->stats, 0, sizeof(subscriber->stats));
+    atomic_store_explicit(&subscriber->ready, true, memory_order_release);
+    return (int)id;
+}
+
+static void write_slot(bus_subscriber_t *subscriber, bus_slot_t *slot, fdf_bus_topic_t topic,
+                       const fdf_rowing_data_t *data)
+{
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    if (seq != 0 && atomic_load_explicit(&slot->read_seq, memory_order_relaxed) != seq) {
+        subscriber->stats.overwritten++;
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->topic = topic;
+    slot->data = *data;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void fdf_bus_publish(fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    if (topic >= FDF_BUS_TOPIC_COUNT || console_id >= FDF_BUS_MAX_CONSOLES || data == NULL) {
+        return;
+    }
+
+    // One comparison per message, shared by every field filter
+    uint16_t changed = has_last[topic][console_id] ?
+                       fdf_bus_changed_fields(&last_message[topic][console_id], data) : data->present;
+    last_message[topic][console_id] = *data;
+    has_last[topic][console_id] = true;
+
+    unsigned int count = atomic_load_explicit(&subscriber_count, memory_order_acquire);
+    if (count > FDF_BUS_MAX_SUBSCRIBERS) {
+        count = FDF_BUS_MAX_SUBSCRIBERS;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        bus_subscriber_t *subscriber = &subscribers[i];
+        const fdf_bus_subscription_t *sub = &subscriber->sub;
+        if (!atomic_load_explicit(&subscriber->ready, memory_order_acquire) ||
+            !(sub->topics & FDF_BUS_TOPIC_BIT(topic)) ||
+            (sub->consoles != 0 && !(sub->consoles & (1u << console_id))) ||
+            (sub->fields != 0 && !(sub->fields & changed))) {
+            continue;
+        }
+
+        subscriber->stats.delivered++;
+        if (sub->delivery == FDF_BUS_LATEST) {
+            write_slot(subscriber, &subscriber->slots[console_id], topic, data);
+        }
+        if (sub->handler != NULL) {
+            sub->handler(sub->ctx, topic, console_id, data);
+        }
+    }
+}
+
+void fdf_bus_parser_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    if (console_id >= FDF_BUS_MAX_CONSOLES) {
+        return;
+    }
+    bool update = !has_last[FDF_BUS_UPDATE][console_id] ||
+                  data->seq != last_message[FDF_BUS_UPDATE][console_id].seq;
+
+    fdf_bus_publish(FDF_BUS_LINE, console_id, data);
+    if (update) {
+        fdf_bus_publish(FDF_BUS_UPDATE, console_id, data);
+    }
+}
+
+void fdf_bus_reset_console(uint8_t console_id)
+{
+    if (console_id >= FDF_BUS_MAX_CONSOLES) {
+        return;
+    }
+    for (int topic = 0; topic < FDF_BUS_TOPIC_COUNT; topic++) {
+        has_last[topic][console_id] = false;
+    }
+}
+
+bool fdf_bus_read(int subscriber_id, uint8_t console_id, fdf_rowing_data_t *data, fdf_bus_topic_t *topic)
+{
+    if (subscriber_id < 0 || subscriber_id >= FDF_BUS_MAX_SUBSCRIBERS ||
+        console_id >= FDF_BUS_MAX_CONSOLES || data == NULL) {
+        return false;
+    }
+    bus_subscriber_t *subscriber = &subscribers[subscriber_id];
+    bus_slot_t *slot = &subscriber->slots[console_id];
+
+    // Retry while the publisher rewrites the slot under us
+    uint32_t seq;
+    fdf_bus_topic_t slot_topic;
+    while (1) {
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        slot_topic = slot->topic;
+        *data = slot->data;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+    if (topic != NULL) {
+        *topic = slot_topic;
+    }
+    if (seq == 0 || atomic_load_explicit(&slot->read_seq, memory_order_relaxed) == seq) {
+        return false;
+    }
+    atomic_store_explicit(&slot->read_seq, seq, memory_order_relaxed);
+    subscriber->stats.read++;
+    return true;
+}
+
+const char *fdf_bus_get_stats(int subscriber_id, fdf_bus_stats_t *stats)
+{
+    if (subscriber_id < 0 || (unsigned int)subscriber_id >= atomic_load(&subscriber_count) ||
+        subscriber_id >= FDF_BUS_MAX_SUBSCRIBERS ||
+        !atomic_load_explicit(&subscribers[subscriber_id].ready, memory_order_acquire)) {
+        return NULL;
+    }
+    if (stats != NULL) {
+        *stats = subscribers[subscriber_id].stats;
+    }
+    return subscribers[subscriber_id].sub.name != NULL ? subscribers[subscriber_id].sub.name : "?";
+}
@@ -0,0 +1,142 @@
+#ifndef FDF_BUS_H
+#define FDF_BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Rowing update bus
+ *
+ * Publish/subscribe dispatch of rowing snapshots between the parser and the
+ * stages consuming them (metrics, FTMS, stroke storage, diagnostics). The
+ * subscriber table has a fixed size; each subscriber selects topics,
+ * consoles and the fields it cares about, and gets its own context pointer
+ * back.
+ *
+ * Delivery is either direct, the handler running in the publisher's task in
+ * subscription order, or through a latest-value slot per console: the
+ * publisher overwrites the slot without waiting and the subscriber reads the
+ * newest snapshot when it gets to it, so a slow subscriber loses
+ * intermediate snapshots but never holds up the publisher.
+ *
+ * Subscribers can be added at any time and are never removed. Messages of
+ * one console are published from one task at a time. A field filter
+ * compares a message with the previous one of the same topic and console;
+ * a session start or end changes every field.
+ */
+
+#define FDF_BUS_MAX_SUBSCRIBERS 8
+#define FDF_BUS_MAX_CONSOLES CONFIG_FDF_MAX_CONSOLES
+
+// Topics, in pipeline order
+typedef enum {
+    FDF_BUS_LINE,                 // Every parsed line, also those that changed nothing
+    FDF_BUS_UPDATE,               // Lines that changed a value, as parsed
+    FDF_BUS_SNAPSHOT,             // Updates completed by the metrics stage
+    FDF_BUS_TOPIC_COUNT
+} fdf_bus_topic_t;
+
+#define FDF_BUS_TOPIC_BIT(topic) (1u << (topic))
+
+// How messages reach a subscriber
+typedef enum {
+    FDF_BUS_DIRECT,               // Handler called by the publisher
+    FDF_BUS_LATEST,               // Written to a latest-value slot, read with fdf_bus_read()
+} fdf_bus_delivery_t;
+
+/**
+ * @brief Subscriber handler
+ *
+ * For direct delivery it gets the message and must not block. For
+ * latest-value delivery it is called after the slot was written, with the
+ * same arguments, to wake the subscriber (e.g. a task notification); it may
+ * be NULL.
+ */
+typedef void (*fdf_bus_handler_t)(void *ctx, fdf_bus_topic_t topic, uint8_t console_id,
+                                  const fdf_rowing_data_t *data);
+
+// Subscription
+typedef struct {
+    const char *name;             // For diagnostics
+    uint32_t topics;              // FDF_BUS_TOPIC_BIT() of the topics to receive
+    uint32_t consoles;            // Bits of the consoles to receive, 0 for all
+    uint16_t fields;              // FDF_FIELD_* bits one of which must change, 0 for every message
+    fdf_bus_delivery_t delivery;
+    fdf_bus_handler_t handler;
+    void *ctx;                    // Passed to the handler
+} fdf_bus_subscription_t;
+
+// Counters of a subscriber
+typedef struct {
+    uint32_t delivered;           // Messages that passed the filters
+    uint32_t overwritten;         // Latest-value slot contents replaced before being read
+    uint32_t read;                // Snapshots taken with fdf_bus_read()
+} fdf_bus_stats_t;
+
+/**
+ * @brief Add a subscriber
+ * @param subscription Subscription, copied
+ * @return Subscriber id, or -1 if the table is full or the subscription invalid
+ */
+int fdf_bus_subscribe(const fdf_bus_subscription_t *subscription);
+
+/**
+ * @brief Publish a message to the matching subscribers, never blocks
+ * @param topic Topic
+ * @param console_id Console the snapshot belongs to
+ * @param data Snapshot
+ */
+void fdf_bus_publish(fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data);
+
+/**
+ * @brief Parser callback publishing every line, and lines that changed a value as updates
+ *
+ * Register it with fdf_parser_register_callback().
+ */
+void fdf_bus_parser_callback(uint8_t console_id, const fdf_rowing_data_t *data);
+
+/**
+ * @brief Forget the last messages of a console, e.g. when a new console takes its slot
+ * @param console_id Console
+ */
+void fdf_bus_reset_console(uint8_t console_id);
+
+/**
+ * @brief Take the newest snapshot from a latest-value slot
+ * @param subscriber Subscriber id
+ * @param console_id Console
+ * @param data Filled with the snapshot
+ * @param topic Filled with its topic, may be NULL
+ * @return true if a snapshot was published since the previous read
+ */
+bool fdf_bus_read(int subscriber, uint8_t console_id, fdf_rowing_data_t *data, fdf_bus_topic_t *topic);
+
+/**
+ * @brief Get the name and counters of a subscriber
+ * @param subscriber Subscriber id
+ * @param stats Filled with the counters
+ * @return Subscriber name, NULL if there is no such subscriber
+ */
+const char *fdf_bus_get_stats(int subscriber, fdf_bus_stats_t *stats);
+
+/**
+ * @brief Fields that differ between two snapshots
+ * @param a Snapshot
+ * @param b Snapshot
+ * @return FDF_FIELD_* bits
+ */
+uint16_t fdf_bus_changed_fields(const fdf_rowing_data_t *a, const fdf_rowing_data_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_BUS_H
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "fdf_port.h"
+#include "fdf_config.h"
+
+static const char *TAG = "CONFIG";
+
+#define BLOB_MAGIC 0xFDC0
+#define BLOB_FORMAT 1
+#define BLOB_HEADER_SIZE 4
+#define BLOB_CRC_SIZE 4
+#define RECORD_HEADER_SIZE 2
+
+// Defaults: what the bridge used before the settings could be changed
+#define DEFAULT_ADV_INTERVAL_MIN 0x20       // 20 ms
+#define DEFAULT_ADV_INTERVAL_MAX 0x40       // 40 ms
+#define DEFAULT_CONN_INTERVAL_MIN 24        // 30 ms
+#define DEFAULT_CONN_INTERVAL_MAX 200       // 250 ms
+#define DEFAULT_USB_BUFFER 1024
+#define DEFAULT_USB_HOST_PRIORITY 20
+#define DEFAULT_USB_TX_PRIORITY 6
+#define DEFAULT_CDC_DRIVER_PRIORITY 5
+#ifdef CONFIG_LOG_DEFAULT_LEVEL
+#define DEFAULT_LOG_LEVEL CONFIG_LOG_DEFAULT_LEVEL
+#else
+#define DEFAULT_LOG_LEVEL 3
+#endif
+
+#define KEY(key_id, key_name, key_type, field, lo, hi, text) { \
+        .id = (key_id), .name = (key_name), .type = (key_type), \
+        .offset = offsetof(fdf_config_t, field), .min = (lo), .max = (hi), .help = (text) }
+
+// Ids are stored in the blob: append new keys, never renumber. Connection
+// intervals stay where every request is valid: ble_ftms asks for 3/4 of the
+// interval as the minimum, which must not go below 6 (7.5 ms), and the 4 s
+// supervision timeout must exceed two intervals
+static const fdf_config_key_t keys[] = {
+    KEY(1, "name", FDF_CONFIG_STRING, device_name, 1, FDF_CONFIG_NAME_MAX,
+        "advertised name, next advertising"),
+    KEY(2, "adv_min", FDF_CONFIG_U16, adv_interval_min, 0x20, 0x4000,
+        "advertising interval, 0.625 ms units, next advertising"),
+    KEY(3, "adv_max", FDF_CONFIG_U16, adv_interval_max, 0x20, 0x4000,
+        "advertising interval, 0.625 ms units, next advertising"),
+    KEY(4, "conn_min", FDF_CONFIG_U16, conn_interval_min, 8, 1599,
+        "connection interval, 1.25 ms units, next request"),
+    KEY(5, "conn_max", FDF_CONFIG_U16, conn_interval_max, 8, 1599,
+        "connection interval, 1.25 ms units, next request"),
+    KEY(6, "usb_rx_buf", FDF_CONFIG_U16, usb_rx_buffer, 64, 4096,
+        "CDC-ACM receive buffer, bytes, next console"),
+    KEY(7, "usb_tx_buf", FDF_CONFIG_U16, usb_tx_buffer, 64, 4096,
+        "CDC-ACM transmit buffer, bytes, next console"),
+    KEY(8, "usb_prio", FDF_CONFIG_U8, usb_host_priority, 1, 24,
+        "USB library and host task priority, restart"),
+    KEY(9, "usb_tx_prio", FDF_CONFIG_U8, usb_tx_priority, 1, 24,
+        "command transmit task priority, restart"),
+    KEY(10, "cdc_prio", FDF_CONFIG_U8, cdc_driver_priority, 1, 24,
+        "CDC-ACM driver task priority, restart"),
+    KEY(11, "log_level", FDF_CONFIG_U8, log_level, 0, 5,
+        "0 none, 1 error, 2 warn, 3 info, 4 debug, 5 verbose, now"),
+};
+
+#define KEY_COUNT (sizeof(keys) / sizeof(keys[0]))
+
+static const char *const result_names[] = {
+    [FDF_CONFIG_OK] = "ok",
+    [FDF_CONFIG_UNKNOWN_KEY] = "unknown key",
+    [FDF_CONFIG_INVALID_VALUE] = "invalid value",
+    [FDF_CONFIG_BUSY] = "busy",
+    [FDF_CONFIG_STORAGE_ERROR] = "storage error",
+};
+
+// The current settings are one of the two copies, the other one is scratch.
+// The generation counts writes to scratch and swaps: a reader whose copy
+// spans a change retries, in case it copied a copy being reused.
+static fdf_config_t copies[2];
+static _Atomic(const fdf_config_t *) current = &copies[0];
+static atomic_uint generation = 0;
+static atomic_flag changing = ATOMIC_FLAG_INIT;
+
+static fdf_config_storage_t storage;
+static bool has_storage = false;
+static fdf_config_listener_t listener = NULL;
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t get_number(const fdf_config_t *config, const fdf_config_key_t *key)
+{
+    const uint8_t *field = (const uint8_t *)config + key->offset;
+    if (key->type == FDF_CONFIG_U8) {
+        return *field;
+    }
+    uint16_t value;
+    memcpy(&value, field, sizeof(value));
+    return value;
+}
+
+static void set_number(fdf_config_t *config, const fdf_config_key_t *key, uint32_t value)
+{
+    uint8_t *field = (uint8_t *)config + key->offset;
+    if (key->type == FDF_CONFIG_U8) {
+        *field = (uint8_t)value;
+    } else {
+        uint16_t value16 = (uint16_t)value;
+        memcpy(field, &value16, sizeof(value16));
+    }
+}
+
+static const fdf_config_key_t *find_key(const char *name, size_t name_len)
+{
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        if (strlen(keys[i].name) == name_len && strncmp(keys[i].name, name, name_len) == 0) {
+            return &keys[i];
+        }
+    }
+    return NULL;
+}
+
+static const fdf_config_key_t *find_key_id(uint8_t id)
+{
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        if (keys[i].id == id) {
+            return &keys[i];
+        }
+    }
+    return NULL;
+}
+
+// Parse value[0..len) into the key's field of config
+static bool parse_value(fdf_config_t *config, const fdf_config_key_t *key, const char *value, size_t len)
+{
+    if (key->type == FDF_CONFIG_STRING) {
+        if (len < key->min || len > key->max) {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if ((unsigned char)value[i] < 0x20 || (unsigned char)value[i] > 0x7E) {
+                return false;
+            }
+        }
+        char *field = (char *)config + key->offset;
+        memcpy(field, value, len);
+        field[len] = '\0';
+        return true;
+    }
+
+    char text[12];
+    if (len == 0 || len >= sizeof(text)) {
+        return false;
+    }
+    memcpy(text, value, len);
+    text[len] = '\0';
+    char *end;
+    unsigned long number = strtoul(text, &end, 0);
+    if (*end != '\0' || text[0] == '-' || number < key->min || number > key->max) {
+        return false;
+    }
+    set_number(config, key, (uint32_t)number);
+    return true;
+}
+
+// Make the scratch copy current; the caller holds the change flag
+static void publish(fdf_config_t *next)
+{
+    atomic_store_explicit(&current, next, memory_order_release);
+    atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+    if (listener != NULL) {
+        listener(next);
+    }
+}
+
+// The copy that is not current, about to be written; the caller holds the change flag
+static fdf_config_t *scratch(void)
+{
+    const fdf_config_t *now = atomic_load_explicit(&current, memory_order_relaxed);
+    // Readers still copying the old settings out of it see the generation move
+    atomic_fetch_add_explicit(&generation, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return now == &copies[0] ? &copies[1] : &copies[0];
+}
+
+void fdf_config_defaults(fdf_config_t *config)
+{
+    memset(config, 0, sizeof(fdf_config_t));
+    strncpy(config->device_name, CONFIG_FDF_DEVICE_NAME, FDF_CONFIG_NAME_MAX);
+    config->adv_interval_min = DEFAULT_ADV_INTERVAL_MIN;
+    config->adv_interval_max = DEFAULT_ADV_INTERVAL_MAX;
+    config->conn_interval_min = DEFAULT_CONN_INTERVAL_MIN;
+    config->conn_interval_max = DEFAULT_CONN_INTERVAL_MAX;
+    config->usb_rx_buffer = DEFAULT_USB_BUFFER;
+    config->usb_tx_buffer = DEFAULT_USB_BUFFER;
+    config->usb_host_priority = DEFAULT_USB_HOST_PRIORITY;
+    config->usb_tx_priority = DEFAULT_USB_TX_PRIORITY;
+    config->cdc_driver_priority = DEFAULT_CDC_DRIVER_PRIORITY;
+    config->log_level = DEFAULT_LOG_LEVEL;
+}
+
+bool fdf_config_validate(const fdf_config_t *config)
+{
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        const fdf_config_key_t *key = &keys[i];
+        if (key->type == FDF_CONFIG_STRING) {
+            const char *field = (const char *)config + key->offset;
+            size_t len = strnlen(field, key->max + 1);
+            if (len < key->min || len > key->max) {
+                return false;
+            }
+        } else {
+            uint32_t value = get_number(config, key);
+            if (value < key->min || value > key->max) {
+                return false;
+            }
+        }
+    }
+    return config->adv_interval_min <= config->adv_interval_max &&
+           config->conn_interval_min <= config->conn_interval_max;
+}
+
+size_t fdf_config_encode(const fdf_config_t *config, uint8_t *buf, size_t len)
+{
+    if (len < FDF_CONFIG_BLOB_MAX) {
+        return 0;
+    }
+
+    size_t pos = BLOB_HEADER_SIZE;
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        const fdf_config_key_t *key = &keys[i];
+        size_t value_len;
+        if (key->type == FDF_CONFIG_STRING) {
+            value_len = strnlen((const char *)config + key->offset, key->max);
+            memcpy(&buf[pos + RECORD_HEADER_SIZE], (const char *)config + key->offset, value_len);
+        } else {
+            uint32_t value = get_number(config, key);
+            value_len = key->type == FDF_CONFIG_U8 ? 1 : 2;
+            for (size_t b = 0; b < value_len; b++) {
+                buf[pos + RECORD_HEADER_SIZE + b] = (uint8_t)(value >> (8 * b));
+            }
+        }
+        buf[pos] = key->id;
+        buf[pos + 1] = (uint8_t)value_len;
+        pos += RECORD_HEADER_SIZE + value_len;
+    }
+
+    buf[0] = BLOB_MAGIC & 0xFF;
+    buf[1] = BLOB_MAGIC >> 8;
+    buf[2] = BLOB_FORMAT;
+    buf[3] = (uint8_t)KEY_COUNT;
+    uint32_t crc = crc32(buf, pos);
+    for (size_t b = 0; b < BLOB_CRC_SIZE; b++) {
+        buf[pos++] = (uint8_t)(crc >> (8 * b));
+    }
+    return pos;
+}
+
+bool fdf_config_decode(fdf_config_t *config, const uint8_t *blob, size_t len)
+{
+    fdf_config_defaults(config);
+    if (len < BLOB_HEADER_SIZE + BLOB_CRC_SIZE ||
+        (blob[0] | (blob[1] << 8)) != BLOB_MAGIC || blob[2] != BLOB_FORMAT) {
+        return false;
+    }
+    size_t end = len - BLOB_CRC_SIZE;
+    uint32_t crc = blob[end] | (blob[end + 1] << 8) | (blob[end + 2] << 16) | ((uint32_t)blob[end + 3] << 24);
+    if (crc32(blob, end) != crc) {
+        return false;
+    }
+
+    size_t pos = BLOB_HEADER_SIZE;
+    for (unsigned int record = 0; record < blob[3]; record++) {
+        if (pos + RECORD_HEADER_SIZE > end || pos + RECORD_HEADER_SIZE + blob[pos + 1] > end) {
+            return false;
+        }
+        const fdf_config_key_t *key = find_key_id(blob[pos]);
+        const uint8_t *value = &blob[pos + RECORD_HEADER_SIZE];
+        size_t value_len = blob[pos + 1];
+        pos += RECORD_HEADER_SIZE + value_len;
+
+        // Written by a later firmware: keep the default
+        if (key == NULL) {
+            continue;
+        }
+        if (key->type == FDF_CONFIG_STRING) {
+            if (!parse_value(config, key, (const char *)value, value_len)) {
+                return false;
+            }
+        } else {
+            if (value_len != (key->type == FDF_CONFIG_U8 ? 1u : 2u)) {
+                return false;
+            }
+            set_number(config, key, value_len == 1 ? value[0] : (uint32_t)(value[0] | (value[1] << 8)));
+        }
+    }
+    return pos == end && fdf_config_validate(config);
+}
+
+bool fdf_config_init(const fdf_config_storage_t *config_storage)
+{
+    fdf_config_t *config = &copies[0];
+    fdf_config_defaults(config);
+    atomic_store_explicit(&current, config, memory_order_release);
+    has_storage = config_storage != NULL;
+    if (!has_storage) {
+        return false;
+    }
+    storage = *config_storage;
+
+    uint8_t blob[FDF_CONFIG_BLOB_MAX];
+    size_t len = sizeof(blob);
+    if (!storage.load(storage.ctx, blob, &len)) {
+        ESP_LOGI(TAG, "No stored settings, using the defaults");
+        return false;
+    }
+    if (!fdf_config_decode(config, blob, len)) {
+        ESP_LOGW(TAG, "Stored settings are damaged or invalid, using the defaults");
+        fdf_config_defaults(config);
+        return false;
+    }
+    ESP_LOGI(TAG, "Settings loaded (%u bytes)", (unsigned)len);
+    return true;
+}
+
+void fdf_config_read(fdf_config_t *config)
+{
+    unsigned int before;
+    unsigned int after;
+    do {
+        before = atomic_load_explicit(&generation, memory_order_acquire);
+        *config = *atomic_load_explicit(&current, memory_order_acquire);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&generation, memory_order_relaxed);
+    } while (before != after);
+}
+
+void fdf_config_register_listener(fdf_config_listener_t config_listener)
+{
+    listener = config_listener;
+}
+
+fdf_config_result_t fdf_config_set(const char *name, const char *value)
+{
+    const fdf_config_key_t *key = find_key(name, strlen(name));
+    if (key == NULL) {
+        return FDF_CONFIG_UNKNOWN_KEY;
+    }
+    if (atomic_flag_test_and_set_explicit(&changing, memory_order_acquire)) {
+        return FDF_CONFIG_BUSY;
+    }
+
+    fdf_config_t *next = scratch();
+    *next = *atomic_load_explicit(&current, memory_order_relaxed);
+    fdf_config_result_t result = FDF_CONFIG_INVALID_VALUE;
+    if (parse_value(next, key, value, strlen(value)) && fdf_config_validate(next)) {
+        publish(next);
+        result = FDF_CONFIG_OK;
+    }
+    atomic_flag_clear_explicit(&changing, memory_order_release);
+    return result;
+}
+
+fdf_config_result_t fdf_config_reset(void)
+{
+    if (atomic_flag_test_and_set_explicit(&changing, memory_order_acquire)) {
+        return FDF_CONFIG_BUSY;
+    }
+    fdf_config_t *next = scratch();
+    fdf_config_defaults(next);
+    publish(next);
+    atomic_flag_clear_explicit(&changing, memory_order_release);
+    return FDF_CONFIG_OK;
+}
+
+fdf_config_result_t fdf_config_save(void)
+{
+    if (!has_storage) {
+        return FDF_CONFIG_STORAGE_ERROR;
+    }
+    if (atomic_flag_test_and_set_explicit(&changing, memory_order_acquire)) {
+        return FDF_CONFIG_BUSY;
+    }
+
+    uint8_t blob[FDF_CONFIG_BLOB_MAX];
+    size_t len = fdf_config_encode(atomic_load_explicit(&current, memory_order_relaxed), blob, sizeof(blob));
+    bool saved = storage.save(storage.ctx, blob, len);
+    atomic_flag_clear_explicit(&changing, memory_order_release);
+    if (!saved) {
+        ESP_LOGE(TAG, "Failed to store the settings");
+        return FDF_CONFIG_STORAGE_ERROR;
+    }
+    ESP_LOGI(TAG, "Settings stored (%u bytes)", (unsigned)len);
+    return FDF_CONFIG_OK;
+}
+
+size_t fdf_config_key_count(void)
+{
+    return KEY_COUNT;
+}
+
+const fdf_config_key_t *fdf_config_key(size_t index)
+{
+    return index < KEY_COUNT ? &keys[index] : NULL;
+}
+
+int fdf_config_format(const fdf_config_t *config, const fdf_config_key_t *key, char *buf, size_t len)
+{
+    if (key->type == FDF_CONFIG_STRING) {
+        return snprintf(buf, len, "%s", (const char *)config + key->offset);
+    }
+    return snprintf(buf, len, "%u", (unsigned)get_number(config, key));
+}
+
+const char *fdf_config_result_name(fdf_config_result_t result)
+{
+    return (size_t)result < sizeof(result_names) / sizeof(result_names[0]) ? result_names[result] : "?";
+}
@@ -0,0 +1,211 @@
+#ifndef FDF_CONFIG_H
+#define FDF_CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime configuration
+ *
+ * Settings that used to be fixed at build time (advertised name, advertising
+ * and connection intervals, USB buffer sizes, task priorities, log level),
+ * loaded once at boot into a RAM structure and edited by key from the
+ * diagnostics console. They are not writable over BLE: the bridge
+ * cannot pair with MITM protection, and the FTMS Control Point is open to
+ * any central that takes control.
+ *
+ * Reads take no lock: fdf_config_read() copies the current structure out,
+ * which is never written while it is current. A change fills the other of
+ * two copies, validates it as a whole and swaps the pointer, so readers see
+ * either the old or the new settings, never a mix. The next change reuses
+ * the old copy; a generation counter bumped before the reuse and at every
+ * swap makes a reader that was still copying it start over. Changes are
+ * serialized internally; one made while another is in progress fails.
+ *
+ * Storage holds one blob: a header, one record per key (id, length, value)
+ * and a CRC-32. Keys missing from the blob keep their default and unknown
+ * ones are skipped, so the layout can grow without losing saved settings.
+ * A blob that does not decode or validate is ignored as a whole.
+ *
+ *   blob:   magic (2 bytes) | format (1) | record count (1) | records | CRC-32 (4)
+ *   record: key id (1) | length (1) | value, little-endian or string bytes
+ */
+
+// Longest advertised name that fits the advertising packet with the
+// flags, TX power and FTMS service UUID
+#define FDF_CONFIG_NAME_MAX 20
+
+// Largest encoded blob
+#define FDF_CONFIG_BLOB_MAX 96
+
+typedef struct {
+    char device_name[FDF_CONFIG_NAME_MAX + 1];
+    uint16_t adv_interval_min;    // 0.625 ms units
+    uint16_t adv_interval_max;
+    uint16_t conn_interval_min;   // 1.25 ms units, bounds when following the console cadence
+    uint16_t conn_interval_max;
+    uint16_t usb_rx_buffer;       // CDC-ACM transfer buffers, bytes
+    uint16_t usb_tx_buffer;
+    uint8_t usb_host_priority;    // USB library and host tasks
+    uint8_t usb_tx_priority;      // Command transmit task
+    uint8_t cdc_driver_priority;  // CDC-ACM driver task
+    uint8_t log_level;            // Default log level, 0 none to 5 verbose
+} fdf_config_t;
+
+typedef enum {
+    FDF_CONFIG_OK,
+    FDF_CONFIG_UNKNOWN_KEY,
+    FDF_CONFIG_INVALID_VALUE,     // Does not parse, is out of range or conflicts with another key
+    FDF_CONFIG_BUSY,              // Another change is in progress
+    FDF_CONFIG_STORAGE_ERROR,
+} fdf_config_result_t;
+
+typedef enum {
+    FDF_CONFIG_U8,
+    FDF_CONFIG_U16,
+    FDF_CONFIG_STRING,
+} fdf_config_type_t;
+
+// A setting, for listing and editing by name
+typedef struct {
+    uint8_t id;                   // Record id in the blob, never reused
+    const char *name;
+    fdf_config_type_t type;
+    uint16_t offset;              // In fdf_config_t
+    uint16_t min;                 // Value range, string length for strings
+    uint16_t max;
+    const char *help;             // Unit and when a change takes effect
+} fdf_config_key_t;
+
+// Where the blob is kept
+typedef struct {
+    // Fills data with up to *len bytes and sets *len; false if nothing is stored
+    bool (*load)(void *ctx, void *data, size_t *len);
+    // Replaces the stored blob as a whole, or leaves it unchanged
+    bool (*save)(void *ctx, const void *data, size_t len);
+    void *ctx;
+} fdf_config_storage_t;
+
+// Called after every change with the new settings, valid during the call, by the task that made it
+typedef void (*fdf_config_listener_t)(const fdf_config_t *config);
+
+/**
+ * @brief Fill in the build-time defaults
+ * @param config Settings to fill
+ */
+void fdf_config_defaults(fdf_config_t *config);
+
+/**
+ * @brief Check every value and the relations between them
+ * @param config Settings
+ * @return true if the settings can be used
+ */
+bool fdf_config_validate(const fdf_config_t *config);
+
+/**
+ * @brief Load the stored settings, once at boot
+ * @param storage Where the blob is kept, copied; NULL keeps the defaults in RAM only
+ * @return true if stored settings were loaded, false if the defaults are used
+ */
+bool fdf_config_init(const fdf_config_storage_t *storage);
+
+/**
+ * @brief Copy the current settings
+ * @param config Filled with the settings, whole from one change
+ */
+void fdf_config_read(fdf_config_t *config);
+
+/**
+ * @brief Register the function called after every change
+ * @param listener Function, NULL to remove
+ */
+void fdf_config_register_listener(fdf_config_listener_t listener);
+
+/**
+ * @brief Change a setting in RAM
+ * @param name Key name
+ * @param value Value as text: decimal or 0x-prefixed hexadecimal for numbers
+ * @return FDF_CONFIG_OK if the new settings are current
+ */
+fdf_config_result_t fdf_config_set(const char *name, const char *value);
+
+/**
+ * @brief Go back to the defaults in RAM
+ * @return FDF_CONFIG_OK, or FDF_CONFIG_BUSY
+ */
+fdf_config_result_t fdf_config_reset(void);
+
+/**
+ * @brief Store the current settings, replacing the stored blob at once
+ * @return FDF_CONFIG_OK, FDF_CONFIG_BUSY or FDF_CONFIG_STORAGE_ERROR
+ */
+fdf_config_result_t fdf_config_save(void);
+
+/**
+ * @brief Number of keys
+ */
+size_t fdf_config_key_count(void);
+
+/**
+ * @brief Get a key
+ * @param index Key, from 0
+ * @return Key, NULL past the last one
+ */
+const fdf_config_key_t *fdf_config_key(size_t index);
+
+/**
+ * @brief Format the value of a key
+ * @param config Settings
+ * @param key Key
+ * @param buf Output buffer
+ * @param len Buffer size
+ * @return Length written, as snprintf
+ */
+int fdf_config_format(const fdf_config_t *config, const fdf_config_key_t *key, char *buf, size_t len);
+
+/**
+ * @brief Encode settings as a storage blob
+ * @param config Settings
+ * @param buf Output, at least FDF_CONFIG_BLOB_MAX bytes
+ * @param len Buffer size
+ * @return Blob length, 0 if the buffer is too small
+ */
+size_t fdf_config_encode(const fdf_config_t *config, uint8_t *buf, size_t len);
+
+/**
+ * @brief Decode a storage blob over the defaults
+ * @param config Filled with the defaults, then the stored values
+ * @param blob Blob
+ * @param len Blob length
+ * @return false if the blob is damaged or its settings invalid
+ */
+bool fdf_config_decode(fdf_config_t *config, const uint8_t *blob, size_t len);
+
+/**
+ * @brief Storage of the blob in NVS (fdf_config_nvs.c, firmware only)
+ *
+ * The blob is one NVS entry, which NVS replaces atomically on commit: a
+ * reset while saving leaves either the old or the new settings. NVS must be
+ * initialized first.
+ *
+ * @return Storage to pass to fdf_config_init()
+ */
+const fdf_config_storage_t *fdf_config_nvs_storage(void);
+
+/**
+ * @brief Name of a result, for logs
+ * @param result Result
+ * @return Static string
+ */
+const char *fdf_config_result_name(fdf_config_result_t result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_CONFIG_H
@@ -0,0 +1,51 @@
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "fdf_config.h"
+
+static const char *TAG = "CONFIG";
+
+#define NVS_NAMESPACE "fdf"
+#define NVS_KEY "config"
+
+static bool nvs_load(void *ctx, void *data, size_t *len)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t ret = nvs_get_blob(handle, NVS_KEY, data, len);
+    nvs_close(handle);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed to read the settings: %s", esp_err_to_name(ret));
+    }
+    return ret == ESP_OK;
+}
+
+static bool nvs_save(void *ctx, const void *data, size_t len)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, NVS_KEY, data, len);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the settings: %s", esp_err_to_name(ret));
+    }
+    return ret == ESP_OK;
+}
+
+static const fdf_config_storage_t nvs_storage = {
+    .load = nvs_load,
+    .save = nvs_save,
+    .ctx = NULL,
+};
+
+const fdf_config_storage_t *fdf_config_nvs_storage(void)
+{
+    return &nvs_storage;
+}
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "sdkconfig.h"
+
+#include "fdf_diag.h"
+#include "usb_host_handler.h"
+#include "ble_ftms.h"
+#include "fdf_supervisor.h"
+#include "fdf_power.h"
+#include "fdf_bus.h"
+#include "fdf_config.h"
+#include "session_recorder.h"
+#if CONFIG_FDF_POWER_MANAGEMENT
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "DIAG";
+
+// Tasks listed by "tasks"; the bridge runs about 20
+#define DIAG_MAX_TASKS 40
+
+// Recorder log bytes per line of "record dump"
+#define DIAG_DUMP_LINE_BYTES 32
+
+static fdf_parser_t *diag_parsers = NULL;
+static const fdf_watchdog_t *diag_watchdogs = NULL;
+static size_t diag_parser_count = 0;
+
+// Latest-value subscription to the snapshots, read by "snapshot"
+static int diag_subscriber = -1;
+
+static const char *const event_names[FDF_SUP_EVENT_COUNT] = {
+    [FDF_SUP_USB_CONNECTED] = "usb connected",
+    [FDF_SUP_USB_DISCONNECTED] = "usb disconnected",
+    [FDF_SUP_DATA_STALL] = "data stall",
+    [FDF_SUP_BLE_CONNECTED] = "ble connected",
+    [FDF_SUP_BLE_DISCONNECTED] = "ble disconnected",
+    [FDF_SUP_BLE_CONGESTED] = "ble congested",
+};
+
+static const char *const level_names[] = {
+    [ESP_LOG_NONE] = "none",
+    [ESP_LOG_ERROR] = "error",
+    [ESP_LOG_WARN] = "warn",
+    [ESP_LOG_INFO] = "info",
+    [ESP_LOG_DEBUG] = "debug",
+    [ESP_LOG_VERBOSE] = "verbose",
+};
+
+static int cmd_stats(int argc, char **argv)
+{
+    for (size_t i = 0; i < diag_parser_count; i++) {
+        const fdf_parser_stats_t *parser = &diag_parsers[i].stats;
+        usb_console_stats_t usb;
+        usb_poll_stats_t poll;
+        usb_host_get_console_stats(i, &usb);
+        usb_host_get_poll_stats(i, &poll);
+
+        printf("console %u%s\n", (unsigned)i, usb_host_console_is_connected(i) ? "" : " (not connected)");
+        printf("  usb     rx %" PRIu32 " chunks, %" PRIu64 " bytes, %" PRIu32 " discarded; "
+               "tx %" PRIu32 " commands, %" PRIu32 " errors\n",
+               usb.rx_chunks, usb.rx_bytes, usb.rx_discarded, usb.tx_commands, usb.tx_errors);
+        printf("  parser  %" PRIu64 " bytes, %" PRIu32 " lines, %" PRIu32 " updates, "
+               "%" PRIu32 " parse errors, %" PRIu32 " overflow resets\n",
+               parser->bytes, parser->lines, parser->updates, parser->parse_errors, parser->overflow_resets);
+        printf("  poll    %" PRIu32 " sent, %" PRIu32 " matched, %" PRIu32 " timed out, %" PRIu32 " skipped, "
+               "rtt %" PRIu32 " us (max %" PRIu32 " us)\n",
+               poll.requests_sent, poll.responses_matched, poll.requests_timed_out, poll.polls_skipped,
+               poll.last_rtt_us, poll.max_rtt_us);
+        if (diag_watchdogs != NULL) {
+            const fdf_watchdog_t *wd = &diag_watchdogs[i];
+            printf("  watchdog %s, timeout %" PRIu32 " ms, %" PRIu32 " stalls, %" PRIu32 " recovered, "
+                   "steps %" PRIu32 " poll / %" PRIu32 " dtr / %" PRIu32 " reopen, "
+                   "recovery %" PRIu32 " ms (max %" PRIu32 " ms) via %s\n",
+                   fdf_watchdog_is_stalled(wd) ? "stale" : "fresh", wd->timeout_us / 1000,
+                   wd->stats.stalls, wd->stats.recoveries, wd->stats.steps[FDF_RECOVERY_POLL],
+                   wd->stats.steps[FDF_RECOVERY_TOGGLE_DTR], wd->stats.steps[FDF_RECOVERY_REOPEN],
+                   wd->stats.last_recovery_ms, wd->stats.max_recovery_ms,
+                   fdf_watchdog_step_name(wd->stats.last_step));
+        }
+    }
+
+    ble_ftms_stats_t ble;
+    ble_ftms_get_stats(&ble);
+    printf("ble       %" PRIu32 " notifications, %" PRIu32 " failed, %" PRIu32 " congestion events\n",
+           ble.notifications_sent, ble.notifications_failed, ble.congestion_events);
+
+    ble_ftms_conn_info_t conns[BLE_FTMS_MAX_CONNECTIONS];
+    size_t conn_count = ble_ftms_get_connections(conns, BLE_FTMS_MAX_CONNECTIONS);
+    for (size_t i = 0; i < conn_count; i++) {
+        printf("  central %u: mtu %u, interval %u.%02u ms, subscribed 0x%" PRIx32 "%s%s\n",
+               conns[i].conn_id, conns[i].mtu, conns[i].interval * 5 / 4, (conns[i].interval * 125) % 100,
+               conns[i].subscribed, conns[i].congested ? ", congested" : "",
+               conns[i].exporting ? ", exporting" : "");
+    }
+
+    fdf_bus_stats_t bus;
+    const char *name;
+    printf("bus      ");
+    for (int i = 0; (name = fdf_bus_get_stats(i, &bus)) != NULL; i++) {
+        printf(" %s %" PRIu32, name, bus.delivered);
+        if (bus.read > 0 || bus.overwritten > 0) {
+            printf(" (%" PRIu32 " read, %" PRIu32 " overwritten)", bus.read, bus.overwritten);
+        }
+    }
+    printf("\n");
+
+    fdf_supervisor_stats_t sup;
+    fdf_supervisor_get_stats(&sup);
+    printf("supervisor uptime %" PRId64 " s, %u consoles, %u centrals, "
+           "%" PRIu32 " console / %" PRIu32 " central reconnects\n",
+           sup.uptime_us / 1000000, sup.consoles, sup.centrals, sup.usb_reconnects, sup.ble_reconnects);
+    for (int i = 0; i < FDF_SUP_EVENT_COUNT; i++) {
+        printf("  %-17s %" PRIu32 "\n", event_names[i], sup.events[i]);
+    }
+    return 0;
+}
+
+static int cmd_snapshot(int argc, char **argv)
+{
+    for (size_t i = 0; i < diag_parser_count; i++) {
+        fdf_rowing_data_t data;
+        memset(&data, 0, sizeof(data));
+        bool fresh = fdf_bus_read(diag_subscriber, i, &data, NULL);
+        if (data.seq == 0) {
+            printf("console %u: no data\n", (unsigned)i);
+            continue;
+        }
+        printf("console %u: #%" PRIu32 "%s, %" PRIu32 ".%01" PRIu32 " s, %u strokes, %" PRIu32 " m, "
+               "%u spm, %u W, pace %" PRIu32 ".%01" PRIu32 " s, %u kcal\n",
+               (unsigned)i, data.seq, fresh ? "" : " (unchanged)",
+               data.elapsed_time_ms / 1000, data.elapsed_time_ms % 1000 / 100, data.stroke_count,
+               data.distance_m, data.stroke_rate, data.power_watts,
+               data.pace_500m_ms / 1000, data.pace_500m_ms % 1000 / 100, data.calories);
+        if (data.present & FDF_FIELD_REMAINING_TIME) {
+            printf("  workout: %u s left\n", data.remaining_time_s);
+        }
+    }
+    return 0;
+}
+
+static int cmd_reset_stats(int argc, char **argv)
+{
+    for (size_t i = 0; i < diag_parser_count; i++) {
+        memset(&diag_parsers[i].stats, 0, sizeof(fdf_parser_stats_t));
+    }
+    usb_host_reset_stats();
+    ble_ftms_reset_stats();
+    printf("Counters cleared\n");
+    return 0;
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static const char task_states[] = {
+    [eRunning] = 'X', [eReady] = 'R', [eBlocked] = 'B', [eSuspended] = 'S', [eDeleted] = 'D', [eInvalid] = '?',
+};
+
+static int cmd_tasks(int argc, char **argv)
+{
+    // Too large for the REPL task's stack
+    static TaskStatus_t tasks[DIAG_MAX_TASKS];
+    uint32_t total_runtime = 0;
+
+    UBaseType_t count = uxTaskGetSystemState(tasks, DIAG_MAX_TASKS, &total_runtime);
+    if (count == 0) {
+        printf("More than %d tasks\n", DIAG_MAX_TASKS);
+        return 1;
+    }
+
+    // The run-time counter runs on every core, so the shares add up to 100% per core
+    total_runtime /= 100;
+    printf("%-16s %5s %4s %6s %10s\n", "task", "state", "prio", "cpu", "stack free");
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *task = &tasks[i];
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        if (total_runtime > 0) {
+            printf("%-16s %5c %4u %5" PRIu32 "%% %10" PRIu32 "\n", task->pcTaskName,
+                   task_states[task->eCurrentState], (unsigned)task->uxCurrentPriority,
+                   task->ulRunTimeCounter / total_runtime, (uint32_t)task->usStackHighWaterMark);
+            continue;
+        }
+#endif
+        printf("%-16s %5c %4u %6s %10" PRIu32 "\n", task->pcTaskName,
+               task_states[task->eCurrentState], (unsigned)task->uxCurrentPriority, "-",
+               (uint32_t)task->usStackHighWaterMark);
+    }
+    return 0;
+}
+#endif
+
+#if CONFIG_FDF_POWER_MANAGEMENT
+static int cmd_power(int argc, char **argv)
+{
+    printf("state now: %s\n", fdf_power_state_name(fdf_power_get_state()));
+    printf("%-9s %10s %7s %8s %12s %12s\n", "state", "time (s)", "entries", "probes", "wake avg us", "wake max us");
+    for (int i = 0; i < FDF_POWER_STATE_COUNT; i++) {
+        fdf_power_state_stats_t stats;
+        fdf_power_get_stats((fdf_power_state_t)i, &stats);
+        printf("%-9s %10.1f %7" PRIu32 " %8" PRIu32 " %12" PRIu64 " %12" PRIu32 "\n",
+               fdf_power_state_name((fdf_power_state_t)i), stats.time_us / 1e6, stats.entries,
+               stats.wake_samples, stats.wake_samples ? stats.wake_total_us / stats.wake_samples : 0,
+               stats.wake_max_us);
+    }
+#if CONFIG_FDF_PM_PROBE_MS == 0
+    printf("wake-up probe off, set CONFIG_FDF_PM_PROBE_MS to measure\n");
+#endif
+#if CONFIG_PM_PROFILING
+    // Lock holders and time per clock mode, as accounted by esp_pm
+    esp_pm_dump_locks(stdout);
+#endif
+    return 0;
+}
+#endif
+
+static int cmd_log(int argc, char **argv)
+{
+    if (argc != 3) {
+        printf("Usage: log <tag|*> <none|error|warn|info|debug|verbose>\n");
+        return 1;
+    }
+
+    for (size_t level = 0; level < sizeof(level_names) / sizeof(level_names[0]); level++) {
+        if (strcasecmp(argv[2], level_names[level]) == 0) {
+            esp_log_level_set(argv[1], (esp_log_level_t)level);
+            printf("%s: %s\n", argv[1], level_names[level]);
+            return 0;
+        }
+    }
+    printf("Unknown level '%s'\n", argv[2]);
+    return 1;
+}
+
+static int cmd_config(int argc, char **argv)
+{
+    if (argc == 1) {
+        fdf_config_t config;
+        fdf_config_read(&config);
+        for (size_t i = 0; i < fdf_config_key_count(); i++) {
+            const fdf_config_key_t *key = fdf_config_key(i);
+            char value[FDF_CONFIG_NAME_MAX + 1];
+            fdf_config_format(&config, key, value, sizeof(value));
+            printf("%-12s %-20s %s\n", key->name, value, key->help);
+        }
+        return 0;
+    }
+
+    fdf_config_result_t result;
+    if (argc >= 4 && strcmp(argv[1], "set") == 0) {
+        // Names may hold spaces: the value is the rest of the line
+        char value[FDF_CONFIG_NAME_MAX + 2] = "";
+        size_t len = 0;
+        for (int i = 3; i < argc && len < sizeof(value); i++) {
+            len += snprintf(&value[len], sizeof(value) - len, i > 3 ? " %s" : "%s", argv[i]);
+        }
+        result = fdf_config_set(argv[2], value);
+    } else if (argc == 2 && strcmp(argv[1], "save") == 0) {
+        result = fdf_config_save();
+    } else if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        result = fdf_config_reset();
+    } else {
+        printf("Usage: config [set <key> <value> | save | reset]\n");
+        return 1;
+    }
+    printf("%s\n", fdf_config_result_name(result));
+    return result == FDF_CONFIG_OK ? 0 : 1;
+}
+
+#if CONFIG_FDF_SESSION_RECORDER
+static int cmd_record(int argc, char **argv)
+{
+    const uint8_t *log;
+    size_t size;
+    if (!session_recorder_get(&log, &size)) {
+        printf("Not recording\n");
+        return 1;
+    }
+    if (argc == 1) {
+        session_log_writer_t writer;
+        session_recorder_get_stats(&writer);
+        printf("%zu bytes, %" PRIu32 " chunks, %" PRIu32 " dropped\n", size, writer.chunks, writer.dropped);
+        return 0;
+    }
+    if (argc != 2 || strcmp(argv[1], "dump") != 0) {
+        printf("Usage: record [dump]\n");
+        return 1;
+    }
+
+    // Hex lines between markers, read by fdf_replay --from-hex; recording goes on, and a
+    // chunk arriving meanwhile may be cut off at the end, where replay stops
+    printf("FDFR-HEX %zu\n", size);
+    for (size_t pos = 0; pos < size; pos += DIAG_DUMP_LINE_BYTES) {
+        size_t end = pos + DIAG_DUMP_LINE_BYTES < size ? pos + DIAG_DUMP_LINE_BYTES : size;
+        for (size_t i = pos; i < end; i++) {
+            printf("%02x", log[i]);
+        }
+        printf("\n");
+    }
+    printf("FDFR-HEX END\n");
+    return 0;
+}
+#endif
+
+static const esp_console_cmd_t commands[] = {
+    {
+        .command = "stats",
+        .help = "Print the parser, USB, poll, watchdog, BLE and supervisor counters",
+        .func = cmd_stats,
+    },
+    {
+        .command = "snapshot",
+        .help = "Print the newest snapshot of each console",
+        .func = cmd_snapshot,
+    },
+    {
+        .command = "reset_stats",
+        .help = "Clear the parser, USB, poll and BLE counters",
+        .func = cmd_reset_stats,
+    },
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    {
+        .command = "tasks",
+        .help = "List tasks with CPU time since boot and free stack (bytes)",
+        .func = cmd_tasks,
+    },
+#endif
+#if CONFIG_FDF_POWER_MANAGEMENT
+    {
+        .command = "power",
+        .help = "Time spent in each power state and timer wake-up latency",
+        .func = cmd_power,
+    },
+#endif
+    {
+        .command = "log",
+        .help = "Set the log level of a tag, or of all tags with *",
+        .hint = "<tag|*> <none|error|warn|info|debug|verbose>",
+        .func = cmd_log,
+    },
+    {
+        .command = "config",
+        .help = "List the settings, change one in RAM, store them on flash or go back to the defaults",
+        .hint = "[set <key> <value> | save | reset]",
+        .func = cmd_config,
+    },
+#if CONFIG_FDF_SESSION_RECORDER
+    {
+        .command = "record",
+        .help = "Print the size of the session recording, or dump it as hex for fdf_replay --from-hex",
+        .hint = "[dump]",
+        .func = cmd_record,
+    },
+#endif
+};
+
+bool fdf_diag_start(fdf_parser_t *parsers, const fdf_watchdog_t *watchdogs, size_t parser_count)
+{
+    diag_parsers = parsers;
+    diag_watchdogs = watchdogs;
+
+    // Slots only: typing a command never holds up the data path
+    const fdf_bus_subscription_t subscription = {
+        .name = "diag",
+        .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_SNAPSHOT),
+        .delivery = FDF_BUS_LATEST,
+    };
+    diag_subscriber = fdf_bus_subscribe(&subscription);
+    diag_parser_count = parser_count;
+
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "fdf>";
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+    esp_err_t ret = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the console: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    esp_console_register_help_command();
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        ESP_ERROR_CHECK(esp_console_cmd_register(&commands[i]));
+    }
+
+    ret = esp_console_start_repl(repl);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the console: %s", esp_err_to_name(ret));
+        return false;
+    }
+    ESP_LOGI(TAG, "Diagnostics console ready, type 'help'");
+    return true;
+}
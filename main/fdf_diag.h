@@ -0,0 +1,49 @@
+#ifndef FDF_DIAG_H
+#define FDF_DIAG_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "fdf_protocol.h"
+#include "fdf_watchdog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Diagnostics console
+ *
+ * An esp_console REPL on the UART that prints the pipeline counters (parser,
+ * USB transfers, poll scheduler, data watchdog, FTMS notifications,
+ * supervisor), the task
+ * list with CPU time and stack high-water marks, and changes log levels at
+ * runtime. Counters are read without locking while the bridge runs, so a
+ * value may be one update behind the others.
+ *
+ * Commands:
+ *   stats                     pipeline counters and connected centrals
+ *   snapshot                  newest snapshot of each console, from the update bus
+ *   tasks                     tasks, CPU time since boot, free stack
+ *   reset_stats               clear the pipeline counters
+ *   power                     residency and wake-up latency per power state
+ *   log <tag|*> <level>       none, error, warn, info, debug or verbose
+ *   config                    settings with their values (see fdf_config.h)
+ *   config set <key> <value>  change a setting in RAM
+ *   config save | reset       store the settings on flash, or go back to the defaults
+ */
+
+/**
+ * @brief Register the commands and start the REPL task
+ * @param parsers Parser of each console, read by "stats"
+ * @param watchdogs Data watchdog of each console, read by "stats", or NULL
+ * @param parser_count Number of parsers (and watchdogs)
+ * @return true if the REPL is running
+ */
+bool fdf_diag_start(fdf_parser_t *parsers, const fdf_watchdog_t *watchdogs, size_t parser_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_DIAG_H
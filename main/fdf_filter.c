@@ -0,0 +1,185 @@
+#include <string.h>
+
+#include "fdf_filter.h"
+
+#if !defined(FDF_HOST_BUILD) && !CONFIG_IDF_TARGET_LINUX
+#include "dsps_biquad.h"
+// Picks the ESP32-S3 SIMD kernel when esp-dsp is built optimized
+#define filter_biquad(input, output, len, coef, w) dsps_biquad_f32(input, output, len, coef, w)
+#else
+#define filter_biquad(input, output, len, coef, w) fdf_filter_biquad_ref(input, output, len, coef, w)
+#endif
+
+// Strokes gathered per run: the batch and the window before it
+#define GATHER_MAX (FDF_FILTER_MAX_BATCH + FDF_FILTER_MAX_MEDIAN - 1)
+
+static const uint16_t channel_fields[FDF_FILTER_CHANNELS] = {
+    [FDF_FILTER_POWER] = FDF_FIELD_POWER,
+    [FDF_FILTER_PACE] = FDF_FIELD_PACE,
+    [FDF_FILTER_RATE] = FDF_FIELD_STROKE_RATE,
+};
+
+static float stroke_value(const fdf_stroke_t *stroke, int channel)
+{
+    switch (channel) {
+        case FDF_FILTER_POWER:
+            return stroke->power_watts;
+        case FDF_FILTER_PACE:
+            return stroke->pace_500m_ds;
+        default:
+            return stroke->stroke_rate;
+    }
+}
+
+static uint32_t round_u32(float value, uint32_t max)
+{
+    if (value <= 0.0f) {
+        return 0;
+    }
+    return value >= (float)max ? max : (uint32_t)(value + 0.5f);
+}
+
+static void restart(fdf_filter_t *filter)
+{
+    filter->primed = false;
+    filter->next = 0;
+    filter->last_stroke_count = 0;
+}
+
+void fdf_filter_init(fdf_filter_t *filter, uint8_t median, uint8_t ema_percent)
+{
+    memset(filter, 0, sizeof(fdf_filter_t));
+    if (median < 1) {
+        median = 1;
+    } else if (median > FDF_FILTER_MAX_MEDIAN) {
+        median = FDF_FILTER_MAX_MEDIAN;
+    }
+    filter->median = median | 1;
+    if (ema_percent < 1) {
+        ema_percent = 1;
+    } else if (ema_percent > 100) {
+        ema_percent = 100;
+    }
+
+    // y[n] = a x[n] + (1 - a) y[n-1]
+    float alpha = ema_percent / 100.0f;
+    filter->coef[0] = alpha;
+    filter->coef[3] = -(1.0f - alpha);
+}
+
+void fdf_filter_biquad_ref(const float *input, float *output, int len, const float *coef, float *w)
+{
+    for (int i = 0; i < len; i++) {
+        float d0 = input[i] - coef[3] * w[0] - coef[4] * w[1];
+        output[i] = coef[0] * d0 + coef[1] * w[0] + coef[2] * w[1];
+        w[1] = w[0];
+        w[0] = d0;
+    }
+}
+
+float fdf_filter_median(float *values, int count)
+{
+    // Insertion sort: a handful of values
+    for (int i = 1; i < count; i++) {
+        float value = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > value) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = value;
+    }
+    return values[count / 2];
+}
+
+uint32_t fdf_filter_run(fdf_filter_t *filter, const fdf_stroke_history_t *history)
+{
+    uint32_t held = fdf_strokes_count(history);
+    uint32_t oldest = history->overwritten;
+    uint32_t total = oldest + held;
+    fdf_stroke_t stroke;
+
+    // A new session: fewer strokes than filtered, or another stroke where the last one was
+    if (total < filter->next ||
+        (filter->next > oldest && fdf_strokes_get(history, filter->next - 1 - oldest, &stroke) &&
+         stroke.stroke_count != filter->last_stroke_count)) {
+        restart(filter);
+    }
+
+    uint32_t first = filter->next;
+    if (first < oldest) {
+        first = oldest;
+    }
+    if (total - first > FDF_FILTER_MAX_BATCH) {
+        first = total - FDF_FILTER_MAX_BATCH;
+    }
+    filter->stats.skipped += first - filter->next;
+    uint32_t batch = total - first;
+    if (batch == 0) {
+        return 0;
+    }
+
+    // The batch and the strokes before it that are still held, oldest first
+    uint32_t start = first - oldest >= (uint32_t)(filter->median - 1) ? first - (filter->median - 1) : oldest;
+    uint32_t gathered = total - start;
+    uint32_t lead = first - start;
+    float raw[FDF_FILTER_CHANNELS][GATHER_MAX];
+    float carry[FDF_FILTER_CHANNELS];
+    for (int ch = 0; ch < FDF_FILTER_CHANNELS; ch++) {
+        carry[ch] = filter->primed ? filter->value[ch] : 0.0f;
+    }
+    for (uint32_t i = 0; i < gathered; i++) {
+        fdf_strokes_get(history, start - oldest + i, &stroke);
+        for (int ch = 0; ch < FDF_FILTER_CHANNELS; ch++) {
+            // A missing value repeats the previous one
+            if (stroke.present & channel_fields[ch]) {
+                carry[ch] = stroke_value(&stroke, ch);
+            }
+            raw[ch][i] = carry[ch];
+        }
+    }
+
+    // Outlier rejection, then smoothing of the whole batch per channel
+    float smoothed[FDF_FILTER_MAX_BATCH];
+    for (int ch = 0; ch < FDF_FILTER_CHANNELS; ch++) {
+        float medians[FDF_FILTER_MAX_BATCH];
+        for (uint32_t i = 0; i < batch; i++) {
+            uint32_t end = lead + i + 1;
+            uint32_t width = end < filter->median ? end : filter->median;
+            float window[FDF_FILTER_MAX_MEDIAN];
+            memcpy(window, &raw[ch][end - width], width * sizeof(float));
+            medians[i] = fdf_filter_median(window, (int)width);
+        }
+        if (!filter->primed) {
+            // Start the average at the first value instead of ramping up from zero
+            filter->state[ch][0] = medians[0] / filter->coef[0];
+            filter->state[ch][1] = filter->state[ch][0];
+        }
+        filter_biquad(medians, smoothed, (int)batch, filter->coef, filter->state[ch]);
+        filter->value[ch] = smoothed[batch - 1];
+    }
+
+    filter->primed = true;
+    filter->next = total;
+    filter->last_stroke_count = stroke.stroke_count;
+    filter->stats.runs++;
+    filter->stats.strokes += batch;
+    return batch;
+}
+
+void fdf_filter_apply(const fdf_filter_t *filter, fdf_rowing_data_t *data)
+{
+    // Nothing filtered yet, or values of a session that ended
+    if (!filter->primed || data->stroke_count < filter->last_stroke_count) {
+        return;
+    }
+    if (data->present & FDF_FIELD_POWER) {
+        data->power_watts = (uint16_t)round_u32(filter->value[FDF_FILTER_POWER], UINT16_MAX);
+    }
+    if (data->present & FDF_FIELD_PACE) {
+        data->pace_500m_ms = round_u32(filter->value[FDF_FILTER_PACE] * 100.0f, UINT32_MAX / 2);
+    }
+    if (data->present & FDF_FIELD_STROKE_RATE) {
+        data->stroke_rate = (uint16_t)round_u32(filter->value[FDF_FILTER_RATE], UINT16_MAX);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef FDF_FILTER_H
+#define FDF_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fdf_protocol.h"
+#include "fdf_strokes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Power, pace and stroke rate filtering
+ *
+ * Consoles report these once per stroke, and a single garbled line shows up
+ * as a spike in every app. The filter works on the stroke history of a
+ * console rather than on every update: each run takes the strokes recorded
+ * since the previous one as a batch, rejects outliers with a running median
+ * over the last strokes (the ring holds the ones before the batch), then
+ * smooths the medians with an exponential moving average, a first-order IIR.
+ * Updates between strokes only copy the latest outputs into the snapshot.
+ *
+ * The IIR runs as a biquad over the batch: esp-dsp's kernel on the device
+ * (the SIMD one on the ESP32-S3), fdf_filter_biquad_ref() in host builds
+ * and on the linux target. Both compute the same direct form II, so host
+ * tests cover the device arithmetic up to float rounding.
+ *
+ * No locking: the caller serializes runs and reads.
+ */
+
+// Largest median window
+#define FDF_FILTER_MAX_MEDIAN 9
+
+// Strokes filtered per run; older ones of a longer backlog are skipped
+#define FDF_FILTER_MAX_BATCH 32
+
+typedef enum {
+    FDF_FILTER_POWER,             // Watts
+    FDF_FILTER_PACE,              // Tenths of a second per 500 m, as in stroke records
+    FDF_FILTER_RATE,              // Strokes per minute
+    FDF_FILTER_CHANNELS
+} fdf_filter_channel_t;
+
+typedef struct {
+    uint32_t runs;
+    uint32_t strokes;             // Strokes filtered
+    uint32_t skipped;             // Strokes of a backlog past FDF_FILTER_MAX_BATCH, or overwritten
+} fdf_filter_stats_t;
+
+typedef struct {
+    uint8_t median;               // Median window in strokes, odd
+    float coef[5];                // EMA as a biquad: b0, b1, b2, a1, a2
+    float state[FDF_FILTER_CHANNELS][2];
+    bool primed;                  // Delay lines hold the session's values
+    uint32_t next;                // Stroke to filter next, counted from the session start
+    uint16_t last_stroke_count;   // Stroke count of the last stroke filtered
+    float value[FDF_FILTER_CHANNELS];
+    fdf_filter_stats_t stats;
+} fdf_filter_t;
+
+/**
+ * @brief Initialize a filter
+ * @param filter Filter
+ * @param median Median window in strokes, up to FDF_FILTER_MAX_MEDIAN, an even one is made
+ *               odd; 1 disables rejection
+ * @param ema_percent Weight of a new stroke in the average, 100 disables smoothing
+ */
+void fdf_filter_init(fdf_filter_t *filter, uint8_t median, uint8_t ema_percent);
+
+/**
+ * @brief Filter the strokes recorded since the previous run
+ *
+ * A stroke history that started a new session starts the filter over.
+ *
+ * @param filter Filter of the console
+ * @param history Stroke history of the console
+ * @return Number of strokes filtered
+ */
+uint32_t fdf_filter_run(fdf_filter_t *filter, const fdf_stroke_history_t *history);
+
+/**
+ * @brief Replace power, pace and stroke rate of a snapshot with the filtered values
+ *
+ * Only fields present in the snapshot are replaced, and only once a stroke
+ * of the session was filtered.
+ *
+ * @param filter Filter of the console
+ * @param data Snapshot
+ */
+void fdf_filter_apply(const fdf_filter_t *filter, fdf_rowing_data_t *data);
+
+/**
+ * @brief Scalar biquad, direct form II, as esp-dsp's dsps_biquad_f32
+ * @param input Samples
+ * @param output Filtered samples, may be input
+ * @param len Number of samples
+ * @param coef b0, b1, b2, a1, a2
+ * @param w Delay line, 2 values, updated
+ */
+void fdf_filter_biquad_ref(const float *input, float *output, int len, const float *coef, float *w);
+
+/**
+ * @brief Median of a few values
+ * @param values Values, reordered
+ * @param count Number of values, 1 to FDF_FILTER_MAX_MEDIAN
+ * @return Middle value, the upper one of an even count
+ */
+float fdf_filter_median(float *values, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_FILTER_H
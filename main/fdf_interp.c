@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "fdf_interp.h"
+
+// Resolution of the console's elapsed time
+#define CONSOLE_CLOCK_RESOLUTION_MS 1000
+
+void fdf_interp_init(fdf_interp_t *interp)
+{
+    memset(interp, 0, sizeof(fdf_interp_t));
+}
+
+void fdf_interp_update(fdf_interp_t *interp, const fdf_rowing_data_t *data, uint32_t speed_mm_s)
+{
+    if (!data->session_active) {
+        return;
+    }
+
+    int64_t now = data->timestamp_us;
+
+    // The console went back to zero: new session
+    if (interp->active && data->distance_m < interp->base.distance_m) {
+        fdf_interp_init(interp);
+    }
+
+    bool console_clock = (data->present & FDF_FIELD_ELAPSED_TIME) &&
+                         !(data->derived & FDF_FIELD_ELAPSED_TIME);
+    if (!interp->active || !console_clock) {
+        // Start, or follow a clock derived from local time as it is
+        interp->clock_origin_us = now - (int64_t)data->elapsed_time_ms * 1000;
+    } else {
+        // A console reading of S seconds means [S, S + 1) s: pull the clock into that range
+        int64_t clock_ms = (now - interp->clock_origin_us) / 1000;
+        if (clock_ms < data->elapsed_time_ms) {
+            interp->clock_origin_us = now - (int64_t)data->elapsed_time_ms * 1000;
+        } else if (clock_ms >= (int64_t)data->elapsed_time_ms + CONSOLE_CLOCK_RESOLUTION_MS) {
+            interp->clock_origin_us = now - ((int64_t)data->elapsed_time_ms +
+                                             CONSOLE_CLOCK_RESOLUTION_MS - 1) * 1000;
+        }
+    }
+
+    interp->base = *data;
+    interp->speed_mm_s = speed_mm_s;
+    interp->console_elapsed_ms = data->elapsed_time_ms;
+    interp->console_clock = console_clock;
+    interp->active = true;
+}
+
+bool fdf_interp_get(fdf_interp_t *interp, int64_t now_us, fdf_rowing_data_t *data)
+{
+    if (!interp->active) {
+        return false;
+    }
+
+    *data = interp->base;
+    int64_t since_us = now_us - interp->base.timestamp_us;
+    if (since_us < 0) {
+        since_us = 0;
+    }
+
+    // Session clock, stopped at the end of the console's current second, or
+    // after the extrapolation limit when the clock is local
+    int64_t clock_ms = (now_us - interp->clock_origin_us) / 1000;
+    int64_t clock_limit_ms = (int64_t)interp->console_elapsed_ms +
+                             (interp->console_clock ? CONSOLE_CLOCK_RESOLUTION_MS - 1 :
+                                                      FDF_INTERP_MAX_EXTRAPOLATION_MS);
+    if (clock_ms > clock_limit_ms) {
+        clock_ms = clock_limit_ms;
+    }
+    if (clock_ms > UINT32_MAX) {
+        clock_ms = UINT32_MAX;
+    }
+    if (clock_ms > interp->elapsed_ms) {
+        interp->elapsed_ms = (uint32_t)clock_ms;
+    }
+
+    // Dead-reckoned distance, for a bounded time after the update
+    if (since_us > (int64_t)FDF_INTERP_MAX_EXTRAPOLATION_MS * 1000) {
+        since_us = (int64_t)FDF_INTERP_MAX_EXTRAPOLATION_MS * 1000;
+    }
+    uint64_t distance_mm = (uint64_t)interp->base.distance_m * 1000 +
+                           (uint64_t)interp->speed_mm_s * (uint64_t)since_us / 1000000;
+    if (distance_mm > interp->distance_mm) {
+        interp->distance_mm = distance_mm;
+    }
+
+    if (data->present & FDF_FIELD_ELAPSED_TIME) {
+        data->elapsed_time_ms = interp->elapsed_ms;
+    }
+    data->distance_m = (uint32_t)(interp->distance_mm / 1000);
+    return true;
+}
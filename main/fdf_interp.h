@@ -0,0 +1,79 @@
+#ifndef FDF_INTERP_H
+#define FDF_INTERP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Interpolation between console updates
+ *
+ * Consoles report elapsed time in whole seconds and distance in whole meters,
+ * at their own cadence. Between updates the bridge keeps a local session clock
+ * and dead-reckons distance from the current speed, so notifications sent at
+ * a higher rate advance smoothly. Every console update corrects the estimate:
+ *
+ *   - The clock runs on the local monotonic time. A console reading of S
+ *     seconds means the true time lies in [S, S + 1) s; the clock is pulled
+ *     into that range when it leaves it, and stops at its end while the
+ *     console's time stands still (pause).
+ *   - Distance runs at the speed given with the last update, for at most
+ *     FDF_INTERP_MAX_EXTRAPOLATION_MS, so a console that stopped reporting
+ *     does not run away.
+ *   - Estimates never go backwards: when the console corrects an estimate
+ *     that ran ahead, the estimate holds until the console catches up.
+ */
+
+// Longest time distance is extrapolated past a console update
+#define FDF_INTERP_MAX_EXTRAPOLATION_MS 2000
+
+// Per-console interpolation state
+typedef struct {
+    fdf_rowing_data_t base;       // Last console snapshot
+    bool active;                  // A session snapshot has been received
+    uint32_t speed_mm_s;          // Speed at the last console snapshot
+    int64_t clock_origin_us;      // Local time at which the session clock read zero
+    uint32_t console_elapsed_ms;  // Elapsed time the console last reported
+    bool console_clock;           // The console reports its elapsed time
+    uint32_t elapsed_ms;          // Last elapsed time handed out
+    uint64_t distance_mm;         // Last distance handed out, in millimeters
+} fdf_interp_t;
+
+/**
+ * @brief Initialize interpolation state
+ * @param interp State to initialize
+ */
+void fdf_interp_init(fdf_interp_t *interp);
+
+/**
+ * @brief Correct the estimate with a new console snapshot
+ * @param interp Interpolation state of the console
+ * @param data Snapshot, completed by fdf_metrics; its timestamp_us is the local receive time
+ * @param speed_mm_s Current speed, e.g. from fdf_metrics_get_summary()
+ */
+void fdf_interp_update(fdf_interp_t *interp, const fdf_rowing_data_t *data, uint32_t speed_mm_s);
+
+/**
+ * @brief Estimate the snapshot at a given local time
+ *
+ * The last console snapshot with elapsed time and distance advanced to
+ * now_us. Successive estimates never go backwards.
+ *
+ * @param interp Interpolation state of the console
+ * @param now_us Local monotonic time, not before the last update
+ * @param data Filled with the estimate
+ * @return true if a session is in progress, false otherwise
+ */
+bool fdf_interp_get(fdf_interp_t *interp, int64_t now_us, fdf_rowing_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_INTERP_H
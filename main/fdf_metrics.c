@@ -0,0 +1,252 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "fdf_metrics.h"
+
+static const char *TAG = "FDF_METRICS";
+
+#define WINDOW_US ((int64_t)FDF_METRICS_WINDOW_MS * 1000)
+
+// Speeds above this are measurement glitches (a 1:15/500 m pace is ~6.7 m/s)
+#define MAX_SPEED_MM_S 20000
+
+// Phases are only resolved when updates come at least this many times per stroke
+#define PHASE_UPDATES_PER_STROKE 4
+
+// Exponential smoothing with gain 1/8, as the parser's cadence estimate
+static uint32_t smooth(uint32_t average, uint32_t sample)
+{
+    if (average == 0) {
+        return sample;
+    }
+    return (uint32_t)((int32_t)average + ((int32_t)sample - (int32_t)average) / 8);
+}
+
+// Distance over time in mm/s
+static uint32_t speed_mm_s(uint32_t distance_m, int64_t interval_us)
+{
+    if (interval_us <= 0) {
+        return 0;
+    }
+    uint64_t speed = (uint64_t)distance_m * 1000000000ULL / (uint64_t)interval_us;
+    return speed > MAX_SPEED_MM_S ? MAX_SPEED_MM_S : (uint32_t)speed;
+}
+
+// Concept2 ergometer power: P = 2.8 * v^3, v in m/s
+static uint32_t power_from_speed(uint32_t speed)
+{
+    uint64_t v = speed;
+    return (uint32_t)(v * v * v * 28 / 10000000000ULL);
+}
+
+// Concept2 calorie rate: 4 * P / 1.1622 kcal/h for the work plus 300 kcal/h at rest
+static uint32_t energy_per_hour(uint32_t power_w)
+{
+    return (power_w * 34416 + 5000) / 10000 + 300;
+}
+
+static uint16_t clamp_u16(uint64_t value)
+{
+    return value > UINT16_MAX ? UINT16_MAX : (uint16_t)value;
+}
+
+// Write a field the console did not report
+#define DERIVE(data, field, bit, value) do { \
+        if (!((data)->present & (bit))) { \
+            (data)->field = (value); \
+            (data)->present |= (bit); \
+            (data)->derived |= (bit); \
+        } \
+    } while (0)
+
+static const fdf_metrics_sample_t *oldest_sample(const fdf_metrics_t *metrics)
+{
+    uint32_t index = (metrics->head + FDF_METRICS_MAX_SAMPLES - metrics->count) % FDF_METRICS_MAX_SAMPLES;
+    return &metrics->samples[index];
+}
+
+static const fdf_metrics_sample_t *newest_sample(const fdf_metrics_t *metrics)
+{
+    return &metrics->samples[(metrics->head + FDF_METRICS_MAX_SAMPLES - 1) % FDF_METRICS_MAX_SAMPLES];
+}
+
+// Close the splits the step from previous_m to distance_m crossed, interpolating their end
+static void update_splits(fdf_metrics_t *metrics, uint32_t previous_m, uint32_t previous_ms,
+                          uint32_t distance_m, uint32_t session_ms)
+{
+    fdf_metrics_summary_t *summary = &metrics->summary;
+
+    // No step to interpolate over
+    if (distance_m == previous_m) {
+        return;
+    }
+    while ((uint64_t)(summary->splits + 1) * FDF_METRICS_SPLIT_M <= distance_m) {
+        uint32_t boundary = (summary->splits + 1) * FDF_METRICS_SPLIT_M;
+        uint32_t end_ms = previous_ms + (uint32_t)((uint64_t)(boundary - previous_m) *
+                                                   (session_ms - previous_ms) /
+                                                   (distance_m - previous_m));
+        summary->last_split_ms = end_ms - metrics->split_start_ms;
+        metrics->split_start_ms = end_ms;
+        summary->splits++;
+    }
+}
+
+// Follow the speed within a stroke: it rises during the drive and falls during the recovery
+static void update_phases(fdf_metrics_t *metrics, uint32_t step_speed, int64_t step_us,
+                          int64_t timestamp_us)
+{
+    fdf_metrics_summary_t *summary = &metrics->summary;
+
+    if (summary->stroke_period_ms == 0 ||
+        step_us * PHASE_UPDATES_PER_STROKE > (int64_t)summary->stroke_period_ms * 1000) {
+        // Too few updates per stroke to see the phases
+        summary->drive_ms = 0;
+        summary->recovery_ms = 0;
+        metrics->phase_start_us = 0;
+    } else if (step_speed > metrics->last_speed_mm_s && !metrics->in_drive) {
+        if (metrics->phase_start_us != 0) {
+            summary->recovery_ms = smooth(summary->recovery_ms,
+                                          (uint32_t)((timestamp_us - metrics->phase_start_us) / 1000));
+        }
+        metrics->in_drive = true;
+        metrics->phase_start_us = timestamp_us;
+    } else if (step_speed < metrics->last_speed_mm_s && metrics->in_drive) {
+        if (metrics->phase_start_us != 0) {
+            summary->drive_ms = smooth(summary->drive_ms,
+                                       (uint32_t)((timestamp_us - metrics->phase_start_us) / 1000));
+        }
+        metrics->in_drive = false;
+        metrics->phase_start_us = timestamp_us;
+    }
+    metrics->last_speed_mm_s = step_speed;
+}
+
+void fdf_metrics_init(fdf_metrics_t *metrics)
+{
+    memset(metrics, 0, sizeof(fdf_metrics_t));
+}
+
+void fdf_metrics_update(fdf_metrics_t *metrics, fdf_rowing_data_t *data)
+{
+    if (!data->session_active) {
+        return;
+    }
+
+    int64_t now = data->timestamp_us;
+    fdf_metrics_summary_t *summary = &metrics->summary;
+
+    // A console that went back to zero started a new session
+    if (metrics->count > 0) {
+        const fdf_metrics_sample_t *last = newest_sample(metrics);
+        if (data->distance_m < last->distance_m || now < last->timestamp_us) {
+            ESP_LOGD(TAG, "Distance went back from %" PRIu32 " to %" PRIu32 " m, new session",
+                     last->distance_m, data->distance_m);
+            fdf_metrics_init(metrics);
+        }
+    }
+    if (metrics->count == 0) {
+        // Joined mid-piece: splits already rowed count, the current one starts now
+        metrics->session_start_us = now;
+        summary->splits = data->distance_m / FDF_METRICS_SPLIT_M;
+        metrics->split_start_ms = 0;
+    }
+    uint32_t session_ms = (uint32_t)((now - metrics->session_start_us) / 1000);
+
+    // Step since the previous snapshot
+    uint32_t previous_m = data->distance_m;
+    uint32_t previous_ms = session_ms;
+    int64_t step_us = 0;
+    uint32_t step_speed = 0;
+    if (metrics->count > 0) {
+        const fdf_metrics_sample_t *last = newest_sample(metrics);
+        previous_m = last->distance_m;
+        previous_ms = (uint32_t)((last->timestamp_us - metrics->session_start_us) / 1000);
+        step_us = now - last->timestamp_us;
+        step_speed = speed_mm_s(data->distance_m - previous_m, step_us);
+    }
+
+    // Drop samples that left the window, keeping one as its start
+    while (metrics->count > 1 && now - oldest_sample(metrics)->timestamp_us > WINDOW_US) {
+        metrics->count--;
+    }
+
+    // Speed over the window, and the power of this step
+    uint32_t window_speed = step_speed;
+    if (metrics->count > 0) {
+        const fdf_metrics_sample_t *oldest = oldest_sample(metrics);
+        window_speed = speed_mm_s(data->distance_m - oldest->distance_m, now - oldest->timestamp_us);
+    }
+    uint32_t power = (data->present & FDF_FIELD_POWER) ? data->power_watts : power_from_speed(window_speed);
+    metrics->work_mj += (uint64_t)power * (uint64_t)step_us / 1000;
+
+    // Add the snapshot to the window
+    fdf_metrics_sample_t *sample = &metrics->samples[metrics->head];
+    sample->timestamp_us = now;
+    sample->distance_m = data->distance_m;
+    sample->work_mj = metrics->work_mj;
+    metrics->head = (metrics->head + 1) % FDF_METRICS_MAX_SAMPLES;
+    if (metrics->count < FDF_METRICS_MAX_SAMPLES) {
+        metrics->count++;
+    }
+
+    // Average power over the window
+    const fdf_metrics_sample_t *oldest = oldest_sample(metrics);
+    int64_t window_us = now - oldest->timestamp_us;
+    uint32_t window_power = power;
+    if (window_us > 0) {
+        window_power = (uint32_t)((metrics->work_mj - oldest->work_mj) * 1000 / (uint64_t)window_us);
+    }
+
+    // Stroke period from stroke count changes
+    if ((data->present & FDF_FIELD_STROKE_COUNT) && data->stroke_count != metrics->last_stroke_count) {
+        uint16_t strokes = data->stroke_count - metrics->last_stroke_count;
+        if (metrics->last_stroke_us != 0 && data->stroke_count > metrics->last_stroke_count) {
+            summary->stroke_period_ms = smooth(summary->stroke_period_ms,
+                                               (uint32_t)((now - metrics->last_stroke_us) / 1000 / strokes));
+        }
+        metrics->last_stroke_count = data->stroke_count;
+        metrics->last_stroke_us = now;
+    }
+
+    update_splits(metrics, previous_m, previous_ms, data->distance_m, session_ms);
+    if (step_us > 0) {
+        update_phases(metrics, step_speed, step_us, now);
+    }
+
+    // Complete the snapshot
+    DERIVE(data, elapsed_time_ms, FDF_FIELD_ELAPSED_TIME, session_ms);
+    uint32_t elapsed_ms = data->elapsed_time_ms;
+
+    DERIVE(data, pace_500m_ms, FDF_FIELD_PACE,
+           window_speed > 0 ? 500000000u / window_speed : 0);
+    DERIVE(data, power_watts, FDF_FIELD_POWER, clamp_u16(power));
+    if (session_ms > 0) {
+        DERIVE(data, avg_power_watts, FDF_FIELD_AVG_POWER, clamp_u16(metrics->work_mj / session_ms));
+    }
+    if (data->distance_m > 0) {
+        DERIVE(data, avg_pace_500m_ms, FDF_FIELD_AVG_PACE,
+               (uint32_t)((uint64_t)elapsed_ms * 500 / data->distance_m));
+    }
+    if (summary->stroke_period_ms > 0) {
+        DERIVE(data, stroke_rate, FDF_FIELD_STROKE_RATE, clamp_u16(60000 / summary->stroke_period_ms));
+    }
+    if ((data->present & FDF_FIELD_STROKE_COUNT) && elapsed_ms > 0) {
+        DERIVE(data, avg_stroke_rate, FDF_FIELD_AVG_STROKE_RATE,
+               clamp_u16((uint64_t)data->stroke_count * 60000 / elapsed_ms));
+    }
+
+    uint32_t per_hour = energy_per_hour(window_power);
+    DERIVE(data, energy_per_hour, FDF_FIELD_ENERGY_RATE, clamp_u16(per_hour));
+    if (data->derived & FDF_FIELD_ENERGY_RATE) {
+        uint32_t per_minute = (per_hour + 30) / 60;
+        data->energy_per_minute = per_minute > UINT8_MAX ? UINT8_MAX : (uint8_t)per_minute;
+    }
+
+    summary->session_ms = session_ms;
+    summary->speed_mm_s = window_speed;
+}
+
+void fdf_metrics_get_summary(const fdf_metrics_t *metrics, fdf_metrics_summary_t *summary)
+{
+    memcpy(summary, &metrics->summary, sizeof(fdf_metrics_summary_t));
+}
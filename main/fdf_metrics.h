@@ -0,0 +1,101 @@
+#ifndef FDF_METRICS_H
+#define FDF_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Derived metrics
+ *
+ * Sits between a console's parser and its FTMS instance. Every snapshot is
+ * added to a rolling window of recent samples bounded by
+ * FDF_METRICS_WINDOW_MS; rates are differences between the newest and the
+ * oldest sample, so each update costs O(1) (amortized) whatever the update
+ * rate. All arithmetic is integer: distances in meters, times in
+ * microseconds, speeds in mm/s and work in millijoules.
+ *
+ * Fields the console does not report (pace, power, their averages, stroke
+ * rates, elapsed time) are filled in from the window and the session clock
+ * and flagged in the snapshot's derived bitmap. Energy rates follow the
+ * Concept2 formula from the average power of the window.
+ */
+
+// Length of the rolling window
+#define FDF_METRICS_WINDOW_MS CONFIG_FDF_METRICS_WINDOW_MS
+
+// Length of a split
+#define FDF_METRICS_SPLIT_M CONFIG_FDF_METRICS_SPLIT_M
+
+// Samples the window holds at most; older ones are dropped early at high update rates
+#define FDF_METRICS_MAX_SAMPLES 64
+
+// One window sample
+typedef struct {
+    int64_t timestamp_us;         // Receive time of the snapshot
+    uint32_t distance_m;
+    uint64_t work_mj;             // Work done since the session started
+} fdf_metrics_sample_t;
+
+// Metrics that have no place in the snapshot
+typedef struct {
+    uint32_t session_ms;          // Time since the first active snapshot
+    uint32_t speed_mm_s;          // Average speed over the window
+    uint32_t splits;              // Completed splits, those before the first snapshot included
+    uint32_t last_split_ms;       // Duration of the last completed split
+    uint32_t stroke_period_ms;    // Smoothed time between strokes
+    uint32_t drive_ms;            // Smoothed drive time, 0 until resolved
+    uint32_t recovery_ms;         // Smoothed recovery time, 0 until resolved
+} fdf_metrics_summary_t;
+
+// Per-console metrics context
+typedef struct {
+    fdf_metrics_sample_t samples[FDF_METRICS_MAX_SAMPLES];
+    uint32_t head;                // Next sample slot
+    uint32_t count;               // Samples in the window
+    int64_t session_start_us;     // Receive time of the first active snapshot
+    uint64_t work_mj;             // Work done since the session started
+    uint32_t split_start_ms;      // Session time at which the current split started
+    uint32_t last_speed_mm_s;     // Speed between the last two snapshots
+    int64_t phase_start_us;       // Start of the current drive or recovery
+    bool in_drive;                // Speed rising since phase_start_us
+    uint16_t last_stroke_count;
+    int64_t last_stroke_us;       // Receive time of the last stroke count change
+    fdf_metrics_summary_t summary;
+} fdf_metrics_t;
+
+/**
+ * @brief Initialize a metrics context
+ * @param metrics Context to initialize
+ */
+void fdf_metrics_init(fdf_metrics_t *metrics);
+
+/**
+ * @brief Add a snapshot and complete it with derived metrics
+ *
+ * Only fields the console did not report are written. A snapshot whose
+ * distance went backwards starts a new session.
+ *
+ * @param metrics Metrics context of the console
+ * @param data Snapshot to complete, its seq must have advanced
+ */
+void fdf_metrics_update(fdf_metrics_t *metrics, fdf_rowing_data_t *data);
+
+/**
+ * @brief Get the metrics that are not part of the snapshot
+ * @param metrics Metrics context
+ * @param summary Filled with the current values
+ */
+void fdf_metrics_get_summary(const fdf_metrics_t *metrics, fdf_metrics_summary_t *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_METRICS_H
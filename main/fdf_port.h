@@ -0,0 +1,101 @@
+#ifndef FDF_PORT_H
+#define FDF_PORT_H
+
+/*
+ * Portability layer for the platform independent parts of the bridge
+ * (protocol parser, FTMS encoder). On ESP-IDF it maps to esp_log and
+ * esp_timer; with FDF_HOST_BUILD defined it maps to stdio and the POSIX
+ * monotonic clock so the same sources build natively on Linux.
+ */
+
+#include <stdint.h>
+
+#ifdef FDF_HOST_BUILD
+
+#include <stdio.h>
+#include <time.h>
+
+// Host log verbosity: 0 none, 1 error, 2 warning, 3 info, 4 debug
+#ifndef FDF_HOST_LOG_LEVEL
+#define FDF_HOST_LOG_LEVEL 2
+#endif
+
+#define FDF_HOST_LOG(level, letter, tag, format, ...) do { \
+        if (FDF_HOST_LOG_LEVEL >= (level)) { \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) FDF_HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) FDF_HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) FDF_HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) FDF_HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) FDF_HOST_LOG(5, "V", tag, format, ##__VA_ARGS__)
+
+// Kconfig defaults for options used by host-built sources
+#ifndef CONFIG_FDF_MAX_CONSOLES
+#define CONFIG_FDF_MAX_CONSOLES 2
+#endif
+#ifndef CONFIG_FDF_METRICS_WINDOW_MS
+#define CONFIG_FDF_METRICS_WINDOW_MS 4000
+#endif
+#ifndef CONFIG_FDF_METRICS_SPLIT_M
+#define CONFIG_FDF_METRICS_SPLIT_M 500
+#endif
+#ifndef CONFIG_FDF_DEVICE_NAME
+#define CONFIG_FDF_DEVICE_NAME "FDF Rower"
+#endif
+#ifndef CONFIG_FDF_TRACE
+#define CONFIG_FDF_TRACE 1
+#endif
+#ifndef CONFIG_FDF_TRACE_RECORDS
+#define CONFIG_FDF_TRACE_RECORDS 256
+#endif
+
+/**
+ * @brief Monotonic time in microseconds
+ */
+static inline int64_t fdf_port_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Sleep the calling thread
+ */
+static inline void fdf_port_sleep_us(int64_t us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+#else
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/**
+ * @brief Monotonic time in microseconds
+ */
+static inline int64_t fdf_port_time_us(void)
+{
+    return esp_timer_get_time();
+}
+
+/**
+ * @brief Sleep the calling task (tick resolution)
+ */
+static inline void fdf_port_sleep_us(int64_t us)
+{
+    TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+}
+
+#endif // FDF_HOST_BUILD
+
+#endif // FDF_PORT_H
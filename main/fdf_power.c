@@ -0,0 +1,208 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "fdf_power.h"
+
+static const char *TAG = "POWER";
+
+static const char *const state_names[FDF_POWER_STATE_COUNT] = {
+    [FDF_POWER_IDLE] = "idle",
+    [FDF_POWER_CONSOLE] = "console",
+    [FDF_POWER_CENTRAL] = "central",
+    [FDF_POWER_BRIDGING] = "bridging",
+};
+
+// USB transfers need the APB clock and no light sleep; notifications need the CPU clock
+static esp_pm_lock_handle_t usb_apb_lock = NULL;
+static esp_pm_lock_handle_t usb_sleep_lock = NULL;
+static esp_pm_lock_handle_t ble_cpu_lock = NULL;
+#if CONFIG_FDF_PM_LIGHT_SLEEP && CONFIG_FDF_DIAG_CONSOLE
+// The UART does not wake the chip; the diagnostics console would not see typing
+static esp_pm_lock_handle_t diag_sleep_lock = NULL;
+#endif
+
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t stage_count[FDF_POWER_STAGE_COUNT];
+static fdf_power_state_t state = FDF_POWER_IDLE;
+static int64_t state_since_us = 0;
+static fdf_power_state_stats_t state_stats[FDF_POWER_STATE_COUNT];
+
+#if CONFIG_FDF_PM_PROBE_MS > 0
+static esp_timer_handle_t probe_timer = NULL;
+static int64_t probe_period_us = 0;
+static int64_t probe_due_us = 0;
+#endif
+
+// Called with power_lock held
+static void update_state(int64_t now_us)
+{
+    fdf_power_state_t next = FDF_POWER_IDLE;
+    for (int i = 0; i < FDF_POWER_STAGE_COUNT; i++) {
+        if (stage_count[i] > 0) {
+            next |= 1 << i;
+        }
+    }
+    if (next == state) {
+        return;
+    }
+    state_stats[state].time_us += now_us - state_since_us;
+    state_since_us = now_us;
+    state = next;
+    state_stats[next].entries++;
+}
+
+#if CONFIG_FDF_PM_PROBE_MS > 0
+// Periodic deadline; how late it fires is the wake-up latency of the current state
+static void probe_timer_callback(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t late_us = now_us - probe_due_us;
+    if (late_us < 0) {
+        late_us = 0;
+    }
+
+    portENTER_CRITICAL(&power_lock);
+    fdf_power_state_stats_t *stats = &state_stats[state];
+    stats->wake_samples++;
+    stats->wake_last_us = (uint32_t)late_us;
+    stats->wake_total_us += (uint64_t)late_us;
+    if (stats->wake_last_us > stats->wake_max_us) {
+        stats->wake_max_us = stats->wake_last_us;
+    }
+    portEXIT_CRITICAL(&power_lock);
+
+    // Periodic timers keep their phase; resync only after a skipped period
+    probe_due_us += probe_period_us;
+    if (now_us >= probe_due_us) {
+        probe_due_us = now_us + probe_period_us;
+    }
+}
+#endif
+
+bool fdf_power_init(void)
+{
+    const esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_FDF_PM_MIN_FREQ_MHZ,
+#if CONFIG_FDF_PM_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "usb_apb", &usb_apb_lock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "usb_awake", &usb_sleep_lock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "ble_cpu", &ble_cpu_lock) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the PM locks");
+        return false;
+    }
+#if CONFIG_FDF_PM_LIGHT_SLEEP && CONFIG_FDF_DIAG_CONSOLE
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "diag_uart", &diag_sleep_lock) == ESP_OK) {
+        esp_pm_lock_acquire(diag_sleep_lock);
+        ESP_LOGW(TAG, "Light sleep held off for the diagnostics console");
+    }
+#endif
+
+    portENTER_CRITICAL(&power_lock);
+    state_since_us = esp_timer_get_time();
+    state_stats[state].entries++;
+    portEXIT_CRITICAL(&power_lock);
+
+#if CONFIG_FDF_PM_PROBE_MS > 0
+    const esp_timer_create_args_t probe_args = {
+        .callback = probe_timer_callback,
+        .name = "pm_probe",
+    };
+    probe_period_us = (int64_t)CONFIG_FDF_PM_PROBE_MS * 1000;
+    if (esp_timer_create(&probe_args, &probe_timer) == ESP_OK) {
+        probe_due_us = esp_timer_get_time() + probe_period_us;
+        esp_timer_start_periodic(probe_timer, (uint64_t)probe_period_us);
+    } else {
+        ESP_LOGW(TAG, "Failed to create the probe timer, wake-up latency is not measured");
+    }
+#endif
+
+    ESP_LOGI(TAG, "CPU clock %d-%d MHz, light sleep %s", CONFIG_FDF_PM_MIN_FREQ_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, pm_config.light_sleep_enable ? "enabled" : "disabled");
+    return true;
+}
+
+void fdf_power_acquire(fdf_power_stage_t stage)
+{
+    if (stage >= FDF_POWER_STAGE_COUNT) {
+        return;
+    }
+    // The locks count acquisitions themselves
+    if (stage == FDF_POWER_STAGE_USB) {
+        esp_pm_lock_acquire(usb_apb_lock);
+        esp_pm_lock_acquire(usb_sleep_lock);
+    } else {
+        esp_pm_lock_acquire(ble_cpu_lock);
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&power_lock);
+    stage_count[stage]++;
+    update_state(now_us);
+    portEXIT_CRITICAL(&power_lock);
+}
+
+void fdf_power_release(fdf_power_stage_t stage)
+{
+    if (stage >= FDF_POWER_STAGE_COUNT) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    bool held;
+    portENTER_CRITICAL(&power_lock);
+    held = stage_count[stage] > 0;
+    if (held) {
+        stage_count[stage]--;
+        update_state(now_us);
+    }
+    portEXIT_CRITICAL(&power_lock);
+    if (!held) {
+        return;
+    }
+
+    if (stage == FDF_POWER_STAGE_USB) {
+        esp_pm_lock_release(usb_sleep_lock);
+        esp_pm_lock_release(usb_apb_lock);
+    } else {
+        esp_pm_lock_release(ble_cpu_lock);
+    }
+}
+
+fdf_power_state_t fdf_power_get_state(void)
+{
+    return state;
+}
+
+void fdf_power_get_stats(fdf_power_state_t power_state, fdf_power_state_stats_t *stats)
+{
+    if (power_state >= FDF_POWER_STATE_COUNT || stats == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&power_lock);
+    *stats = state_stats[power_state];
+    if (power_state == state) {
+        stats->time_us += now_us - state_since_us;
+    }
+    portEXIT_CRITICAL(&power_lock);
+}
+
+const char *fdf_power_state_name(fdf_power_state_t power_state)
+{
+    return power_state < FDF_POWER_STATE_COUNT ? state_names[power_state] : "?";
+}
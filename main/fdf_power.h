@@ -0,0 +1,99 @@
+#ifndef FDF_POWER_H
+#define FDF_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Power management
+ *
+ * Configures dynamic frequency scaling and, with tickless idle, automatic
+ * light sleep. The USB and BLE stages hold PM locks only while they have
+ * work: an open console keeps the APB clock up and the chip out of light
+ * sleep, which the USB controller needs; a connected central keeps the CPU
+ * at full clock for notification latency. With neither, the chip idles at
+ * the minimum clock or in light sleep, and the BLE controller in modem
+ * sleep between advertising events.
+ *
+ * The active stages make up the power state. Time spent in each state is
+ * accounted. An optional low-rate timer probe (CONFIG_FDF_PM_PROBE_MS)
+ * measures how late timer deadlines fire in each state, which is the
+ * wake-up latency out of light sleep; it is off by default since every
+ * probe wakes the chip.
+ * Current draw itself is measured externally; multiplying it per state by
+ * the residency gives the average.
+ */
+
+// Stages that hold PM locks while active
+typedef enum {
+    FDF_POWER_STAGE_USB,          // One acquisition per open console
+    FDF_POWER_STAGE_BLE,          // One acquisition per connected central
+    FDF_POWER_STAGE_COUNT
+} fdf_power_stage_t;
+
+// Power states: the bit mask of active stages
+typedef enum {
+    FDF_POWER_IDLE = 0,                              // Nothing attached
+    FDF_POWER_CONSOLE = 1 << FDF_POWER_STAGE_USB,    // Console attached, no central
+    FDF_POWER_CENTRAL = 1 << FDF_POWER_STAGE_BLE,    // Central connected, no console
+    FDF_POWER_BRIDGING = FDF_POWER_CONSOLE | FDF_POWER_CENTRAL,
+    FDF_POWER_STATE_COUNT
+} fdf_power_state_t;
+
+// Accounting of one power state
+typedef struct {
+    int64_t time_us;              // Residency, including the current stay
+    uint32_t entries;             // Times the state was entered
+    uint32_t wake_samples;        // Probe deadlines that fired in this state
+    uint32_t wake_last_us;        // Lateness of the last one
+    uint32_t wake_max_us;
+    uint64_t wake_total_us;
+} fdf_power_state_stats_t;
+
+/**
+ * @brief Configure DFS and light sleep, create the stage locks and start the probe if enabled
+ * @return true if the configuration was accepted
+ */
+bool fdf_power_init(void);
+
+/**
+ * @brief Mark a stage active; counted, each call needs a matching release
+ * @param stage Stage
+ */
+void fdf_power_acquire(fdf_power_stage_t stage);
+
+/**
+ * @brief Undo one fdf_power_acquire()
+ * @param stage Stage
+ */
+void fdf_power_release(fdf_power_stage_t stage);
+
+/**
+ * @brief Get the current power state
+ * @return Bit mask of the active stages
+ */
+fdf_power_state_t fdf_power_get_state(void);
+
+/**
+ * @brief Get the accounting of a power state
+ * @param state State
+ * @param stats Filled with the residency and wake-up latency
+ */
+void fdf_power_get_stats(fdf_power_state_t state, fdf_power_state_stats_t *stats);
+
+/**
+ * @brief Name of a power state, for logs
+ * @param state State
+ * @return Static string
+ */
+const char *fdf_power_state_name(fdf_power_state_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_POWER_H
@@ -1,56 +1,130 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_log.h"
-#include "esp_timer.h"
+#include <errno.h>
 
+#include "fdf_port.h"
 #include "fdf_protocol.h"
 
 static const char *TAG = "FDF_PROTOCOL";
 
-// Global rowing data
-static fdf_rowing_data_t current_data = {0};
-static fdf_data_callback_t data_callback = NULL;
+// Intervals longer than this are pauses, not cadence
+#define FDF_CADENCE_MAX_INTERVAL_US 5000000
 
-// Data buffer for incoming serial data
-#define MAX_BUFFER_SIZE 1024
-static char data_buffer[MAX_BUFFER_SIZE];
-static size_t buffer_pos = 0;
+// Default parser context for the single-console API
+static fdf_parser_t default_parser;
+static fdf_data_callback_t data_callback = NULL;
 
-// Session start time
-static int64_t session_start_time = 0;
+_Static_assert(sizeof(fdf_rowing_data_t) <= 64, "rowing snapshot must fit in a cache line");
 
-// Helper function to parse integer from string
-static int parse_int(const char *str, int *value)
+// Parse an unsigned decimal value no larger than max
+static bool parse_uint(const char *str, uint32_t max, uint32_t *value)
 {
+    if (*str < '0' || *str > '9') {
+        return false;
+    }
     char *endptr;
-    *value = strtol(str, &endptr, 10);
-    return (endptr != str && *endptr == '\0') ? 1 : 0;
+    errno = 0;
+    unsigned long parsed = strtoul(str, &endptr, 10);
+    if (*endptr != '\0' || errno == ERANGE || parsed > max) {
+        return false;
+    }
+    *value = (uint32_t)parsed;
+    return true;
+}
+
+// Parse a MM:SS duration into milliseconds
+static bool parse_duration_ms(const char *str, uint32_t *value)
+{
+    unsigned int minutes, seconds;
+    if (*str < '0' || *str > '9' || sscanf(str, "%u:%u", &minutes, &seconds) != 2) {
+        return false;
+    }
+    uint64_t ms = ((uint64_t)minutes * 60 + seconds) * 1000;
+    if (ms > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)ms;
+    return true;
+}
+
+// Parse a 16-bit field and mark it present; false if the value is malformed
+static bool set_u16(fdf_rowing_data_t *data, uint16_t *field, uint16_t bit, const char *str)
+{
+    uint32_t value;
+    if (parse_uint(str, UINT16_MAX, &value)) {
+        *field = (uint16_t)value;
+        data->present |= bit;
+        return true;
+    }
+    return false;
+}
+
+// Parse a 32-bit field and mark it present; false if the value is malformed
+static bool set_u32(fdf_rowing_data_t *data, uint32_t *field, uint16_t bit, const char *str)
+{
+    uint32_t value;
+    if (parse_uint(str, UINT32_MAX, &value)) {
+        *field = value;
+        data->present |= bit;
+        return true;
+    }
+    return false;
 }
 
-// Helper function to parse float from string (unused for now)
-// static int parse_float(const char *str, float *value)
-// {
-//     char *endptr;
-//     *value = strtof(str, &endptr);
-//     return (endptr != str && *endptr == '\0') ? 1 : 0;
-// }
+// Parse a MM:SS field into milliseconds and mark it present; false if malformed
+static bool set_duration(fdf_rowing_data_t *data, uint32_t *field, uint16_t bit, const char *str)
+{
+    uint32_t value;
+    if (parse_duration_ms(str, &value)) {
+        *field = value;
+        data->present |= bit;
+        return true;
+    }
+    return false;
+}
+
+// Fold the interval since the previous value change into the cadence estimate.
+// Same smoothing as TCP's RTT estimator: gain 1/8 on the mean, 1/4 on the deviation.
+static void update_cadence(fdf_cadence_t *cadence, int64_t timestamp_us)
+{
+    int64_t interval = timestamp_us - cadence->last_update_us;
+    
+    if (cadence->last_update_us != 0 && interval > 0 && interval < FDF_CADENCE_MAX_INTERVAL_US) {
+        if (cadence->samples == 0) {
+            cadence->interval_us = (uint32_t)interval;
+            cadence->jitter_us = (uint32_t)interval / 2;
+        } else {
+            int32_t err = (int32_t)interval - (int32_t)cadence->interval_us;
+            int32_t abs_err = err < 0 ? -err : err;
+            cadence->interval_us = (uint32_t)((int32_t)cadence->interval_us + err / 8);
+            cadence->jitter_us = (uint32_t)((int32_t)cadence->jitter_us +
+                                            (abs_err - (int32_t)cadence->jitter_us) / 4);
+        }
+        cadence->samples++;
+    }
+    cadence->last_update_us = timestamp_us;
+}
 
 // Parse a line of data from FDF console
 // Based on typical rowing machine formats, expecting something like:
 // "STROKES:123 TIME:12:34 DISTANCE:5000 RATE:24 POWER:150 CALORIES:200"
-static void parse_data_line(const char *line)
+// The line is tokenized in place.
+static void parse_data_line(fdf_parser_t *parser, char *line, int64_t timestamp_us)
 {
-    ESP_LOGD(TAG, "Parsing line: %s", line);
+    fdf_rowing_data_t *current_data = &parser->current_data;
+    fdf_rowing_data_t previous_data;
+    memcpy(&previous_data, current_data, sizeof(fdf_rowing_data_t));
+    
+    ESP_LOGD(TAG, "[%d] Parsing line: %s", parser->console_id, line);
     
-    char *line_copy = strdup(line);
     char *token;
     char *saveptr;
+    uint32_t fields = 0;
+    uint32_t malformed = 0;
     
     // Tokenize by spaces
-    token = strtok_r(line_copy, " \t\r\n", &saveptr);
+    token = strtok_r(line, " \t\r\n", &saveptr);
     while (token != NULL) {
         // Look for key-value pairs
         char *colon = strchr(token, ':');
@@ -58,96 +132,111 @@ static void parse_data_line(const char *line)
             *colon = '\0';
             char *key = token;
             char *value = colon + 1;
+            bool known = true;
+            bool ok = false;
             
             // Parse different metrics based on key
             if (strcmp(key, "STROKES") == 0 || strcmp(key, "STROKE") == 0) {
-                parse_int(value, (int*)&current_data.stroke_count);
+                ok = set_u16(current_data, &current_data->stroke_count, FDF_FIELD_STROKE_COUNT, value);
             }
             else if (strcmp(key, "TIME") == 0) {
-                // Parse time in MM:SS format
-                int minutes, seconds;
-                if (sscanf(value, "%d:%d", &minutes, &seconds) == 2) {
-                    current_data.elapsed_time_ms = (minutes * 60 + seconds) * 1000;
-                }
+                ok = set_duration(current_data, &current_data->elapsed_time_ms, FDF_FIELD_ELAPSED_TIME, value);
             }
             else if (strcmp(key, "DISTANCE") == 0 || strcmp(key, "DIST") == 0) {
-                parse_int(value, (int*)&current_data.distance_m);
+                ok = set_u32(current_data, &current_data->distance_m, FDF_FIELD_DISTANCE, value);
             }
             else if (strcmp(key, "RATE") == 0 || strcmp(key, "SPM") == 0) {
-                parse_int(value, (int*)&current_data.stroke_rate);
+                ok = set_u16(current_data, &current_data->stroke_rate, FDF_FIELD_STROKE_RATE, value);
             }
             else if (strcmp(key, "AVGRATE") == 0 || strcmp(key, "AVG_RATE") == 0) {
-                parse_int(value, (int*)&current_data.avg_stroke_rate);
+                ok = set_u16(current_data, &current_data->avg_stroke_rate, FDF_FIELD_AVG_STROKE_RATE, value);
             }
             else if (strcmp(key, "POWER") == 0 || strcmp(key, "WATTS") == 0) {
-                parse_int(value, (int*)&current_data.power_watts);
+                ok = set_u16(current_data, &current_data->power_watts, FDF_FIELD_POWER, value);
             }
             else if (strcmp(key, "AVGPOWER") == 0 || strcmp(key, "AVG_POWER") == 0) {
-                parse_int(value, (int*)&current_data.avg_power_watts);
+                ok = set_u16(current_data, &current_data->avg_power_watts, FDF_FIELD_AVG_POWER, value);
             }
             else if (strcmp(key, "CALORIES") == 0 || strcmp(key, "CAL") == 0) {
-                parse_int(value, (int*)&current_data.calories);
+                ok = set_u16(current_data, &current_data->calories, FDF_FIELD_CALORIES, value);
             }
             else if (strcmp(key, "PACE") == 0) {
-                // Parse pace in MM:SS format for 500m
-                int minutes, seconds;
-                if (sscanf(value, "%d:%d", &minutes, &seconds) == 2) {
-                    current_data.pace_500m_ms = (minutes * 60 + seconds) * 1000;
-                }
+                // Pace per 500m in MM:SS format
+                ok = set_duration(current_data, &current_data->pace_500m_ms, FDF_FIELD_PACE, value);
             }
             else if (strcmp(key, "AVGPACE") == 0 || strcmp(key, "AVG_PACE") == 0) {
-                // Parse average pace in MM:SS format for 500m
-                int minutes, seconds;
-                if (sscanf(value, "%d:%d", &minutes, &seconds) == 2) {
-                    current_data.avg_pace_500m_ms = (minutes * 60 + seconds) * 1000;
-                }
+                // Average pace per 500m in MM:SS format
+                ok = set_duration(current_data, &current_data->avg_pace_500m_ms, FDF_FIELD_AVG_PACE, value);
+            }
+            else {
+                known = false;
+            }
+            
+            if (known) {
+                fields += ok;
+                malformed += !ok;
             }
         }
         
         token = strtok_r(NULL, " \t\r\n", &saveptr);
     }
     
-    free(line_copy);
+    // A line with a malformed value, or nothing known, is a parse error
+    parser->stats.lines++;
+    if (malformed > 0 || fields == 0) {
+        parser->stats.parse_errors++;
+    }
     
     // Mark session as active if we have any data
-    if (current_data.stroke_count > 0 || current_data.distance_m > 0) {
-        current_data.session_active = true;
-        
-        // If this is the first data, record session start time
-        if (session_start_time == 0) {
-            session_start_time = esp_timer_get_time();
-        }
+    if (current_data->stroke_count > 0 || current_data->distance_m > 0) {
+        current_data->session_active = true;
+    }
+    
+    // Only lines that change a value are console updates
+    if (memcmp(&previous_data, current_data, sizeof(fdf_rowing_data_t)) != 0) {
+        current_data->timestamp_us = timestamp_us;
+        current_data->seq++;
+        update_cadence(&parser->cadence, timestamp_us);
+        parser->stats.updates++;
     }
     
     // Notify callback if registered
+    if (parser->callback) {
+        parser->callback(parser->console_id, current_data);
+    }
+}
+
+// Adapts the default parser's callback to the single-console callback type
+static void default_parser_callback(uint8_t console_id, const fdf_rowing_data_t *data)
+{
     if (data_callback) {
-        data_callback(&current_data);
+        data_callback(data);
     }
 }
 
-bool fdf_protocol_init(void)
+void fdf_parser_init(fdf_parser_t *parser, uint8_t console_id)
 {
-    ESP_LOGI(TAG, "Initializing FDF protocol parser...");
-    
-    // Initialize data structure
-    memset(&current_data, 0, sizeof(fdf_rowing_data_t));
-    buffer_pos = 0;
-    session_start_time = 0;
-    
-    ESP_LOGI(TAG, "FDF protocol parser initialized");
-    return true;
+    memset(parser, 0, sizeof(fdf_parser_t));
+    parser->console_id = console_id;
 }
 
-void fdf_protocol_register_callback(fdf_data_callback_t callback)
+void fdf_parser_register_callback(fdf_parser_t *parser, fdf_parser_callback_t callback)
 {
-    data_callback = callback;
+    parser->callback = callback;
 }
 
-void fdf_protocol_process_data(const uint8_t *data, size_t length)
+void fdf_parser_process_data(fdf_parser_t *parser, const uint8_t *data, size_t length)
+{
+    fdf_parser_process_chunk(parser, data, length, fdf_port_time_us());
+}
+
+void fdf_parser_process_chunk(fdf_parser_t *parser, const uint8_t *data, size_t length,
+                              int64_t timestamp_us)
 {
-    if (!data || length == 0) {
+    if (!parser || !data || length == 0) {
         return;
     }
+    parser->stats.bytes += length;
     
     // Process each byte
     for (size_t i = 0; i < length; i++) {
@@ -155,44 +244,94 @@ void fdf_protocol_process_data(const uint8_t *data, size_t length)
         
         // Handle different line endings
         if (c == '\n' || c == '\r') {
-            if (buffer_pos > 0) {
+            if (parser->buffer_pos > 0) {
                 // Null terminate the buffer
-                data_buffer[buffer_pos] = '\0';
+                parser->data_buffer[parser->buffer_pos] = '\0';
                 
-                // Parse the line
-                parse_data_line(data_buffer);
+                // Parse the line, timestamped with the arrival of its first byte
+                parse_data_line(parser, parser->data_buffer, parser->line_start_us);
                 
                 // Reset buffer
-                buffer_pos = 0;
+                parser->buffer_pos = 0;
             }
         }
-        else if (buffer_pos < MAX_BUFFER_SIZE - 1) {
+        else if (parser->buffer_pos < FDF_MAX_LINE_LENGTH - 1) {
             // Add character to buffer
-            data_buffer[buffer_pos++] = c;
+            if (parser->buffer_pos == 0) {
+                parser->line_start_us = timestamp_us;
+            }
+            parser->data_buffer[parser->buffer_pos++] = c;
         }
         else {
             // Buffer overflow, reset
-            ESP_LOGW(TAG, "Data buffer overflow, resetting");
-            buffer_pos = 0;
+            ESP_LOGW(TAG, "[%d] Data buffer overflow, resetting", parser->console_id);
+            parser->buffer_pos = 0;
+            parser->stats.overflow_resets++;
         }
     }
 }
 
-bool fdf_protocol_get_current_data(fdf_rowing_data_t *data)
+bool fdf_parser_get_cadence(const fdf_parser_t *parser, fdf_cadence_t *cadence)
 {
-    if (!data) {
+    if (!parser || !cadence) {
         return false;
     }
     
-    memcpy(data, &current_data, sizeof(fdf_rowing_data_t));
-    return current_data.session_active;
+    memcpy(cadence, &parser->cadence, sizeof(fdf_cadence_t));
+    return parser->cadence.samples > 0;
+}
+
+bool fdf_parser_get_current_data(const fdf_parser_t *parser, fdf_rowing_data_t *data)
+{
+    if (!parser || !data) {
+        return false;
+    }
+    
+    memcpy(data, &parser->current_data, sizeof(fdf_rowing_data_t));
+    return parser->current_data.session_active;
+}
+
+void fdf_parser_reset_session(fdf_parser_t *parser)
+{
+    uint8_t console_id = parser->console_id;
+    fdf_parser_callback_t callback = parser->callback;
+    fdf_parser_stats_t stats = parser->stats;
+    
+    fdf_parser_init(parser, console_id);
+    parser->callback = callback;
+    parser->stats = stats;
+}
+
+bool fdf_protocol_init(void)
+{
+    ESP_LOGI(TAG, "Initializing FDF protocol parser...");
+    
+    // Initialize default parser context
+    fdf_parser_init(&default_parser, 0);
+    fdf_parser_register_callback(&default_parser, default_parser_callback);
+    
+    ESP_LOGI(TAG, "FDF protocol parser initialized");
+    return true;
+}
+
+void fdf_protocol_register_callback(fdf_data_callback_t callback)
+{
+    data_callback = callback;
+}
+
+void fdf_protocol_process_data(const uint8_t *data, size_t length)
+{
+    fdf_parser_process_data(&default_parser, data, length);
+}
+
+bool fdf_protocol_get_current_data(fdf_rowing_data_t *data)
+{
+    return fdf_parser_get_current_data(&default_parser, data);
 }
 
 void fdf_protocol_reset_session(void)
 {
     ESP_LOGI(TAG, "Resetting FDF session data");
     
-    memset(&current_data, 0, sizeof(fdf_rowing_data_t));
-    buffer_pos = 0;
-    session_start_time = 0;
+    fdf_parser_reset_session(&default_parser);
 }
@@ -3,29 +3,156 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// FDF rowing metrics structure
+// Fields of fdf_rowing_data_t, as bits of its present bitmap
+#define FDF_FIELD_STROKE_COUNT      (1u << 0)
+#define FDF_FIELD_ELAPSED_TIME      (1u << 1)
+#define FDF_FIELD_DISTANCE          (1u << 2)
+#define FDF_FIELD_STROKE_RATE       (1u << 3)
+#define FDF_FIELD_AVG_STROKE_RATE   (1u << 4)
+#define FDF_FIELD_POWER             (1u << 5)
+#define FDF_FIELD_AVG_POWER         (1u << 6)
+#define FDF_FIELD_CALORIES          (1u << 7)
+#define FDF_FIELD_PACE              (1u << 8)
+#define FDF_FIELD_AVG_PACE          (1u << 9)
+#define FDF_FIELD_ENERGY_RATE       (1u << 10)
+#define FDF_FIELD_REMAINING_TIME    (1u << 11)
+
+// FDF rowing metrics snapshot
+//
+// Laid out largest field first so it packs into 56 bytes, within one cache
+// line. Only fields flagged in present hold values, the others are zero.
+// Present fields were reported by the console, or computed by the metrics
+// stage when they are also flagged in derived. seq identifies the snapshot:
+// it increments with every line that changes a value, so consumers detect
+// new data with one comparison.
 typedef struct {
+    int64_t timestamp_us;         // Receive time of the line that last changed a value
+    uint32_t seq;                 // Number of lines that changed a value
+    uint32_t elapsed_time_ms;     // Elapsed time in milliseconds
+    uint32_t distance_m;          // Distance in meters
+    uint32_t pace_500m_ms;        // Pace per 500m in milliseconds
+    uint32_t avg_pace_500m_ms;    // Average pace per 500m in milliseconds
+    uint16_t present;             // FDF_FIELD_* bits of the fields holding values
+    uint16_t derived;             // FDF_FIELD_* bits of the fields derived by fdf_metrics
     uint16_t stroke_count;        // Total strokes
-    uint32_t elapsed_time_ms;    // Elapsed time in milliseconds
-    uint32_t distance_m;         // Distance in meters
-    uint16_t stroke_rate;        // Current stroke rate (strokes per minute)
-    uint16_t avg_stroke_rate;    // Average stroke rate
-    uint16_t power_watts;        // Current power in watts
-    uint16_t avg_power_watts;    // Average power in watts
+    uint16_t stroke_rate;         // Current stroke rate (strokes per minute)
+    uint16_t avg_stroke_rate;     // Average stroke rate
+    uint16_t power_watts;         // Current power in watts
+    uint16_t avg_power_watts;     // Average power in watts
     uint16_t calories;            // Total calories burned
-    uint16_t pace_500m_ms;       // Pace per 500m in milliseconds
-    uint16_t avg_pace_500m_ms;   // Average pace per 500m in milliseconds
+    uint16_t energy_per_hour;     // Energy rate in kcal per hour
+    uint16_t remaining_time_s;    // Time left in the workout piece or rest, set by fdf_workout
+    uint8_t energy_per_minute;    // Energy rate in kcal per minute
     bool session_active;          // Whether a rowing session is active
+    bool stale;                   // The console stopped sending, values are the last known
 } fdf_rowing_data_t;
 
+// Console update cadence estimate
+typedef struct {
+    uint32_t interval_us;         // Smoothed interval between value changes
+    uint32_t jitter_us;           // Smoothed mean deviation of the interval
+    uint32_t samples;             // Intervals folded into the estimate
+    int64_t last_update_us;       // Receive time of the last value change
+} fdf_cadence_t;
+
+// Parser counters; they survive fdf_parser_reset_session()
+typedef struct {
+    uint64_t bytes;               // Bytes received
+    uint32_t lines;               // Lines parsed
+    uint32_t updates;             // Lines that changed a value
+    uint32_t parse_errors;        // Lines with a malformed value or no known field
+    uint32_t overflow_resets;     // Lines dropped for not fitting the line buffer
+} fdf_parser_stats_t;
+
 // Callback function type for updated rowing data
 typedef void (*fdf_data_callback_t)(const fdf_rowing_data_t *data);
 
+// Callback function type for updated rowing data from a parser instance
+typedef void (*fdf_parser_callback_t)(uint8_t console_id, const fdf_rowing_data_t *data);
+
+// Maximum length of a console line
+#define FDF_MAX_LINE_LENGTH 1024
+
+// Per-console parser context
+typedef struct {
+    uint8_t console_id;                  // Console this parser belongs to
+    fdf_rowing_data_t current_data;      // Latest parsed metrics
+    fdf_parser_callback_t callback;      // Called on every parsed line
+    fdf_cadence_t cadence;               // Update cadence estimate
+    fdf_parser_stats_t stats;            // Counters
+    int64_t line_start_us;               // Receive time of the current line's first byte
+    size_t buffer_pos;                   // Bytes in line buffer
+    char data_buffer[FDF_MAX_LINE_LENGTH];
+} fdf_parser_t;
+
+/**
+ * @brief Initialize a parser context
+ * @param parser Parser context to initialize
+ * @param console_id Console identifier passed to the callback
+ */
+void fdf_parser_init(fdf_parser_t *parser, uint8_t console_id);
+
+/**
+ * @brief Register callback for updated rowing data on a parser
+ * @param parser Parser context
+ * @param callback Function to call when data is updated
+ */
+void fdf_parser_register_callback(fdf_parser_t *parser, fdf_parser_callback_t callback);
+
+/**
+ * @brief Process incoming data from a console
+ * @param parser Parser context of the console
+ * @param data Raw data received from console
+ * @param length Length of data
+ */
+void fdf_parser_process_data(fdf_parser_t *parser, const uint8_t *data, size_t length);
+
+/**
+ * @brief Process a timestamped chunk of data from a console
+ * @param parser Parser context of the console
+ * @param data Raw data received from console
+ * @param length Length of data
+ * @param timestamp_us esp_timer time at which the chunk was received
+ */
+void fdf_parser_process_chunk(fdf_parser_t *parser, const uint8_t *data, size_t length,
+                              int64_t timestamp_us);
+
+/**
+ * @brief Get the estimated update cadence of a console
+ *
+ * Only lines that change at least one value count as updates, so repeated
+ * or polled lines do not skew the estimate.
+ *
+ * @param parser Parser context
+ * @param cadence Pointer to structure to fill
+ * @return true once at least one interval has been measured
+ */
+bool fdf_parser_get_cadence(const fdf_parser_t *parser, fdf_cadence_t *cadence);
+
+/**
+ * @brief Get current rowing data of a parser
+ * @param parser Parser context
+ * @param data Pointer to structure to fill with current data
+ * @return true if data is valid, false otherwise
+ */
+bool fdf_parser_get_current_data(const fdf_parser_t *parser, fdf_rowing_data_t *data);
+
+/**
+ * @brief Reset session data of a parser, keeping its counters
+ * @param parser Parser context
+ */
+void fdf_parser_reset_session(fdf_parser_t *parser);
+
+/*
+ * Single-console API, operating on a default parser context
+ */
+
 /**
  * @brief Initialize FDF protocol parser
  * @return true if successful, false otherwise
@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "fdf_strokes.h"
+
+_Static_assert(sizeof(fdf_stroke_t) == 16, "stroke records must stay compact");
+
+static uint16_t clamp_u16(uint32_t value)
+{
+    return value > UINT16_MAX ? UINT16_MAX : (uint16_t)value;
+}
+
+static void reset_session(fdf_stroke_history_t *history, const fdf_rowing_data_t *data)
+{
+    history->head = 0;
+    history->count = 0;
+    history->overwritten = 0;
+    history->started = true;
+    history->last_stroke_count = data->stroke_count;
+    history->last_distance_m = data->distance_m;
+}
+
+void fdf_strokes_init(fdf_stroke_history_t *history, fdf_stroke_t *arena, uint32_t capacity)
+{
+    memset(history, 0, sizeof(fdf_stroke_history_t));
+    history->records = arena;
+    history->capacity = arena != NULL ? capacity : 0;
+}
+
+bool fdf_strokes_update(fdf_stroke_history_t *history, const fdf_rowing_data_t *data)
+{
+    if (history->capacity == 0 || !data->session_active ||
+        !(data->present & FDF_FIELD_STROKE_COUNT)) {
+        return false;
+    }
+
+    // The first snapshot, or a console that went back to zero, starts a session
+    if (!history->started || data->stroke_count < history->last_stroke_count ||
+        data->distance_m < history->last_distance_m) {
+        reset_session(history, data);
+        return false;
+    }
+    if (data->stroke_count == history->last_stroke_count) {
+        return false;
+    }
+
+    fdf_stroke_t *stroke = &history->records[history->head];
+    stroke->elapsed_ms = data->elapsed_time_ms;
+    stroke->stroke_count = data->stroke_count;
+    stroke->distance_m = clamp_u16(data->distance_m - history->last_distance_m);
+    stroke->power_watts = data->power_watts;
+    stroke->stroke_rate = data->stroke_rate;
+    stroke->pace_500m_ds = clamp_u16(data->pace_500m_ms / 100);
+    stroke->present = data->present & FDF_STROKE_FIELDS;
+
+    history->head = (history->head + 1) % history->capacity;
+    if (history->count < history->capacity) {
+        history->count++;
+    } else {
+        history->overwritten++;
+    }
+    history->last_stroke_count = data->stroke_count;
+    history->last_distance_m = data->distance_m;
+    return true;
+}
+
+uint32_t fdf_strokes_count(const fdf_stroke_history_t *history)
+{
+    return history->count;
+}
+
+bool fdf_strokes_get(const fdf_stroke_history_t *history, uint32_t index, fdf_stroke_t *stroke)
+{
+    if (index >= history->count) {
+        return false;
+    }
+    uint32_t slot = (history->head + history->capacity - history->count + index) % history->capacity;
+    *stroke = history->records[slot];
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef FDF_STROKES_H
+#define FDF_STROKES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fdf_port.h"
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-stroke history
+ *
+ * A stroke ends whenever a console's stroke count advances. Each stroke is
+ * appended as a compact record to a fixed-capacity ring kept in an arena
+ * that the caller allocates once (in PSRAM on the device), so recording
+ * never allocates. When the ring is full the oldest strokes are overwritten.
+ * When the stroke count or distance goes back, a new session starts and
+ * the history is cleared.
+ */
+
+// Record fields that hold values, as FDF_FIELD_* bits
+#define FDF_STROKE_FIELDS (FDF_FIELD_ELAPSED_TIME | FDF_FIELD_POWER | \
+                           FDF_FIELD_STROKE_RATE | FDF_FIELD_PACE)
+
+// One stroke, 16 bytes
+typedef struct {
+    uint32_t elapsed_ms;          // Session time at the end of the stroke
+    uint16_t stroke_count;        // Total strokes at the end of the stroke
+    uint16_t distance_m;          // Distance covered during the stroke
+    uint16_t power_watts;         // Power at the end of the stroke
+    uint16_t stroke_rate;         // Stroke rate (strokes per minute)
+    uint16_t pace_500m_ds;        // Pace per 500m in tenths of a second
+    uint16_t present;             // FDF_STROKE_FIELDS bits holding values
+} fdf_stroke_t;
+
+// Per-console stroke history
+typedef struct {
+    fdf_stroke_t *records;        // Arena of capacity records
+    uint32_t capacity;
+    uint32_t head;                // Next record slot
+    uint32_t count;               // Records held
+    uint32_t overwritten;         // Records lost to wrap-around this session
+    bool started;                 // A session snapshot has been seen
+    uint16_t last_stroke_count;
+    uint32_t last_distance_m;
+} fdf_stroke_history_t;
+
+/**
+ * @brief Initialize a stroke history on a preallocated arena
+ * @param history History to initialize
+ * @param arena Records arena, owned by the caller
+ * @param capacity Number of records in the arena
+ */
+void fdf_strokes_init(fdf_stroke_history_t *history, fdf_stroke_t *arena, uint32_t capacity);
+
+/**
+ * @brief Detect a stroke boundary in a snapshot and record the stroke
+ *
+ * A stroke count that advanced by more than one (a console skipping
+ * updates) is recorded as one stroke.
+ *
+ * @param history Stroke history of the console
+ * @param data Snapshot, completed by fdf_metrics
+ * @return true if a stroke was recorded
+ */
+bool fdf_strokes_update(fdf_stroke_history_t *history, const fdf_rowing_data_t *data);
+
+/**
+ * @brief Number of strokes held
+ * @param history Stroke history
+ * @return Strokes that can be read with fdf_strokes_get()
+ */
+uint32_t fdf_strokes_count(const fdf_stroke_history_t *history);
+
+/**
+ * @brief Read a stroke
+ * @param history Stroke history
+ * @param index Stroke index, 0 being the oldest held
+ * @param stroke Filled with the stroke
+ * @return true if the index is held
+ */
+bool fdf_strokes_get(const fdf_stroke_history_t *history, uint32_t index, fdf_stroke_t *stroke);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_STROKES_H
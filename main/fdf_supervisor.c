@@ -0,0 +1,162 @@
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "fdf_supervisor.h"
+#include "usb_host_handler.h"
+#include "ble_ftms.h"
+
+static const char *TAG = "SUPERVISOR";
+
+#define SUPERVISOR_TASK_STACK_SIZE 3072
+#define SUPERVISOR_TASK_PRIORITY 3
+
+#define ALL_EVENTS ((1u << FDF_SUP_EVENT_COUNT) - 1)
+
+static const char *const event_names[FDF_SUP_EVENT_COUNT] = {
+    [FDF_SUP_USB_CONNECTED] = "console connected",
+    [FDF_SUP_USB_DISCONNECTED] = "console disconnected",
+    [FDF_SUP_DATA_STALL] = "console stalled",
+    [FDF_SUP_BLE_CONNECTED] = "central connected",
+    [FDF_SUP_BLE_DISCONNECTED] = "central disconnected",
+    [FDF_SUP_BLE_CONGESTED] = "link congested",
+};
+
+// Disconnects first, so a source that went and came back in one wake-up ends up connected
+static const fdf_sup_event_t handling_order[FDF_SUP_EVENT_COUNT] = {
+    FDF_SUP_USB_DISCONNECTED, FDF_SUP_USB_CONNECTED, FDF_SUP_DATA_STALL,
+    FDF_SUP_BLE_DISCONNECTED, FDF_SUP_BLE_CONNECTED, FDF_SUP_BLE_CONGESTED,
+};
+
+static EventGroupHandle_t events = NULL;
+static StaticEventGroup_t events_buffer;
+static atomic_uint_least32_t pending_sources[FDF_SUP_EVENT_COUNT];
+static fdf_supervisor_hooks_t hooks;
+
+// Supervisor task only
+static fdf_supervisor_stats_t stats;
+static uint32_t console_mask = 0;       // Consoles open now
+static uint32_t console_seen_mask = 0;  // Consoles opened at least once
+static uint32_t central_mask = 0;       // Centrals connected now
+
+static uint8_t count_bits(uint32_t mask)
+{
+    uint8_t n = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        n++;
+    }
+    return n;
+}
+
+static void handle_event(fdf_sup_event_t event, uint8_t source)
+{
+    uint32_t bit = 1u << source;
+    stats.events[event]++;
+
+    switch (event) {
+        case FDF_SUP_USB_CONNECTED:
+            if (console_seen_mask & bit) {
+                stats.usb_reconnects++;
+            }
+            console_mask |= bit;
+            console_seen_mask |= bit;
+            break;
+
+        case FDF_SUP_USB_DISCONNECTED:
+            // The USB host resets the slot when the next console opens on it
+            console_mask &= ~bit;
+            break;
+
+        case FDF_SUP_DATA_STALL:
+            if (hooks.console_stalled != NULL) {
+                hooks.console_stalled(source);
+            }
+            break;
+
+        case FDF_SUP_BLE_CONNECTED:
+            if (stats.events[FDF_SUP_BLE_DISCONNECTED] > 0) {
+                stats.ble_reconnects++;
+            }
+            central_mask |= bit;
+            break;
+
+        case FDF_SUP_BLE_DISCONNECTED:
+            // The controller stops advertising while all connection slots are taken
+            central_mask &= ~bit;
+            ble_ftms_start_advertising();
+            break;
+
+        default:
+            break;
+    }
+
+    uint8_t consoles = stats.consoles;
+    uint8_t centrals = stats.centrals;
+    stats.consoles = count_bits(console_mask);
+    stats.centrals = count_bits(central_mask);
+    if ((stats.consoles != consoles || stats.centrals != centrals) && hooks.activity_changed != NULL) {
+        hooks.activity_changed(stats.consoles, stats.centrals);
+    }
+    ESP_LOGI(TAG, "%s (%d): %d consoles, %d centrals, %" PRIu32 " console / %" PRIu32 " central reconnects",
+             event_names[event], source, stats.consoles, stats.centrals,
+             stats.usb_reconnects, stats.ble_reconnects);
+}
+
+// Sleeps until something changes; no periodic wake-ups
+static void supervisor_task(void *arg)
+{
+    while (1) {
+        EventBits_t bits = xEventGroupWaitBits(events, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
+
+        for (int i = 0; i < FDF_SUP_EVENT_COUNT; i++) {
+            fdf_sup_event_t event = handling_order[i];
+            if (!(bits & (1u << event))) {
+                continue;
+            }
+            uint32_t sources = atomic_exchange(&pending_sources[event], 0);
+            for (uint8_t source = 0; sources != 0; source++, sources >>= 1) {
+                if (sources & 1) {
+                    handle_event(event, source);
+                }
+            }
+        }
+    }
+}
+
+bool fdf_supervisor_start(const fdf_supervisor_hooks_t *app_hooks)
+{
+    if (events != NULL) {
+        return true;
+    }
+
+    if (app_hooks != NULL) {
+        hooks = *app_hooks;
+    }
+    events = xEventGroupCreateStatic(&events_buffer);
+
+    static StaticTask_t task_buffer;
+    static StackType_t task_stack[SUPERVISOR_TASK_STACK_SIZE];
+    xTaskCreateStatic(supervisor_task, "supervisor", SUPERVISOR_TASK_STACK_SIZE, NULL,
+                      SUPERVISOR_TASK_PRIORITY, task_stack, &task_buffer);
+    return true;
+}
+
+void fdf_supervisor_post(fdf_sup_event_t event, uint8_t source)
+{
+    if (events == NULL || event >= FDF_SUP_EVENT_COUNT || source >= 32) {
+        return;
+    }
+    atomic_fetch_or(&pending_sources[event], 1u << source);
+    xEventGroupSetBits(events, 1u << event);
+}
+
+void fdf_supervisor_get_stats(fdf_supervisor_stats_t *out)
+{
+    *out = stats;
+    out->uptime_us = esp_timer_get_time();
+}
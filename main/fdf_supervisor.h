@@ -0,0 +1,71 @@
+#ifndef FDF_SUPERVISOR_H
+#define FDF_SUPERVISOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * System supervisor
+ *
+ * The USB host, the poll scheduler and the FTMS service post state changes
+ * as bits of a FreeRTOS event group; the supervisor task sleeps on it and
+ * reacts as soon as one is set. Posting never blocks. Several posts of the
+ * same event before the task runs fold into one wake-up, with the sources
+ * (console or connection ids) collected in a bitmask.
+ */
+
+typedef enum {
+    FDF_SUP_USB_CONNECTED,        // A console was opened (source: console id)
+    FDF_SUP_USB_DISCONNECTED,     // A console went away (source: console id)
+    FDF_SUP_DATA_STALL,           // A console stopped answering (source: console id)
+    FDF_SUP_BLE_CONNECTED,        // A central connected (source: conn id)
+    FDF_SUP_BLE_DISCONNECTED,     // A central disconnected (source: conn id)
+    FDF_SUP_BLE_CONGESTED,        // A link ran out of buffers (source: conn id)
+    FDF_SUP_EVENT_COUNT
+} fdf_sup_event_t;
+
+// Application reactions that need state the supervisor does not own
+typedef struct {
+    void (*console_stalled)(uint8_t console_id);  // Try to get a console talking again
+    void (*activity_changed)(uint8_t consoles, uint8_t centrals);  // Consoles open or centrals connected changed
+} fdf_supervisor_hooks_t;
+
+// Counters kept by the supervisor
+typedef struct {
+    uint32_t events[FDF_SUP_EVENT_COUNT];  // Sources handled per event
+    uint32_t usb_reconnects;      // Consoles opened again after a disconnect
+    uint32_t ble_reconnects;      // Centrals connected after a disconnect
+    uint8_t consoles;             // Consoles open now
+    uint8_t centrals;             // Centrals connected now
+    int64_t uptime_us;
+} fdf_supervisor_stats_t;
+
+/**
+ * @brief Start the supervisor task
+ * @param hooks Application reactions, copied
+ * @return true if the supervisor is running
+ */
+bool fdf_supervisor_start(const fdf_supervisor_hooks_t *hooks);
+
+/**
+ * @brief Post a state change; safe from any task, never blocks
+ * @param event What happened
+ * @param source Console or connection id (0-31)
+ */
+void fdf_supervisor_post(fdf_sup_event_t event, uint8_t source);
+
+/**
+ * @brief Get the supervisor counters
+ * @param stats Filled with the counters
+ */
+void fdf_supervisor_get_stats(fdf_supervisor_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_SUPERVISOR_H
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "fdf_port.h"
+#include "fdf_synth.h"
+
+static const char *TAG = "FDF_SYNTH";
+
+// Time constant of the stroke rate following its target
+#define RATE_TIME_CONSTANT_S 2.0f
+// Relative power noise between strokes
+#define POWER_NOISE 0.04f
+// Ergometer drag factor: power = DRAG_FACTOR * speed^3
+#define DRAG_FACTOR 2.8f
+
+#define FNV_OFFSET_BASIS 0x811C9DC5u
+#define FNV_PRIME 0x01000193u
+
+// Malformed line kinds
+enum {
+    MALFORMED_GARBAGE,        // Random bytes without key/value pairs
+    MALFORMED_UNKNOWN_KEYS,   // Key/value pairs the parser does not know
+    MALFORMED_OVERLONG,       // Longer than the parser's line buffer
+    MALFORMED_TRUNCATED,      // Line cut off before its first value
+    MALFORMED_KINDS
+};
+
+// xorshift32, deterministic for a given seed
+static uint32_t next_random(fdf_synth_t *synth)
+{
+    uint32_t x = synth->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    synth->rng = x;
+    return x;
+}
+
+// Uniform in [-1, 1]
+static float random_signed(fdf_synth_t *synth)
+{
+    return (float)(next_random(synth) & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+static uint32_t hash_line(const char *line, size_t len)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)line[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Stroke rate the rower aims for at the current point of the session
+static float target_rate(const fdf_synth_t *synth)
+{
+    const fdf_synth_config_t *cfg = &synth->config;
+    uint32_t t = (uint32_t)(synth->sim_ms / 1000);
+
+    if (cfg->pause_every_s > 0 && cfg->pause_s < cfg->pause_every_s &&
+        t % cfg->pause_every_s >= (uint32_t)(cfg->pause_every_s - cfg->pause_s)) {
+        return 0.0f;
+    }
+    if (t < cfg->warmup_s) {
+        return cfg->rest_rate_spm +
+               (float)(cfg->work_rate_spm - cfg->rest_rate_spm) * t / cfg->warmup_s;
+    }
+    if (cfg->work_s == 0) {
+        return cfg->work_rate_spm;
+    }
+    uint32_t phase = (t - cfg->warmup_s) % (cfg->work_s + cfg->rest_s);
+    return phase < cfg->work_s ? cfg->work_rate_spm : cfg->rest_rate_spm;
+}
+
+static void simulate_step(fdf_synth_t *synth)
+{
+    const fdf_synth_config_t *cfg = &synth->config;
+    float dt = cfg->step_ms / 1000.0f;
+
+    float k = dt / RATE_TIME_CONSTANT_S;
+    synth->rate_spm += (target_rate(synth) - synth->rate_spm) * (k < 1.0f ? k : 1.0f);
+    synth->sim_ms += cfg->step_ms;
+
+    if (synth->rate_spm < 1.0f) {
+        // Paddle stop: the console's clock stops with the flywheel
+        synth->rate_spm = 0.0f;
+        synth->power_w = 0.0f;
+        return;
+    }
+
+    float ratio = synth->rate_spm / (cfg->work_rate_spm > 0 ? cfg->work_rate_spm : 1);
+    synth->power_w = cfg->work_power_w * ratio * ratio * (1.0f + POWER_NOISE * random_signed(synth));
+
+    float speed = cbrtf(synth->power_w / DRAG_FACTOR);
+    synth->active_ms += cfg->step_ms;
+    synth->strokes += synth->rate_spm / 60.0f * dt;
+    synth->distance_m += speed * dt;
+    synth->energy_j += synth->power_w * dt;
+    // Ergometer calorie formula: kcal/h = 4 * W * 0.8604 + 300
+    synth->calories += (4.0f * synth->power_w * 0.8604f + 300.0f) / 3600.0f * dt;
+}
+
+// Format the console status line for the current state
+static int format_status(const fdf_synth_t *synth, char *line, size_t size)
+{
+    const fdf_synth_config_t *cfg = &synth->config;
+    uint32_t active_s = (uint32_t)(synth->active_ms / 1000);
+
+    uint32_t strokes = (uint32_t)synth->strokes;
+    if (cfg->stroke_wrap > 0) {
+        strokes %= cfg->stroke_wrap;
+    }
+    uint32_t minutes = active_s / 60;
+    if (cfg->time_wrap_min > 0) {
+        minutes %= cfg->time_wrap_min;
+    }
+
+    uint32_t rate = (uint32_t)(synth->rate_spm + 0.5f);
+    uint32_t power = (uint32_t)(synth->power_w + 0.5f);
+    uint32_t avg_rate = active_s > 0 ? (uint32_t)(synth->strokes * 60.0f / active_s) : 0;
+    uint32_t avg_power = active_s > 0 ? (uint32_t)(synth->energy_j / active_s) : 0;
+
+    uint32_t pace_s = 0;
+    if (synth->power_w > 0.0f) {
+        pace_s = (uint32_t)(500.0f / cbrtf(synth->power_w / DRAG_FACTOR));
+    }
+    uint32_t avg_pace_s = synth->distance_m >= 1.0f ?
+                          (uint32_t)(500.0f * active_s / synth->distance_m) : 0;
+
+    return snprintf(line, size,
+                    "STROKES:%u TIME:%02u:%02u DISTANCE:%u RATE:%u AVGRATE:%u POWER:%u "
+                    "AVGPOWER:%u CALORIES:%u PACE:%u:%02u AVGPACE:%u:%02u\r\n",
+                    (unsigned)strokes, (unsigned)minutes, (unsigned)(active_s % 60),
+                    (unsigned)synth->distance_m, (unsigned)rate, (unsigned)avg_rate,
+                    (unsigned)power, (unsigned)avg_power, (unsigned)synth->calories,
+                    (unsigned)(pace_s / 60), (unsigned)(pace_s % 60),
+                    (unsigned)(avg_pace_s / 60), (unsigned)(avg_pace_s % 60));
+}
+
+// Format a line the parser must ignore without changing any value
+static size_t format_malformed(fdf_synth_t *synth, char *line, size_t size)
+{
+    size_t len = 0;
+
+    switch (next_random(synth) % MALFORMED_KINDS) {
+    case MALFORMED_GARBAGE: {
+        size_t n = 10 + next_random(synth) % 70;
+        while (len < n && len + 2 < size) {
+            char c = (char)(0x20 + next_random(synth) % 0xDF);
+            if (c != ':' && c != '\r' && c != '\n' && c != 0x7F) {
+                line[len++] = c;
+            }
+        }
+        break;
+    }
+    case MALFORMED_UNKNOWN_KEYS: {
+        int n = snprintf(line, size, "ERR:E%02u STATE:RESET", (unsigned)(next_random(synth) % 100));
+        len = n > 0 && (size_t)n < size ? (size_t)n : 0;
+        break;
+    }
+    case MALFORMED_OVERLONG:
+        // The parser drops the buffer on overflow and sees the tail as a short line
+        len = FDF_MAX_LINE_LENGTH + 32;
+        if (len + 2 > size) {
+            return 0;
+        }
+        memset(line, '#', len);
+        break;
+    default:
+        len = 5;
+        if (len + 2 > size) {
+            return 0;
+        }
+        memcpy(line, "STROK", len);
+        break;
+    }
+
+    if (len + 2 > size) {
+        return 0;
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+    return len;
+}
+
+void fdf_synth_default_config(fdf_synth_config_t *config)
+{
+    memset(config, 0, sizeof(fdf_synth_config_t));
+    config->seed = 1;
+    config->step_ms = 1000;
+    config->warmup_s = 120;
+    config->work_s = 240;
+    config->rest_s = 60;
+    config->work_rate_spm = 28;
+    config->rest_rate_spm = 18;
+    config->work_power_w = 220;
+    config->pause_every_s = 900;
+    config->pause_s = 20;
+    config->time_wrap_min = 100;
+}
+
+void fdf_synth_init(fdf_synth_t *synth, const fdf_synth_config_t *config)
+{
+    memset(synth, 0, sizeof(fdf_synth_t));
+    synth->config = *config;
+    if (synth->config.step_ms == 0) {
+        synth->config.step_ms = 1000;
+    }
+    synth->rng = config->seed != 0 ? config->seed : 1;
+
+    // The parser starts from all zero values, which is what the first line shows
+    int len = format_status(synth, synth->line, sizeof(synth->line));
+    synth->last_hash = hash_line(synth->line, (size_t)len);
+}
+
+size_t fdf_synth_next_line(fdf_synth_t *synth, char *line, size_t size)
+{
+    size_t len;
+
+    if (synth->config.malformed_permille > 0 &&
+        next_random(synth) % 1000 < synth->config.malformed_permille) {
+        len = format_malformed(synth, line, size);
+        if (len > 0) {
+            synth->stats.malformed++;
+        }
+    } else {
+        simulate_step(synth);
+        int n = format_status(synth, line, size);
+        if (n <= 0 || (size_t)n >= size) {
+            ESP_LOGW(TAG, "Line buffer too small (%zu bytes)", size);
+            return 0;
+        }
+        len = (size_t)n;
+
+        uint32_t hash = hash_line(line, len);
+        if (hash != synth->last_hash) {
+            synth->stats.changed++;
+            synth->last_hash = hash;
+        }
+    }
+
+    if (len > 0) {
+        synth->stats.lines++;
+        synth->stats.bytes += len;
+    }
+    return len;
+}
+
+uint32_t fdf_synth_emit(fdf_synth_t *synth, uint32_t num_lines, size_t chunk_size,
+                        int64_t start_us, uint32_t line_interval_us,
+                        fdf_synth_emit_cb_t emit, void *ctx)
+{
+    if (chunk_size == 0 || chunk_size > FDF_SYNTH_MAX_CHUNK) {
+        chunk_size = FDF_SYNTH_MAX_CHUNK;
+    }
+
+    uint32_t generated = 0;
+    for (uint32_t i = 0; i < num_lines; i++) {
+        size_t len = fdf_synth_next_line(synth, synth->line, sizeof(synth->line));
+        if (len == 0) {
+            break;
+        }
+        generated++;
+
+        int64_t timestamp_us = start_us + (int64_t)i * line_interval_us;
+        const uint8_t *src = (const uint8_t *)synth->line;
+        while (len > 0) {
+            size_t n = chunk_size - synth->chunk_len;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(synth->chunk + synth->chunk_len, src, n);
+            synth->chunk_len += n;
+            src += n;
+            len -= n;
+
+            if (synth->chunk_len == chunk_size) {
+                emit(synth->chunk, synth->chunk_len, timestamp_us, ctx);
+                synth->chunk_len = 0;
+            }
+        }
+    }
+    return generated;
+}
+
+void fdf_synth_flush(fdf_synth_t *synth, int64_t timestamp_us, fdf_synth_emit_cb_t emit,
+                     void *ctx)
+{
+    if (synth->chunk_len > 0) {
+        emit(synth->chunk, synth->chunk_len, timestamp_us, ctx);
+        synth->chunk_len = 0;
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef FDF_SYNTH_H
+#define FDF_SYNTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Synthetic FDF console
+ *
+ * Simulates a rower (warm-up ramp, work/rest intervals, paddle stops) and
+ * formats the console's status lines, optionally interleaved with malformed
+ * lines. The output is cut into chunks of any size and handed to the same
+ * kind of callback the USB handler feeds, so the bridge can be driven far
+ * beyond real console cadence.
+ */
+
+// Longest line the generator emits (overlong malformed lines exceed the parser's buffer)
+#define FDF_SYNTH_MAX_LINE (FDF_MAX_LINE_LENGTH + 64)
+
+// Largest chunk fdf_synth_emit() can cut the stream into
+#define FDF_SYNTH_MAX_CHUNK 512
+
+// Session shape
+typedef struct {
+    uint32_t seed;                // Random seed, equal seeds give equal sessions
+    uint32_t step_ms;             // Simulated time between two status lines
+    uint16_t warmup_s;            // Ramp from rest to work rate
+    uint16_t work_s;              // Work interval length (0 = steady state after warm-up)
+    uint16_t rest_s;              // Rest interval length
+    uint16_t work_rate_spm;       // Stroke rate during work
+    uint16_t rest_rate_spm;       // Stroke rate during rest and at the start of warm-up
+    uint16_t work_power_w;        // Power at work rate
+    uint16_t pause_every_s;       // A paddle stop ends every this many seconds (0 = never)
+    uint16_t pause_s;             // Length of a paddle stop
+    uint16_t malformed_permille;  // Share of malformed lines
+    uint16_t stroke_wrap;         // STROKES rolls over at this count (0 = never)
+    uint16_t time_wrap_min;       // TIME rolls over at this many minutes (0 = never)
+} fdf_synth_config_t;
+
+// Generator statistics
+typedef struct {
+    uint32_t lines;               // Lines generated, malformed included
+    uint32_t malformed;           // Malformed lines generated
+    uint32_t changed;             // Well-formed lines that differ from the previous one
+    uint64_t bytes;               // Bytes generated
+} fdf_synth_stats_t;
+
+// Generator state
+typedef struct {
+    fdf_synth_config_t config;
+    fdf_synth_stats_t stats;
+    uint32_t rng;
+    uint64_t sim_ms;              // Simulated wall time
+    uint64_t active_ms;           // Time shown by the console (stops during pauses)
+    float rate_spm;
+    float power_w;
+    float strokes;
+    float distance_m;
+    float energy_j;
+    float calories;
+    uint32_t last_hash;           // Hash of the previous well-formed line
+    size_t chunk_len;             // Bytes waiting in chunk
+    uint8_t chunk[FDF_SYNTH_MAX_CHUNK];
+    char line[FDF_SYNTH_MAX_LINE];
+} fdf_synth_t;
+
+// Receives a chunk of the generated stream
+typedef void (*fdf_synth_emit_cb_t)(const uint8_t *data, size_t length, int64_t timestamp_us,
+                                    void *ctx);
+
+/**
+ * @brief Fill a configuration with a warm-up followed by 4 min / 1 min intervals
+ * @param config Configuration to fill
+ */
+void fdf_synth_default_config(fdf_synth_config_t *config);
+
+/**
+ * @brief Initialize a generator
+ * @param synth Generator to initialize
+ * @param config Session shape (copied)
+ */
+void fdf_synth_init(fdf_synth_t *synth, const fdf_synth_config_t *config);
+
+/**
+ * @brief Generate the next console line
+ *
+ * A well-formed line advances the simulation by config.step_ms; a malformed
+ * line does not.
+ *
+ * @param synth Generator
+ * @param line Buffer for the line, including its line ending
+ * @param size Buffer size (FDF_SYNTH_MAX_LINE holds any line)
+ * @return Length of the line, 0 if it did not fit
+ */
+size_t fdf_synth_next_line(fdf_synth_t *synth, char *line, size_t size);
+
+/**
+ * @brief Generate lines and emit them as a chunked byte stream
+ *
+ * Chunks may span line boundaries; bytes that do not fill a whole chunk
+ * wait for the next call or fdf_synth_flush().
+ *
+ * @param synth Generator
+ * @param num_lines Number of lines to generate
+ * @param chunk_size Chunk size (at most FDF_SYNTH_MAX_CHUNK)
+ * @param start_us Timestamp of the first line
+ * @param line_interval_us Timestamp increment per line
+ * @param emit Function receiving the chunks
+ * @param ctx Context passed to emit
+ * @return Number of lines generated
+ */
+uint32_t fdf_synth_emit(fdf_synth_t *synth, uint32_t num_lines, size_t chunk_size,
+                        int64_t start_us, uint32_t line_interval_us,
+                        fdf_synth_emit_cb_t emit, void *ctx);
+
+/**
+ * @brief Emit the bytes still waiting for a full chunk
+ */
+void fdf_synth_flush(fdf_synth_t *synth, int64_t timestamp_us, fdf_synth_emit_cb_t emit,
+                     void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_SYNTH_H
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+
+#include "fdf_trace.h"
+
+#if (FDF_TRACE_RECORDS & (FDF_TRACE_RECORDS - 1)) != 0
+#error "CONFIG_FDF_TRACE_RECORDS must be a power of two"
+#endif
+
+// Ring slot; seq is index + 1 once the record is complete, 0 while it is written
+typedef struct {
+    atomic_uint_least32_t seq;
+    fdf_trace_record_t record;
+} trace_slot_t;
+
+static trace_slot_t trace_ring[FDF_TRACE_RECORDS];
+static atomic_uint_least32_t trace_head = 0;  // Next index to write
+static uint32_t trace_tail = 0;               // Next index to read, reader only
+static uint32_t trace_lost = 0;
+
+// Name and argument format of every event
+static const struct {
+    const char *name;
+    const char *format;
+} trace_events[FDF_TRACE_EVENT_COUNT] = {
+    [FDF_TRACE_UPDATE] = {
+        "update", "strokes %" PRIu32 ", distance %" PRIu32 " m, rate %" PRIu32 " spm, power %" PRIu32 " W"
+    },
+    [FDF_TRACE_NOTIFY] = {
+        "notify", "%" PRIu32 " bytes to %" PRIu32 " centrals"
+    },
+    [FDF_TRACE_NOTIFY_ERROR] = {
+        "notify failed", "conn %" PRIu32 ", error 0x%" PRIx32
+    },
+    [FDF_TRACE_CONN_INTERVAL] = {
+        "conn interval", "requested %" PRIu32 " ms (cadence %" PRIu32 " ms)"
+    },
+    [FDF_TRACE_STROKE] = {
+        "stroke", "#%" PRIu32 ", %" PRIu32 " m, %" PRIu32 " W, pace %" PRIu32 " ds"
+    },
+    [FDF_TRACE_EXPORT] = {
+        "export", "%" PRIu32 " bytes in %" PRIu32 " packets, %" PRIu32 " ms, %" PRIu32 " KB/s"
+    },
+};
+
+void fdf_trace_record(uint16_t event, uint8_t console_id,
+                      uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t index = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_slot_t *slot = &trace_ring[index & (FDF_TRACE_RECORDS - 1)];
+
+    // Invalidate the slot before overwriting it, so the reader never takes a torn record
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->record.timestamp_us = (uint32_t)fdf_port_time_us();
+    slot->record.event = event;
+    slot->record.console_id = console_id;
+    slot->record.args[0] = a0;
+    slot->record.args[1] = a1;
+    slot->record.args[2] = a2;
+    slot->record.args[3] = a3;
+
+    atomic_store_explicit(&slot->seq, index + 1, memory_order_release);
+}
+
+bool fdf_trace_read(fdf_trace_record_t *record)
+{
+    while (1) {
+        uint32_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+        if (head == trace_tail) {
+            return false;
+        }
+
+        // Skip what the writers have already lapped
+        if (head - trace_tail > FDF_TRACE_RECORDS) {
+            trace_lost += head - trace_tail - FDF_TRACE_RECORDS;
+            trace_tail = head - FDF_TRACE_RECORDS;
+        }
+
+        trace_slot_t *slot = &trace_ring[trace_tail & (FDF_TRACE_RECORDS - 1)];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != trace_tail + 1) {
+            if (seq == 0 || (int32_t)(seq - (trace_tail + 1)) < 0) {
+                // Still being written, try again later
+                return false;
+            }
+            trace_lost++;
+            trace_tail++;
+            continue;
+        }
+
+        *record = slot->record;
+
+        // A writer that lapped the reader during the copy invalidated the slot
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+            trace_lost++;
+            trace_tail++;
+            continue;
+        }
+
+        trace_tail++;
+        return true;
+    }
+}
+
+uint32_t fdf_trace_lost(void)
+{
+    return trace_lost;
+}
+
+int fdf_trace_format(const fdf_trace_record_t *record, char *buf, size_t size)
+{
+    if (record->event == 0 || record->event >= FDF_TRACE_EVENT_COUNT) {
+        return snprintf(buf, size, "%10" PRIu32 " [%u] event %u", record->timestamp_us,
+                        record->console_id, record->event);
+    }
+
+    int n = snprintf(buf, size, "%10" PRIu32 " [%u] %s: ", record->timestamp_us,
+                     record->console_id, trace_events[record->event].name);
+    if (n < 0 || (size_t)n >= size) {
+        return n;
+    }
+    int m = snprintf(buf + n, size - n, trace_events[record->event].format,
+                     record->args[0], record->args[1], record->args[2], record->args[3]);
+    return m < 0 ? m : n + m;
+}
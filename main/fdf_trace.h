@@ -0,0 +1,89 @@
+#ifndef FDF_TRACE_H
+#define FDF_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdf_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary trace ring
+ *
+ * Hot paths record fixed-size binary events (id, timestamp, console, four
+ * integer arguments) instead of formatting log lines. Writers are lock-free
+ * and may run in any task; a single low-priority reader drains the ring and
+ * formats the records. When the reader falls behind, the oldest records are
+ * overwritten and counted as lost.
+ */
+
+// Number of records in the ring (power of two)
+#define FDF_TRACE_RECORDS CONFIG_FDF_TRACE_RECORDS
+
+#define FDF_TRACE_MAX_ARGS 4
+
+// Trace events
+typedef enum {
+    FDF_TRACE_UPDATE = 1,         // Update forwarded: strokes, distance, rate, power
+    FDF_TRACE_NOTIFY,             // Notification sent: length, centrals
+    FDF_TRACE_NOTIFY_ERROR,       // Notification failed: conn id, error
+    FDF_TRACE_CONN_INTERVAL,      // Connection interval requested: interval ms, cadence ms
+    FDF_TRACE_STROKE,             // Stroke recorded: stroke count, distance m, power, pace ds
+    FDF_TRACE_EXPORT,             // Session export ended: bytes, packets, duration ms, KB/s
+    FDF_TRACE_EVENT_COUNT
+} fdf_trace_event_t;
+
+// One trace record
+typedef struct {
+    uint32_t timestamp_us;        // Low 32 bits of the event time
+    uint16_t event;               // fdf_trace_event_t
+    uint16_t console_id;
+    uint32_t args[FDF_TRACE_MAX_ARGS];
+} fdf_trace_record_t;
+
+/**
+ * @brief Record an event, never blocks
+ * @param event Event id
+ * @param console_id Console (or FTMS instance) the event belongs to
+ * @param a0..a3 Event arguments, see fdf_trace_event_t
+ */
+void fdf_trace_record(uint16_t event, uint8_t console_id,
+                      uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+/**
+ * @brief Take the oldest record from the ring (single reader)
+ * @param record Filled with the record
+ * @return true if a record was read, false if the ring is empty
+ */
+bool fdf_trace_read(fdf_trace_record_t *record);
+
+/**
+ * @brief Number of records overwritten before they were read
+ */
+uint32_t fdf_trace_lost(void);
+
+/**
+ * @brief Format a record as a line of text
+ * @param record Record to format
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @return Length of the text, as snprintf()
+ */
+int fdf_trace_format(const fdf_trace_record_t *record, char *buf, size_t size);
+
+#if CONFIG_FDF_TRACE
+#define FDF_TRACE(event, console_id, a0, a1, a2, a3) \
+    fdf_trace_record((event), (console_id), (a0), (a1), (a2), (a3))
+#else
+#define FDF_TRACE(event, console_id, a0, a1, a2, a3) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_TRACE_H
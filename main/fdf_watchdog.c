@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include "fdf_watchdog.h"
+
+static const char *const step_names[FDF_RECOVERY_STEP_COUNT] = {
+    [FDF_RECOVERY_NONE] = "none",
+    [FDF_RECOVERY_POLL] = "poll",
+    [FDF_RECOVERY_TOGGLE_DTR] = "dtr",
+    [FDF_RECOVERY_REOPEN] = "reopen",
+};
+
+static uint32_t timeout_us(const fdf_watchdog_config_t *config, uint32_t interval_us)
+{
+    uint64_t timeout = (uint64_t)interval_us * config->factor;
+    uint64_t min = (uint64_t)config->min_timeout_ms * 1000;
+    uint64_t max = (uint64_t)config->max_timeout_ms * 1000;
+    if (interval_us == 0 || timeout > max) {
+        timeout = max;
+    }
+    if (timeout < min) {
+        timeout = min;
+    }
+    return (uint32_t)timeout;
+}
+
+void fdf_watchdog_init(fdf_watchdog_t *watchdog, const fdf_watchdog_config_t *config)
+{
+    memset(watchdog, 0, sizeof(fdf_watchdog_t));
+    watchdog->config = *config;
+}
+
+void fdf_watchdog_disarm(fdf_watchdog_t *watchdog)
+{
+    watchdog->last_data_us = 0;
+    watchdog->stalled = false;
+    watchdog->attempts = 0;
+    watchdog->step = FDF_RECOVERY_NONE;
+}
+
+bool fdf_watchdog_feed(fdf_watchdog_t *watchdog, int64_t now_us, uint32_t interval_us)
+{
+    bool recovered = watchdog->stalled;
+    if (recovered) {
+        fdf_watchdog_stats_t *stats = &watchdog->stats;
+        stats->recoveries++;
+        stats->last_step = watchdog->step;
+        stats->last_recovery_ms = (uint32_t)((now_us - watchdog->stalled_us) / 1000);
+        stats->last_outage_ms = (uint32_t)((now_us - watchdog->last_data_us) / 1000);
+        if (stats->last_recovery_ms > stats->max_recovery_ms) {
+            stats->max_recovery_ms = stats->last_recovery_ms;
+        }
+        watchdog->stalled = false;
+        watchdog->attempts = 0;
+        watchdog->step = FDF_RECOVERY_NONE;
+    }
+
+    watchdog->last_data_us = now_us;
+    watchdog->timeout_us = timeout_us(&watchdog->config, interval_us);
+    return recovered;
+}
+
+fdf_recovery_step_t fdf_watchdog_check(fdf_watchdog_t *watchdog, int64_t now_us)
+{
+    if (watchdog->last_data_us == 0) {
+        return FDF_RECOVERY_NONE;
+    }
+
+    if (!watchdog->stalled) {
+        if (now_us - watchdog->last_data_us < watchdog->timeout_us) {
+            return FDF_RECOVERY_NONE;
+        }
+        watchdog->stalled = true;
+        watchdog->stalled_us = now_us;
+        watchdog->stats.stalls++;
+    } else if (now_us < watchdog->next_step_us) {
+        return FDF_RECOVERY_NONE;
+    }
+
+    // Up the ladder once, then keep asking
+    fdf_recovery_step_t step = (fdf_recovery_step_t)(watchdog->attempts + 1);
+    if (step >= FDF_RECOVERY_STEP_COUNT) {
+        step = FDF_RECOVERY_POLL;
+    }
+    if (watchdog->attempts < UINT8_MAX) {
+        watchdog->attempts++;
+    }
+    watchdog->step = step;
+    watchdog->next_step_us = now_us + (int64_t)watchdog->config.retry_ms * 1000;
+    watchdog->stats.steps[step]++;
+    return step;
+}
+
+const char *fdf_watchdog_step_name(fdf_recovery_step_t step)
+{
+    return step < FDF_RECOVERY_STEP_COUNT ? step_names[step] : "?";
+}
@@ -0,0 +1,118 @@
+#ifndef FDF_WATCHDOG_H
+#define FDF_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Data freshness watchdog
+ *
+ * One per console. Every parsed line feeds it, with the console's update
+ * cadence; it is checked periodically. Data is stale once no line arrived
+ * for factor times the cadence interval, clamped to [min, max] (max until
+ * the cadence is known). A stale console gets recovery steps of increasing
+ * weight, one per retry period: a status request, a DTR pulse, then a
+ * reopen of the device, then status requests again for as long as the stall
+ * lasts. The first line after a stall ends it; the time from detection to
+ * that line is the recovery time.
+ *
+ * No locking: the caller serializes feeds and checks.
+ */
+
+// Recovery steps, in the order they are tried
+typedef enum {
+    FDF_RECOVERY_NONE,
+    FDF_RECOVERY_POLL,            // Send a status request
+    FDF_RECOVERY_TOGGLE_DTR,      // Drop and raise DTR, which wakes some consoles
+    FDF_RECOVERY_REOPEN,          // Close and reopen the CDC-ACM device
+    FDF_RECOVERY_STEP_COUNT
+} fdf_recovery_step_t;
+
+// Thresholds
+typedef struct {
+    uint32_t factor;              // Stale after this many cadence intervals without a line
+    uint32_t min_timeout_ms;
+    uint32_t max_timeout_ms;      // Also the timeout until the cadence is known
+    uint32_t retry_ms;            // Time between recovery steps
+} fdf_watchdog_config_t;
+
+// Counters, kept across consoles on the slot
+typedef struct {
+    uint32_t stalls;              // Stalls detected
+    uint32_t recoveries;          // Stalls that ended with data
+    uint32_t steps[FDF_RECOVERY_STEP_COUNT];  // Recovery steps taken, per step
+    fdf_recovery_step_t last_step;  // Last step taken before the last recovery
+    uint32_t last_recovery_ms;    // Detection to first line, last stall
+    uint32_t max_recovery_ms;
+    uint32_t last_outage_ms;      // Last line before to first line after, last stall
+} fdf_watchdog_stats_t;
+
+// Watchdog state of a console
+typedef struct {
+    fdf_watchdog_config_t config;
+    int64_t last_data_us;         // Time of the last line, 0 while disarmed
+    uint32_t timeout_us;          // Current staleness threshold
+    bool stalled;
+    int64_t stalled_us;           // Time the stall was detected
+    int64_t next_step_us;         // Time the next recovery step is due
+    uint8_t attempts;             // Recovery steps taken in the current stall
+    fdf_recovery_step_t step;     // Last step handed out
+    fdf_watchdog_stats_t stats;
+} fdf_watchdog_t;
+
+/**
+ * @brief Initialize a disarmed watchdog
+ * @param watchdog Watchdog to initialize
+ * @param config Thresholds, copied
+ */
+void fdf_watchdog_init(fdf_watchdog_t *watchdog, const fdf_watchdog_config_t *config);
+
+/**
+ * @brief Disarm until the next line, e.g. when the console goes away; keeps the counters
+ * @param watchdog Watchdog
+ */
+void fdf_watchdog_disarm(fdf_watchdog_t *watchdog);
+
+/**
+ * @brief Record a line
+ * @param watchdog Watchdog
+ * @param now_us Receive time of the line
+ * @param interval_us Current cadence interval of the console, 0 if unknown
+ * @return true if the line ended a stall
+ */
+bool fdf_watchdog_feed(fdf_watchdog_t *watchdog, int64_t now_us, uint32_t interval_us);
+
+/**
+ * @brief Check freshness
+ * @param watchdog Watchdog
+ * @param now_us Current time
+ * @return Recovery step to take now, FDF_RECOVERY_NONE if there is none due
+ */
+fdf_recovery_step_t fdf_watchdog_check(fdf_watchdog_t *watchdog, int64_t now_us);
+
+/**
+ * @brief Whether the console's data is stale
+ * @param watchdog Watchdog
+ * @return true between the detection of a stall and the next line
+ */
+static inline bool fdf_watchdog_is_stalled(const fdf_watchdog_t *watchdog)
+{
+    return watchdog->stalled;
+}
+
+/**
+ * @brief Name of a recovery step, for logs
+ * @param step Step
+ * @return Static string
+ */
+const char *fdf_watchdog_step_name(fdf_recovery_step_t step);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_WATCHDOG_H
@@ -0,0 +1,259 @@
+#include <string.h>
+
+#include "fdf_workout.h"
+
+static const char *const phase_names[FDF_WORKOUT_PHASE_COUNT] = {
+    [FDF_WORKOUT_IDLE] = "idle",
+    [FDF_WORKOUT_READY] = "ready",
+    [FDF_WORKOUT_WORK] = "work",
+    [FDF_WORKOUT_REST] = "rest",
+    [FDF_WORKOUT_DONE] = "done",
+};
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// Distance or time since the start of the piece, never negative
+static uint32_t piece_progress(const fdf_workout_t *workout, uint32_t distance_m, uint32_t time_ms)
+{
+    uint32_t value = workout->config.type == FDF_WORKOUT_DISTANCE ? distance_m : time_ms;
+    uint32_t start = workout->config.type == FDF_WORKOUT_DISTANCE ? workout->piece_start_m :
+                     workout->piece_start_ms;
+    return value > start ? value - start : 0;
+}
+
+static void arm(fdf_workout_t *workout)
+{
+    workout->phase = FDF_WORKOUT_READY;
+    workout->piece = 0;
+    memset(&workout->progress, 0, sizeof(workout->progress));
+    workout->progress.pieces = workout->config.pieces;
+}
+
+static void start_piece(fdf_workout_t *workout, uint32_t distance_m, uint32_t time_ms, uint16_t strokes)
+{
+    workout->phase = FDF_WORKOUT_WORK;
+    workout->piece_start_m = distance_m;
+    workout->piece_start_ms = time_ms;
+    workout->split_start_m = distance_m;
+    workout->split_start_ms = time_ms;
+    workout->split_start_strokes = strokes;
+    workout->split_end = min_u32(workout->split_len, workout->target);
+}
+
+// Close every split the update crossed, and the piece with its last one
+static void advance(fdf_workout_t *workout, const fdf_rowing_data_t *data)
+{
+    uint32_t distance_m = data->distance_m;
+    uint32_t time_ms = data->elapsed_time_ms;
+
+    while (workout->phase == FDF_WORKOUT_WORK) {
+        uint32_t from = piece_progress(workout, workout->last_m, workout->last_ms);
+        uint32_t to = piece_progress(workout, distance_m, time_ms);
+        if (to < workout->split_end) {
+            return;
+        }
+
+        // Where the boundary falls between the last update and this one
+        uint32_t at_m = distance_m;
+        uint32_t at_ms = time_ms;
+        if (from < workout->split_end && workout->last_m <= distance_m && workout->last_ms <= time_ms) {
+            uint64_t num = workout->split_end - from;
+            uint64_t den = to - from;
+            at_m = workout->last_m + (uint32_t)((distance_m - workout->last_m) * num / den);
+            at_ms = workout->last_ms + (uint32_t)((time_ms - workout->last_ms) * num / den);
+        }
+
+        uint32_t index = workout->progress.splits++;
+        if (index < FDF_WORKOUT_MAX_SPLITS) {
+            fdf_workout_split_t *split = &workout->splits[index];
+            split->piece = workout->piece;
+            split->time_ms = at_ms - workout->split_start_ms;
+            split->distance_m = at_m - workout->split_start_m;
+            split->strokes = (uint16_t)(data->stroke_count - workout->split_start_strokes);
+        }
+        workout->split_start_m = at_m;
+        workout->split_start_ms = at_ms;
+        workout->split_start_strokes = data->stroke_count;
+
+        if (workout->split_end < workout->target) {
+            workout->split_end = min_u32(workout->split_end + workout->split_len, workout->target);
+            continue;
+        }
+
+        // End of the piece
+        if (workout->piece + 1 >= workout->config.pieces) {
+            workout->phase = FDF_WORKOUT_DONE;
+        } else if (workout->config.rest_s > 0) {
+            workout->phase = FDF_WORKOUT_REST;
+            workout->rest_end_us = data->timestamp_us + (int64_t)workout->config.rest_s * 1000000;
+        } else {
+            // No rest: what the update went past the boundary counts for the next piece
+            workout->piece++;
+            start_piece(workout, at_m, at_ms, data->stroke_count);
+            workout->last_m = at_m;
+            workout->last_ms = at_ms;
+        }
+    }
+}
+
+// Time left at the pace of the snapshot
+static bool pace_time_s(const fdf_rowing_data_t *data, uint32_t distance_m, uint32_t *time_s)
+{
+    if (!(data->present & FDF_FIELD_PACE) || data->pace_500m_ms == 0) {
+        return false;
+    }
+    *time_s = (uint32_t)(((uint64_t)distance_m * data->pace_500m_ms / 500 + 999) / 1000);
+    return true;
+}
+
+static void update_progress(fdf_workout_t *workout, const fdf_rowing_data_t *data)
+{
+    fdf_workout_progress_t *progress = &workout->progress;
+    progress->phase = workout->phase;
+    progress->piece = workout->piece;
+    progress->remaining_time_known = false;
+
+    switch (workout->phase) {
+        case FDF_WORKOUT_READY:
+            progress->remaining = workout->target;
+            if (workout->config.type == FDF_WORKOUT_TIME) {
+                progress->remaining_time_s = workout->config.target;
+                progress->remaining_time_known = true;
+            }
+            break;
+        case FDF_WORKOUT_WORK: {
+            uint32_t done = piece_progress(workout, data->distance_m, data->elapsed_time_ms);
+            progress->piece_distance_m = data->distance_m - workout->piece_start_m;
+            progress->piece_time_ms = data->elapsed_time_ms - workout->piece_start_ms;
+            progress->remaining = workout->target - min_u32(done, workout->target);
+            if (workout->config.type == FDF_WORKOUT_TIME) {
+                progress->remaining_time_s = (progress->remaining + 999) / 1000;
+                progress->remaining_time_known = true;
+            } else {
+                progress->remaining_time_known = pace_time_s(data, progress->remaining,
+                                                             &progress->remaining_time_s);
+            }
+            break;
+        }
+        case FDF_WORKOUT_REST: {
+            int64_t left_us = workout->rest_end_us - data->timestamp_us;
+            progress->remaining = workout->target;
+            progress->remaining_time_s = left_us > 0 ? (uint32_t)((left_us + 999999) / 1000000) : 0;
+            progress->remaining_time_known = true;
+            break;
+        }
+        case FDF_WORKOUT_DONE:
+            progress->remaining = 0;
+            progress->remaining_time_s = 0;
+            progress->remaining_time_known = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void fdf_workout_init(fdf_workout_t *workout)
+{
+    memset(workout, 0, sizeof(fdf_workout_t));
+}
+
+bool fdf_workout_set(fdf_workout_t *workout, const fdf_workout_config_t *config)
+{
+    if (config->type == FDF_WORKOUT_FREE) {
+        workout->config = *config;
+        workout->phase = FDF_WORKOUT_IDLE;
+        memset(&workout->progress, 0, sizeof(workout->progress));
+        return true;
+    }
+    if ((config->type != FDF_WORKOUT_DISTANCE && config->type != FDF_WORKOUT_TIME) ||
+        config->target == 0 || config->pieces == 0 || config->split > config->target ||
+        (config->type == FDF_WORKOUT_TIME && config->target > UINT32_MAX / 1000)) {
+        return false;
+    }
+
+    // Work in meters or milliseconds
+    uint32_t scale = config->type == FDF_WORKOUT_TIME ? 1000 : 1;
+    uint32_t split = config->split != 0 ? config->split : config->target / FDF_WORKOUT_DEFAULT_SPLITS;
+    workout->config = *config;
+    workout->target = config->target * scale;
+    workout->split_len = split > 0 ? split * scale : workout->target;
+    arm(workout);
+    return true;
+}
+
+bool fdf_workout_restart(fdf_workout_t *workout)
+{
+    if (workout->phase == FDF_WORKOUT_IDLE) {
+        return false;
+    }
+    arm(workout);
+    return true;
+}
+
+void fdf_workout_stop(fdf_workout_t *workout)
+{
+    if (workout->phase != FDF_WORKOUT_IDLE) {
+        workout->phase = FDF_WORKOUT_DONE;
+        workout->progress.phase = FDF_WORKOUT_DONE;
+    }
+}
+
+void fdf_workout_update(fdf_workout_t *workout, fdf_rowing_data_t *data)
+{
+    uint32_t distance_m = data->distance_m;
+    uint32_t time_ms = data->elapsed_time_ms;
+
+    // A new console session starts a running workout over
+    bool went_back = workout->has_last && (distance_m < workout->last_m || time_ms < workout->last_ms);
+    if (went_back && (workout->phase == FDF_WORKOUT_WORK || workout->phase == FDF_WORKOUT_REST)) {
+        arm(workout);
+    }
+
+    // The piece starts where the rower was before moving
+    if (workout->phase == FDF_WORKOUT_READY && workout->has_last && !went_back &&
+        distance_m > workout->last_m) {
+        start_piece(workout, workout->last_m, workout->last_ms, workout->last_strokes);
+    } else if (workout->phase == FDF_WORKOUT_REST && data->timestamp_us >= workout->rest_end_us) {
+        workout->piece++;
+        start_piece(workout, distance_m, time_ms, data->stroke_count);
+    }
+    if (workout->phase == FDF_WORKOUT_WORK) {
+        advance(workout, data);
+    }
+
+    workout->has_last = true;
+    workout->last_m = distance_m;
+    workout->last_ms = time_ms;
+    workout->last_strokes = data->stroke_count;
+
+    update_progress(workout, data);
+    if (workout->progress.remaining_time_known) {
+        data->remaining_time_s = (uint16_t)min_u32(workout->progress.remaining_time_s, UINT16_MAX);
+        data->present |= FDF_FIELD_REMAINING_TIME;
+    } else {
+        data->remaining_time_s = 0;
+        data->present &= ~FDF_FIELD_REMAINING_TIME;
+    }
+}
+
+void fdf_workout_get_progress(const fdf_workout_t *workout, fdf_workout_progress_t *progress)
+{
+    *progress = workout->progress;
+}
+
+bool fdf_workout_get_split(const fdf_workout_t *workout, uint32_t index, fdf_workout_split_t *split)
+{
+    if (index >= workout->progress.splits || index >= FDF_WORKOUT_MAX_SPLITS) {
+        return false;
+    }
+    *split = workout->splits[index];
+    return true;
+}
+
+const char *fdf_workout_phase_name(fdf_workout_phase_t phase)
+{
+    return phase < FDF_WORKOUT_PHASE_COUNT ? phase_names[phase] : "?";
+}
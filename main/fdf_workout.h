@@ -0,0 +1,174 @@
+#ifndef FDF_WORKOUT_H
+#define FDF_WORKOUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Workouts
+ *
+ * One per console. A workout is one or more work pieces of a fixed distance
+ * or a fixed time, with a rest of fixed length between pieces: a single
+ * piece is a distance or time workout, several make an interval workout.
+ * It starts with the first update whose distance moved after it was set,
+ * and is followed from the completed snapshots: piece progress, splits and
+ * what remains are kept as running values, so each update costs O(1)
+ * whatever the length of the workout.
+ *
+ * Distance and time of a piece are the console's, counted from where the
+ * piece started. Rests run on the receive clock, since consoles often stop
+ * their own while the rower is idle. A split ends where the update crossing
+ * its boundary is interpolated to meet it.
+ *
+ * No locking: the caller serializes updates, configuration and reads.
+ */
+
+// Splits kept per workout; later ones are counted but not recorded
+#define FDF_WORKOUT_MAX_SPLITS 32
+
+// Splits per piece when the split length is not given
+#define FDF_WORKOUT_DEFAULT_SPLITS 5
+
+// What a work piece is measured in
+typedef enum {
+    FDF_WORKOUT_FREE,             // No workout, nothing is tracked
+    FDF_WORKOUT_DISTANCE,         // Pieces of a fixed distance
+    FDF_WORKOUT_TIME,             // Pieces of a fixed time
+} fdf_workout_type_t;
+
+// Where the workout is
+typedef enum {
+    FDF_WORKOUT_IDLE,             // No workout set
+    FDF_WORKOUT_READY,            // Set, waiting for the rower to move
+    FDF_WORKOUT_WORK,             // In a work piece
+    FDF_WORKOUT_REST,             // Resting between pieces
+    FDF_WORKOUT_DONE,             // Last piece finished, or stopped
+    FDF_WORKOUT_PHASE_COUNT
+} fdf_workout_phase_t;
+
+// Workout definition
+typedef struct {
+    fdf_workout_type_t type;
+    uint32_t target;              // Work per piece, meters or seconds by type
+    uint32_t split;               // Split length in the same unit, 0 for a fifth of a piece
+    uint16_t rest_s;              // Rest after every piece but the last
+    uint8_t pieces;               // Work pieces, 1 for a single piece
+} fdf_workout_config_t;
+
+// A completed split
+typedef struct {
+    uint8_t piece;                // Piece the split belongs to, from 0
+    uint32_t time_ms;             // Duration
+    uint32_t distance_m;
+    uint16_t strokes;
+} fdf_workout_split_t;
+
+// Where the workout is, for display
+typedef struct {
+    fdf_workout_phase_t phase;
+    uint8_t piece;                // Current piece, from 0
+    uint8_t pieces;
+    uint32_t piece_distance_m;    // Distance into the current piece
+    uint32_t piece_time_ms;       // Time into the current piece
+    uint32_t remaining;           // Work left in the piece, meters or milliseconds by type
+    uint32_t remaining_time_s;    // Time left in the piece or rest, when known
+    bool remaining_time_known;    // Distance pieces: once the pace is
+    uint32_t splits;              // Splits completed, also those not recorded
+} fdf_workout_progress_t;
+
+// Workout state of a console
+typedef struct {
+    fdf_workout_config_t config;
+    fdf_workout_phase_t phase;
+    uint8_t piece;
+    uint32_t target;              // Work per piece, meters or milliseconds
+    uint32_t split_len;           // Split length, meters or milliseconds
+    uint32_t split_end;           // Progress at which the current split ends
+    uint32_t piece_start_m;       // Console distance and time where the piece started
+    uint32_t piece_start_ms;
+    uint32_t split_start_m;       // Console distance, time and strokes where the split started
+    uint32_t split_start_ms;
+    uint16_t split_start_strokes;
+    int64_t rest_end_us;          // Receive time at which the rest ends
+    bool has_last;                // Whether last_* hold an update
+    uint32_t last_m;              // Last update, for starts and split interpolation
+    uint32_t last_ms;
+    uint16_t last_strokes;
+    fdf_workout_progress_t progress;
+    fdf_workout_split_t splits[FDF_WORKOUT_MAX_SPLITS];
+} fdf_workout_t;
+
+/**
+ * @brief Initialize without a workout
+ * @param workout Workout to initialize
+ */
+void fdf_workout_init(fdf_workout_t *workout);
+
+/**
+ * @brief Set a workout, which starts when the rower moves
+ * @param workout Workout
+ * @param config Definition, copied; FDF_WORKOUT_FREE clears the workout
+ * @return false if the definition is invalid, the workout is then unchanged
+ */
+bool fdf_workout_set(fdf_workout_t *workout, const fdf_workout_config_t *config);
+
+/**
+ * @brief Start the set workout over, from the next time the rower moves
+ * @param workout Workout
+ * @return false if no workout is set
+ */
+bool fdf_workout_restart(fdf_workout_t *workout);
+
+/**
+ * @brief End the workout where it is; its splits stay readable
+ * @param workout Workout
+ */
+void fdf_workout_stop(fdf_workout_t *workout);
+
+/**
+ * @brief Follow a completed snapshot and fill in the time remaining
+ *
+ * Sets remaining_time_s and flags it in present while a workout runs and
+ * the time left is known, clears both otherwise. A snapshot whose distance
+ * or time went back is a new console session: a running workout waits for
+ * the rower to move again and starts over.
+ *
+ * @param workout Workout of the console
+ * @param data Snapshot, completed by fdf_metrics
+ */
+void fdf_workout_update(fdf_workout_t *workout, fdf_rowing_data_t *data);
+
+/**
+ * @brief Get where the workout is
+ * @param workout Workout
+ * @param progress Filled with the current values
+ */
+void fdf_workout_get_progress(const fdf_workout_t *workout, fdf_workout_progress_t *progress);
+
+/**
+ * @brief Get a recorded split
+ * @param workout Workout
+ * @param index Split, from 0
+ * @param split Filled with the split
+ * @return false if the split is not recorded
+ */
+bool fdf_workout_get_split(const fdf_workout_t *workout, uint32_t index, fdf_workout_split_t *split);
+
+/**
+ * @brief Name of a phase, for logs
+ * @param phase Phase
+ * @return Static string
+ */
+const char *fdf_workout_phase_name(fdf_workout_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_WORKOUT_H
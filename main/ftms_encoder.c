@@ -0,0 +1,282 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ftms_encoder.h"
+
+// Flags field, and the Stroke Rate and Stroke Count fields sent without More Data
+#define FTMS_FLAGS_LEN 2
+#define FTMS_STROKE_FIELDS_LEN 3
+
+// "Data Not Available" values of the Expended Energy fields
+#define FTMS_TOTAL_ENERGY_NA 0xFFFF
+#define FTMS_ENERGY_PER_HOUR_NA 0xFFFF
+#define FTMS_ENERGY_PER_MINUTE_NA 0xFF
+
+// Flags the decoder knows the field sizes of
+#define FTMS_KNOWN_FLAGS 0x1FFF
+
+// Optional field of the record, in flag order
+typedef struct {
+    uint16_t flag;                // FTMS_FLAG_*_PRESENT
+    uint16_t field;               // FDF_FIELD_* bits the field is sent for
+    uint8_t size;                 // Bytes on the wire
+} ftms_field_t;
+
+static const ftms_field_t rower_fields[] = {
+    { FTMS_FLAG_AVG_STROKE_RATE_PRESENT,     FDF_FIELD_AVG_STROKE_RATE, 1 },
+    { FTMS_FLAG_TOTAL_DISTANCE_PRESENT,      FDF_FIELD_DISTANCE,        3 },
+    { FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT,  FDF_FIELD_PACE,            2 },
+    { FTMS_FLAG_AVERAGE_PACE_PRESENT,        FDF_FIELD_AVG_PACE,        2 },
+    { FTMS_FLAG_INSTANTANEOUS_POWER_PRESENT, FDF_FIELD_POWER,           2 },
+    { FTMS_FLAG_AVERAGE_POWER_PRESENT,       FDF_FIELD_AVG_POWER,       2 },
+    { FTMS_FLAG_EXPENDED_ENERGY_PRESENT,     FDF_FIELD_CALORIES | FDF_FIELD_ENERGY_RATE, 5 },
+    { FTMS_FLAG_ELAPSED_TIME_PRESENT,        FDF_FIELD_ELAPSED_TIME,    2 },
+    { FTMS_FLAG_REMAINING_TIME_PRESENT,      FDF_FIELD_REMAINING_TIME,  2 },
+};
+
+#define NUM_ROWER_FIELDS (sizeof(rower_fields) / sizeof(rower_fields[0]))
+
+static uint32_t clamp(uint32_t value, uint32_t max)
+{
+    return value > max ? max : value;
+}
+
+static void write_le(uint8_t *packet, size_t *idx, uint32_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        packet[(*idx)++] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+// Stroke rates are sent with a resolution of 0.5 per minute
+static uint8_t encode_stroke_rate(uint16_t rate)
+{
+    return (uint8_t)clamp((uint32_t)rate * 2, UINT8_MAX);
+}
+
+static void write_field(uint8_t *packet, size_t *idx, uint16_t flag, const fdf_rowing_data_t *data)
+{
+    switch (flag) {
+        case FTMS_FLAG_AVG_STROKE_RATE_PRESENT:
+            write_le(packet, idx, encode_stroke_rate(data->avg_stroke_rate), 1);
+            break;
+        case FTMS_FLAG_TOTAL_DISTANCE_PRESENT:
+            // Meters
+            write_le(packet, idx, clamp(data->distance_m, 0xFFFFFF), 3);
+            break;
+        case FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT:
+            // Seconds per 500 m
+            write_le(packet, idx, clamp(data->pace_500m_ms / 1000, UINT16_MAX), 2);
+            break;
+        case FTMS_FLAG_AVERAGE_PACE_PRESENT:
+            write_le(packet, idx, clamp(data->avg_pace_500m_ms / 1000, UINT16_MAX), 2);
+            break;
+        case FTMS_FLAG_INSTANTANEOUS_POWER_PRESENT:
+            // Watts, signed
+            write_le(packet, idx, clamp(data->power_watts, INT16_MAX), 2);
+            break;
+        case FTMS_FLAG_AVERAGE_POWER_PRESENT:
+            write_le(packet, idx, clamp(data->avg_power_watts, INT16_MAX), 2);
+            break;
+        case FTMS_FLAG_EXPENDED_ENERGY_PRESENT:
+            // Total kcal, kcal per hour and kcal per minute
+            write_le(packet, idx, (data->present & FDF_FIELD_CALORIES) ?
+                                  clamp(data->calories, FTMS_TOTAL_ENERGY_NA - 1) : FTMS_TOTAL_ENERGY_NA, 2);
+            if (data->present & FDF_FIELD_ENERGY_RATE) {
+                write_le(packet, idx, clamp(data->energy_per_hour, FTMS_ENERGY_PER_HOUR_NA - 1), 2);
+                write_le(packet, idx, clamp(data->energy_per_minute, FTMS_ENERGY_PER_MINUTE_NA - 1), 1);
+            } else {
+                write_le(packet, idx, FTMS_ENERGY_PER_HOUR_NA, 2);
+                write_le(packet, idx, FTMS_ENERGY_PER_MINUTE_NA, 1);
+            }
+            break;
+        case FTMS_FLAG_ELAPSED_TIME_PRESENT:
+            // Seconds
+            write_le(packet, idx, clamp(data->elapsed_time_ms / 1000, UINT16_MAX), 2);
+            break;
+        case FTMS_FLAG_REMAINING_TIME_PRESENT:
+            // Seconds
+            write_le(packet, idx, data->remaining_time_s, 2);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Encode a snapshot as Indoor Rower Data notifications
+ */
+size_t ftms_encode_indoor_rower_data(const fdf_rowing_data_t *data, size_t max_len,
+                                     ftms_packet_t *packets)
+{
+    if (max_len < FTMS_DEFAULT_PAYLOAD_LEN) {
+        max_len = FTMS_DEFAULT_PAYLOAD_LEN;
+    } else if (max_len > FTMS_INDOOR_ROWER_DATA_MAX_LEN) {
+        max_len = FTMS_INDOOR_ROWER_DATA_MAX_LEN;
+    }
+    
+    // Bytes of the optional fields the console reported
+    size_t remaining = 0;
+    for (size_t f = 0; f < NUM_ROWER_FIELDS; f++) {
+        if (data->present & rower_fields[f].field) {
+            remaining += rower_fields[f].size;
+        }
+    }
+    
+    size_t count = 0;
+    size_t f = 0;
+    
+    // Leading More Data packets, until the rest fits with Stroke Rate and Stroke Count
+    while (FTMS_FLAGS_LEN + FTMS_STROKE_FIELDS_LEN + remaining > max_len &&
+           count < FTMS_INDOOR_ROWER_MAX_PACKETS - 1) {
+        ftms_packet_t *packet = &packets[count++];
+        uint16_t flags = FTMS_FLAG_MORE_DATA;
+        size_t idx = FTMS_FLAGS_LEN;
+        
+        for (; f < NUM_ROWER_FIELDS; f++) {
+            if (!(data->present & rower_fields[f].field)) {
+                continue;
+            }
+            if (idx + rower_fields[f].size > max_len) {
+                break;
+            }
+            write_field(packet->data, &idx, rower_fields[f].flag, data);
+            flags |= rower_fields[f].flag;
+            remaining -= rower_fields[f].size;
+        }
+        
+        packet->data[0] = flags & 0xFF;
+        packet->data[1] = (flags >> 8) & 0xFF;
+        packet->len = idx;
+    }
+    
+    // Last packet: Stroke Rate, Stroke Count and the remaining fields
+    ftms_packet_t *packet = &packets[count++];
+    uint16_t flags = 0;
+    size_t idx = FTMS_FLAGS_LEN;
+    
+    write_le(packet->data, &idx, encode_stroke_rate(data->stroke_rate), 1);
+    write_le(packet->data, &idx, data->stroke_count, 2);
+    for (; f < NUM_ROWER_FIELDS; f++) {
+        if (data->present & rower_fields[f].field) {
+            write_field(packet->data, &idx, rower_fields[f].flag, data);
+            flags |= rower_fields[f].flag;
+        }
+    }
+    
+    packet->data[0] = flags & 0xFF;
+    packet->data[1] = (flags >> 8) & 0xFF;
+    packet->len = idx;
+    
+    return count;
+}
+
+// Little-endian field reader for the decoder
+static uint32_t read_le(const uint8_t *packet, size_t *idx, size_t size)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint32_t)packet[*idx + i] << (8 * i);
+    }
+    *idx += size;
+    return value;
+}
+
+/**
+ * @brief Decode one Indoor Rower Data notification
+ */
+bool ftms_decode_indoor_rower_data(const uint8_t *packet, size_t packet_len, fdf_rowing_data_t *data)
+{
+    size_t idx = 0;
+    
+    if (packet_len < FTMS_FLAGS_LEN) {
+        return false;
+    }
+    uint16_t flags = (uint16_t)read_le(packet, &idx, FTMS_FLAGS_LEN);
+    if (flags & ~FTMS_KNOWN_FLAGS) {
+        return false;
+    }
+    
+    // Wire size of every field the flags announce
+    size_t expected = FTMS_FLAGS_LEN;
+    if (!(flags & FTMS_FLAG_MORE_DATA)) {
+        expected += FTMS_STROKE_FIELDS_LEN;
+    }
+    for (size_t f = 0; f < NUM_ROWER_FIELDS; f++) {
+        if (flags & rower_fields[f].flag) {
+            expected += rower_fields[f].size;
+        }
+    }
+    expected += (flags & FTMS_FLAG_RESISTANCE_LEVEL_PRESENT) ? 2 : 0;
+    expected += (flags & FTMS_FLAG_HEART_RATE_PRESENT) ? 1 : 0;
+    expected += (flags & FTMS_FLAG_METABOLIC_EQUIVALENT_PRESENT) ? 1 : 0;
+    if (packet_len != expected) {
+        return false;
+    }
+    
+    if (!(flags & FTMS_FLAG_MORE_DATA)) {
+        data->stroke_rate = (uint16_t)(read_le(packet, &idx, 1) / 2);
+        data->stroke_count = (uint16_t)read_le(packet, &idx, 2);
+        data->present |= FDF_FIELD_STROKE_RATE | FDF_FIELD_STROKE_COUNT;
+    }
+    if (flags & FTMS_FLAG_AVG_STROKE_RATE_PRESENT) {
+        data->avg_stroke_rate = (uint16_t)(read_le(packet, &idx, 1) / 2);
+        data->present |= FDF_FIELD_AVG_STROKE_RATE;
+    }
+    if (flags & FTMS_FLAG_TOTAL_DISTANCE_PRESENT) {
+        data->distance_m = read_le(packet, &idx, 3);
+        data->present |= FDF_FIELD_DISTANCE;
+    }
+    if (flags & FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT) {
+        data->pace_500m_ms = read_le(packet, &idx, 2) * 1000;
+        data->present |= FDF_FIELD_PACE;
+    }
+    if (flags & FTMS_FLAG_AVERAGE_PACE_PRESENT) {
+        data->avg_pace_500m_ms = read_le(packet, &idx, 2) * 1000;
+        data->present |= FDF_FIELD_AVG_PACE;
+    }
+    if (flags & FTMS_FLAG_INSTANTANEOUS_POWER_PRESENT) {
+        int16_t power = (int16_t)read_le(packet, &idx, 2);
+        data->power_watts = power > 0 ? (uint16_t)power : 0;
+        data->present |= FDF_FIELD_POWER;
+    }
+    if (flags & FTMS_FLAG_AVERAGE_POWER_PRESENT) {
+        int16_t power = (int16_t)read_le(packet, &idx, 2);
+        data->avg_power_watts = power > 0 ? (uint16_t)power : 0;
+        data->present |= FDF_FIELD_AVG_POWER;
+    }
+    if (flags & FTMS_FLAG_RESISTANCE_LEVEL_PRESENT) {
+        idx += 2;
+    }
+    if (flags & FTMS_FLAG_EXPENDED_ENERGY_PRESENT) {
+        uint16_t total = (uint16_t)read_le(packet, &idx, 2);
+        uint16_t per_hour = (uint16_t)read_le(packet, &idx, 2);
+        uint8_t per_minute = (uint8_t)read_le(packet, &idx, 1);
+        if (total != FTMS_TOTAL_ENERGY_NA) {
+            data->calories = total;
+            data->present |= FDF_FIELD_CALORIES;
+        }
+        if (per_hour != FTMS_ENERGY_PER_HOUR_NA) {
+            data->energy_per_hour = per_hour;
+            data->energy_per_minute = per_minute;
+            data->present |= FDF_FIELD_ENERGY_RATE;
+        }
+    }
+    if (flags & FTMS_FLAG_HEART_RATE_PRESENT) {
+        idx += 1;
+    }
+    if (flags & FTMS_FLAG_METABOLIC_EQUIVALENT_PRESENT) {
+        idx += 1;
+    }
+    if (flags & FTMS_FLAG_ELAPSED_TIME_PRESENT) {
+        data->elapsed_time_ms = read_le(packet, &idx, 2) * 1000;
+        data->present |= FDF_FIELD_ELAPSED_TIME;
+    }
+    if (flags & FTMS_FLAG_REMAINING_TIME_PRESENT) {
+        data->remaining_time_s = (uint16_t)read_le(packet, &idx, 2);
+        data->present |= FDF_FIELD_REMAINING_TIME;
+    }
+    
+    return true;
+}
@@ -0,0 +1,121 @@
+#ifndef FTMS_ENCODER_H
+#define FTMS_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fdf_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// FTMS Indoor Rower Data flags (FTMS v1.0, 4.8.1)
+#define FTMS_FLAG_MORE_DATA                   0x0001  // Stroke Rate and Stroke Count absent
+#define FTMS_FLAG_AVG_STROKE_RATE_PRESENT     0x0002
+#define FTMS_FLAG_TOTAL_DISTANCE_PRESENT      0x0004
+#define FTMS_FLAG_INSTANTANEOUS_PACE_PRESENT  0x0008
+#define FTMS_FLAG_AVERAGE_PACE_PRESENT        0x0010
+#define FTMS_FLAG_INSTANTANEOUS_POWER_PRESENT 0x0020
+#define FTMS_FLAG_AVERAGE_POWER_PRESENT       0x0040
+#define FTMS_FLAG_RESISTANCE_LEVEL_PRESENT    0x0080
+#define FTMS_FLAG_EXPENDED_ENERGY_PRESENT     0x0100
+#define FTMS_FLAG_HEART_RATE_PRESENT          0x0200
+#define FTMS_FLAG_METABOLIC_EQUIVALENT_PRESENT 0x0400
+#define FTMS_FLAG_ELAPSED_TIME_PRESENT        0x0800
+#define FTMS_FLAG_REMAINING_TIME_PRESENT      0x1000
+
+// Fitness Machine Status op codes and parameters (FTMS v1.0, 4.17)
+#define FTMS_STATUS_RESET                     0x01
+#define FTMS_STATUS_STOPPED_OR_PAUSED         0x02  // Parameter: FTMS_STATUS_PARAM_*
+#define FTMS_STATUS_STARTED_OR_RESUMED        0x04
+#define FTMS_STATUS_TARGETED_DISTANCE_CHANGED 0x0D  // Parameter: distance in meters, uint24
+#define FTMS_STATUS_TARGETED_TIME_CHANGED     0x0E  // Parameter: time in seconds, uint16
+#define FTMS_STATUS_PARAM_STOP                0x01
+#define FTMS_STATUS_PARAM_PAUSE               0x02
+
+// Fitness Machine Control Point op codes (FTMS v1.0, 4.16)
+#define FTMS_CONTROL_REQUEST_CONTROL          0x00
+#define FTMS_CONTROL_RESET                    0x01
+#define FTMS_CONTROL_START_OR_RESUME          0x07
+#define FTMS_CONTROL_STOP_OR_PAUSE            0x08  // Parameter: FTMS_STATUS_PARAM_*
+#define FTMS_CONTROL_SET_TARGETED_DISTANCE    0x0C  // Parameter: meters, uint24
+#define FTMS_CONTROL_SET_TARGETED_TIME        0x0D  // Parameter: seconds, uint16
+#define FTMS_CONTROL_RESPONSE                 0x80  // Followed by the request op code and a result
+
+// Bridge specific, in the reserved range: interval workout, parameters
+// piece type (0 distance, 1 time), uint8; work per piece in meters or
+// seconds, uint24; rest in seconds, uint16; pieces, uint8
+#define FTMS_CONTROL_SET_INTERVALS            0x70
+#define FTMS_CONTROL_SET_INTERVALS_LEN        8
+
+// Control Point result codes
+#define FTMS_RESULT_SUCCESS                   0x01
+#define FTMS_RESULT_NOT_SUPPORTED             0x02
+#define FTMS_RESULT_INVALID_PARAMETER         0x03
+#define FTMS_RESULT_FAILED                    0x04
+#define FTMS_RESULT_CONTROL_NOT_PERMITTED     0x05
+
+// Fitness Machine Feature bits (FTMS v1.0, 4.3)
+#define FTMS_FEATURE_CADENCE                  (1u << 1)
+#define FTMS_FEATURE_TOTAL_DISTANCE           (1u << 2)
+#define FTMS_FEATURE_PACE                     (1u << 5)
+#define FTMS_FEATURE_EXPENDED_ENERGY          (1u << 9)
+#define FTMS_FEATURE_ELAPSED_TIME             (1u << 12)
+#define FTMS_FEATURE_REMAINING_TIME           (1u << 13)
+#define FTMS_FEATURE_POWER_MEASUREMENT        (1u << 14)
+#define FTMS_TARGET_DISTANCE                  (1u << 8)
+#define FTMS_TARGET_TRAINING_TIME             (1u << 9)
+
+// Size of an Indoor Rower Data record with every field the bridge reports
+#define FTMS_INDOOR_ROWER_DATA_MAX_LEN 26
+
+// Notification payload with the default ATT MTU of 23
+#define FTMS_DEFAULT_PAYLOAD_LEN 20
+
+// Notifications a record is split into at most, with payloads of at least
+// FTMS_DEFAULT_PAYLOAD_LEN bytes
+#define FTMS_INDOOR_ROWER_MAX_PACKETS 2
+
+// One Indoor Rower Data notification
+typedef struct {
+    uint8_t data[FTMS_INDOOR_ROWER_DATA_MAX_LEN];
+    size_t len;
+} ftms_packet_t;
+
+/**
+ * @brief Encode a snapshot as Indoor Rower Data notifications
+ *
+ * Only the fields flagged in data->present are sent. When they do not fit in
+ * one notification of max_len bytes, the record is split as the FTMS
+ * specification allows: the leading packets have the More Data flag set and
+ * the last one carries Stroke Rate and Stroke Count.
+ *
+ * @param data Rowing data to encode
+ * @param max_len Largest notification payload (ATT MTU - 3), at least
+ *                FTMS_DEFAULT_PAYLOAD_LEN
+ * @param packets Output, room for FTMS_INDOOR_ROWER_MAX_PACKETS packets
+ * @return Number of packets written
+ */
+size_t ftms_encode_indoor_rower_data(const fdf_rowing_data_t *data, size_t max_len,
+                                     ftms_packet_t *packets);
+
+/**
+ * @brief Decode one Indoor Rower Data notification
+ *
+ * Fields are converted back to the units of fdf_rowing_data_t, stored in data
+ * and flagged in data->present; other fields are left untouched, so the
+ * packets of a split record can be decoded into the same snapshot.
+ *
+ * @param packet Packet bytes
+ * @param packet_len Packet length
+ * @param data Snapshot the decoded fields are stored in
+ * @return true if the packet is well formed, false otherwise
+ */
+bool ftms_decode_indoor_rower_data(const uint8_t *packet, size_t packet_len, fdf_rowing_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FTMS_ENCODER_H
@@ -0,0 +1,88 @@
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_trace.h"
+
+#include "heap_audit.h"
+
+static const char *TAG = "HEAP_AUDIT";
+
+// Only counts are used, so a small record buffer is enough
+#define HEAP_AUDIT_NUM_RECORDS 32
+
+// Tasks of the USB-to-BLE pipeline
+static const char *const audited_tasks[] = {
+    "main", "usb_host_task", "usb_lib_task", "usb_tx_task", "supervisor", "synth_console", "esp_timer",
+    "BTC_TASK", "BTU_TASK",
+};
+
+static heap_trace_record_t trace_records[HEAP_AUDIT_NUM_RECORDS];
+static bool audit_running = false;
+static uint32_t last_allocations = 0;
+static uint32_t last_updates = 0;
+
+esp_err_t heap_audit_start(void)
+{
+    esp_err_t ret = heap_trace_init_standalone(trace_records, HEAP_AUDIT_NUM_RECORDS);
+    if (ret == ESP_OK) {
+        ret = heap_trace_start(HEAP_TRACE_ALL);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start heap tracing: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    audit_running = true;
+    last_allocations = 0;
+    last_updates = 0;
+    ESP_LOGI(TAG, "Counting heap allocations of the steady state");
+    return ESP_OK;
+}
+
+bool heap_audit_check(uint32_t updates, bool strict)
+{
+    heap_trace_summary_t summary;
+    
+    if (!audit_running || heap_trace_summary(&summary) != ESP_OK) {
+        return false;
+    }
+    
+    uint32_t allocations = summary.total_allocations - last_allocations;
+    uint32_t window_updates = updates - last_updates;
+    last_allocations = summary.total_allocations;
+    last_updates = updates;
+    
+    if (allocations == 0) {
+        ESP_LOGI(TAG, "No allocations in %" PRIu32 " updates", window_updates);
+        return true;
+    }
+    
+    if (strict) {
+        // Tracing counts every task, a diagnostics command included: report, do not stop
+        ESP_LOGE(TAG, "%" PRIu32 " allocations in %" PRIu32 " updates without BLE traffic",
+                 allocations, window_updates);
+        heap_trace_dump();
+    } else {
+        ESP_LOGI(TAG, "%" PRIu32 " allocations in %" PRIu32 " updates (BLE traffic included)",
+                 allocations, window_updates);
+    }
+    return false;
+}
+
+void heap_audit_report_watermarks(void)
+{
+    ESP_LOGI(TAG, "Heap: %zu bytes free, %zu minimum, %zu largest block",
+             heap_caps_get_free_size(MALLOC_CAP_8BIT),
+             heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    
+    for (size_t i = 0; i < sizeof(audited_tasks) / sizeof(audited_tasks[0]); i++) {
+        TaskHandle_t task = xTaskGetHandle(audited_tasks[i]);
+        if (task != NULL) {
+            ESP_LOGI(TAG, "Stack %-16s %5" PRIu32 " bytes never used", audited_tasks[i],
+                     (uint32_t)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef HEAP_AUDIT_H
+#define HEAP_AUDIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocation audit of the steady state
+ *
+ * Counts heap allocations with ESP-IDF's standalone heap tracing once the
+ * bridge is up. The USB-to-BLE path is expected not to allocate at all; the
+ * Bluetooth stack does allocate for every notification it sends, so the
+ * zero-allocation check is only strict while no central was connected. A
+ * strict check that finds allocations logs an error and prints the traced
+ * ones rather than aborting: tracing counts the allocations of every task,
+ * so a diagnostics command typed in the window shows up too.
+ */
+
+/**
+ * @brief Start counting allocations
+ * @return ESP_OK if heap tracing was started
+ */
+esp_err_t heap_audit_start(void);
+
+/**
+ * @brief Check the allocations made since the previous check
+ * @param updates Total number of updates forwarded so far
+ * @param strict Report allocations as an error and print the traced ones (no BLE traffic in the window)
+ * @return true if no allocation was made, false otherwise
+ */
+bool heap_audit_check(uint32_t updates, bool strict);
+
+/**
+ * @brief Log heap low-water marks and the stack high-water marks of the pipeline tasks
+ */
+void heap_audit_report_watermarks(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEAP_AUDIT_H
@@ -3,34 +3,600 @@
 #include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "esp_heap_caps.h"
 
 #include "usb_host_handler.h"
 #include "fdf_protocol.h"
+#include "fdf_metrics.h"
+#include "fdf_interp.h"
+#include "fdf_strokes.h"
 #include "ble_ftms.h"
+#include "session_recorder.h"
+#include "session_archive.h"
+#include "fdf_synth.h"
+#include "heap_audit.h"
+#include "fdf_diag.h"
+#include "fdf_trace.h"
+#include "fdf_boot.h"
+#include "fdf_supervisor.h"
+#include "fdf_watchdog.h"
+#include "fdf_power.h"
+#include "fdf_bus.h"
+#include "fdf_workout.h"
+#include "fdf_config.h"
+#include "fdf_filter.h"
 
 static const char *TAG = "FDF_BRIDGE";
 
-// Global data callback to bridge USB data to protocol parser
-static void usb_data_received(const uint8_t *data, size_t length)
+#define SYNTH_TASK_STACK_SIZE 4096
+#define TRACE_TASK_STACK_SIZE 3072
+#define INTERP_TASK_STACK_SIZE 3072
+#define USB_INIT_TASK_STACK_SIZE 4096
+#define STORAGE_INIT_TASK_STACK_SIZE 3072
+
+// Longest wait for the subsystems to come up before reporting the boot
+#define BOOT_TIMEOUT_MS 5000
+
+// One parser per console slot
+static fdf_parser_t parsers[USB_HOST_MAX_CONSOLES];
+
+// Derived metrics per console slot
+static fdf_metrics_t metrics[USB_HOST_MAX_CONSOLES];
+
+#if CONFIG_FDF_STROKE_HISTORY
+// Stroke history per console slot, on an arena allocated at boot
+static fdf_stroke_history_t strokes[USB_HOST_MAX_CONSOLES];
+#endif
+
+#if CONFIG_FDF_FILTER
+// Power, pace and rate filter per console slot, run by the stroke stage and
+// read by the FTMS stage, both in the publisher's task
+static fdf_filter_t filters[USB_HOST_MAX_CONSOLES];
+#endif
+
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+#define INTERP_PERIOD_MS (1000 / CONFIG_FDF_INTERP_RATE_HZ)
+
+// Interpolation per console slot; the mutex also orders the notifications
+// of console updates and interpolated ones
+static fdf_interp_t interp[USB_HOST_MAX_CONSOLES];
+static SemaphoreHandle_t interp_mutex = NULL;
+static StaticSemaphore_t interp_mutex_buffer;
+#endif
+
+#if CONFIG_FDF_CONSOLE_POLL_ENABLE
+// Status request of consoles that do not stream
+static const char poll_request[] = CONFIG_FDF_CONSOLE_POLL_REQUEST;
+#endif
+
+#if CONFIG_FDF_WATCHDOG
+#define WATCHDOG_PERIOD_MS 250
+
+// Data freshness per console slot, fed by the USB host task and checked by a timer
+static fdf_watchdog_t watchdogs[USB_HOST_MAX_CONSOLES];
+static portMUX_TYPE watchdog_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t watchdog_timer = NULL;
+static bool watchdog_timer_scheduled = false;  // Under watchdog_lock
+
+// Recovery step handed from the timer to the supervisor, per console slot
+static volatile fdf_recovery_step_t recovery_due[USB_HOST_MAX_CONSOLES];
+#endif
+
+#if CONFIG_FDF_WORKOUT
+// Workout per console slot, set by the Bluetooth task and followed by the USB host task
+static fdf_workout_t workouts[USB_HOST_MAX_CONSOLES];
+static portMUX_TYPE workout_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Updates forwarded to FTMS, all consoles
+static volatile uint32_t updates_forwarded = 0;
+
+// Set while a console is open or a central connected; periodic tasks sleep on these
+// bits instead of polling, so an idle chip has no wake-ups of its own
+#define ACTIVITY_CONSOLE (1u << 0)
+#define ACTIVITY_CENTRAL (1u << 1)
+static EventGroupHandle_t activity = NULL;
+static StaticEventGroup_t activity_buffer;
+
+#if CONFIG_FDF_WATCHDOG || CONFIG_FDF_INTERP_RATE_HZ > 0
+// A console delivers data on this slot: an open USB device, or the synthetic console
+static bool console_present(uint8_t console_id)
+{
+#if CONFIG_FDF_SYNTH_CONSOLE
+    if (console_id == CONFIG_FDF_SYNTH_CONSOLE_ID) {
+        return true;
+    }
+#endif
+    return usb_host_console_is_connected(console_id);
+}
+#endif
+
+// Global data callback to bridge USB data to the console's protocol parser
+static void usb_data_received(const usb_rx_chunk_t *chunk)
+{
+    ESP_LOGD(TAG, "Received %zu bytes from console %d", chunk->length, chunk->console_id);
+    fdf_boot_mark(FDF_BOOT_FIRST_DATA);
+    session_recorder_add(chunk->console_id, chunk->timestamp_us, chunk->data, chunk->length);
+    if (chunk->console_id < USB_HOST_MAX_CONSOLES) {
+        fdf_parser_process_chunk(&parsers[chunk->console_id], chunk->data, chunk->length,
+                                 chunk->timestamp_us);
+    }
+}
+
+#if CONFIG_FDF_WATCHDOG
+// A line arrived: the console's data is fresh, again if it was stale
+static void watchdog_feed(uint8_t console_id)
+{
+    fdf_cadence_t cadence;
+    uint32_t interval_us = fdf_parser_get_cadence(&parsers[console_id], &cadence) ? cadence.interval_us : 0;
+    int64_t now_us = esp_timer_get_time();
+    
+    portENTER_CRITICAL(&watchdog_lock);
+    bool recovered = fdf_watchdog_feed(&watchdogs[console_id], now_us, interval_us);
+    fdf_watchdog_stats_t stats = watchdogs[console_id].stats;
+    bool schedule = !watchdog_timer_scheduled;
+    watchdog_timer_scheduled = true;
+    portEXIT_CRITICAL(&watchdog_lock);
+    
+    // The check timer only runs while a watchdog is armed
+    if (schedule) {
+        esp_timer_start_once(watchdog_timer, WATCHDOG_PERIOD_MS * 1000);
+    }
+    
+    if (recovered) {
+        ble_ftms_set_stale(console_id, false);
+        ESP_LOGI(TAG, "[%d] Console recovered %" PRIu32 " ms after detection (%s), no data for %" PRIu32 " ms",
+                 console_id, stats.last_recovery_ms, fdf_watchdog_step_name(stats.last_step),
+                 stats.last_outage_ms);
+    }
+}
+
+// Freshness check, every period while a watchdog is armed; the supervisor
+// takes the recovery steps
+static void watchdog_timer_callback(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    bool armed = false;
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        portENTER_CRITICAL(&watchdog_lock);
+        fdf_recovery_step_t step = fdf_watchdog_check(&watchdogs[i], now_us);
+        armed = armed || watchdogs[i].last_data_us != 0;
+        if (i == USB_HOST_MAX_CONSOLES - 1) {
+            // Decided under the lock, so a feed either sees this or reschedules
+            watchdog_timer_scheduled = armed;
+        }
+        portEXIT_CRITICAL(&watchdog_lock);
+        if (step != FDF_RECOVERY_NONE) {
+            recovery_due[i] = step;
+            fdf_supervisor_post(FDF_SUP_DATA_STALL, i);
+        }
+    }
+    if (armed) {
+        esp_timer_start_once(watchdog_timer, WATCHDOG_PERIOD_MS * 1000);
+    }
+}
+#endif
+
+// Bus subscriber: every parsed line answers a poll and shows the console is alive
+static void line_received(void *ctx, fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    // A parsed line answers the oldest outstanding poll, if any
+    usb_host_poll_response_received(console_id, NULL);
+#if CONFIG_FDF_WATCHDOG
+    watchdog_feed(console_id);
+#endif
+}
+
+// Bus subscriber: completes console updates with derived metrics and publishes the snapshot
+static void update_received(void *ctx, fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    fdf_metrics_t *console_metrics = &((fdf_metrics_t *)ctx)[console_id];
+    updates_forwarded++;
+    
+    // Fill in what the console does not report
+    fdf_rowing_data_t snapshot = *data;
+    fdf_metrics_update(console_metrics, &snapshot);
+    
+#if CONFIG_FDF_WORKOUT
+    // Then what is left of the workout
+    fdf_workout_t *workout = &workouts[console_id];
+    portENTER_CRITICAL(&workout_lock);
+    fdf_workout_phase_t phase = workout->phase;
+    uint8_t piece = workout->piece;
+    uint32_t splits = workout->progress.splits;
+    fdf_workout_update(workout, &snapshot);
+    fdf_workout_progress_t progress = workout->progress;
+    fdf_workout_split_t split;
+    bool new_split = progress.splits != splits && fdf_workout_get_split(workout, progress.splits - 1, &split);
+    portEXIT_CRITICAL(&workout_lock);
+    if (new_split) {
+        ESP_LOGI(TAG, "[%d] Split %" PRIu32 ": %" PRIu32 " m in %" PRIu32 ".%01" PRIu32 " s, %u strokes",
+                 console_id, progress.splits, split.distance_m, split.time_ms / 1000,
+                 split.time_ms % 1000 / 100, split.strokes);
+    }
+    if (progress.phase != phase || progress.piece != piece) {
+        ESP_LOGI(TAG, "[%d] Workout %s, piece %d/%d", console_id,
+                 fdf_workout_phase_name(progress.phase), progress.piece + 1, progress.pieces);
+    }
+#endif
+    
+    FDF_TRACE(FDF_TRACE_UPDATE, console_id, snapshot.stroke_count, snapshot.distance_m,
+              snapshot.stroke_rate, snapshot.power_watts);
+    fdf_bus_publish(FDF_BUS_SNAPSHOT, console_id, &snapshot);
+}
+
+#if CONFIG_FDF_STROKE_HISTORY
+// Bus subscriber: records a stroke when the stroke count moves
+static void snapshot_strokes(void *ctx, fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    fdf_stroke_history_t *history = &((fdf_stroke_history_t *)ctx)[console_id];
+    if (fdf_strokes_update(history, data)) {
+        fdf_stroke_t stroke;
+        fdf_strokes_get(history, fdf_strokes_count(history) - 1, &stroke);
+        FDF_TRACE(FDF_TRACE_STROKE, console_id, stroke.stroke_count, stroke.distance_m,
+                  stroke.power_watts, stroke.pace_500m_ds);
+#if CONFIG_FDF_SESSION_STORE
+        session_archive_add_stroke(console_id, &stroke);
+#endif
+#if CONFIG_FDF_FILTER
+        // Every stroke not filtered yet, as one batch
+        fdf_filter_run(&filters[console_id], history);
+#endif
+    }
+}
+#endif
+
+#if CONFIG_FDF_WORKOUT
+// FTMS Control Point: targets set by the app become the console's workout
+static uint8_t workout_control(uint8_t instance, const uint8_t *data, size_t len)
+{
+    if (instance >= USB_HOST_MAX_CONSOLES) {
+        return FTMS_RESULT_FAILED;
+    }
+    fdf_workout_t *workout = &workouts[instance];
+    fdf_workout_config_t config = { .pieces = 1 };
+    
+    switch (data[0]) {
+        case FTMS_CONTROL_RESET:
+            // Back to free rowing
+            config.type = FDF_WORKOUT_FREE;
+            break;
+        case FTMS_CONTROL_START_OR_RESUME:
+            // A finished workout starts over; a running one goes on
+            portENTER_CRITICAL(&workout_lock);
+            if (workout->phase == FDF_WORKOUT_DONE) {
+                fdf_workout_restart(workout);
+            }
+            portEXIT_CRITICAL(&workout_lock);
+            return FTMS_RESULT_SUCCESS;
+        case FTMS_CONTROL_STOP_OR_PAUSE:
+            // Rowing cannot be paused from here
+            if (len != 2 || data[1] != FTMS_STATUS_PARAM_STOP) {
+                return FTMS_RESULT_INVALID_PARAMETER;
+            }
+            portENTER_CRITICAL(&workout_lock);
+            fdf_workout_stop(workout);
+            portEXIT_CRITICAL(&workout_lock);
+            return FTMS_RESULT_SUCCESS;
+        case FTMS_CONTROL_SET_TARGETED_DISTANCE:
+            if (len != 4) {
+                return FTMS_RESULT_INVALID_PARAMETER;
+            }
+            config.type = FDF_WORKOUT_DISTANCE;
+            config.target = data[1] | (data[2] << 8) | ((uint32_t)data[3] << 16);
+            break;
+        case FTMS_CONTROL_SET_TARGETED_TIME:
+            if (len != 3) {
+                return FTMS_RESULT_INVALID_PARAMETER;
+            }
+            config.type = FDF_WORKOUT_TIME;
+            config.target = data[1] | (data[2] << 8);
+            break;
+        case FTMS_CONTROL_SET_INTERVALS:
+            if (len != FTMS_CONTROL_SET_INTERVALS_LEN || data[1] > 1) {
+                return FTMS_RESULT_INVALID_PARAMETER;
+            }
+            config.type = data[1] == 0 ? FDF_WORKOUT_DISTANCE : FDF_WORKOUT_TIME;
+            config.target = data[2] | (data[3] << 8) | ((uint32_t)data[4] << 16);
+            config.rest_s = data[5] | (data[6] << 8);
+            config.pieces = data[7];
+            break;
+        default:
+            return FTMS_RESULT_NOT_SUPPORTED;
+    }
+    
+    portENTER_CRITICAL(&workout_lock);
+    bool valid = fdf_workout_set(workout, &config);
+    portEXIT_CRITICAL(&workout_lock);
+    return valid ? FTMS_RESULT_SUCCESS : FTMS_RESULT_INVALID_PARAMETER;
+}
+#endif
+
+// Bus subscriber: forwards snapshots to the console's FTMS instance
+static void snapshot_to_ftms(void *ctx, fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    fdf_rowing_data_t snapshot = *data;
+#if CONFIG_FDF_FILTER
+    // Apps get the filtered values, stored strokes keep the raw ones
+    fdf_filter_apply(&filters[console_id], &snapshot);
+#endif
+    
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+    // Correct the interpolation; what the apps already saw does not go back
+    fdf_metrics_summary_t summary;
+    fdf_metrics_get_summary(&metrics[console_id], &summary);
+    xSemaphoreTake(interp_mutex, portMAX_DELAY);
+    fdf_interp_update(&interp[console_id], &snapshot, summary.speed_mm_s);
+    fdf_interp_get(&interp[console_id], snapshot.timestamp_us, &snapshot);
+    ble_ftms_update_instance(console_id, &snapshot);
+    xSemaphoreGive(interp_mutex);
+#else
+    ble_ftms_update_instance(console_id, &snapshot);
+#endif
+    
+    // Let the BLE link follow the console's real update rate, or the
+    // interpolation rate when that is faster
+    fdf_cadence_t cadence;
+    if (fdf_parser_get_cadence(&parsers[console_id], &cadence)) {
+        uint32_t interval_us = cadence.interval_us;
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+        if (interval_us > INTERP_PERIOD_MS * 1000) {
+            interval_us = INTERP_PERIOD_MS * 1000;
+        }
+#endif
+        ble_ftms_set_update_interval(console_id, interval_us);
+    }
+}
+
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+// Sends interpolated snapshots between console updates
+static void interp_task(void *arg)
+{
+    while (1) {
+        // Interpolates for a console and a central only
+        xEventGroupWaitBits(activity, ACTIVITY_CONSOLE | ACTIVITY_CENTRAL, pdFALSE, pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(INTERP_PERIOD_MS));
+        
+        int64_t now_us = esp_timer_get_time();
+        for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+            xSemaphoreTake(interp_mutex, portMAX_DELAY);
+            
+            // Skip consoles that went away or just sent an update of their own
+            fdf_rowing_data_t snapshot;
+            if (console_present(i) &&
+                now_us - interp[i].base.timestamp_us >= INTERP_PERIOD_MS * 1000 / 2 &&
+                fdf_interp_get(&interp[i], now_us, &snapshot)) {
+                ble_ftms_update_instance(i, &snapshot);
+            }
+            xSemaphoreGive(interp_mutex);
+        }
+    }
+}
+#endif
+
+#if CONFIG_FDF_TRACE
+// Prints the data path trace at low priority
+static void trace_print_task(void *arg)
+{
+    fdf_trace_record_t record;
+    char line[128];
+    uint32_t reported_lost = 0;
+    
+    while (1) {
+        // Records are written on the data path; once idle, the last ones were printed
+        xEventGroupWaitBits(activity, ACTIVITY_CONSOLE | ACTIVITY_CENTRAL, pdFALSE, pdFALSE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_FDF_TRACE_PRINT_PERIOD_MS));
+        
+        while (fdf_trace_read(&record)) {
+            fdf_trace_format(&record, line, sizeof(line));
+            ESP_LOGI(TAG, "%s", line);
+        }
+        
+        uint32_t lost = fdf_trace_lost();
+        if (lost != reported_lost) {
+            ESP_LOGW(TAG, "%" PRIu32 " trace records lost", lost - reported_lost);
+            reported_lost = lost;
+        }
+    }
+}
+#endif
+
+#if CONFIG_FDF_SYNTH_CONSOLE
+static void synth_chunk_ready(const uint8_t *data, size_t length, int64_t timestamp_us, void *ctx)
+{
+    const usb_rx_chunk_t chunk = {
+        .console_id = CONFIG_FDF_SYNTH_CONSOLE_ID,
+        .timestamp_us = timestamp_us,
+        .data = data,
+        .length = length,
+    };
+    usb_data_received(&chunk);
+}
+
+// Feeds a simulated session into the bridge at the configured line rate
+static void synth_console_task(void *arg)
+{
+    static fdf_synth_t synth;
+    fdf_synth_config_t config;
+    
+    fdf_synth_default_config(&config);
+    config.seed = (uint32_t)esp_timer_get_time() | 1;
+    config.malformed_permille = CONFIG_FDF_SYNTH_MALFORMED_PERMILLE;
+    fdf_synth_init(&synth, &config);
+    
+    ESP_LOGI(TAG, "Synthetic console on slot %d: %d lines/s, %d byte chunks",
+             CONFIG_FDF_SYNTH_CONSOLE_ID, CONFIG_FDF_SYNTH_LINE_RATE_HZ, CONFIG_FDF_SYNTH_CHUNK_SIZE);
+    
+    int64_t start_us = esp_timer_get_time();
+    uint64_t lines_sent = 0;
+    while (1) {
+        // Generate every line that is due by now, so rates above the tick rate work too
+        int64_t now_us = esp_timer_get_time();
+        uint64_t due = (uint64_t)(now_us - start_us) * CONFIG_FDF_SYNTH_LINE_RATE_HZ / 1000000 + 1;
+        if (due > lines_sent) {
+            lines_sent += fdf_synth_emit(&synth, (uint32_t)(due - lines_sent),
+                                         CONFIG_FDF_SYNTH_CHUNK_SIZE, now_us, 0,
+                                         synth_chunk_ready, NULL);
+        }
+        vTaskDelay(1);
+    }
+}
+#endif
+
+// USB host hook: a console was opened on a slot and starts from scratch; called by the
+// USB host task before the device delivers data, so the data path cannot run meanwhile
+static void console_reset(uint8_t console_id)
+{
+    if (console_id >= USB_HOST_MAX_CONSOLES) {
+        return;
+    }
+    fdf_parser_reset_session(&parsers[console_id]);
+    fdf_bus_reset_console(console_id);
+    fdf_metrics_init(&metrics[console_id]);
+#if CONFIG_FDF_STROKE_HISTORY
+    fdf_strokes_init(&strokes[console_id], strokes[console_id].records, CONFIG_FDF_STROKE_HISTORY_STROKES);
+#endif
+#if CONFIG_FDF_FILTER
+    fdf_filter_init(&filters[console_id], CONFIG_FDF_FILTER_MEDIAN, CONFIG_FDF_FILTER_EMA_PERCENT);
+#endif
+#if CONFIG_FDF_WORKOUT
+    // The workout was set for the previous rower
+    portENTER_CRITICAL(&workout_lock);
+    fdf_workout_init(&workouts[console_id]);
+    portEXIT_CRITICAL(&workout_lock);
+#endif
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+    xSemaphoreTake(interp_mutex, portMAX_DELAY);
+    fdf_interp_init(&interp[console_id]);
+    xSemaphoreGive(interp_mutex);
+#endif
+#if CONFIG_FDF_WATCHDOG
+    portENTER_CRITICAL(&watchdog_lock);
+    fdf_watchdog_disarm(&watchdogs[console_id]);
+    portEXIT_CRITICAL(&watchdog_lock);
+    recovery_due[console_id] = FDF_RECOVERY_NONE;
+    ble_ftms_set_stale(console_id, false);
+#endif
+}
+
+// Supervisor hook: wakes or idles the periodic tasks
+static void activity_changed(uint8_t consoles, uint8_t centrals)
 {
-    ESP_LOGD(TAG, "Received %d bytes from USB", length);
-    fdf_protocol_process_data(data, length);
+    EventBits_t bits = (consoles > 0 ? ACTIVITY_CONSOLE : 0) | (centrals > 0 ? ACTIVITY_CENTRAL : 0);
+#if CONFIG_FDF_SYNTH_CONSOLE
+    bits |= ACTIVITY_CONSOLE;
+#endif
+    xEventGroupClearBits(activity, ~bits & (ACTIVITY_CONSOLE | ACTIVITY_CENTRAL));
+    xEventGroupSetBits(activity, bits);
 }
 
-// Global callback to bridge protocol data to FTMS
-static void fdf_data_updated(const fdf_rowing_data_t *data)
+// Supervisor hook: a console stopped answering its polls, or stopped sending
+static void console_stalled(uint8_t console_id)
 {
-    ESP_LOGI(TAG, "Rowing data updated - Strokes: %" PRIu16 ", Distance: %" PRIu32 " m, Rate: %" PRIu16 " spm, Power: %" PRIu16 " W", 
-             data->stroke_count, data->distance_m, data->stroke_rate, data->power_watts);
+    if (console_id >= USB_HOST_MAX_CONSOLES) {
+        return;
+    }
+    fdf_recovery_step_t step = FDF_RECOVERY_POLL;
     
-    ble_ftms_update_data(data);
+#if CONFIG_FDF_WATCHDOG
+    // A console that went away is silent for good: stop watching it until the next one opens
+    if (!console_present(console_id)) {
+        portENTER_CRITICAL(&watchdog_lock);
+        fdf_watchdog_disarm(&watchdogs[console_id]);
+        portEXIT_CRITICAL(&watchdog_lock);
+        recovery_due[console_id] = FDF_RECOVERY_NONE;
+        return;
+    }
+    
+    // Stalls found by the watchdog come with the step to take, poll timeouts do not
+    if (recovery_due[console_id] != FDF_RECOVERY_NONE) {
+        step = recovery_due[console_id];
+        recovery_due[console_id] = FDF_RECOVERY_NONE;
+        ESP_LOGW(TAG, "[%d] Console stalled, recovery: %s", console_id, fdf_watchdog_step_name(step));
+        
+        // A line may have ended the stall since; whichever clears last wins
+        ble_ftms_set_stale(console_id, true);
+        if (!fdf_watchdog_is_stalled(&watchdogs[console_id])) {
+            ble_ftms_set_stale(console_id, false);
+        }
+    }
+#endif
+    
+    switch (step) {
+        case FDF_RECOVERY_POLL:
+#if CONFIG_FDF_CONSOLE_POLL_ENABLE
+            // An extra request right away, ahead of the scheduled ones
+            usb_host_send_data(console_id, (const uint8_t *)poll_request, sizeof(poll_request) - 1);
+#endif
+            break;
+        case FDF_RECOVERY_TOGGLE_DTR:
+            usb_host_toggle_dtr(console_id);
+            break;
+        case FDF_RECOVERY_REOPEN:
+            usb_host_reopen_console(console_id);
+            break;
+        default:
+            break;
+    }
+}
+
+// Brings up the USB host while Bluetooth starts, then exits
+static void usb_init_task(void *arg)
+{
+    usb_host_register_open_callback(console_reset);
+    esp_err_t usb_ret = usb_host_init(usb_data_received);
+    if (usb_ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize USB host: %s", esp_err_to_name(usb_ret));
+        vTaskDelete(NULL);
+        return;
+    }
+
+#if CONFIG_FDF_CONSOLE_POLL_ENABLE
+    // Request status periodically from consoles that do not stream
+    const usb_poll_config_t poll_config = {
+        .request = (const uint8_t *)poll_request,
+        .request_len = sizeof(poll_request) - 1,
+        .rate_hz = CONFIG_FDF_CONSOLE_POLL_RATE_HZ,
+        .max_in_flight = CONFIG_FDF_CONSOLE_POLL_MAX_IN_FLIGHT,
+        .response_timeout_ms = CONFIG_FDF_CONSOLE_POLL_TIMEOUT_MS,
+    };
+    usb_ret = usb_host_start_polling(&poll_config);
+    if (usb_ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start console polling: %s", esp_err_to_name(usb_ret));
+    }
+#endif
+
+    fdf_boot_mark(FDF_BOOT_USB_HOST);
+    vTaskDelete(NULL);
 }
 
+// Applies the settings that take effect at once; the others are read where used
+static void config_changed(const fdf_config_t *config)
+{
+    esp_log_level_set("*", (esp_log_level_t)config->log_level);
+}
+
+#if CONFIG_FDF_SESSION_STORE
+// Opens the session store, which scans the whole partition, then exits
+static void storage_init_task(void *arg)
+{
+    // Keep sessions on flash, whatever happens to the BLE link
+    if (session_archive_start()) {
+        fdf_boot_mark(FDF_BOOT_STORAGE);
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
 void app_main(void)
 {
+    fdf_boot_init();
     ESP_LOGI(TAG, "FDF Bluetooth Bridge starting...");
 
     // Initialize NVS
@@ -40,45 +606,198 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    fdf_boot_mark(FDF_BOOT_NVS);
+    
+    // Settings stored over the build defaults, before anything reads them
+    fdf_config_init(fdf_config_nvs_storage());
+    fdf_config_t config;
+    fdf_config_read(&config);
+    config_changed(&config);
+    fdf_config_register_listener(config_changed);
 
-    // Initialize FDF protocol parser
-    if (!fdf_protocol_init()) {
-        ESP_LOGE(TAG, "Failed to initialize FDF protocol parser");
-        return;
+#if CONFIG_FDF_POWER_MANAGEMENT
+    // Before the stages start taking their PM locks
+    fdf_power_init();
+#endif
+
+    // React to state changes posted by the USB host and the FTMS service
+    activity = xEventGroupCreateStatic(&activity_buffer);
+    activity_changed(0, 0);
+    const fdf_supervisor_hooks_t supervisor_hooks = {
+        .console_stalled = console_stalled,
+        .activity_changed = activity_changed,
+    };
+    fdf_supervisor_start(&supervisor_hooks);
+
+#if CONFIG_FDF_TRACE
+    static StaticTask_t trace_task_buffer;
+    static StackType_t trace_task_stack[TRACE_TASK_STACK_SIZE];
+    xTaskCreateStatic(trace_print_task, "trace_print", TRACE_TASK_STACK_SIZE, NULL,
+                      tskIDLE_PRIORITY + 1, trace_task_stack, &trace_task_buffer);
+#endif
+
+#if CONFIG_FDF_SESSION_RECORDER
+    // Capture the raw console stream for later replay
+    session_recorder_start(CONFIG_FDF_SESSION_RECORDER_SIZE_KB * 1024);
+#endif
+
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+    interp_mutex = xSemaphoreCreateMutexStatic(&interp_mutex_buffer);
+#endif
+
+#if CONFIG_FDF_STROKE_HISTORY
+    // One arena for all consoles; hours of strokes only fit in PSRAM
+    fdf_stroke_t *stroke_arena = heap_caps_malloc(sizeof(fdf_stroke_t) * CONFIG_FDF_STROKE_HISTORY_STROKES *
+                                                  USB_HOST_MAX_CONSOLES, MALLOC_CAP_SPIRAM);
+    if (stroke_arena == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the stroke history in PSRAM, strokes are not recorded");
     }
-    fdf_protocol_register_callback(fdf_data_updated);
+#endif
 
-    // Initialize Bluetooth FTMS service
+    // Initialize one FDF protocol parser per console
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        fdf_parser_init(&parsers[i], i);
+        fdf_metrics_init(&metrics[i]);
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+        fdf_interp_init(&interp[i]);
+#endif
+#if CONFIG_FDF_WORKOUT
+        fdf_workout_init(&workouts[i]);
+#endif
+#if CONFIG_FDF_STROKE_HISTORY
+        fdf_strokes_init(&strokes[i], stroke_arena != NULL ?
+                         stroke_arena + i * CONFIG_FDF_STROKE_HISTORY_STROKES : NULL,
+                         CONFIG_FDF_STROKE_HISTORY_STROKES);
+#endif
+#if CONFIG_FDF_FILTER
+        fdf_filter_init(&filters[i], CONFIG_FDF_FILTER_MEDIAN, CONFIG_FDF_FILTER_EMA_PERCENT);
+#endif
+        fdf_parser_register_callback(&parsers[i], fdf_bus_parser_callback);
+    }
+
+    // Stages consuming the parsed lines, called in this order
+    const fdf_bus_subscription_t subscriptions[] = {
+        { .name = "link", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_LINE), .handler = line_received },
+        { .name = "metrics", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_UPDATE), .handler = update_received,
+          .ctx = metrics },
+#if CONFIG_FDF_STROKE_HISTORY
+        { .name = "strokes", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_SNAPSHOT),
+          .fields = FDF_FIELD_STROKE_COUNT | FDF_FIELD_DISTANCE, .handler = snapshot_strokes, .ctx = strokes },
+#endif
+        { .name = "ftms", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_SNAPSHOT), .handler = snapshot_to_ftms },
+    };
+    for (size_t i = 0; i < sizeof(subscriptions) / sizeof(subscriptions[0]); i++) {
+        fdf_bus_subscribe(&subscriptions[i]);
+    }
+
+#if CONFIG_FDF_WATCHDOG
+    // Stale data is flagged and recovered from as soon as it is overdue
+    const fdf_watchdog_config_t watchdog_config = {
+        .factor = CONFIG_FDF_WATCHDOG_FACTOR,
+        .min_timeout_ms = CONFIG_FDF_WATCHDOG_MIN_MS,
+        .max_timeout_ms = CONFIG_FDF_WATCHDOG_MAX_MS,
+        .retry_ms = CONFIG_FDF_WATCHDOG_RETRY_MS,
+    };
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        fdf_watchdog_init(&watchdogs[i], &watchdog_config);
+    }
+    const esp_timer_create_args_t watchdog_timer_args = {
+        .callback = watchdog_timer_callback,
+        .name = "fdf_watchdog",
+    };
+    if (esp_timer_create(&watchdog_timer_args, &watchdog_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the watchdog timer, stalls are not detected");
+        watchdog_timer_scheduled = true;
+    }
+#endif
+
+    // Storage and USB come up on their own tasks while Bluetooth starts here,
+    // the longest part of the way to advertising
+#if CONFIG_FDF_SESSION_STORE
+    static StaticTask_t storage_init_task_buffer;
+    static StackType_t storage_init_task_stack[STORAGE_INIT_TASK_STACK_SIZE];
+    xTaskCreateStatic(storage_init_task, "storage_init", STORAGE_INIT_TASK_STACK_SIZE, NULL,
+                      tskIDLE_PRIORITY + 1, storage_init_task_stack, &storage_init_task_buffer);
+#else
+    fdf_boot_mark(FDF_BOOT_STORAGE);
+#endif
+    static StaticTask_t usb_init_task_buffer;
+    static StackType_t usb_init_task_stack[USB_INIT_TASK_STACK_SIZE];
+    xTaskCreateStatic(usb_init_task, "usb_init", USB_INIT_TASK_STACK_SIZE, NULL, 2,
+                      usb_init_task_stack, &usb_init_task_buffer);
+
+#if CONFIG_FDF_SESSION_EXPORT
+    // Stored sessions are exported by the archive task, which owns the store
+    ble_ftms_register_export_callback(session_archive_export_command);
+#endif
+#if CONFIG_FDF_WORKOUT
+    ble_ftms_register_control_callback(workout_control);
+#endif
+
+    // Initialize Bluetooth FTMS service; advertising starts on its own once
+    // the services are registered
     if (!ble_ftms_init()) {
         ESP_LOGE(TAG, "Failed to initialize Bluetooth FTMS service");
         return;
     }
+    fdf_boot_mark(FDF_BOOT_BLE_STACK);
 
-    // Initialize USB host
-    esp_err_t usb_ret = usb_host_init(usb_data_received);
-    if (usb_ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize USB host: %s", esp_err_to_name(usb_ret));
-        return;
+#if CONFIG_FDF_INTERP_RATE_HZ > 0
+    static StaticTask_t interp_task_buffer;
+    static StackType_t interp_task_stack[INTERP_TASK_STACK_SIZE];
+    xTaskCreateStatic(interp_task, "fdf_interp", INTERP_TASK_STACK_SIZE, NULL, 4,
+                      interp_task_stack, &interp_task_buffer);
+#endif
+
+#if CONFIG_FDF_SYNTH_CONSOLE
+    if (CONFIG_FDF_SYNTH_CONSOLE_ID < USB_HOST_MAX_CONSOLES) {
+        static StaticTask_t synth_task_buffer;
+        static StackType_t synth_task_stack[SYNTH_TASK_STACK_SIZE];
+        xTaskCreateStatic(synth_console_task, "synth_console", SYNTH_TASK_STACK_SIZE, NULL, 5,
+                          synth_task_stack, &synth_task_buffer);
+    } else {
+        ESP_LOGE(TAG, "Synthetic console slot %d out of range", CONFIG_FDF_SYNTH_CONSOLE_ID);
     }
+#endif
 
-    ESP_LOGI(TAG, "FDF Bluetooth Bridge initialized successfully");
-    ESP_LOGI(TAG, "Connect your FDF console via USB and pair with 'FDF Rower' device");
+    // Wait for the subsystems started in parallel
+    const uint32_t ready = FDF_BOOT_BIT(FDF_BOOT_ADVERTISING) | FDF_BOOT_BIT(FDF_BOOT_USB_HOST) |
+                           FDF_BOOT_BIT(FDF_BOOT_STORAGE);
+    if (fdf_boot_wait(ready, BOOT_TIMEOUT_MS)) {
+        ESP_LOGI(TAG, "FDF Bluetooth Bridge initialized successfully");
+    } else {
+        ESP_LOGW(TAG, "FDF Bluetooth Bridge partly initialized after %d ms", BOOT_TIMEOUT_MS);
+    }
+    fdf_boot_report();
+    fdf_config_read(&config);
+    ESP_LOGI(TAG, "Connect your FDF console via USB and pair with '%s' device", config.device_name);
 
-    // Start advertising
-    ble_ftms_start_advertising();
+#if CONFIG_FDF_DIAG_CONSOLE
+    // Counters and task statistics on the UART, on demand
+#if CONFIG_FDF_WATCHDOG
+    fdf_diag_start(parsers, watchdogs, USB_HOST_MAX_CONSOLES);
+#else
+    fdf_diag_start(parsers, NULL, USB_HOST_MAX_CONSOLES);
+#endif
+#endif
 
-    // Main loop - monitor system status
+    // Connections and stalls are handled by the supervisor as they happen
+#if CONFIG_FDF_HEAP_AUDIT
+    // Everything is allocated, count what the steady state allocates
+    heap_audit_start();
+    fdf_supervisor_stats_t sup_stats;
+    fdf_supervisor_get_stats(&sup_stats);
+    uint32_t connects = sup_stats.events[FDF_SUP_BLE_CONNECTED];
+    bool was_connected = true;
     while (1) {
-        // Check USB connection status
-        if (!usb_host_is_connected()) {
-            ESP_LOGW(TAG, "FDF console disconnected");
-        }
-
-        // Check Bluetooth connection status
-        if (!ble_ftms_is_connected()) {
-            ESP_LOGW(TAG, "No Bluetooth clients connected");
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(5000)); // Check every 5 seconds
+        // Strict only for a window no central was connected in, not even briefly
+        fdf_supervisor_get_stats(&sup_stats);
+        bool connected = sup_stats.centrals > 0 || sup_stats.events[FDF_SUP_BLE_CONNECTED] != connects;
+        heap_audit_check(updates_forwarded, !connected && !was_connected);
+        was_connected = sup_stats.centrals > 0;
+        connects = sup_stats.events[FDF_SUP_BLE_CONNECTED];
+        heap_audit_report_watermarks();
+        vTaskDelay(pdMS_TO_TICKS(5000));
     }
+#endif
 }
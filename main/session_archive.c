@@ -0,0 +1,296 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+
+#include "session_archive.h"
+#include "session_store.h"
+#include "session_export.h"
+#include "ble_ftms.h"
+#include "fdf_trace.h"
+
+static const char *TAG = "SESSION_ARCHIVE";
+
+#define ARCHIVE_QUEUE_LENGTH 32
+#define ARCHIVE_TASK_STACK_SIZE 3072
+
+#define FLUSH_PERIOD_US ((int64_t)CONFIG_FDF_SESSION_STORE_FLUSH_S * 1000000)
+#define IDLE_TIMEOUT_US ((int64_t)CONFIG_FDF_SESSION_STORE_IDLE_S * 1000000)
+
+// Export packets sent per wake-up before the queue is looked at again
+#define EXPORT_BURST 8
+
+// Wait before retrying a packet the stack did not take
+#define EXPORT_RETRY_MS 5
+
+typedef enum {
+    ARCHIVE_STROKE,
+    ARCHIVE_EXPORT_COMMAND,
+} archive_item_type_t;
+
+typedef struct {
+    uint8_t type;                 // archive_item_type_t
+    uint8_t console_id;
+    union {
+        fdf_stroke_t stroke;
+        struct {
+            uint16_t conn_id;
+            uint8_t len;
+            uint8_t data[SESSION_EXPORT_MAX_COMMAND];
+        } command;
+    };
+} archive_item_t;
+
+static session_store_t store;
+static QueueHandle_t queue = NULL;
+static uint32_t dropped = 0;
+
+#if CONFIG_FDF_SESSION_EXPORT
+static session_export_t exporter;
+static uint16_t export_conn_id;
+static int64_t export_start_us;
+static uint8_t export_packet[BLE_FTMS_MAX_EXPORT_PAYLOAD];
+static size_t export_pending = 0;   // Length of a packet the stack did not take yet
+#endif
+
+static bool partition_read(void *ctx, uint32_t offset, void *data, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, data, len) == ESP_OK;
+}
+
+static bool partition_write(void *ctx, uint32_t offset, const void *data, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, data, len) == ESP_OK;
+}
+
+static bool partition_erase_page(void *ctx, uint32_t offset)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, SESSION_STORE_PAGE_SIZE) == ESP_OK;
+}
+
+#if CONFIG_FDF_SESSION_EXPORT
+static void export_finish(const char *reason)
+{
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - export_start_us) / 1000);
+    uint32_t kbps = ms > 0 ? (uint32_t)((uint64_t)exporter.bytes * 1000 / 1024 / ms) : 0;
+    ESP_LOGI(TAG, "Export %s: %" PRIu32 " bytes in %" PRIu32 " packets, %" PRIu32 " ms (%" PRIu32 " KB/s)",
+             reason, exporter.bytes, exporter.packets, ms, kbps);
+    FDF_TRACE(FDF_TRACE_EXPORT, 0, exporter.bytes, exporter.packets, ms, kbps);
+    exporter.active = false;
+    export_pending = 0;
+}
+
+static void export_command(const archive_item_t *item)
+{
+    const uint8_t *data = item->command.data;
+    bool was_active = exporter.active;
+    if (data[0] == SESSION_EXPORT_OP_START) {
+        if (was_active) {
+            export_finish("restarted");
+        }
+        // Include what was recorded so far
+        session_store_flush(&store);
+    }
+
+    if (!session_export_command(&exporter, data, item->command.len)) {
+        ESP_LOGW(TAG, "Invalid export command 0x%02x (%d bytes)", data[0], item->command.len);
+        return;
+    }
+
+    if (data[0] == SESSION_EXPORT_OP_START) {
+        export_conn_id = item->command.conn_id;
+        export_start_us = esp_timer_get_time();
+        export_pending = 0;
+        ESP_LOGI(TAG, "Export to conn %d from position %" PRIu32, export_conn_id, exporter.position);
+    } else if (data[0] == SESSION_EXPORT_OP_STOP && was_active) {
+        export_finish("stopped");
+    }
+}
+
+// Send export packets while the client has credits and the stack takes them
+static void export_pump(void)
+{
+    for (int i = 0; i < EXPORT_BURST && exporter.active; i++) {
+        size_t max_len = ble_ftms_export_payload_len(export_conn_id);
+        if (max_len == 0) {
+            export_finish("interrupted");
+            return;
+        }
+        if (max_len > sizeof(export_packet)) {
+            max_len = sizeof(export_packet);
+        }
+
+        if (export_pending == 0) {
+            export_pending = session_export_next(&exporter, &store, export_packet, max_len);
+            if (export_pending == 0) {
+                return;
+            }
+        }
+        if (!ble_ftms_send_export(export_conn_id, export_packet, export_pending)) {
+            return;
+        }
+
+        bool last = export_pending == SESSION_EXPORT_HEADER_SIZE;
+        export_pending = 0;
+        if (last) {
+            export_finish("done");
+        }
+    }
+}
+
+// How long the task may sleep: short while packets are waiting to go out
+static TickType_t export_wait(TickType_t wait)
+{
+    if (!exporter.active) {
+        return wait;
+    }
+    if (export_pending != 0) {
+        return pdMS_TO_TICKS(EXPORT_RETRY_MS);
+    }
+    if (exporter.credits > 0 && !exporter.finished) {
+        return 1;
+    }
+    return pdMS_TO_TICKS(1000);
+}
+#endif
+
+// Owns the store: appends queued strokes, flushes, ends idle sessions and
+// serves exports
+static void archive_task(void *arg)
+{
+    int64_t last_stroke_us[SESSION_STORE_MAX_CONSOLES] = {0};
+    int64_t last_flush_us = esp_timer_get_time();
+    uint32_t reported_dropped = 0;
+
+    while (1) {
+        // Nothing to end or flush without an open session: sleep until a stroke or command
+        bool open = false;
+        for (uint8_t c = 0; c < SESSION_STORE_MAX_CONSOLES; c++) {
+            open |= store.sessions[c].open;
+        }
+        TickType_t wait = open ? pdMS_TO_TICKS(1000) : portMAX_DELAY;
+#if CONFIG_FDF_SESSION_EXPORT
+        wait = export_wait(wait);
+#endif
+        archive_item_t item;
+        if (xQueueReceive(queue, &item, wait) == pdTRUE) {
+            if (item.type == ARCHIVE_STROKE && item.console_id < SESSION_STORE_MAX_CONSOLES) {
+                session_store_add_stroke(&store, item.console_id, &item.stroke);
+                last_stroke_us[item.console_id] = esp_timer_get_time();
+            }
+#if CONFIG_FDF_SESSION_EXPORT
+            if (item.type == ARCHIVE_EXPORT_COMMAND) {
+                export_command(&item);
+            }
+#endif
+        }
+#if CONFIG_FDF_SESSION_EXPORT
+        export_pump();
+#endif
+        int64_t now = esp_timer_get_time();
+
+        // A console that stopped rowing ended its session; write it out now
+        bool ended = false;
+        for (uint8_t c = 0; c < SESSION_STORE_MAX_CONSOLES; c++) {
+            if (store.sessions[c].open && now - last_stroke_us[c] >= IDLE_TIMEOUT_US) {
+                ESP_LOGI(TAG, "[%d] Session %" PRIu32 " ended: %" PRIu32 " strokes, %" PRIu32 " m",
+                         c, store.sessions[c].session_id, store.sessions[c].strokes,
+                         store.sessions[c].distance_m);
+                session_store_end_session(&store, c);
+                ended = true;
+            }
+        }
+
+        if (ended || now - last_flush_us >= FLUSH_PERIOD_US) {
+            session_store_flush(&store);
+            last_flush_us = now;
+        }
+
+        if (dropped != reported_dropped) {
+            ESP_LOGW(TAG, "%" PRIu32 " strokes dropped, the archive queue was full", dropped - reported_dropped);
+            reported_dropped = dropped;
+        }
+    }
+}
+
+bool session_archive_start(void)
+{
+    if (queue != NULL) {
+        return true;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                CONFIG_FDF_SESSION_STORE_PARTITION);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No '%s' partition, sessions are not stored", CONFIG_FDF_SESSION_STORE_PARTITION);
+        return false;
+    }
+
+    const session_store_flash_t flash = {
+        .read = partition_read,
+        .write = partition_write,
+        .erase_page = partition_erase_page,
+        .ctx = (void *)partition,
+        .size = partition->size - partition->size % SESSION_STORE_PAGE_SIZE,
+    };
+    if (!session_store_open(&store, &flash)) {
+        ESP_LOGE(TAG, "Failed to open the session store");
+        return false;
+    }
+
+    static StaticQueue_t queue_buffer;
+    static uint8_t queue_storage[ARCHIVE_QUEUE_LENGTH * sizeof(archive_item_t)];
+    queue = xQueueCreateStatic(ARCHIVE_QUEUE_LENGTH, sizeof(archive_item_t), queue_storage, &queue_buffer);
+
+    static StaticTask_t task_buffer;
+    static StackType_t task_stack[ARCHIVE_TASK_STACK_SIZE];
+    xTaskCreateStatic(archive_task, "session_archive", ARCHIVE_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1,
+                      task_stack, &task_buffer);
+
+    ESP_LOGI(TAG, "Session store on '%s': %" PRIu32 " of %" PRIu32 " KB used, next session %" PRIu32,
+             partition->label, session_store_used(&store) / 1024, flash.size / 1024, store.next_session_id);
+    return true;
+}
+
+void session_archive_add_stroke(uint8_t console_id, const fdf_stroke_t *stroke)
+{
+    if (queue == NULL) {
+        return;
+    }
+
+    archive_item_t item = {
+        .type = ARCHIVE_STROKE,
+        .console_id = console_id,
+        .stroke = *stroke,
+    };
+    if (xQueueSend(queue, &item, 0) != pdTRUE) {
+        dropped++;
+    }
+}
+
+#if CONFIG_FDF_SESSION_EXPORT
+void session_archive_export_command(uint16_t conn_id, const uint8_t *data, size_t len)
+{
+    if (queue == NULL || len == 0 || len > SESSION_EXPORT_MAX_COMMAND) {
+        return;
+    }
+
+    archive_item_t item = {
+        .type = ARCHIVE_EXPORT_COMMAND,
+        .command = {
+            .conn_id = conn_id,
+            .len = (uint8_t)len,
+        },
+    };
+    memcpy(item.command.data, data, len);
+
+    // Controls are rare; wait a little rather than lose one
+    if (xQueueSend(queue, &item, pdMS_TO_TICKS(10)) != pdTRUE) {
+        ESP_LOGW(TAG, "Export command 0x%02x dropped, the archive queue was full", data[0]);
+    }
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef SESSION_ARCHIVE_H
+#define SESSION_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdf_strokes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Open the session store partition and start the archive task
+ *
+ * Strokes are handed to a low-priority task that appends them to the
+ * store (see session_store.h), flushes every CONFIG_FDF_SESSION_STORE_FLUSH_S
+ * seconds and ends the session of a console that stopped rowing for
+ * CONFIG_FDF_SESSION_STORE_IDLE_S seconds.
+ *
+ * @return true if the archive is running
+ */
+bool session_archive_start(void);
+
+/**
+ * @brief Archive a stroke
+ *
+ * Cheap enough for the USB receive path: one non-blocking queue send.
+ * Strokes that do not fit in the queue are counted as dropped.
+ *
+ * @param console_id Console the stroke belongs to
+ * @param stroke Stroke from the console's fdf_strokes history
+ */
+void session_archive_add_stroke(uint8_t console_id, const fdf_stroke_t *stroke);
+
+/**
+ * @brief Hand a write of the session export control point to the archive task
+ *
+ * The archive task owns the store, so it also streams the export (see
+ * session_export.h), flushing pending records at START. Matches
+ * ble_ftms_export_callback_t.
+ *
+ * @param conn_id Connection of the central
+ * @param data Written bytes
+ * @param len Number of bytes
+ */
+void session_archive_export_command(uint16_t conn_id, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_ARCHIVE_H
@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include "session_export.h"
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+void session_export_init(session_export_t *exporter)
+{
+    memset(exporter, 0, sizeof(session_export_t));
+}
+
+bool session_export_command(session_export_t *exporter, const uint8_t *data, size_t len)
+{
+    if (len == 0) {
+        return false;
+    }
+
+    switch (data[0]) {
+    case SESSION_EXPORT_OP_START:
+        if (len != 7) {
+            return false;
+        }
+        session_export_init(exporter);
+        exporter->active = true;
+        exporter->position = get_u32(&data[1]);
+        exporter->credits = get_u16(&data[5]);
+        return true;
+
+    case SESSION_EXPORT_OP_CREDIT:
+        if (len != 3 || !exporter->active) {
+            return false;
+        }
+        exporter->credits += get_u16(&data[1]);
+        return true;
+
+    case SESSION_EXPORT_OP_STOP:
+        exporter->active = false;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+size_t session_export_next(session_export_t *exporter, const session_store_t *store,
+                           uint8_t *packet, size_t max_len)
+{
+    if (!exporter->active || exporter->finished || exporter->credits == 0 ||
+        max_len <= SESSION_EXPORT_HEADER_SIZE) {
+        return 0;
+    }
+
+    // Load the block holding the position once the current one is sent
+    if (exporter->block_len == 0 ||
+        exporter->position >= exporter->block_position + exporter->block_len) {
+        uint32_t position = exporter->position;
+        if (!session_store_find_block(store, &position, exporter->block, &exporter->block_len)) {
+            exporter->block_len = 0;
+        } else {
+            exporter->block_position = position;
+            if (exporter->position < position) {
+                exporter->position = position;
+            }
+        }
+    }
+
+    size_t len = 0;
+    if (exporter->block_len != 0) {
+        len = exporter->block_position + exporter->block_len - exporter->position;
+        if (len > max_len - SESSION_EXPORT_HEADER_SIZE) {
+            len = max_len - SESSION_EXPORT_HEADER_SIZE;
+        }
+        memcpy(&packet[SESSION_EXPORT_HEADER_SIZE],
+               &exporter->block[exporter->position - exporter->block_position], len);
+    } else {
+        exporter->finished = true;
+    }
+
+    packet[0] = (uint8_t)exporter->position;
+    packet[1] = (uint8_t)(exporter->position >> 8);
+    packet[2] = (uint8_t)(exporter->position >> 16);
+    packet[3] = (uint8_t)(exporter->position >> 24);
+    exporter->position += (uint32_t)len;
+    exporter->bytes += (uint32_t)len;
+    exporter->packets++;
+    exporter->credits--;
+    return SESSION_EXPORT_HEADER_SIZE + len;
+}
@@ -0,0 +1,91 @@
+#ifndef SESSION_EXPORT_H
+#define SESSION_EXPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "session_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bulk export of the session store
+ *
+ * Streams the stored blocks, oldest first, as they are on flash: each block
+ * carries its own CRC-32 and decodes on its own (see session_store.h).
+ *
+ * Control point writes (little endian):
+ *   START  0x01 | stream position (4 bytes) | credits (2 bytes)
+ *          start or resume at a position, 0 for the oldest block
+ *   CREDIT 0x02 | credits (2 bytes)
+ *          allow that many more packets
+ *   STOP   0x03
+ *
+ * Data packets:
+ *   stream position of the first byte (4 bytes) | stream bytes
+ *
+ * A packet without stream bytes ends the export. Positions jump at page
+ * boundaries and past erased pages. A client resumes after an interruption
+ * with START at the position following the last whole block it received.
+ * Credits let it bound what is in flight, so packets are notifications
+ * without confirmation and controls are writes without response.
+ */
+
+#define SESSION_EXPORT_OP_START 0x01
+#define SESSION_EXPORT_OP_CREDIT 0x02
+#define SESSION_EXPORT_OP_STOP 0x03
+
+// Longest control point write
+#define SESSION_EXPORT_MAX_COMMAND 7
+
+// Position header of a data packet
+#define SESSION_EXPORT_HEADER_SIZE 4
+
+// Export state
+typedef struct {
+    bool active;
+    bool finished;                // The end packet was produced
+    uint32_t credits;             // Packets the client still accepts
+    uint32_t position;            // Next stream position to send
+    uint8_t block[SESSION_STORE_MAX_BLOCK];
+    uint32_t block_position;      // Stream position of block[0]
+    uint16_t block_len;           // 0 until a block is loaded
+    uint32_t bytes;               // Stream bytes produced since START
+    uint32_t packets;
+} session_export_t;
+
+/**
+ * @brief Initialize an idle exporter
+ * @param exporter Exporter to initialize
+ */
+void session_export_init(session_export_t *exporter);
+
+/**
+ * @brief Apply a control point write
+ * @param exporter Exporter
+ * @param data Written bytes
+ * @param len Number of bytes
+ * @return true if the command was valid
+ */
+bool session_export_command(session_export_t *exporter, const uint8_t *data, size_t len);
+
+/**
+ * @brief Produce the next data packet, if the client has credits left
+ * @param exporter Exporter
+ * @param store Store to read
+ * @param packet Filled with the packet
+ * @param max_len Largest packet the link takes (ATT MTU - 3), at least
+ *                SESSION_EXPORT_HEADER_SIZE + 1
+ * @return Packet length, 0 if there is nothing to send
+ */
+size_t session_export_next(session_export_t *exporter, const session_store_t *store,
+                           uint8_t *packet, size_t max_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_EXPORT_H
@@ -0,0 +1,169 @@
+#include <string.h>
+
+#include "fdf_port.h"
+#include "session_log.h"
+
+static const char *TAG = "SESSION_LOG";
+
+// Encode an unsigned LEB128 varint, returns bytes written
+static size_t put_varint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Decode an unsigned LEB128 varint, returns bytes consumed or 0 if truncated
+static size_t get_varint(const uint8_t *in, size_t avail, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t n = 0; n < avail && n < 10; n++) {
+        result |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+bool session_log_writer_init(session_log_writer_t *writer, session_log_sink_t sink, void *ctx)
+{
+    memset(writer, 0, sizeof(session_log_writer_t));
+    writer->sink = sink;
+    writer->sink_ctx = ctx;
+
+    const uint8_t header[SESSION_LOG_HEADER_SIZE] = {
+        'F', 'D', 'F', 'R', SESSION_LOG_VERSION, 0, 0, 0
+    };
+    if (!sink(header, sizeof(header), NULL, 0, ctx)) {
+        ESP_LOGE(TAG, "Failed to write log header");
+        return false;
+    }
+    writer->bytes = sizeof(header);
+    return true;
+}
+
+bool session_log_write_chunk(session_log_writer_t *writer, uint8_t console_id,
+                             int64_t timestamp_us, const uint8_t *data, size_t length)
+{
+    uint8_t head[SESSION_LOG_RECORD_OVERHEAD];
+    size_t head_len = 0;
+
+    // The first record starts the log's time base
+    int64_t delta = writer->started ? timestamp_us - writer->last_timestamp_us : 0;
+    if (delta < 0) {
+        delta = 0;
+    }
+
+    head[head_len++] = console_id;
+    head_len += put_varint(&head[head_len], (uint64_t)delta);
+    head_len += put_varint(&head[head_len], (uint64_t)length);
+
+    if (!writer->sink(head, head_len, data, length, writer->sink_ctx)) {
+        writer->dropped++;
+        return false;
+    }
+
+    writer->started = true;
+    writer->last_timestamp_us = timestamp_us;
+    writer->chunks++;
+    writer->bytes += head_len + length;
+    return true;
+}
+
+bool session_log_buffer_sink(const uint8_t *head, size_t head_len,
+                             const uint8_t *data, size_t len, void *ctx)
+{
+    session_log_buffer_t *buf = (session_log_buffer_t *)ctx;
+    if (buf->size - buf->used < head_len + len) {
+        return false;
+    }
+    memcpy(buf->buffer + buf->used, head, head_len);
+    buf->used += head_len;
+    if (len > 0) {
+        memcpy(buf->buffer + buf->used, data, len);
+        buf->used += len;
+    }
+    return true;
+}
+
+bool session_log_reader_open(session_log_reader_t *reader, const uint8_t *log, size_t size)
+{
+    memset(reader, 0, sizeof(session_log_reader_t));
+
+    if (log == NULL || size < SESSION_LOG_HEADER_SIZE ||
+        memcmp(log, SESSION_LOG_MAGIC, 4) != 0 || log[4] != SESSION_LOG_VERSION) {
+        ESP_LOGE(TAG, "Not a session log (version %d expected)", SESSION_LOG_VERSION);
+        return false;
+    }
+
+    reader->log = log;
+    reader->size = size;
+    reader->pos = SESSION_LOG_HEADER_SIZE;
+    return true;
+}
+
+bool session_log_reader_next(session_log_reader_t *reader, session_log_chunk_t *chunk)
+{
+    size_t pos = reader->pos;
+    uint64_t delta, length;
+    size_t n;
+
+    if (pos >= reader->size) {
+        return false;
+    }
+    chunk->console_id = reader->log[pos++];
+
+    n = get_varint(reader->log + pos, reader->size - pos, &delta);
+    if (n == 0) {
+        return false;
+    }
+    pos += n;
+
+    n = get_varint(reader->log + pos, reader->size - pos, &length);
+    if (n == 0 || length > reader->size - pos - n) {
+        ESP_LOGW(TAG, "Truncated record at offset %zu", reader->pos);
+        return false;
+    }
+    pos += n;
+
+    reader->timestamp_us += (int64_t)delta;
+    chunk->timestamp_us = reader->timestamp_us;
+    chunk->data = reader->log + pos;
+    chunk->length = (size_t)length;
+    reader->pos = pos + (size_t)length;
+    return true;
+}
+
+int session_log_replay(const uint8_t *log, size_t size, uint32_t speed,
+                       session_log_replay_cb_t callback, void *ctx)
+{
+    session_log_reader_t reader;
+    session_log_chunk_t chunk;
+    int count = 0;
+
+    if (!session_log_reader_open(&reader, log, size)) {
+        return -1;
+    }
+
+    int64_t start_us = fdf_port_time_us();
+    while (session_log_reader_next(&reader, &chunk)) {
+        if (speed != SESSION_LOG_SPEED_MAX) {
+            // Wait until the chunk's scaled log time has been reached
+            int64_t due_us = start_us + chunk.timestamp_us / speed;
+            int64_t wait_us = due_us - fdf_port_time_us();
+            if (wait_us > 0) {
+                fdf_port_sleep_us(wait_us);
+            }
+        }
+        callback(&chunk, ctx);
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,139 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw console stream log
+ *
+ * Captures the bytes handed to the protocol parser together with their
+ * receive time, so a session can be replayed deterministically.
+ *
+ * Format (all multi-byte integers are LEB128 varints):
+ *   header: "FDFR" | version (1 byte) | reserved (3 bytes)
+ *   record: console_id (1 byte) | delta_us since previous record | length | bytes
+ */
+
+#define SESSION_LOG_MAGIC "FDFR"
+#define SESSION_LOG_VERSION 1
+#define SESSION_LOG_HEADER_SIZE 8
+
+// Worst-case record overhead: console id + two 64-bit varints
+#define SESSION_LOG_RECORD_OVERHEAD 21
+
+// Sink the writer appends to. A record arrives as its head and payload in one
+// call and must be taken whole or not at all; returns true if it was appended.
+typedef bool (*session_log_sink_t)(const uint8_t *head, size_t head_len,
+                                   const uint8_t *data, size_t len, void *ctx);
+
+// Log writer
+typedef struct {
+    session_log_sink_t sink;
+    void *sink_ctx;
+    int64_t last_timestamp_us;    // Timestamp of the previous record
+    bool started;                 // First record written
+    uint32_t chunks;              // Records written
+    uint32_t dropped;             // Records the sink did not accept
+    uint64_t bytes;               // Log bytes written, header included
+} session_log_writer_t;
+
+// Fixed-size memory sink for session_log_writer_init()
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t used;
+} session_log_buffer_t;
+
+// Log reader
+typedef struct {
+    const uint8_t *log;
+    size_t size;
+    size_t pos;
+    int64_t timestamp_us;         // Timestamp of the last record returned
+} session_log_reader_t;
+
+// One recorded chunk
+typedef struct {
+    uint8_t console_id;
+    int64_t timestamp_us;         // Relative to the first record of the log
+    const uint8_t *data;          // Points into the log buffer
+    size_t length;
+} session_log_chunk_t;
+
+// Replay speed selecting "as fast as possible"
+#define SESSION_LOG_SPEED_MAX 0
+
+// Called for every replayed chunk
+typedef void (*session_log_replay_cb_t)(const session_log_chunk_t *chunk, void *ctx);
+
+/**
+ * @brief Start a log on a sink, writing the header
+ * @param writer Writer to initialize
+ * @param sink Function appending bytes to the log
+ * @param ctx Context passed to the sink
+ * @return true if the header was written
+ */
+bool session_log_writer_init(session_log_writer_t *writer, session_log_sink_t sink, void *ctx);
+
+/**
+ * @brief Append a received chunk to the log
+ *
+ * Records are written whole or not at all; a record the sink cannot take
+ * is counted in writer->dropped.
+ *
+ * @param writer Writer
+ * @param console_id Console the chunk came from
+ * @param timestamp_us Receive time of the chunk
+ * @param data Received bytes
+ * @param length Number of bytes
+ * @return true if the record was written
+ */
+bool session_log_write_chunk(session_log_writer_t *writer, uint8_t console_id,
+                             int64_t timestamp_us, const uint8_t *data, size_t length);
+
+/**
+ * @brief Sink appending to a fixed memory buffer (ctx is a session_log_buffer_t)
+ */
+bool session_log_buffer_sink(const uint8_t *head, size_t head_len,
+                             const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Open a log for reading
+ * @param reader Reader to initialize
+ * @param log Log bytes
+ * @param size Log size
+ * @return true if the header is valid
+ */
+bool session_log_reader_open(session_log_reader_t *reader, const uint8_t *log, size_t size);
+
+/**
+ * @brief Read the next chunk of a log
+ * @param reader Reader
+ * @param chunk Filled with the next chunk
+ * @return true if a chunk was read, false at end of log or on a truncated record
+ */
+bool session_log_reader_next(session_log_reader_t *reader, session_log_chunk_t *chunk);
+
+/**
+ * @brief Replay a log, pacing chunks by their recorded timestamps
+ * @param log Log bytes
+ * @param size Log size
+ * @param speed Playback speed multiplier (1 = real time), or SESSION_LOG_SPEED_MAX
+ * @param callback Function receiving every chunk
+ * @param ctx Context passed to the callback
+ * @return Number of chunks replayed, or -1 if the log is invalid
+ */
+int session_log_replay(const uint8_t *log, size_t size, uint32_t speed,
+                       session_log_replay_cb_t callback, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_LOG_H
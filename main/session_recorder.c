@@ -0,0 +1,72 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "session_recorder.h"
+
+static const char *TAG = "RECORDER";
+
+static session_log_buffer_t log_buffer = {0};
+static session_log_writer_t writer = {0};
+static bool recording = false;
+
+bool session_recorder_start(size_t size)
+{
+    if (recording) {
+        return true;
+    }
+    
+    // Prefer PSRAM, the log can be large
+    uint8_t *buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buffer == NULL) {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    if (buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte recording buffer", size);
+        return false;
+    }
+    
+    log_buffer.buffer = buffer;
+    log_buffer.size = size;
+    log_buffer.used = 0;
+    
+    if (!session_log_writer_init(&writer, session_log_buffer_sink, &log_buffer)) {
+        heap_caps_free(buffer);
+        log_buffer.buffer = NULL;
+        return false;
+    }
+    
+    recording = true;
+    ESP_LOGI(TAG, "Recording raw console stream into %zu byte buffer", size);
+    return true;
+}
+
+void session_recorder_add(uint8_t console_id, int64_t timestamp_us, const uint8_t *data, size_t length)
+{
+    if (!recording) {
+        return;
+    }
+    
+    if (!session_log_write_chunk(&writer, console_id, timestamp_us, data, length) &&
+        writer.dropped == 1) {
+        ESP_LOGW(TAG, "Recording buffer full, further chunks are dropped");
+    }
+}
+
+bool session_recorder_get(const uint8_t **log, size_t *size)
+{
+    if (!recording || log == NULL || size == NULL) {
+        return false;
+    }
+    
+    *log = log_buffer.buffer;
+    *size = log_buffer.used;
+    return true;
+}
+
+void session_recorder_get_stats(session_log_writer_t *stats)
+{
+    if (stats != NULL) {
+        memcpy(stats, &writer, sizeof(session_log_writer_t));
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "session_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocate the recording buffer (PSRAM if available) and start a log
+ * @param size Buffer size in bytes
+ * @return true if recording started
+ */
+bool session_recorder_start(size_t size);
+
+/**
+ * @brief Record a chunk received from a console
+ *
+ * Cheap enough for the USB receive path: one varint encode and one copy.
+ * Chunks that no longer fit are counted as dropped.
+ *
+ * @param console_id Console the chunk came from
+ * @param timestamp_us Receive time of the chunk
+ * @param data Received bytes
+ * @param length Number of bytes
+ */
+void session_recorder_add(uint8_t console_id, int64_t timestamp_us, const uint8_t *data, size_t length);
+
+/**
+ * @brief Get the recorded log
+ *
+ * Recording goes on: the first *size bytes do not change, but the last
+ * record may still be incomplete.
+ *
+ * @param log Filled with a pointer to the log bytes
+ * @param size Filled with the log size
+ * @return true if a recording exists
+ */
+bool session_recorder_get(const uint8_t **log, size_t *size);
+
+/**
+ * @brief Get recorder statistics
+ * @param stats Filled with a copy of the log writer state
+ */
+void session_recorder_get_stats(session_log_writer_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_RECORDER_H
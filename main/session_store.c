@@ -0,0 +1,607 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "fdf_port.h"
+#include "session_store.h"
+
+static const char *TAG = "SESSION_STORE";
+
+#define PAGE_MAGIC 0x53464446     // "FDFS"
+#define BLOCK_MAGIC 0xB10C
+#define ERASED_U16 0xFFFF
+
+// Stroke fields, in the order of the stroke record bitmap
+#define STROKE_FIELDS 7
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t seq_inv;
+    uint32_t reserved;
+} page_header_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t length;
+    uint32_t crc;
+} block_header_t;
+
+_Static_assert(sizeof(page_header_t) == SESSION_STORE_PAGE_HEADER_SIZE, "page header layout");
+_Static_assert(sizeof(block_header_t) == SESSION_STORE_BLOCK_HEADER_SIZE, "block header layout");
+
+static uint32_t align4(uint32_t value)
+{
+    return (value + 3) & ~3u;
+}
+
+// CRC-32 (IEEE 802.3), bitwise: blocks are written seldom and read at boot
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Encode an unsigned LEB128 varint, returns bytes written
+static size_t put_varint(uint8_t *out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Decode an unsigned LEB128 varint, returns bytes consumed or 0 if truncated
+static size_t get_varint(const uint8_t *in, size_t avail, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (size_t n = 0; n < avail && n < 5; n++) {
+        result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t zigzag(int64_t value)
+{
+    return (uint32_t)(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static int64_t unzigzag(uint32_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void stroke_to_fields(const fdf_stroke_t *stroke, uint32_t fields[STROKE_FIELDS])
+{
+    fields[0] = stroke->elapsed_ms;
+    fields[1] = stroke->stroke_count;
+    fields[2] = stroke->distance_m;
+    fields[3] = stroke->power_watts;
+    fields[4] = stroke->stroke_rate;
+    fields[5] = stroke->pace_500m_ds;
+    fields[6] = stroke->present;
+}
+
+static void fields_to_stroke(const uint32_t fields[STROKE_FIELDS], fdf_stroke_t *stroke)
+{
+    stroke->elapsed_ms = fields[0];
+    stroke->stroke_count = (uint16_t)fields[1];
+    stroke->distance_m = (uint16_t)fields[2];
+    stroke->power_watts = (uint16_t)fields[3];
+    stroke->stroke_rate = (uint16_t)fields[4];
+    stroke->pace_500m_ds = (uint16_t)fields[5];
+    stroke->present = (uint16_t)fields[6];
+}
+
+static bool read_page_header(const session_store_t *store, uint32_t page, uint32_t *seq)
+{
+    page_header_t header;
+    if (!store->flash.read(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE, &header, sizeof(header))) {
+        return false;
+    }
+    if (header.magic != PAGE_MAGIC || header.seq != ~header.seq_inv) {
+        return false;
+    }
+    *seq = header.seq;
+    return true;
+}
+
+// Read the block at offset in page; false at the end of the page's valid blocks
+static bool read_block(const session_store_t *store, uint32_t page, uint32_t offset,
+                       uint8_t *payload, uint16_t *length, bool *torn)
+{
+    *torn = false;
+    if (offset + SESSION_STORE_BLOCK_HEADER_SIZE > SESSION_STORE_PAGE_SIZE) {
+        return false;
+    }
+
+    uint32_t address = page * SESSION_STORE_PAGE_SIZE + offset;
+    block_header_t header;
+    if (!store->flash.read(store->flash.ctx, address, &header, sizeof(header))) {
+        *torn = true;
+        return false;
+    }
+    if (header.magic == ERASED_U16 && header.length == ERASED_U16) {
+        return false;
+    }
+    if (header.magic != BLOCK_MAGIC || header.length == 0 || header.length > SESSION_STORE_MAX_PAYLOAD ||
+        offset + SESSION_STORE_BLOCK_HEADER_SIZE + header.length > SESSION_STORE_PAGE_SIZE) {
+        *torn = true;
+        return false;
+    }
+    if (!store->flash.read(store->flash.ctx, address + SESSION_STORE_BLOCK_HEADER_SIZE, payload, header.length) ||
+        crc32(payload, header.length) != header.crc) {
+        *torn = true;
+        return false;
+    }
+    *length = header.length;
+    return true;
+}
+
+// Read a block header at offset in page, without checking the payload
+static bool read_block_header(const session_store_t *store, uint32_t page, uint32_t offset,
+                              block_header_t *header)
+{
+    if (offset + SESSION_STORE_BLOCK_HEADER_SIZE > SESSION_STORE_PAGE_SIZE ||
+        !store->flash.read(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE + offset, header, sizeof(*header))) {
+        return false;
+    }
+    return header->magic == BLOCK_MAGIC && header->length > 0 && header->length <= SESSION_STORE_MAX_PAYLOAD &&
+           offset + SESSION_STORE_BLOCK_HEADER_SIZE + header->length <= SESSION_STORE_PAGE_SIZE;
+}
+
+// Whether the page is erased from offset to its end
+static bool page_erased_from(const session_store_t *store, uint32_t page, uint32_t offset)
+{
+    uint8_t chunk[64];
+    while (offset < SESSION_STORE_PAGE_SIZE) {
+        size_t len = SESSION_STORE_PAGE_SIZE - offset < sizeof(chunk) ? SESSION_STORE_PAGE_SIZE - offset :
+                                                                        sizeof(chunk);
+        if (!store->flash.read(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE + offset, chunk, len)) {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if (chunk[i] != 0xFF) {
+                return false;
+            }
+        }
+        offset += len;
+    }
+    return true;
+}
+
+static bool start_page(session_store_t *store, uint32_t page, uint32_t seq)
+{
+    store->page = page;
+    store->page_seq = seq;
+    store->offset = SESSION_STORE_PAGE_SIZE;
+
+    const page_header_t header = {
+        .magic = PAGE_MAGIC,
+        .seq = seq,
+        .seq_inv = ~seq,
+        .reserved = 0xFFFFFFFF,
+    };
+    if (!store->flash.erase_page(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE) ||
+        !store->flash.write(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE, &header, sizeof(header))) {
+        ESP_LOGE(TAG, "Failed to start page %" PRIu32, page);
+        store->write_errors++;
+        return false;
+    }
+    store->pages_erased++;
+    store->offset = SESSION_STORE_PAGE_HEADER_SIZE;
+    return true;
+}
+
+static bool next_page(session_store_t *store)
+{
+    return start_page(store, (store->page + 1) % store->pages, store->page_seq + 1);
+}
+
+// Whether the pending block has room for one more record
+static bool record_fits(const session_store_t *store)
+{
+    return store->offset + align4(SESSION_STORE_BLOCK_HEADER_SIZE + store->pending +
+                                  SESSION_STORE_MAX_RECORD) <= SESSION_STORE_PAGE_SIZE;
+}
+
+static bool make_room(session_store_t *store)
+{
+    if (!record_fits(store) && !session_store_flush(store)) {
+        return false;
+    }
+    return record_fits(store) || next_page(store);
+}
+
+static void append_record(session_store_t *store, const uint8_t *record, size_t len)
+{
+    memcpy(&store->block[store->pending], record, len);
+    store->pending += (uint16_t)len;
+}
+
+static bool put_start(session_store_t *store, uint8_t console_id, uint32_t session_id)
+{
+    if (!make_room(store)) {
+        return false;
+    }
+    uint8_t record[SESSION_STORE_MAX_RECORD];
+    size_t len = 0;
+    record[len++] = SESSION_STORE_START | (console_id << 4);
+    len += put_varint(&record[len], session_id);
+    append_record(store, record, len);
+    return true;
+}
+
+bool session_store_open(session_store_t *store, const session_store_flash_t *flash)
+{
+    memset(store, 0, sizeof(session_store_t));
+    store->flash = *flash;
+    store->pages = flash->size / SESSION_STORE_PAGE_SIZE;
+    store->next_session_id = 1;
+    if (store->pages < 2) {
+        ESP_LOGE(TAG, "Store of %" PRIu32 " bytes is too small", flash->size);
+        return false;
+    }
+
+    // Resume on the newest page
+    bool found = false;
+    for (uint32_t page = 0; page < store->pages; page++) {
+        uint32_t seq;
+        if (read_page_header(store, page, &seq) && (!found || seq > store->page_seq)) {
+            store->page = page;
+            store->page_seq = seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        ESP_LOGI(TAG, "Formatting %" PRIu32 " pages", store->pages);
+        return start_page(store, 0, 1);
+    }
+
+    // After its last valid block, unless a torn write left it dirty
+    uint32_t offset = SESSION_STORE_PAGE_HEADER_SIZE;
+    uint16_t length;
+    bool torn;
+    while (read_block(store, store->page, offset, store->block, &length, &torn)) {
+        offset += align4(SESSION_STORE_BLOCK_HEADER_SIZE + length);
+    }
+    store->offset = offset;
+    if (torn || !page_erased_from(store, store->page, offset)) {
+        ESP_LOGW(TAG, "Page %" PRIu32 " ends in a torn block at %" PRIu32, store->page, offset);
+        store->offset = SESSION_STORE_PAGE_SIZE;
+    }
+
+    // Continue the session ids
+    static session_store_reader_t reader;
+    session_store_record_t record;
+    session_store_reader_init(&reader, store);
+    while (session_store_reader_next(&reader, &record)) {
+        if (record.session_id >= store->next_session_id) {
+            store->next_session_id = record.session_id + 1;
+        }
+    }
+    return true;
+}
+
+bool session_store_add_stroke(session_store_t *store, uint8_t console_id, const fdf_stroke_t *stroke)
+{
+    if (console_id >= SESSION_STORE_MAX_CONSOLES) {
+        return false;
+    }
+    session_store_session_t *session = &store->sessions[console_id];
+
+    // A stroke count that went back belongs to a new session
+    if (session->open && stroke->stroke_count <= session->last.stroke_count) {
+        session_store_end_session(store, console_id);
+    }
+    if (!session->open) {
+        if (!put_start(store, console_id, store->next_session_id)) {
+            return false;
+        }
+        memset(session, 0, sizeof(session_store_session_t));
+        session->open = true;
+        session->session_id = store->next_session_id++;
+    }
+
+    if (!make_room(store)) {
+        return false;
+    }
+
+    // Deltas from the previous stroke of this console in the pending block
+    uint32_t fields[STROKE_FIELDS];
+    uint32_t base[STROKE_FIELDS];
+    stroke_to_fields(stroke, fields);
+    stroke_to_fields(&store->base[console_id], base);
+
+    uint8_t record[SESSION_STORE_MAX_RECORD];
+    size_t len = 0;
+    record[len++] = SESSION_STORE_STROKE | (console_id << 4);
+    uint8_t *changed = &record[len++];
+    *changed = 0;
+    for (int i = 0; i < STROKE_FIELDS; i++) {
+        if (fields[i] != base[i]) {
+            *changed |= 1 << i;
+            len += put_varint(&record[len], zigzag((int64_t)fields[i] - (int64_t)base[i]));
+        }
+    }
+    append_record(store, record, len);
+    store->base[console_id] = *stroke;
+
+    session->last = *stroke;
+    session->distance_m += stroke->distance_m;
+    session->strokes++;
+    return true;
+}
+
+bool session_store_end_session(session_store_t *store, uint8_t console_id)
+{
+    if (console_id >= SESSION_STORE_MAX_CONSOLES || !store->sessions[console_id].open) {
+        return true;
+    }
+    session_store_session_t *session = &store->sessions[console_id];
+    session->open = false;
+
+    if (!make_room(store)) {
+        return false;
+    }
+    uint8_t record[SESSION_STORE_MAX_RECORD];
+    size_t len = 0;
+    record[len++] = SESSION_STORE_END | (console_id << 4);
+    len += put_varint(&record[len], session->session_id);
+    len += put_varint(&record[len], session->last.elapsed_ms);
+    len += put_varint(&record[len], session->distance_m);
+    len += put_varint(&record[len], session->strokes);
+    append_record(store, record, len);
+    return true;
+}
+
+bool session_store_flush(session_store_t *store)
+{
+    if (store->pending == 0) {
+        return true;
+    }
+    if (store->offset >= SESSION_STORE_PAGE_SIZE && !next_page(store)) {
+        return false;
+    }
+
+    // Payload first: a block is only valid once its header is written
+    uint32_t offset = store->offset;
+    uint32_t address = store->page * SESSION_STORE_PAGE_SIZE + offset;
+    const block_header_t header = {
+        .magic = BLOCK_MAGIC,
+        .length = store->pending,
+        .crc = crc32(store->block, store->pending),
+    };
+    bool written = store->flash.write(store->flash.ctx, address + SESSION_STORE_BLOCK_HEADER_SIZE,
+                                      store->block, store->pending) &&
+                   store->flash.write(store->flash.ctx, address, &header, sizeof(header));
+
+    store->offset += align4(SESSION_STORE_BLOCK_HEADER_SIZE + store->pending);
+    store->pending = 0;
+    memset(store->base, 0, sizeof(store->base));
+    if (!written) {
+        ESP_LOGE(TAG, "Failed to write block at page %" PRIu32 " offset %" PRIu32, store->page, offset);
+        store->write_errors++;
+        store->offset = SESSION_STORE_PAGE_SIZE;
+        return false;
+    }
+    store->blocks_written++;
+
+    // Leave a page that cannot take another block
+    if (!record_fits(store)) {
+        store->offset = SESSION_STORE_PAGE_SIZE;
+    }
+    return true;
+}
+
+uint32_t session_store_used(const session_store_t *store)
+{
+    uint32_t used = 0;
+    for (uint32_t page = 0; page < store->pages; page++) {
+        uint32_t seq;
+        if (page == store->page) {
+            used += store->offset;
+        } else if (read_page_header(store, page, &seq)) {
+            used += SESSION_STORE_PAGE_SIZE;
+        }
+    }
+    return used;
+}
+
+bool session_store_find_block(const session_store_t *store, uint32_t *position,
+                              uint8_t *block, uint16_t *length)
+{
+    uint32_t seq = *position / SESSION_STORE_PAGE_SIZE;
+    uint32_t offset = *position % SESSION_STORE_PAGE_SIZE;
+
+    // Positions on erased pages continue with the oldest page
+    uint32_t oldest_seq = store->page_seq >= store->pages ? store->page_seq - store->pages + 1 : 1;
+    if (seq < oldest_seq) {
+        seq = oldest_seq;
+        offset = 0;
+    }
+
+    for (; seq <= store->page_seq; seq++, offset = 0) {
+        uint32_t page = (store->page + store->pages - (store->page_seq - seq)) % store->pages;
+        uint32_t page_seq;
+        if (!read_page_header(store, page, &page_seq) || page_seq != seq) {
+            continue;
+        }
+
+        // Walk the headers up to the block ending after offset
+        uint32_t block_offset = SESSION_STORE_PAGE_HEADER_SIZE;
+        block_header_t header;
+        while (read_block_header(store, page, block_offset, &header)) {
+            uint32_t size = align4(SESSION_STORE_BLOCK_HEADER_SIZE + header.length);
+            if (block_offset + size <= offset) {
+                block_offset += size;
+                continue;
+            }
+            if (!store->flash.read(store->flash.ctx, page * SESSION_STORE_PAGE_SIZE + block_offset,
+                                   block, SESSION_STORE_BLOCK_HEADER_SIZE + header.length) ||
+                crc32(&block[SESSION_STORE_BLOCK_HEADER_SIZE], header.length) != header.crc) {
+                break;
+            }
+            memset(&block[SESSION_STORE_BLOCK_HEADER_SIZE + header.length], 0xFF,
+                   size - SESSION_STORE_BLOCK_HEADER_SIZE - header.length);
+            *position = seq * SESSION_STORE_PAGE_SIZE + block_offset;
+            *length = (uint16_t)size;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool session_store_check_block(const uint8_t *block, size_t len, uint16_t *length)
+{
+    block_header_t header;
+    if (len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, block, sizeof(header));
+    if (header.magic != BLOCK_MAGIC || header.length == 0 || header.length > SESSION_STORE_MAX_PAYLOAD ||
+        len < SESSION_STORE_BLOCK_HEADER_SIZE + (size_t)header.length ||
+        crc32(&block[SESSION_STORE_BLOCK_HEADER_SIZE], header.length) != header.crc) {
+        return false;
+    }
+    *length = (uint16_t)align4(SESSION_STORE_BLOCK_HEADER_SIZE + header.length);
+    return true;
+}
+
+void session_store_reader_init(session_store_reader_t *reader, const session_store_t *store)
+{
+    memset(reader, 0, sizeof(session_store_reader_t));
+    reader->store = store;
+    reader->pages_left = store->pages;
+    reader->page = (store->page + 1) % store->pages;
+}
+
+// Load the next valid block, crossing pages oldest to newest
+static bool next_block(session_store_reader_t *reader)
+{
+    const session_store_t *store = reader->store;
+
+    while (true) {
+        if (reader->offset == 0) {
+            uint32_t seq;
+            if (reader->pages_left == 0) {
+                return false;
+            }
+            reader->pages_left--;
+            if (!read_page_header(store, reader->page, &seq)) {
+                reader->page = (reader->page + 1) % store->pages;
+                continue;
+            }
+            reader->offset = SESSION_STORE_PAGE_HEADER_SIZE;
+        }
+
+        bool torn;
+        if (read_block(store, reader->page, reader->offset, reader->block, &reader->block_len, &torn)) {
+            reader->offset += align4(SESSION_STORE_BLOCK_HEADER_SIZE + reader->block_len);
+            reader->pos = 0;
+            memset(reader->base, 0, sizeof(reader->base));
+            return true;
+        }
+        if (torn) {
+            reader->corrupt_blocks++;
+        }
+        reader->page = (reader->page + 1) % store->pages;
+        reader->offset = 0;
+    }
+}
+
+// Decode the record at the reader's position
+static bool decode_record(session_store_reader_t *reader, session_store_record_t *record)
+{
+    const uint8_t *in = reader->block;
+    size_t pos = reader->pos;
+    size_t end = reader->block_len;
+    size_t n;
+
+    memset(record, 0, sizeof(session_store_record_t));
+    record->type = (session_store_record_type_t)(in[pos] & 0x0F);
+    record->console_id = in[pos] >> 4;
+    pos++;
+    uint8_t console_id = record->console_id;
+
+    switch (record->type) {
+    case SESSION_STORE_START:
+        if ((n = get_varint(&in[pos], end - pos, &record->session_id)) == 0) {
+            return false;
+        }
+        pos += n;
+        reader->session_ids[console_id] = record->session_id;
+        break;
+
+    case SESSION_STORE_STROKE: {
+        if (pos >= end) {
+            return false;
+        }
+        uint8_t changed = in[pos++];
+        uint32_t fields[STROKE_FIELDS];
+        stroke_to_fields(&reader->base[console_id], fields);
+        for (int i = 0; i < STROKE_FIELDS; i++) {
+            uint32_t delta;
+            if (changed & (1 << i)) {
+                if ((n = get_varint(&in[pos], end - pos, &delta)) == 0) {
+                    return false;
+                }
+                pos += n;
+                fields[i] = (uint32_t)((int64_t)fields[i] + unzigzag(delta));
+            }
+        }
+        fields_to_stroke(fields, &record->stroke);
+        reader->base[console_id] = record->stroke;
+        record->session_id = reader->session_ids[console_id];
+        break;
+    }
+
+    case SESSION_STORE_END: {
+        uint32_t *values[] = {&record->session_id, &record->elapsed_ms, &record->distance_m, &record->strokes};
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            if ((n = get_varint(&in[pos], end - pos, values[i])) == 0) {
+                return false;
+            }
+            pos += n;
+        }
+        reader->session_ids[console_id] = 0;
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    reader->pos = (uint16_t)pos;
+    return true;
+}
+
+bool session_store_reader_next(session_store_reader_t *reader, session_store_record_t *record)
+{
+    while (true) {
+        if (reader->pos < reader->block_len) {
+            if (decode_record(reader, record)) {
+                return true;
+            }
+            // A CRC-checked block that does not decode: skip the rest of it
+            reader->corrupt_blocks++;
+            reader->block_len = 0;
+            continue;
+        }
+        if (!next_block(reader)) {
+            return false;
+        }
+    }
+}
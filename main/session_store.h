@@ -0,0 +1,217 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdf_strokes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Session store
+ *
+ * Append-only storage of sessions, stroke by stroke, on a flash region
+ * used as a ring of erase pages.
+ *
+ * Format (all multi-byte integers are little endian unless LEB128 varints):
+ *   page:   "FDFS" | seq (4 bytes) | ~seq (4 bytes) | reserved (4 bytes) | blocks
+ *   block:  magic (2 bytes) | payload length (2 bytes) | CRC-32 of payload (4 bytes)
+ *           | payload, padded to 4 bytes
+ *   record: type | console_id << 4 (1 byte) | fields
+ *     start:  session id
+ *     stroke: bitmap of changed fields (1 byte) | zigzag varint delta per changed
+ *             field, in fdf_stroke_t order
+ *     end:    session id | elapsed ms | distance m | strokes
+ *
+ * Records are collected in RAM and written as one block when the page has
+ * no room for the next record, or on session_store_flush(). Each block
+ * starts its deltas from zero, so blocks decode on their own. Erased flash
+ * reads 0xFF, so blocks are appended to the erased end of a page without
+ * erasing; a page is erased only when the ring wraps onto it, dropping the
+ * oldest sessions.
+ *
+ * Crash safety: a block only counts once its CRC matches. After a reset the
+ * store resumes after the last valid block; a torn block ends its page and
+ * writing resumes on the next one. Records not yet flushed are lost.
+ *
+ * Stream positions address stored bytes across wrap-arounds:
+ * page seq * SESSION_STORE_PAGE_SIZE + offset within the page. They only
+ * grow, so a position stays valid until its page is erased.
+ */
+
+#define SESSION_STORE_PAGE_SIZE 4096
+#define SESSION_STORE_PAGE_HEADER_SIZE 16
+#define SESSION_STORE_BLOCK_HEADER_SIZE 8
+
+// Largest block payload: a page holding a single block
+#define SESSION_STORE_MAX_PAYLOAD (SESSION_STORE_PAGE_SIZE - SESSION_STORE_PAGE_HEADER_SIZE - \
+                                   SESSION_STORE_BLOCK_HEADER_SIZE)
+
+// Largest block, header and padding included
+#define SESSION_STORE_MAX_BLOCK (SESSION_STORE_PAGE_SIZE - SESSION_STORE_PAGE_HEADER_SIZE)
+
+// Worst-case record: header, bitmap and seven 32-bit varints
+#define SESSION_STORE_MAX_RECORD 37
+
+// Consoles with a session of their own (console ids fit in 4 bits)
+#define SESSION_STORE_MAX_CONSOLES 16
+
+// Flash region the store lives on; offsets are relative to its start
+typedef struct {
+    bool (*read)(void *ctx, uint32_t offset, void *data, size_t len);
+    bool (*write)(void *ctx, uint32_t offset, const void *data, size_t len);
+    bool (*erase_page)(void *ctx, uint32_t offset);
+    void *ctx;
+    uint32_t size;                // Region size, a multiple of SESSION_STORE_PAGE_SIZE
+} session_store_flash_t;
+
+typedef enum {
+    SESSION_STORE_START = 1,      // A console started a session
+    SESSION_STORE_STROKE,         // A stroke of the console's session
+    SESSION_STORE_END,            // The session ended, with its totals
+} session_store_record_type_t;
+
+// One decoded record
+typedef struct {
+    session_store_record_type_t type;
+    uint8_t console_id;
+    uint32_t session_id;          // 0 for strokes whose start record was overwritten
+    fdf_stroke_t stroke;          // SESSION_STORE_STROKE
+    uint32_t elapsed_ms;          // SESSION_STORE_END totals
+    uint32_t distance_m;
+    uint32_t strokes;
+} session_store_record_t;
+
+// Session in progress on a console
+typedef struct {
+    bool open;
+    uint32_t session_id;
+    fdf_stroke_t last;            // Last stroke written
+    uint32_t distance_m;          // Distance since the session started
+    uint32_t strokes;             // Strokes written in this session
+} session_store_session_t;
+
+// Store state
+typedef struct {
+    session_store_flash_t flash;
+    uint32_t pages;
+    uint32_t page;                // Page being written
+    uint32_t page_seq;            // Sequence number of that page
+    uint32_t offset;              // Next block offset within that page
+    uint32_t next_session_id;
+    session_store_session_t sessions[SESSION_STORE_MAX_CONSOLES];
+    fdf_stroke_t base[SESSION_STORE_MAX_CONSOLES];  // Delta bases of the pending block
+    uint16_t pending;             // Payload bytes of the pending block
+    uint8_t block[SESSION_STORE_MAX_PAYLOAD];
+    uint32_t blocks_written;
+    uint32_t pages_erased;
+    uint32_t write_errors;
+} session_store_t;
+
+// Reader over the records of a store, oldest first
+typedef struct {
+    const session_store_t *store;
+    uint32_t pages_left;          // Pages not yet entered
+    uint32_t page;
+    uint32_t offset;              // Next block offset within page
+    uint8_t block[SESSION_STORE_MAX_PAYLOAD];
+    uint16_t block_len;
+    uint16_t pos;                 // Next record within block
+    fdf_stroke_t base[SESSION_STORE_MAX_CONSOLES];
+    uint32_t session_ids[SESSION_STORE_MAX_CONSOLES];
+    uint32_t corrupt_blocks;
+} session_store_reader_t;
+
+/**
+ * @brief Open a store, resuming after its last valid block
+ *
+ * A region without a valid page is formatted. The session id counter
+ * continues from the highest id found.
+ *
+ * @param store Store to open
+ * @param flash Flash region of the store
+ * @return true if the store is ready
+ */
+bool session_store_open(session_store_t *store, const session_store_flash_t *flash);
+
+/**
+ * @brief Append a stroke to the console's session
+ *
+ * Opens a session if the console has none, or ends it and opens a new one
+ * when the stroke count went back. Only buffers in RAM unless the current
+ * page is full.
+ *
+ * @param store Store
+ * @param console_id Console the stroke belongs to
+ * @param stroke Stroke from the console's fdf_strokes history
+ * @return true if the stroke was taken
+ */
+bool session_store_add_stroke(session_store_t *store, uint8_t console_id, const fdf_stroke_t *stroke);
+
+/**
+ * @brief End the console's session with its totals, if one is open
+ * @param store Store
+ * @param console_id Console whose session ended
+ * @return true if no session was open or the end record was taken
+ */
+bool session_store_end_session(session_store_t *store, uint8_t console_id);
+
+/**
+ * @brief Write the pending records to flash as one block
+ * @param store Store
+ * @return true if nothing was pending or the block was written
+ */
+bool session_store_flush(session_store_t *store);
+
+/**
+ * @brief Bytes of the region still holding records, pending ones excluded
+ * @param store Store
+ * @return Bytes used
+ */
+uint32_t session_store_used(const session_store_t *store);
+
+/**
+ * @brief Find the block holding a stream position, or the first one after it
+ * @param store Store
+ * @param position Position to look for; set to the position of the block found
+ * @param block Filled with the block as stored, header and padding included
+ *              (SESSION_STORE_MAX_BLOCK bytes)
+ * @param length Filled with the block length
+ * @return true if a block was found, false past the newest block
+ */
+bool session_store_find_block(const session_store_t *store, uint32_t *position,
+                              uint8_t *block, uint16_t *length);
+
+/**
+ * @brief Check a block as returned by session_store_find_block()
+ * @param block Block bytes, header first
+ * @param len Bytes available
+ * @param length Filled with the block length, header and padding included
+ * @return true if a whole block with a matching CRC is there
+ */
+bool session_store_check_block(const uint8_t *block, size_t len, uint16_t *length);
+
+/**
+ * @brief Start reading a store from its oldest record
+ * @param reader Reader to initialize
+ * @param store Store to read; flush it first to include pending records
+ */
+void session_store_reader_init(session_store_reader_t *reader, const session_store_t *store);
+
+/**
+ * @brief Read the next record
+ * @param reader Reader
+ * @param record Filled with the record
+ * @return true if a record was read, false after the newest one
+ */
+bool session_store_reader_next(session_store_reader_t *reader, session_store_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_STORE_H
@@ -0,0 +1,300 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ble_ftms.h"
+#include "fdf_sim.h"
+#include "session_export.h"
+#include "fdf_boot.h"
+#include "fdf_supervisor.h"
+
+static const char *TAG = "BLE_FTMS_SIM";
+
+static ble_ftms_sim_stats_t instance_stats[BLE_FTMS_MAX_INSTANCES];
+static fdf_rowing_data_t last_sent[BLE_FTMS_MAX_INSTANCES];
+
+// Whether the decoded notifications carry the snapshot at the encoder's resolution
+static bool decoded_matches(const fdf_rowing_data_t *decoded, const fdf_rowing_data_t *data)
+{
+    uint16_t sent = data->present | FDF_FIELD_STROKE_RATE | FDF_FIELD_STROKE_COUNT;
+    return decoded->present == sent &&
+           decoded->stroke_rate == data->stroke_rate &&
+           decoded->stroke_count == data->stroke_count &&
+           decoded->avg_stroke_rate == data->avg_stroke_rate &&
+           decoded->distance_m == data->distance_m &&
+           decoded->pace_500m_ms == data->pace_500m_ms / 1000 * 1000 &&
+           decoded->avg_pace_500m_ms == data->avg_pace_500m_ms / 1000 * 1000 &&
+           decoded->power_watts == data->power_watts &&
+           decoded->avg_power_watts == data->avg_power_watts &&
+           decoded->calories == data->calories &&
+           decoded->energy_per_hour == data->energy_per_hour &&
+           decoded->energy_per_minute == data->energy_per_minute &&
+           decoded->elapsed_time_ms == data->elapsed_time_ms / 1000 * 1000 &&
+           decoded->remaining_time_s == data->remaining_time_s;
+}
+
+bool ble_ftms_init(void)
+{
+    memset(instance_stats, 0, sizeof(instance_stats));
+    memset(last_sent, 0, sizeof(last_sent));
+    ESP_LOGI(TAG, "Simulated FTMS sink with %d instances", BLE_FTMS_MAX_INSTANCES);
+
+    // The sink takes notifications right away, one central per instance
+    fdf_boot_mark(FDF_BOOT_ADVERTISING);
+    for (int i = 0; i < BLE_FTMS_MAX_INSTANCES; i++) {
+        fdf_supervisor_post(FDF_SUP_BLE_CONNECTED, i);
+    }
+    return true;
+}
+
+void ble_ftms_update_data(const fdf_rowing_data_t *data)
+{
+    ble_ftms_update_instance(0, data);
+}
+
+void ble_ftms_update_instance(uint8_t instance, const fdf_rowing_data_t *data)
+{
+    if (instance >= BLE_FTMS_MAX_INSTANCES || data == NULL) {
+        return;
+    }
+    ble_ftms_sim_stats_t *stats = &instance_stats[instance];
+    if (stats->stale) {
+        stats->stale_dropped++;
+        return;
+    }
+    fdf_boot_mark(FDF_BOOT_FIRST_NOTIFY);
+
+    // Capture the notifications a central with the default MTU would receive
+    ftms_packet_t packets[FTMS_INDOOR_ROWER_MAX_PACKETS];
+    size_t count = ftms_encode_indoor_rower_data(data, FTMS_DEFAULT_PAYLOAD_LEN, packets);
+    int64_t latency_us = esp_timer_get_time() - data->timestamp_us;
+
+    fdf_rowing_data_t decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    bool decoded_ok = true;
+    for (size_t i = 0; i < count; i++) {
+        decoded_ok = decoded_ok && packets[i].len <= FTMS_DEFAULT_PAYLOAD_LEN &&
+                     ftms_decode_indoor_rower_data(packets[i].data, packets[i].len, &decoded);
+    }
+    if (!decoded_ok || !decoded_matches(&decoded, data)) {
+        ESP_LOGE(TAG, "[%d] Notification %" PRIu32 " does not decode to its snapshot",
+                 instance, stats->notifications);
+        stats->decode_errors++;
+    }
+
+    // Within a session, apps must never see time or distance go back
+    const fdf_rowing_data_t *last = &last_sent[instance];
+    if (stats->notifications > 0 && data->distance_m >= last->distance_m &&
+        data->elapsed_time_ms < last->elapsed_time_ms) {
+        ESP_LOGE(TAG, "[%d] Elapsed time went back from %" PRIu32 " to %" PRIu32 " ms",
+                 instance, last->elapsed_time_ms, data->elapsed_time_ms);
+        stats->regressions++;
+    }
+    if (decoded.present & FDF_FIELD_REMAINING_TIME) {
+        stats->remaining_time++;
+    }
+    bool update = stats->notifications == 0 || data->seq != last->seq;
+    last_sent[instance] = *data;
+
+    stats->notifications++;
+    if (!update) {
+        stats->interpolated++;
+        return;
+    }
+    stats->updates++;
+    stats->latency_total_us += latency_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+}
+
+void ble_ftms_set_update_interval(uint8_t instance, uint32_t interval_us)
+{
+    if (instance < BLE_FTMS_MAX_INSTANCES) {
+        instance_stats[instance].update_interval_us = interval_us;
+    }
+}
+
+void ble_ftms_set_stale(uint8_t instance, bool stale)
+{
+    if (instance >= BLE_FTMS_MAX_INSTANCES || instance_stats[instance].stale == stale) {
+        return;
+    }
+    ble_ftms_sim_stats_t *stats = &instance_stats[instance];
+    stats->stale = stale;
+    if (stale) {
+        stats->stale_marks++;
+    } else {
+        stats->fresh_marks++;
+    }
+}
+
+static ble_ftms_control_callback_t control_callback = NULL;
+
+void ble_ftms_register_control_callback(ble_ftms_control_callback_t callback)
+{
+    control_callback = callback;
+}
+
+uint8_t ble_ftms_sim_control(uint8_t instance, const uint8_t *data, size_t len)
+{
+    if (instance >= BLE_FTMS_MAX_INSTANCES || len == 0) {
+        return FTMS_RESULT_INVALID_PARAMETER;
+    }
+    // The simulated central is always in control
+    if (data[0] == FTMS_CONTROL_REQUEST_CONTROL) {
+        return FTMS_RESULT_SUCCESS;
+    }
+    return control_callback != NULL ? control_callback(instance, data, len) : FTMS_RESULT_NOT_SUPPORTED;
+}
+
+bool ble_ftms_is_connected(void)
+{
+    // Every instance has a subscribed central
+    return true;
+}
+
+void ble_ftms_start_advertising(void)
+{
+}
+
+void ble_ftms_stop_advertising(void)
+{
+}
+
+void ble_ftms_deinit(void)
+{
+}
+
+#if CONFIG_FDF_SESSION_EXPORT
+// The simulated central: MTU 247, credits granted in batches of half its window
+#define SIM_EXPORT_CONN_ID 0
+#define SIM_EXPORT_PAYLOAD 244
+#define SIM_EXPORT_CREDITS 32
+
+// A central that got nothing back writes START again, as an app would
+#define SIM_EXPORT_RETRY_MS 500
+
+static ble_ftms_export_callback_t export_callback = NULL;
+static volatile bool export_subscribed = false;
+static ble_ftms_sim_export_t export_result;
+static uint8_t export_block[SESSION_STORE_MAX_BLOCK];
+static size_t export_fill = 0;
+static uint32_t export_next_position = 0;
+
+void ble_ftms_register_export_callback(ble_ftms_export_callback_t callback)
+{
+    export_callback = callback;
+}
+
+size_t ble_ftms_export_payload_len(uint16_t conn_id)
+{
+    return conn_id == SIM_EXPORT_CONN_ID && export_subscribed ? SIM_EXPORT_PAYLOAD : 0;
+}
+
+// Check the blocks collected so far, keeping a partial one for the next packet
+static void export_check_blocks(void)
+{
+    while (export_fill >= SESSION_STORE_BLOCK_HEADER_SIZE) {
+        uint16_t payload_len = (uint16_t)(export_block[2] | (export_block[3] << 8));
+        size_t block_len = (SESSION_STORE_BLOCK_HEADER_SIZE + payload_len + 3u) & ~3u;
+        if (block_len > sizeof(export_block)) {
+            export_result.bad_blocks++;
+            export_fill = 0;
+            return;
+        }
+        if (export_fill < block_len) {
+            return;
+        }
+        uint16_t length;
+        if (session_store_check_block(export_block, export_fill, &length) && length == block_len) {
+            export_result.blocks++;
+        } else {
+            export_result.bad_blocks++;
+        }
+        export_fill -= block_len;
+        memmove(export_block, &export_block[block_len], export_fill);
+    }
+}
+
+bool ble_ftms_send_export(uint16_t conn_id, const uint8_t *data, size_t len)
+{
+    if (conn_id != SIM_EXPORT_CONN_ID || !export_subscribed ||
+        len < SESSION_EXPORT_HEADER_SIZE || len > SIM_EXPORT_PAYLOAD) {
+        return false;
+    }
+
+    uint32_t position = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                        ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    size_t bytes = len - SESSION_EXPORT_HEADER_SIZE;
+
+    // A jump in position must fall between blocks
+    if (position != export_next_position || bytes == 0) {
+        if (export_fill != 0) {
+            export_result.bad_blocks++;
+            export_fill = 0;
+        }
+    }
+    if (bytes > sizeof(export_block) - export_fill) {
+        export_result.bad_blocks++;
+        export_fill = 0;
+    }
+    memcpy(&export_block[export_fill], &data[SESSION_EXPORT_HEADER_SIZE], bytes);
+    export_fill += bytes;
+    export_next_position = position + (uint32_t)bytes;
+    export_check_blocks();
+
+    export_result.bytes += (uint32_t)bytes;
+    export_result.packets++;
+    if (bytes == 0) {
+        export_result.done = true;
+    }
+    return true;
+}
+
+bool ble_ftms_sim_export(uint32_t timeout_ms, ble_ftms_sim_export_t *result)
+{
+    memset(&export_result, 0, sizeof(export_result));
+    export_fill = 0;
+    export_next_position = 0;
+    export_subscribed = true;
+
+    if (export_callback == NULL) {
+        return false;
+    }
+
+    const uint8_t start[] = {SESSION_EXPORT_OP_START, 0, 0, 0, 0, SIM_EXPORT_CREDITS, 0};
+    export_callback(SIM_EXPORT_CONN_ID, start, sizeof(start));
+    int64_t start_us = esp_timer_get_time();
+
+    uint32_t granted = SIM_EXPORT_CREDITS;
+    int64_t deadline_us = start_us + (int64_t)timeout_ms * 1000;
+    while (!export_result.done && esp_timer_get_time() < deadline_us) {
+        vTaskDelay(1);
+        if (export_result.packets == 0 && esp_timer_get_time() - start_us >= SIM_EXPORT_RETRY_MS * 1000) {
+            export_callback(SIM_EXPORT_CONN_ID, start, sizeof(start));
+            start_us = esp_timer_get_time();
+        }
+        if (export_result.packets + SIM_EXPORT_CREDITS / 2 >= granted) {
+            const uint8_t credit[] = {SESSION_EXPORT_OP_CREDIT, SIM_EXPORT_CREDITS / 2, 0};
+            export_callback(SIM_EXPORT_CONN_ID, credit, sizeof(credit));
+            granted += SIM_EXPORT_CREDITS / 2;
+        }
+    }
+
+    export_subscribed = false;
+    *result = export_result;
+    return export_result.done;
+}
+#endif
+
+void ble_ftms_sim_get_stats(uint8_t instance, ble_ftms_sim_stats_t *stats)
+{
+    if (instance < BLE_FTMS_MAX_INSTANCES && stats != NULL) {
+        *stats = instance_stats[instance];
+    }
+}
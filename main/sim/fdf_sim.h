@@ -0,0 +1,99 @@
+#ifndef FDF_SIM_H
+#define FDF_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "usb_host_handler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * End-to-end simulation on the ESP-IDF linux target
+ *
+ * usb_host_sim.c and ble_ftms_sim.c replace the USB and BLE drivers behind
+ * usb_host_handler.h and ble_ftms.h, so the unchanged app_main() wiring runs
+ * in a plain Linux process:
+ *
+ *   - consoles are fed from a session log (FDF_SIM_SESSION=path.fdfr) or
+ *     from synthetic consoles (FDF_SIM_LINES lines each, default 3600)
+ *   - FDF_SIM_SPEED scales the log's timing (0 = as fast as possible, default)
+ *   - FDF_SIM_CHUNK sets the synthetic chunk size (default 64)
+ *   - FDF_SIM_STALL=n silences the last synthetic console after n lines,
+ *     until the data watchdog pulses DTR or reopens it; the console must be
+ *     flagged stale, recovered and flagged fresh again
+ *   - FDF_SIM_WORKOUT=m sets a distance workout of m meters on console 0
+ *     through the Control Point before feeding; its notifications must then
+ *     carry Remaining Time
+ *   - every FTMS notification is captured, decoded and checked against the
+ *     snapshot it was encoded from, and against the previous one: elapsed
+ *     time and distance must not go back within a session
+ *   - with CONFIG_FDF_SESSION_EXPORT, the session store is then exported to
+ *     a simulated central (MTU 247) and every block it receives is checked
+ *
+ * When the source is exhausted a report is printed and the process exits,
+ * with a non-zero status if a packet did not decode or an update was lost.
+ */
+
+// Notifications captured for one FTMS instance
+typedef struct {
+    uint32_t notifications;       // Packets captured
+    uint32_t updates;             // Notifications carrying a new console update
+    uint32_t interpolated;        // Notifications sent between console updates
+    uint32_t decode_errors;       // Packets that did not decode to their snapshot
+    uint32_t regressions;         // Notifications whose elapsed time or distance went back
+    uint32_t update_interval_us;  // Last interval requested by the cadence tracker
+    bool stale;                   // Marked stale by the data watchdog now
+    uint32_t stale_marks;         // Times marked stale
+    uint32_t fresh_marks;         // Times marked fresh again
+    uint32_t stale_dropped;       // Updates not notified while stale
+    uint32_t remaining_time;      // Notifications carrying Remaining Time
+    int64_t latency_total_us;     // Sum of chunk receive to notification times
+    int64_t latency_max_us;       // Worst chunk receive to notification time
+} ble_ftms_sim_stats_t;
+
+// Session store export received by the simulated central
+typedef struct {
+    bool done;                    // The end packet arrived
+    uint32_t packets;
+    uint32_t bytes;               // Stream bytes received
+    uint32_t blocks;              // Whole blocks with a matching CRC
+    uint32_t bad_blocks;          // Blocks cut short or failing their CRC
+} ble_ftms_sim_export_t;
+
+/**
+ * @brief Export the session store to the simulated central
+ *
+ * Writes START through the registered export callback, then grants credits
+ * as packets arrive, like a client app would.
+ *
+ * @param timeout_ms Longest wait for the end packet
+ * @param result Filled with what the central received
+ * @return true if the export ended in time
+ */
+bool ble_ftms_sim_export(uint32_t timeout_ms, ble_ftms_sim_export_t *result);
+
+/**
+ * @brief Write a Control Point request as the central in control of an instance
+ * @param instance Instance (console slot)
+ * @param data Request: op code and parameters
+ * @param len Request length
+ * @return FTMS_RESULT_* code of the response
+ */
+uint8_t ble_ftms_sim_control(uint8_t instance, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get the capture statistics of an FTMS instance
+ * @param instance Instance (console slot)
+ * @param stats Filled with the statistics
+ */
+void ble_ftms_sim_get_stats(uint8_t instance, ble_ftms_sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDF_SIM_H
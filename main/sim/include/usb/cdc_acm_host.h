@@ -0,0 +1,21 @@
+#ifndef SIM_CDC_ACM_HOST_H
+#define SIM_CDC_ACM_HOST_H
+
+/*
+ * Stand-in for the usb_host_cdc_acm component header on the linux target.
+ * Only what the console profiles use is provided.
+ */
+
+#include <stdint.h>
+
+#define CDC_HOST_ANY_VID 0
+#define CDC_HOST_ANY_PID 0
+
+typedef struct {
+    uint32_t dwDTERate;
+    uint8_t bCharFormat;
+    uint8_t bParityType;
+    uint8_t bDataBits;
+} __attribute__((packed)) cdc_acm_line_coding_t;
+
+#endif // SIM_CDC_ACM_HOST_H
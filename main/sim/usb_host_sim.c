@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "usb_host_handler.h"
+#include "session_log.h"
+#include "fdf_synth.h"
+#include "ftms_encoder.h"
+#include "fdf_sim.h"
+#include "fdf_supervisor.h"
+
+static const char *TAG = "USB_HOST_SIM";
+
+#define SIM_DEFAULT_LINES 3600
+#define SIM_DEFAULT_CHUNK_SIZE 64
+// Lines generated per console before moving on to the next one
+#define SIM_LINES_PER_ROUND 16
+
+// Longest wait for the session store export at the end of a run
+#define SIM_EXPORT_TIMEOUT_MS 10000
+
+// Longest wait for the data watchdog to wake a silenced console
+#define SIM_STALL_TIMEOUT_MS 30000
+
+static usb_data_callback_t data_callback = NULL;
+static usb_open_callback_t open_callback = NULL;
+static bool console_active[USB_HOST_MAX_CONSOLES];
+static fdf_synth_t synths[USB_HOST_MAX_CONSOLES];
+static uint64_t chunks_fed = 0;
+static uint64_t bytes_fed = 0;
+
+// Stall injection: the console stays silent until DTR is pulsed or it is reopened
+static int stall_console = -1;
+static volatile bool console_asleep[USB_HOST_MAX_CONSOLES];
+static int64_t stall_start_us = 0;
+static int64_t stall_end_us = 0;
+static const char *stall_woken_by = NULL;
+
+// Distance workout set on console 0 before feeding, 0 for none
+static uint32_t workout_m = 0;
+
+static uint32_t env_u32(const char *name, uint32_t default_value)
+{
+    const char *value = getenv(name);
+    return value != NULL ? (uint32_t)strtoul(value, NULL, 0) : default_value;
+}
+
+// Opens a console slot the way the USB host task does, on its first chunk
+static void open_console(uint8_t console_id)
+{
+    if (!console_active[console_id]) {
+        if (open_callback != NULL) {
+            open_callback(console_id);
+        }
+        console_active[console_id] = true;
+        fdf_supervisor_post(FDF_SUP_USB_CONNECTED, console_id);
+    }
+}
+
+// Hands a chunk to the bridge the way the CDC-ACM data callback does
+static void feed_chunk(uint8_t console_id, const uint8_t *data, size_t length)
+{
+    if (console_id >= USB_HOST_MAX_CONSOLES) {
+        return;
+    }
+    // Fed back to back, chunks can share a microsecond, which no real USB
+    // transfer does; keep receive times strictly increasing per console
+    static int64_t last_timestamp_us[USB_HOST_MAX_CONSOLES];
+    int64_t timestamp_us = esp_timer_get_time();
+    if (timestamp_us <= last_timestamp_us[console_id]) {
+        timestamp_us = last_timestamp_us[console_id] + 1;
+    }
+    last_timestamp_us[console_id] = timestamp_us;
+    
+    const usb_rx_chunk_t chunk = {
+        .console_id = console_id,
+        .timestamp_us = timestamp_us,
+        .data = data,
+        .length = length,
+    };
+    open_console(console_id);
+    chunks_fed++;
+    bytes_fed += length;
+    data_callback(&chunk);
+}
+
+static void replay_chunk(const session_log_chunk_t *chunk, void *ctx)
+{
+    feed_chunk(chunk->console_id, chunk->data, chunk->length);
+}
+
+static void synth_chunk(const uint8_t *data, size_t length, int64_t timestamp_us, void *ctx)
+{
+    feed_chunk((uint8_t)(uintptr_t)ctx, data, length);
+}
+
+static bool run_replay(const char *path, uint32_t speed)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *log = size > 0 ? malloc((size_t)size) : NULL;
+    bool ok = log != NULL && fread(log, 1, (size_t)size, f) == (size_t)size;
+    fclose(f);
+
+    if (ok) {
+        ESP_LOGI(TAG, "Replaying %s (%ld bytes) at speed %" PRIu32, path, size, speed);
+        ok = session_log_replay(log, (size_t)size, speed, replay_chunk, NULL) >= 0;
+    }
+    free(log);
+    return ok;
+}
+
+static void wake_console(uint8_t console_id, const char *how)
+{
+    if (console_id < USB_HOST_MAX_CONSOLES && console_asleep[console_id]) {
+        stall_end_us = esp_timer_get_time();
+        stall_woken_by = how;
+        console_asleep[console_id] = false;
+        ESP_LOGI(TAG, "[%d] Console woken by %s", console_id, how);
+    }
+}
+
+static void run_synthetic(uint32_t num_lines, size_t chunk_size, uint32_t stall_line)
+{
+    ESP_LOGI(TAG, "Feeding %d synthetic consoles, %" PRIu32 " lines each, %zu byte chunks",
+             USB_HOST_MAX_CONSOLES, num_lines, chunk_size);
+
+    for (int c = 0; c < USB_HOST_MAX_CONSOLES; c++) {
+        fdf_synth_config_t config;
+        fdf_synth_default_config(&config);
+        config.seed = 1 + c;
+        fdf_synth_init(&synths[c], &config);
+    }
+
+    // The last console goes silent once, between two rounds
+    if (stall_line > 0 && stall_line < num_lines) {
+        stall_console = USB_HOST_MAX_CONSOLES - 1;
+    }
+
+    uint32_t generated[USB_HOST_MAX_CONSOLES] = {0};
+    bool remaining = true;
+    while (remaining) {
+        remaining = false;
+        bool fed = false;
+        for (int c = 0; c < USB_HOST_MAX_CONSOLES; c++) {
+            if (generated[c] >= num_lines) {
+                continue;
+            }
+            remaining = true;
+            if (c == stall_console && stall_start_us == 0 && generated[c] >= stall_line) {
+                ESP_LOGI(TAG, "[%d] Console goes silent after %" PRIu32 " lines", c, generated[c]);
+                stall_start_us = esp_timer_get_time();
+                console_asleep[c] = true;
+            }
+            if (console_asleep[c]) {
+                if (esp_timer_get_time() - stall_start_us < SIM_STALL_TIMEOUT_MS * 1000LL) {
+                    continue;
+                }
+                ESP_LOGE(TAG, "[%d] Console was not woken in %d ms", c, SIM_STALL_TIMEOUT_MS);
+                console_asleep[c] = false;
+            }
+            uint32_t batch = num_lines - generated[c];
+            if (batch > SIM_LINES_PER_ROUND) {
+                batch = SIM_LINES_PER_ROUND;
+            }
+            fdf_synth_emit(&synths[c], batch, chunk_size, 0, 0, synth_chunk, (void *)(uintptr_t)c);
+            generated[c] += batch;
+            fed = true;
+        }
+        if (remaining && !fed) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    for (int c = 0; c < USB_HOST_MAX_CONSOLES; c++) {
+        fdf_synth_flush(&synths[c], 0, synth_chunk, (void *)(uintptr_t)c);
+    }
+}
+
+// Prints the end-to-end results, returns the number of failed checks
+static int report(int64_t elapsed_us, bool synthetic)
+{
+    int failures = 0;
+    uint32_t total_notifications = 0;
+
+    printf("\n=== FDF bridge simulation ===\n");
+    printf("fed:            %" PRIu64 " chunks, %" PRIu64 " bytes in %.3f s\n",
+           chunks_fed, bytes_fed, elapsed_us / 1e6);
+    for (int c = 0; c < USB_HOST_MAX_CONSOLES; c++) {
+        ble_ftms_sim_stats_t stats;
+        ble_ftms_sim_get_stats(c, &stats);
+        if (!console_active[c]) {
+            continue;
+        }
+        total_notifications += stats.notifications;
+        printf("console %d:      %" PRIu32 " notifications (%" PRIu32 " updates, %" PRIu32 " interpolated), "
+               "%" PRIu32 " decode errors, %" PRIu32 " regressions, "
+               "latency avg %.1f us max %" PRId64 " us, BLE interval %" PRIu32 " us\n",
+               c, stats.notifications, stats.updates, stats.interpolated,
+               stats.decode_errors, stats.regressions,
+               stats.updates ? (double)stats.latency_total_us / stats.updates : 0.0,
+               stats.latency_max_us, stats.update_interval_us);
+        failures += stats.decode_errors > 0;
+        failures += stats.regressions > 0;
+        if (synthetic && stats.updates != synths[c].stats.changed) {
+            printf("console %d:      expected %" PRIu32 " updates\n", c, synths[c].stats.changed);
+            failures++;
+        }
+        if (c == stall_console) {
+            bool recovered = stall_woken_by != NULL && stats.stale_marks == 1 && stats.fresh_marks == 1;
+            printf("stall:          console %d silent for %.3f s, woken by %s, "
+                   "marked stale %" PRIu32 " / fresh %" PRIu32 " times, %" PRIu32 " updates held back\n",
+                   c, stall_woken_by != NULL ? (stall_end_us - stall_start_us) / 1e6 : 0.0,
+                   stall_woken_by != NULL ? stall_woken_by : "nothing",
+                   stats.stale_marks, stats.fresh_marks, stats.stale_dropped);
+            failures += !recovered;
+        }
+        if (c == 0 && workout_m > 0) {
+            printf("workout:        %" PRIu32 " m on console 0, %" PRIu32 " notifications with Remaining Time\n",
+                   workout_m, stats.remaining_time);
+            failures += stats.remaining_time == 0;
+        }
+    }
+    printf("throughput:     %.0f notifications/s\n",
+           total_notifications * 1e6 / (double)(elapsed_us > 0 ? elapsed_us : 1));
+
+#if CONFIG_FDF_SESSION_EXPORT
+    ble_ftms_sim_export_t store_export;
+    int64_t export_start_us = esp_timer_get_time();
+    bool exported = ble_ftms_sim_export(SIM_EXPORT_TIMEOUT_MS, &store_export);
+    int64_t export_us = esp_timer_get_time() - export_start_us;
+    printf("export:         %" PRIu32 " bytes in %" PRIu32 " packets, %" PRIu32 " blocks, "
+           "%" PRIu32 " bad blocks, %.3f s\n",
+           store_export.bytes, store_export.packets, store_export.blocks, store_export.bad_blocks,
+           export_us / 1e6);
+    failures += !exported;
+    failures += store_export.bad_blocks > 0;
+#endif
+    printf("result:         %s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures;
+}
+
+static void usb_sim_task(void *arg)
+{
+    const char *session = getenv("FDF_SIM_SESSION");
+    uint32_t speed = env_u32("FDF_SIM_SPEED", SESSION_LOG_SPEED_MAX);
+    uint32_t num_lines = env_u32("FDF_SIM_LINES", SIM_DEFAULT_LINES);
+    size_t chunk_size = env_u32("FDF_SIM_CHUNK", SIM_DEFAULT_CHUNK_SIZE);
+    uint32_t stall_line = env_u32("FDF_SIM_STALL", 0);
+    workout_m = env_u32("FDF_SIM_WORKOUT", 0);
+
+    // Give app_main time to finish its setup, as a real console would
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    if (workout_m > 0) {
+        // A workout is set for the console plugged in, as a new console resets it
+        open_console(0);
+        const uint8_t request_control[] = {FTMS_CONTROL_REQUEST_CONTROL};
+        const uint8_t set_distance[] = {FTMS_CONTROL_SET_TARGETED_DISTANCE, workout_m & 0xFF,
+                                        (workout_m >> 8) & 0xFF, (workout_m >> 16) & 0xFF};
+        if (ble_ftms_sim_control(0, request_control, sizeof(request_control)) != FTMS_RESULT_SUCCESS ||
+            ble_ftms_sim_control(0, set_distance, sizeof(set_distance)) != FTMS_RESULT_SUCCESS) {
+            printf("workout:        not accepted\n");
+        }
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    bool ok = true;
+    if (session != NULL) {
+        ok = run_replay(session, speed);
+    } else {
+        run_synthetic(num_lines, chunk_size, stall_line);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    int failures = report(elapsed_us, session == NULL);
+    fflush(stdout);
+    exit(ok && failures == 0 ? 0 : 1);
+}
+
+esp_err_t usb_host_init(usb_data_callback_t callback)
+{
+    data_callback = callback;
+    if (xTaskCreate(usb_sim_task, "usb_sim", 8192, NULL, 5, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void usb_host_register_open_callback(usb_open_callback_t callback)
+{
+    open_callback = callback;
+}
+
+bool usb_host_is_connected(void)
+{
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        if (console_active[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool usb_host_console_is_connected(uint8_t console_id)
+{
+    return console_id < USB_HOST_MAX_CONSOLES && console_active[console_id];
+}
+
+const console_profile_t *usb_host_get_console_profile(uint8_t console_id)
+{
+    // Simulated consoles behave like an unknown adapter
+    return usb_host_console_is_connected(console_id) ? console_profile_find(0, 0) : NULL;
+}
+
+usb_host_status_t usb_host_get_status(void)
+{
+    return usb_host_is_connected() ? USB_HOST_STATUS_CONNECTED : USB_HOST_STATUS_DISCONNECTED;
+}
+
+esp_err_t usb_host_send_data(uint8_t console_id, const uint8_t *data, size_t len)
+{
+    if (!usb_host_console_is_connected(console_id)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > USB_TX_MAX_COMMAND_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Simulated consoles stream on their own and ignore commands
+    return ESP_OK;
+}
+
+esp_err_t usb_host_toggle_dtr(uint8_t console_id)
+{
+    if (!usb_host_console_is_connected(console_id)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    wake_console(console_id, "DTR pulse");
+    return ESP_OK;
+}
+
+esp_err_t usb_host_reopen_console(uint8_t console_id)
+{
+    if (!usb_host_console_is_connected(console_id)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    wake_console(console_id, "reopen");
+    return ESP_OK;
+}
+
+esp_err_t usb_host_start_polling(const usb_poll_config_t *config)
+{
+    return ESP_OK;
+}
+
+void usb_host_stop_polling(void)
+{
+}
+
+bool usb_host_poll_response_received(uint8_t console_id, uint32_t *rtt_us)
+{
+    return false;
+}
+
+void usb_host_get_poll_stats(uint8_t console_id, usb_poll_stats_t *stats)
+{
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(usb_poll_stats_t));
+    }
+}
+
+void usb_host_deinit(void)
+{
+    data_callback = NULL;
+}
@@ -1,53 +1,651 @@
 #include <stdio.h>
 #include <string.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "esp_log.h"
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "fdf_port.h"
 #include "fdf_protocol.h"
+#include "ftms_encoder.h"
+#include "fdf_metrics.h"
+#include "fdf_interp.h"
+#include "fdf_strokes.h"
+#include "session_store.h"
+#include "session_export.h"
+#include "fdf_trace.h"
+#include "fdf_watchdog.h"
+#include "fdf_bus.h"
+#include "fdf_workout.h"
+#include "fdf_config.h"
+#include "fdf_filter.h"
 
 static const char *TAG = "FDF_TEST";
 
+static int updates_received = 0;
+
 // Test data callback
 static void test_data_callback(const fdf_rowing_data_t *data)
 {
+    updates_received++;
+
     ESP_LOGI(TAG, "Test Data Update:");
-    ESP_LOGI(TAG, "  Strokes: %d", data->stroke_count);
-    ESP_LOGI(TAG, "  Time: %d ms", data->elapsed_time_ms);
-    ESP_LOGI(TAG, "  Distance: %d m", data->distance_m);
-    ESP_LOGI(TAG, "  Stroke Rate: %d spm", data->stroke_rate);
-    ESP_LOGI(TAG, "  Power: %d W", data->power_watts);
-    ESP_LOGI(TAG, "  Calories: %d", data->calories);
+    ESP_LOGI(TAG, "  Strokes: %" PRIu16, data->stroke_count);
+    ESP_LOGI(TAG, "  Time: %" PRIu32 " ms", data->elapsed_time_ms);
+    ESP_LOGI(TAG, "  Distance: %" PRIu32 " m", data->distance_m);
+    ESP_LOGI(TAG, "  Stroke Rate: %" PRIu16 " spm", data->stroke_rate);
+    ESP_LOGI(TAG, "  Power: %" PRIu16 " W", data->power_watts);
+    ESP_LOGI(TAG, "  Calories: %" PRIu16, data->calories);
     ESP_LOGI(TAG, "  Session Active: %s", data->session_active ? "Yes" : "No");
 }
 
-void test_fdf_protocol(void)
+#define TEST_CHECK(cond) do { \
+        if (!(cond)) { \
+            ESP_LOGE(TAG, "Check failed at line %d: %s", __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+// NOR flash in RAM for the session store: writes only clear bits
+#define TEST_FLASH_PAGES 4
+static uint8_t test_flash[TEST_FLASH_PAGES * SESSION_STORE_PAGE_SIZE];
+
+// Settings storage in RAM
+static uint8_t test_config_blob[FDF_CONFIG_BLOB_MAX];
+static size_t test_config_len = 0;
+
+static bool test_config_load(void *ctx, void *data, size_t *len)
+{
+    if (test_config_len == 0 || test_config_len > *len) {
+        return false;
+    }
+    memcpy(data, test_config_blob, test_config_len);
+    *len = test_config_len;
+    return true;
+}
+
+static bool test_config_save(void *ctx, const void *data, size_t len)
+{
+    memcpy(test_config_blob, data, len);
+    test_config_len = len;
+    return true;
+}
+
+// Counts bus messages into the int given as context
+static void test_bus_handler(void *ctx, fdf_bus_topic_t topic, uint8_t console_id, const fdf_rowing_data_t *data)
+{
+    (*(int *)ctx)++;
+}
+
+static bool test_flash_read(void *ctx, uint32_t offset, void *data, size_t len)
+{
+    memcpy(data, &test_flash[offset], len);
+    return true;
+}
+
+static bool test_flash_write(void *ctx, uint32_t offset, const void *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        test_flash[offset + i] &= ((const uint8_t *)data)[i];
+    }
+    return true;
+}
+
+static bool test_flash_erase_page(void *ctx, uint32_t offset)
+{
+    memset(&test_flash[offset], 0xFF, SESSION_STORE_PAGE_SIZE);
+    return true;
+}
+
+bool test_fdf_protocol(void)
 {
     ESP_LOGI(TAG, "Testing FDF Protocol Parser...");
-    
+
     // Initialize protocol parser
     if (!fdf_protocol_init()) {
         ESP_LOGE(TAG, "Failed to initialize FDF protocol");
-        return;
+        return false;
     }
-    
+
     // Register test callback
+    updates_received = 0;
     fdf_protocol_register_callback(test_data_callback);
-    
+
     // Test data samples (simulating FDF console output)
     const char* test_lines[] = {
-        "STROKES:0 TIME:00:00 DISTANCE:0 RATE:0 POWER:0 CALORIES:0",
-        "STROKES:1 TIME:00:05 DISTANCE:25 RATE:12 POWER:80 CALORIES:2",
-        "STROKES:5 TIME:00:25 DISTANCE:125 RATE:15 POWER:120 CALORIES:8",
-        "STROKES:10 TIME:00:50 DISTANCE:250 RATE:18 POWER:150 CALORIES:15",
-        "STROKES:20 TIME:01:40 DISTANCE:500 RATE:20 POWER:180 CALORIES:30"
+        "STROKES:0 TIME:00:00 DISTANCE:0 RATE:0 POWER:0 CALORIES:0\r\n",
+        "STROKES:1 TIME:00:05 DISTANCE:25 RATE:12 POWER:80 CALORIES:2\r\n",
+        "STROKES:5 TIME:00:25 DISTANCE:125 RATE:15 POWER:120 CALORIES:8\r\n",
+        "STROKES:10 TIME:00:50 DISTANCE:250 RATE:18 POWER:150 CALORIES:15\r\n",
+        "STROKES:20 TIME:01:40 DISTANCE:500 RATE:20 POWER:180 CALORIES:30\r\n"
     };
-    
+    const size_t num_lines = sizeof(test_lines) / sizeof(test_lines[0]);
+
     // Process test data
-    for (int i = 0; i < sizeof(test_lines) / sizeof(test_lines[0]); i++) {
-        ESP_LOGI(TAG, "Processing test line %d: %s", i + 1, test_lines[i]);
+    for (size_t i = 0; i < num_lines; i++) {
+        ESP_LOGI(TAG, "Processing test line %zu: %s", i + 1, test_lines[i]);
         fdf_protocol_process_data((const uint8_t*)test_lines[i], strlen(test_lines[i]));
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Wait 1 second between updates
     }
+
+    fdf_rowing_data_t data;
+    TEST_CHECK(updates_received == (int)num_lines);
+    TEST_CHECK(fdf_protocol_get_current_data(&data));
+    TEST_CHECK(data.stroke_count == 20);
+    TEST_CHECK(data.elapsed_time_ms == 100000);
+    TEST_CHECK(data.distance_m == 500);
+    TEST_CHECK(data.stroke_rate == 20);
+    TEST_CHECK(data.power_watts == 180);
+    TEST_CHECK(data.calories == 30);
+
+    // A line split across chunks is parsed once complete
+    const char *split_line = "STROKES:21 DISTANCE:510\r\n";
+    fdf_protocol_process_data((const uint8_t*)split_line, 9);
+    TEST_CHECK(updates_received == (int)num_lines);
+    fdf_protocol_process_data((const uint8_t*)split_line + 9, strlen(split_line) - 9);
+    TEST_CHECK(updates_received == (int)num_lines + 1);
+    fdf_protocol_get_current_data(&data);
+    TEST_CHECK(data.stroke_count == 21);
+    TEST_CHECK(data.distance_m == 510);
+
+    // Every reported field is present, and lines that changed a value advance seq
+    const uint16_t all_fields = FDF_FIELD_STROKE_COUNT | FDF_FIELD_ELAPSED_TIME |
+                                FDF_FIELD_DISTANCE | FDF_FIELD_STROKE_RATE |
+                                FDF_FIELD_POWER | FDF_FIELD_CALORIES;
+    TEST_CHECK(data.present == all_fields);
+    TEST_CHECK(data.seq == num_lines + 1);
+    
+    // Out of range values are rejected instead of spilling into other fields
+    fdf_protocol_process_data((const uint8_t*)"STROKES:70000 RATE:-3 PACE:2:05\r\n", 33);
+    fdf_protocol_get_current_data(&data);
+    TEST_CHECK(data.stroke_count == 21);
+    TEST_CHECK(data.stroke_rate == 20);
+    TEST_CHECK(data.pace_500m_ms == 125000);
+    TEST_CHECK(data.present == (all_fields | FDF_FIELD_PACE));
+
+    // Lines without a known field or with a malformed value count as parse errors
+    static fdf_parser_t counted;
+    const char *counted_lines = "STROKES:1\r\nHELLO\r\nSTROKES:x DISTANCE:5\r\n";
+    fdf_parser_init(&counted, 0);
+    fdf_parser_process_data(&counted, (const uint8_t*)counted_lines, strlen(counted_lines));
+    TEST_CHECK(counted.stats.bytes == strlen(counted_lines));
+    TEST_CHECK(counted.stats.lines == 3);
+    TEST_CHECK(counted.stats.updates == 2);
+    TEST_CHECK(counted.stats.parse_errors == 2);
+    fdf_parser_reset_session(&counted);
+    TEST_CHECK(counted.stats.lines == 3);
+
+    // A full record fits one notification with a large enough MTU
+    ftms_packet_t packets[FTMS_INDOOR_ROWER_MAX_PACKETS];
+    size_t count = ftms_encode_indoor_rower_data(&data, FTMS_INDOOR_ROWER_DATA_MAX_LEN, packets);
+    TEST_CHECK(count == 1);
+    TEST_CHECK((packets[0].data[0] & FTMS_FLAG_MORE_DATA) == 0);
+    TEST_CHECK(packets[0].data[2] == 40);            // Stroke rate, 0.5 spm units
+    TEST_CHECK((packets[0].data[5] | (packets[0].data[6] << 8) | (packets[0].data[7] << 16)) == 510);
     
+    // The packet decodes back to the snapshot
+    fdf_rowing_data_t decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    TEST_CHECK(ftms_decode_indoor_rower_data(packets[0].data, packets[0].len, &decoded));
+    TEST_CHECK(decoded.stroke_count == 21);
+    TEST_CHECK(decoded.distance_m == 510);
+    TEST_CHECK(decoded.elapsed_time_ms == 100000);
+    TEST_CHECK(decoded.pace_500m_ms == 125000);
+    TEST_CHECK(!ftms_decode_indoor_rower_data(packets[0].data, packets[0].len - 1, &decoded));
+    
+    // With the default MTU every field is sent, split with More Data
+    data.present |= FDF_FIELD_AVG_STROKE_RATE | FDF_FIELD_AVG_POWER | FDF_FIELD_AVG_PACE |
+                    FDF_FIELD_REMAINING_TIME;
+    data.remaining_time_s = 420;
+    count = ftms_encode_indoor_rower_data(&data, FTMS_DEFAULT_PAYLOAD_LEN, packets);
+    TEST_CHECK(count == 2);
+    TEST_CHECK(packets[0].data[0] & FTMS_FLAG_MORE_DATA);
+    TEST_CHECK(packets[0].len <= FTMS_DEFAULT_PAYLOAD_LEN && packets[1].len <= FTMS_DEFAULT_PAYLOAD_LEN);
+    TEST_CHECK(packets[0].len + packets[1].len == FTMS_INDOOR_ROWER_DATA_MAX_LEN + 2);
+    memset(&decoded, 0, sizeof(decoded));
+    TEST_CHECK(ftms_decode_indoor_rower_data(packets[0].data, packets[0].len, &decoded));
+    TEST_CHECK(ftms_decode_indoor_rower_data(packets[1].data, packets[1].len, &decoded));
+    TEST_CHECK(decoded.present == data.present);
+    TEST_CHECK(decoded.stroke_count == 21);
+    TEST_CHECK(decoded.elapsed_time_ms == 100000);
+    TEST_CHECK(decoded.remaining_time_s == 420);
+    
+    // Metrics of a console reporting only strokes and distance: 4 m/s at
+    // 10 updates per second, one stroke every 2.5 s
+    static fdf_metrics_t metrics;
+    fdf_metrics_init(&metrics);
+    fdf_rowing_data_t sample;
+    for (uint32_t i = 1; i <= 1500; i++) {
+        memset(&sample, 0, sizeof(sample));
+        sample.timestamp_us = (int64_t)i * 100000;
+        sample.distance_m = (i * 4 + 5) / 10;
+        sample.stroke_count = (uint16_t)(i / 25);
+        sample.present = FDF_FIELD_DISTANCE | FDF_FIELD_STROKE_COUNT;
+        sample.session_active = true;
+        fdf_metrics_update(&metrics, &sample);
+    }
+    fdf_metrics_summary_t summary;
+    fdf_metrics_get_summary(&metrics, &summary);
+    TEST_CHECK(sample.derived == (FDF_FIELD_ELAPSED_TIME | FDF_FIELD_PACE | FDF_FIELD_POWER |
+                                  FDF_FIELD_AVG_POWER | FDF_FIELD_AVG_PACE | FDF_FIELD_STROKE_RATE |
+                                  FDF_FIELD_AVG_STROKE_RATE | FDF_FIELD_ENERGY_RATE));
+    // Whole meters over a 4 s window: within 1/16 of the true speed
+    TEST_CHECK(sample.pace_500m_ms >= 117000 && sample.pace_500m_ms <= 133000);
+    TEST_CHECK(sample.power_watts >= 150 && sample.power_watts <= 215);     // 2.8 * 4^3
+    TEST_CHECK(sample.stroke_rate == 24);
+    TEST_CHECK(sample.energy_per_hour >= 815 && sample.energy_per_hour <= 1040);
+    TEST_CHECK(sample.energy_per_minute == (sample.energy_per_hour + 30) / 60);
+    TEST_CHECK(summary.splits == 1);
+    TEST_CHECK(summary.last_split_ms >= 124000 && summary.last_split_ms <= 126000);
+    
+    // Reported fields are left alone
+    sample.timestamp_us += 100000;
+    sample.distance_m += 1;
+    sample.power_watts = 150;
+    sample.present |= FDF_FIELD_POWER;
+    sample.derived = 0;
+    fdf_metrics_update(&metrics, &sample);
+    TEST_CHECK(sample.power_watts == 150 && !(sample.derived & FDF_FIELD_POWER));
+    
+    // A session joined at 1200 m: the splits rowed count, the first one timed ends at 1500 m
+    fdf_metrics_init(&metrics);
+    for (uint32_t i = 0; i <= 800; i++) {
+        memset(&sample, 0, sizeof(sample));
+        sample.timestamp_us = (int64_t)i * 100000;
+        sample.distance_m = 1200 + (i * 4 + 5) / 10;
+        sample.present = FDF_FIELD_DISTANCE;
+        sample.session_active = true;
+        fdf_metrics_update(&metrics, &sample);
+        if (i == 0) {
+            fdf_metrics_get_summary(&metrics, &summary);
+            TEST_CHECK(summary.splits == 2 && summary.last_split_ms == 0);
+        }
+    }
+    fdf_metrics_get_summary(&metrics, &summary);
+    TEST_CHECK(summary.splits == 3);
+    TEST_CHECK(summary.last_split_ms >= 74000 && summary.last_split_ms <= 76000);
+    
+    // Interpolation of a console reporting whole seconds and meters at 4 m/s
+    static fdf_interp_t interp;
+    fdf_interp_init(&interp);
+    fdf_rowing_data_t estimate;
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp_us = 10000000;
+    sample.elapsed_time_ms = 10000;
+    sample.distance_m = 40;
+    sample.present = FDF_FIELD_ELAPSED_TIME | FDF_FIELD_DISTANCE;
+    sample.session_active = true;
+    fdf_interp_update(&interp, &sample, 4000);
+    TEST_CHECK(fdf_interp_get(&interp, 10500000, &estimate));
+    TEST_CHECK(estimate.elapsed_time_ms == 10500 && estimate.distance_m == 42);
+    
+    // No update: the clock stops at the end of the console's second, distance at the limit
+    TEST_CHECK(fdf_interp_get(&interp, 20000000, &estimate));
+    TEST_CHECK(estimate.elapsed_time_ms == 10999);
+    TEST_CHECK(estimate.distance_m == 40 + 4 * FDF_INTERP_MAX_EXTRAPOLATION_MS / 1000);
+    
+    // A console update behind the estimate holds it instead of going back
+    sample.timestamp_us = 11000000;
+    sample.elapsed_time_ms = 11000;
+    sample.distance_m = 43;
+    fdf_interp_update(&interp, &sample, 4000);
+    TEST_CHECK(fdf_interp_get(&interp, 11000000, &estimate));
+    TEST_CHECK(estimate.elapsed_time_ms == 11000 && estimate.distance_m == 48);
+    TEST_CHECK(fdf_interp_get(&interp, 12500000, &estimate));
+    TEST_CHECK(estimate.elapsed_time_ms == 11999 && estimate.distance_m == 49);
+    
+    // Distance back to zero starts a new session
+    sample.timestamp_us = 13000000;
+    sample.elapsed_time_ms = 0;
+    sample.distance_m = 0;
+    fdf_interp_update(&interp, &sample, 0);
+    TEST_CHECK(fdf_interp_get(&interp, 13000000, &estimate));
+    TEST_CHECK(estimate.elapsed_time_ms == 0 && estimate.distance_m == 0);
+    
+    // Stroke history: one record per stroke count change, the oldest overwritten
+    static fdf_stroke_t stroke_arena[4];
+    static fdf_stroke_history_t history;
+    fdf_stroke_t stroke;
+    fdf_strokes_init(&history, stroke_arena, 4);
+    memset(&sample, 0, sizeof(sample));
+    sample.present = FDF_FIELD_STROKE_COUNT | FDF_FIELD_DISTANCE | FDF_FIELD_POWER | FDF_FIELD_PACE;
+    sample.session_active = true;
+    uint32_t recorded = 0;
+    for (uint32_t i = 0; i <= 60; i++) {
+        sample.elapsed_time_ms = i * 500;
+        sample.stroke_count = (uint16_t)(i / 5);
+        sample.distance_m = i;
+        sample.power_watts = (uint16_t)(100 + i);
+        sample.pace_500m_ms = 125000;
+        recorded += fdf_strokes_update(&history, &sample);
+    }
+    TEST_CHECK(recorded == 12);
+    TEST_CHECK(fdf_strokes_count(&history) == 4 && history.overwritten == 8);
+    TEST_CHECK(fdf_strokes_get(&history, 0, &stroke) && stroke.stroke_count == 9);
+    TEST_CHECK(fdf_strokes_get(&history, 3, &stroke) && stroke.stroke_count == 12);
+    TEST_CHECK(stroke.elapsed_ms == 30000 && stroke.distance_m == 5 && stroke.power_watts == 160);
+    TEST_CHECK(stroke.pace_500m_ds == 1250 && stroke.present == (FDF_FIELD_POWER | FDF_FIELD_PACE));
+    TEST_CHECK(!fdf_strokes_get(&history, 4, &stroke));
+    sample.stroke_count = 0;
+    sample.distance_m = 0;
+    TEST_CHECK(!fdf_strokes_update(&history, &sample) && fdf_strokes_count(&history) == 0);
+    
+    // Session store: a session survives a reset, a torn block is skipped
+    static session_store_t store;
+    static session_store_reader_t reader;
+    session_store_record_t stored;
+    const session_store_flash_t flash = {
+        .read = test_flash_read,
+        .write = test_flash_write,
+        .erase_page = test_flash_erase_page,
+        .size = sizeof(test_flash),
+    };
+    memset(test_flash, 0xFF, sizeof(test_flash));
+    TEST_CHECK(session_store_open(&store, &flash));
+    for (uint32_t i = 1; i <= 300; i++) {
+        memset(&stroke, 0, sizeof(stroke));
+        stroke.elapsed_ms = i * 2100;
+        stroke.stroke_count = (uint16_t)i;
+        stroke.distance_m = 9 + i % 3;
+        stroke.power_watts = (uint16_t)(150 + i % 7);
+        stroke.stroke_rate = 28;
+        stroke.pace_500m_ds = (uint16_t)(1200 - i % 7);
+        stroke.present = FDF_FIELD_POWER | FDF_FIELD_STROKE_RATE | FDF_FIELD_PACE;
+        TEST_CHECK(session_store_add_stroke(&store, 1, &stroke));
+    }
+    TEST_CHECK(session_store_end_session(&store, 1));
+    TEST_CHECK(session_store_flush(&store));
+    TEST_CHECK(session_store_used(&store) < 300 * 9);     // 16 byte strokes in under 9
+    
+    TEST_CHECK(session_store_open(&store, &flash));
+    TEST_CHECK(store.next_session_id == 2);
+    session_store_reader_init(&reader, &store);
+    TEST_CHECK(session_store_reader_next(&reader, &stored));
+    TEST_CHECK(stored.type == SESSION_STORE_START && stored.console_id == 1 && stored.session_id == 1);
+    uint32_t strokes_read = 0;
+    while (session_store_reader_next(&reader, &stored) && stored.type == SESSION_STORE_STROKE) {
+        strokes_read++;
+        TEST_CHECK(stored.session_id == 1 && stored.stroke.stroke_count == strokes_read);
+        TEST_CHECK(stored.stroke.elapsed_ms == strokes_read * 2100 &&
+                   stored.stroke.pace_500m_ds == 1200 - strokes_read % 7);
+    }
+    TEST_CHECK(strokes_read == 300);
+    TEST_CHECK(stored.type == SESSION_STORE_END && stored.strokes == 300 && stored.elapsed_ms == 630000);
+    TEST_CHECK(!session_store_reader_next(&reader, &stored) && reader.corrupt_blocks == 0);
+    
+    // Tear the next block: its header is written, its payload is not all there
+    uint32_t torn_offset = store.page * SESSION_STORE_PAGE_SIZE + store.offset;
+    stroke.stroke_count = 1;
+    TEST_CHECK(session_store_add_stroke(&store, 0, &stroke));
+    TEST_CHECK(session_store_flush(&store));
+    test_flash[torn_offset + SESSION_STORE_BLOCK_HEADER_SIZE] ^= 0x01;
+    uint32_t torn_page = store.page;
+    TEST_CHECK(session_store_open(&store, &flash));
+    TEST_CHECK(store.next_session_id == 2);
+    stroke.stroke_count = 2;
+    TEST_CHECK(session_store_add_stroke(&store, 0, &stroke));
+    TEST_CHECK(session_store_flush(&store) && store.page != torn_page);
+    session_store_reader_init(&reader, &store);
+    strokes_read = 0;
+    while (session_store_reader_next(&reader, &stored)) {
+        strokes_read += stored.type == SESSION_STORE_STROKE;
+    }
+    TEST_CHECK(strokes_read == 301 && reader.corrupt_blocks == 1);
+    TEST_CHECK(stored.type == SESSION_STORE_STROKE && stored.session_id == 2 && stored.stroke.stroke_count == 2);
+    
+    // Session export: every valid block arrives whole, the torn one is skipped
+    static session_export_t exporter;
+    static uint8_t received[SESSION_STORE_MAX_BLOCK + 244];
+    uint8_t packet[244];
+    const uint8_t export_start[] = {SESSION_EXPORT_OP_START, 0, 0, 0, 0, 0xFF, 0xFF};
+    session_export_init(&exporter);
+    TEST_CHECK(session_export_command(&exporter, export_start, sizeof(export_start)));
+    uint32_t blocks_exported = 0;
+    uint32_t next_position = 0;
+    uint32_t last_jump = 0;
+    size_t received_len = 0;
+    size_t packet_len;
+    while ((packet_len = session_export_next(&exporter, &store, packet, sizeof(packet))) > SESSION_EXPORT_HEADER_SIZE) {
+        uint32_t position = packet[0] | packet[1] << 8 | packet[2] << 16 | (uint32_t)packet[3] << 24;
+        if (position != next_position) {
+            TEST_CHECK(received_len == 0);
+            last_jump = position;
+        }
+        memcpy(&received[received_len], &packet[SESSION_EXPORT_HEADER_SIZE], packet_len - SESSION_EXPORT_HEADER_SIZE);
+        received_len += packet_len - SESSION_EXPORT_HEADER_SIZE;
+        next_position = position + (uint32_t)(packet_len - SESSION_EXPORT_HEADER_SIZE);
+        uint16_t block_len;
+        while (session_store_check_block(received, received_len, &block_len) && block_len <= received_len) {
+            blocks_exported++;
+            received_len -= block_len;
+            memmove(received, &received[block_len], received_len);
+        }
+    }
+    TEST_CHECK(packet_len == SESSION_EXPORT_HEADER_SIZE && exporter.finished);
+    TEST_CHECK(blocks_exported == 2 && received_len == 0);
+    
+    // Resume at the last block, one credit at a time
+    const uint8_t export_resume[] = {SESSION_EXPORT_OP_START, (uint8_t)last_jump, (uint8_t)(last_jump >> 8),
+                                     (uint8_t)(last_jump >> 16), (uint8_t)(last_jump >> 24), 1, 0};
+    const uint8_t export_credit[] = {SESSION_EXPORT_OP_CREDIT, 1, 0};
+    TEST_CHECK(session_export_command(&exporter, export_resume, sizeof(export_resume)));
+    TEST_CHECK(session_export_next(&exporter, &store, packet, sizeof(packet)) > SESSION_EXPORT_HEADER_SIZE);
+    TEST_CHECK((packet[0] | packet[1] << 8 | packet[2] << 16 | (uint32_t)packet[3] << 24) == last_jump);
+    TEST_CHECK(session_export_next(&exporter, &store, packet, sizeof(packet)) == 0);
+    TEST_CHECK(session_export_command(&exporter, export_credit, sizeof(export_credit)));
+    TEST_CHECK(session_export_next(&exporter, &store, packet, sizeof(packet)) == SESSION_EXPORT_HEADER_SIZE);
+    
+    // Trace ring: the oldest records are dropped and counted once it wraps
+    fdf_trace_record_t record;
+    char line[128];
+    while (fdf_trace_read(&record)) {
+    }
+    uint32_t lost_before = fdf_trace_lost();
+    for (uint32_t i = 0; i < FDF_TRACE_RECORDS + 3; i++) {
+        fdf_trace_record(FDF_TRACE_UPDATE, 1, i, 510, 20, 180);
+    }
+    uint32_t traced = 0;
+    uint32_t first = 0;
+    while (fdf_trace_read(&record)) {
+        if (traced++ == 0) {
+            first = record.args[0];
+        }
+    }
+    TEST_CHECK(traced == FDF_TRACE_RECORDS);
+    TEST_CHECK(first == 3);
+    TEST_CHECK(fdf_trace_lost() - lost_before == 3);
+    char expected[64];
+    snprintf(expected, sizeof(expected), "[1] update: strokes %d, distance 510 m",
+             FDF_TRACE_RECORDS + 2);
+    fdf_trace_format(&record, line, sizeof(line));
+    TEST_CHECK(strstr(line, expected) != NULL);
+
+    // Watchdog: stale after 4 intervals of 1 s, then poll, DTR, reopen, poll, 2 s apart
+    fdf_watchdog_t wd;
+    const fdf_watchdog_config_t wd_config = { .factor = 4, .min_timeout_ms = 3000,
+                                              .max_timeout_ms = 10000, .retry_ms = 2000 };
+    fdf_watchdog_init(&wd, &wd_config);
+    TEST_CHECK(fdf_watchdog_check(&wd, 60000000) == FDF_RECOVERY_NONE);
+    TEST_CHECK(!fdf_watchdog_feed(&wd, 1000000, 1000000));
+    TEST_CHECK(fdf_watchdog_check(&wd, 4999999) == FDF_RECOVERY_NONE);
+    TEST_CHECK(fdf_watchdog_check(&wd, 5000000) == FDF_RECOVERY_POLL);
+    TEST_CHECK(fdf_watchdog_is_stalled(&wd));
+    TEST_CHECK(fdf_watchdog_check(&wd, 6000000) == FDF_RECOVERY_NONE);
+    TEST_CHECK(fdf_watchdog_check(&wd, 7000000) == FDF_RECOVERY_TOGGLE_DTR);
+    TEST_CHECK(fdf_watchdog_check(&wd, 9000000) == FDF_RECOVERY_REOPEN);
+    TEST_CHECK(fdf_watchdog_check(&wd, 11000000) == FDF_RECOVERY_POLL);
+    TEST_CHECK(fdf_watchdog_feed(&wd, 12500000, 1000000));
+    TEST_CHECK(!fdf_watchdog_is_stalled(&wd));
+    TEST_CHECK(wd.stats.stalls == 1 && wd.stats.recoveries == 1);
+    TEST_CHECK(wd.stats.last_recovery_ms == 7500 && wd.stats.last_outage_ms == 11500);
+    TEST_CHECK(wd.stats.last_step == FDF_RECOVERY_POLL);
+    // Unknown cadence: the maximum timeout
+    TEST_CHECK(!fdf_watchdog_feed(&wd, 20000000, 0));
+    TEST_CHECK(fdf_watchdog_check(&wd, 29999999) == FDF_RECOVERY_NONE);
+    TEST_CHECK(fdf_watchdog_check(&wd, 30000000) == FDF_RECOVERY_POLL);
+
+    // Bus: updates only once per changed line, field and console filters, latest-value slot
+    static int bus_strokes = 0;
+    const fdf_bus_subscription_t stroke_sub = {
+        .name = "strokes", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_UPDATE), .consoles = 1u << 1,
+        .fields = FDF_FIELD_STROKE_COUNT, .handler = test_bus_handler, .ctx = &bus_strokes,
+    };
+    const fdf_bus_subscription_t slow_sub = {
+        .name = "slow", .topics = FDF_BUS_TOPIC_BIT(FDF_BUS_UPDATE), .delivery = FDF_BUS_LATEST,
+    };
+    TEST_CHECK(fdf_bus_subscribe(&stroke_sub) >= 0);
+    int slow = fdf_bus_subscribe(&slow_sub);
+    TEST_CHECK(slow >= 0);
+    fdf_rowing_data_t bus_data;
+    memset(&bus_data, 0, sizeof(bus_data));
+    bus_data.present = FDF_FIELD_STROKE_COUNT | FDF_FIELD_DISTANCE;
+    bus_data.session_active = true;
+    for (uint32_t i = 1; i <= 4; i++) {
+        bus_data.seq = i;
+        bus_data.distance_m = i * 10;
+        bus_data.stroke_count = i / 2;
+        fdf_bus_parser_callback(1, &bus_data);
+        fdf_bus_parser_callback(1, &bus_data);
+        fdf_bus_parser_callback(0, &bus_data);
+    }
+    TEST_CHECK(bus_strokes == 3);
+    fdf_bus_topic_t bus_topic;
+    fdf_rowing_data_t bus_out;
+    TEST_CHECK(fdf_bus_read(slow, 1, &bus_out, &bus_topic));
+    TEST_CHECK(bus_out.seq == 4 && bus_topic == FDF_BUS_UPDATE);
+    TEST_CHECK(!fdf_bus_read(slow, 1, &bus_out, NULL));
+    fdf_bus_stats_t bus_stats;
+    TEST_CHECK(fdf_bus_get_stats(slow, &bus_stats) != NULL);
+    TEST_CHECK(bus_stats.delivered == 8 && bus_stats.overwritten == 6 && bus_stats.read == 1);
+
+    // Workout: 2 x 500 m, 250 m splits, 60 s rest, rowed at 6 m/s with a pace of 1:23.3
+    static fdf_workout_t workout;
+    fdf_workout_init(&workout);
+    fdf_workout_config_t intervals = { .type = FDF_WORKOUT_DISTANCE, .target = 500, .split = 600,
+                                       .rest_s = 60, .pieces = 2 };
+    TEST_CHECK(!fdf_workout_set(&workout, &intervals));
+    intervals.split = 250;
+    TEST_CHECK(fdf_workout_set(&workout, &intervals));
+    fdf_rowing_data_t row;
+    memset(&row, 0, sizeof(row));
+    row.present = FDF_FIELD_DISTANCE | FDF_FIELD_ELAPSED_TIME | FDF_FIELD_PACE;
+    row.pace_500m_ms = 83333;
+    fdf_workout_update(&workout, &row);
+    TEST_CHECK(workout.phase == FDF_WORKOUT_READY && !(row.present & FDF_FIELD_REMAINING_TIME));
+    uint32_t rowed_m = 0;
+    for (uint32_t t = 1; t <= 228; t++) {
+        // Idle through the rest, the console clock running on
+        if (t <= 84 || t > 144) {
+            rowed_m += 6;
+        }
+        row.timestamp_us = (int64_t)t * 1000000;
+        row.elapsed_time_ms = t * 1000;
+        row.distance_m = rowed_m;
+        fdf_workout_update(&workout, &row);
+        if (t == 1) {
+            TEST_CHECK(workout.phase == FDF_WORKOUT_WORK);
+            TEST_CHECK((row.present & FDF_FIELD_REMAINING_TIME) && row.remaining_time_s == 83);
+        } else if (t == 84) {
+            TEST_CHECK(workout.phase == FDF_WORKOUT_REST && workout.progress.splits == 2);
+            TEST_CHECK(row.remaining_time_s == 60);
+        } else if (t == 114) {
+            TEST_CHECK(row.remaining_time_s == 30);
+        } else if (t == 145) {
+            TEST_CHECK(workout.phase == FDF_WORKOUT_WORK && workout.piece == 1);
+        }
+    }
+    TEST_CHECK(workout.phase == FDF_WORKOUT_DONE && workout.progress.splits == 4);
+    TEST_CHECK((row.present & FDF_FIELD_REMAINING_TIME) && row.remaining_time_s == 0);
+    // Splits end where the crossing update is interpolated to the boundary
+    fdf_workout_split_t split;
+    TEST_CHECK(fdf_workout_get_split(&workout, 0, &split));
+    TEST_CHECK(split.piece == 0 && split.distance_m == 250 && split.time_ms == 41666);
+    TEST_CHECK(fdf_workout_get_split(&workout, 1, &split));
+    TEST_CHECK(split.distance_m == 250 && split.time_ms == 41667);
+    TEST_CHECK(fdf_workout_get_split(&workout, 3, &split) && split.piece == 1);
+    TEST_CHECK(!fdf_workout_get_split(&workout, 4, &split));
+    TEST_CHECK(fdf_workout_restart(&workout) && workout.phase == FDF_WORKOUT_READY);
+
+    // Settings: defaults without a blob, edits checked as a whole, stored and loaded back
+    const fdf_config_storage_t config_storage = {
+        .load = test_config_load,
+        .save = test_config_save,
+    };
+    TEST_CHECK(!fdf_config_init(&config_storage));
+    fdf_config_t defaults;
+    fdf_config_t config;
+    fdf_config_defaults(&defaults);
+    fdf_config_read(&config);
+    TEST_CHECK(memcmp(&config, &defaults, sizeof(defaults)) == 0 && fdf_config_validate(&defaults));
+    TEST_CHECK(fdf_config_set("name", "Gym Rower 3") == FDF_CONFIG_OK);
+    fdf_config_read(&config);
+    TEST_CHECK(strcmp(config.device_name, "Gym Rower 3") == 0);
+    TEST_CHECK(fdf_config_set("name", "") == FDF_CONFIG_INVALID_VALUE);
+    TEST_CHECK(fdf_config_set("conn_max", "0x10") == FDF_CONFIG_INVALID_VALUE);
+    TEST_CHECK(fdf_config_set("conn_min", "7") == FDF_CONFIG_INVALID_VALUE);
+    TEST_CHECK(fdf_config_set("conn_max", "1600") == FDF_CONFIG_INVALID_VALUE);
+    TEST_CHECK(fdf_config_set("conn_max", "1599") == FDF_CONFIG_OK);
+    TEST_CHECK(fdf_config_set("conn_max", "200") == FDF_CONFIG_OK);
+    TEST_CHECK(fdf_config_set("conn_min", "12") == FDF_CONFIG_OK);
+    TEST_CHECK(fdf_config_set("usb_rx_buf", "99999") == FDF_CONFIG_INVALID_VALUE);
+    TEST_CHECK(fdf_config_set("no_such_key", "1") == FDF_CONFIG_UNKNOWN_KEY);
+    TEST_CHECK(fdf_config_set("log_level", "4") == FDF_CONFIG_OK);
+    fdf_config_read(&config);
+    TEST_CHECK(config.log_level == 4 && config.conn_interval_min == 12);
+    TEST_CHECK(fdf_config_save() == FDF_CONFIG_OK && test_config_len <= FDF_CONFIG_BLOB_MAX);
+    TEST_CHECK(fdf_config_init(&config_storage));
+    fdf_config_read(&config);
+    TEST_CHECK(strcmp(config.device_name, "Gym Rower 3") == 0 && config.log_level == 4);
+    // A damaged blob is ignored as a whole
+    fdf_config_t loaded;
+    test_config_blob[6] ^= 0x01;
+    TEST_CHECK(!fdf_config_decode(&loaded, test_config_blob, test_config_len));
+    TEST_CHECK(!fdf_config_init(&config_storage));
+    fdf_config_read(&config);
+    TEST_CHECK(config.log_level == defaults.log_level);
+    TEST_CHECK(fdf_config_reset() == FDF_CONFIG_OK);
+    fdf_config_read(&config);
+    TEST_CHECK(config.conn_interval_min == 24);
+
+    // Filter: a one-stroke power spike is rejected, and a batch gives what stroke by stroke runs give
+    static fdf_stroke_t filter_arena[32];
+    static fdf_stroke_history_t filter_history;
+    fdf_filter_t stepped;
+    fdf_filter_t batched;
+    fdf_filter_t median_only;
+    fdf_strokes_init(&filter_history, filter_arena, 32);
+    fdf_filter_init(&stepped, 3, 50);
+    fdf_filter_init(&batched, 3, 50);
+    fdf_filter_init(&median_only, 4, 100);
+    TEST_CHECK(median_only.median == 5);
+    memset(&sample, 0, sizeof(sample));
+    sample.present = FDF_FIELD_STROKE_COUNT | FDF_FIELD_DISTANCE | FDF_FIELD_POWER |
+                     FDF_FIELD_PACE | FDF_FIELD_STROKE_RATE;
+    sample.session_active = true;
+    for (uint16_t i = 0; i <= 20; i++) {
+        sample.stroke_count = i;
+        sample.distance_m = i * 10u;
+        sample.power_watts = i == 8 ? 900 : (i < 12 ? 200 : 240);
+        sample.pace_500m_ms = 120000;
+        sample.stroke_rate = 24;
+        if (fdf_strokes_update(&filter_history, &sample)) {
+            TEST_CHECK(fdf_filter_run(&stepped, &filter_history) == 1);
+            fdf_filter_run(&median_only, &filter_history);
+            TEST_CHECK(median_only.value[FDF_FILTER_POWER] < 241.0f);
+        }
+    }
+    TEST_CHECK(fdf_filter_run(&batched, &filter_history) == 20 && fdf_filter_run(&batched, &filter_history) == 0);
+    for (int ch = 0; ch < FDF_FILTER_CHANNELS; ch++) {
+        float diff = stepped.value[ch] - batched.value[ch];
+        TEST_CHECK(diff < 0.01f && diff > -0.01f);
+    }
+    TEST_CHECK(stepped.value[FDF_FILTER_POWER] > 239.0f && stepped.value[FDF_FILTER_POWER] < 240.0f);
+    fdf_filter_apply(&stepped, &sample);
+    TEST_CHECK(sample.power_watts == 240 && sample.pace_500m_ms == 120000 && sample.stroke_rate == 24);
+    // The biquad is the moving average: y = a x + (1 - a) y[n-1]
+    float ema_in[3] = {10.0f, 20.0f, 20.0f};
+    float ema_out[3];
+    float ema_w[2] = {10.0f / 0.5f, 10.0f / 0.5f};
+    fdf_filter_biquad_ref(ema_in, ema_out, 3, stepped.coef, ema_w);
+    TEST_CHECK(ema_out[0] == 10.0f && ema_out[1] == 15.0f && ema_out[2] == 17.5f);
+
     ESP_LOGI(TAG, "FDF Protocol test completed");
+    return true;
 }
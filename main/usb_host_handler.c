@@ -1,41 +1,363 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 
 // USB Host includes
 #include "usb/usb_host.h"
 #include "usb/cdc_acm_host.h"
 
 #include "usb_host_handler.h"
+#include "console_profiles.h"
+#include "fdf_supervisor.h"
+#include "fdf_power.h"
+#include "fdf_config.h"
 
 static const char *TAG = "USB_HOST";
 
-// USB Host configuration
-#define USB_HOST_PRIORITY 20
+// USB Host configuration; buffer sizes and task priorities are settings (fdf_config.h)
 #define USB_HOST_TASK_STACK_SIZE 4096
 #define USB_HOST_EVENT_QUEUE_SIZE 10
+#define USB_LIB_TASK_STACK_SIZE 3072
 
-// CDC-ACM configuration
-#define CDC_ACM_RX_BUFFER_SIZE 1024
-#define CDC_ACM_TX_BUFFER_SIZE 1024
+// TX queue configuration
+#define USB_TX_QUEUE_SIZE 8
+#define USB_TX_TASK_STACK_SIZE 3072
+#define USB_TX_TIMEOUT_MS 100
+
+// Poll scheduler configuration
+#define USB_POLL_MAX_IN_FLIGHT 4
+#define USB_POLL_MAX_RATE_HZ 50
+
+// Length of a DTR pulse
+#define USB_DTR_PULSE_MS 100
+
+// USB device class of hubs, which are enumerated but never opened as consoles
+#define USB_CLASS_HUB 0x09
+
+// Queued TX command
+typedef struct {
+    uint8_t data[USB_TX_MAX_COMMAND_SIZE];
+    uint8_t len;
+    uint8_t console_id;
+    bool is_poll;  // Expects a response, tracked by the poll scheduler
+} usb_tx_command_t;
+
+// Per-console state
+typedef struct {
+    uint8_t id;                     // Slot index, reported with received data
+    cdc_acm_dev_hdl_t device;       // Open CDC-ACM device, NULL if closed
+    usb_device_handle_t usb_device; // Enumerated device, held open until it is gone; NULL if slot is free
+    const usb_device_desc_t *desc;  // Its descriptor, which identifies the device the driver opened
+    uint8_t address;                // USB address of the device
+    uint16_t vid;
+    uint16_t pid;
+    const console_profile_t *profile;  // Control lines applied at open
+    volatile bool ready;            // Profile applied, received data is usable
+    
+    // Outstanding requests, oldest first (send timestamps in microseconds)
+    int64_t pending_sent_us[USB_POLL_MAX_IN_FLIGHT];
+    uint8_t pending_head;
+    uint8_t pending_count;
+    uint8_t queued_polls;           // Polls queued but not yet written
+    bool stalled;                   // A request timed out, no response since
+    usb_poll_stats_t poll_stats;
+    usb_console_stats_t stats;
+} usb_console_t;
 
 // Global variables
 static usb_data_callback_t data_callback = NULL;
+static usb_open_callback_t open_callback = NULL;
 static usb_host_status_t host_status = USB_HOST_STATUS_DISCONNECTED;
-static cdc_acm_dev_hdl_t cdc_acm_device = NULL;
+static usb_console_t consoles[USB_HOST_MAX_CONSOLES];
 static usb_host_client_handle_t client_handle = NULL;
 static TaskHandle_t usb_host_task_handle = NULL;
+static TaskHandle_t usb_lib_task_handle = NULL;
 static QueueHandle_t usb_event_queue = NULL;
+static QueueHandle_t usb_tx_queue = NULL;
+static TaskHandle_t usb_tx_task_handle = NULL;
+
+// Devices left closed while an adapter with the same VID/PID is open, retried when a device goes
+static uint8_t deferred_addresses[USB_HOST_MAX_CONSOLES];
+static int deferred_count = 0;
+
+// Statically allocated pipeline objects, so the steady state never touches the heap
+static StaticQueue_t usb_event_queue_buffer;
+static uint8_t usb_event_queue_storage[USB_HOST_EVENT_QUEUE_SIZE * sizeof(usb_host_client_event_msg_t)];
+static StaticQueue_t usb_tx_queue_buffer;
+static uint8_t usb_tx_queue_storage[USB_TX_QUEUE_SIZE * sizeof(usb_tx_command_t)];
+static StaticTask_t usb_host_task_buffer;
+static StackType_t usb_host_task_stack[USB_HOST_TASK_STACK_SIZE];
+static StaticTask_t usb_lib_task_buffer;
+static StackType_t usb_lib_task_stack[USB_LIB_TASK_STACK_SIZE];
+static StaticTask_t usb_tx_task_buffer;
+static StackType_t usb_tx_task_stack[USB_TX_TASK_STACK_SIZE];
+
+// Poll scheduler state
+static esp_timer_handle_t poll_timer = NULL;
+static usb_tx_command_t poll_command;
+static uint8_t poll_max_in_flight = 1;
+static int64_t poll_timeout_us = 0;
+static portMUX_TYPE poll_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Consoles to reopen, one bit per slot, served by the USB host task
+static atomic_uint_least32_t reopen_requests;
 
 // Forward declarations
 static void usb_host_task(void *arg);
+static void usb_lib_task(void *arg);
 static void usb_event_callback(const usb_host_client_event_msg_t *event_msg, void *arg);
 static bool cdc_acm_data_callback(const uint8_t *data, size_t data_len, void *user_arg);
 static void cdc_acm_event_callback(const cdc_acm_host_dev_event_data_t *event, void *user_ctx);
+static void usb_tx_task(void *arg);
+static void poll_timer_callback(void *arg);
+static void poll_reset_pending(usb_console_t *console);
+
+/**
+ * @brief Recompute aggregate host status from the console slots
+ */
+static void update_host_status(void)
+{
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        if (consoles[i].device != NULL) {
+            host_status = USB_HOST_STATUS_CONNECTED;
+            return;
+        }
+    }
+    host_status = USB_HOST_STATUS_DISCONNECTED;
+}
+
+/**
+ * @brief Open the CDC-ACM device of a console slot and apply its profile
+ */
+static esp_err_t open_cdc_device(usb_console_t *console)
+{
+    fdf_config_t config;
+    fdf_config_read(&config);
+    const cdc_acm_host_device_config_t dev_config = {
+        .connection_timeout_ms = 5000,
+        .out_buffer_size = config.usb_tx_buffer,
+        .in_buffer_size = config.usb_rx_buffer,
+        .event_cb = cdc_acm_event_callback,
+        .data_cb = cdc_acm_data_callback,
+        .user_arg = console,
+    };
+    
+    cdc_acm_dev_hdl_t cdc_dev = NULL;
+    esp_err_t ret = cdc_acm_host_open(console->vid, console->pid, 0, &dev_config, &cdc_dev);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // The driver opens the first device with this VID/PID, which must be the enumerated one
+    const usb_device_desc_t *desc = NULL;
+    if (cdc_acm_host_get_device_descriptor(cdc_dev, &desc) != ESP_OK || desc != console->desc) {
+        ESP_LOGE(TAG, "Console %d: driver opened another %04x:%04x device", console->id,
+                 console->vid, console->pid);
+        cdc_acm_host_close(cdc_dev);
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    poll_reset_pending(console);
+    console->stalled = false;
+    console->ready = false;
+    console->device = cdc_dev;
+#if CONFIG_FDF_POWER_MANAGEMENT
+    // Held for as long as the device is open: no light sleep, full APB clock
+    fdf_power_acquire(FDF_POWER_STAGE_USB);
+#endif
+    
+    // Apply line coding and control lines before accepting any data
+    const console_profile_t *profile = console->profile;
+    ret = cdc_acm_host_line_coding_set(cdc_dev, console_line_coding());
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Console %d: failed to set line coding: %s", console->id, esp_err_to_name(ret));
+    }
+    ret = cdc_acm_host_set_control_line_state(cdc_dev, profile->dtr, profile->rts);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Console %d: failed to set control lines: %s", console->id, esp_err_to_name(ret));
+    }
+    console->ready = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Close a console's device and open it again, keeping the slot
+ */
+static void reopen_console(usb_console_t *console)
+{
+    cdc_acm_dev_hdl_t cdc_dev = console->device;
+    if (cdc_dev == NULL) {
+        // Unplugged since the request
+        return;
+    }
+    
+    console->ready = false;
+    console->device = NULL;
+    cdc_acm_host_close(cdc_dev);
+#if CONFIG_FDF_POWER_MANAGEMENT
+    fdf_power_release(FDF_POWER_STAGE_USB);
+#endif
+    
+    esp_err_t ret = open_cdc_device(console);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to reopen console %d: %s", console->id, esp_err_to_name(ret));
+        update_host_status();
+        fdf_supervisor_post(FDF_SUP_USB_DISCONNECTED, console->id);
+        return;
+    }
+    ESP_LOGI(TAG, "Console %d reopened", console->id);
+}
+
+/**
+ * @brief Keep a device for later, once an identical adapter is gone
+ */
+static void defer_device(uint8_t address)
+{
+    for (int i = 0; i < deferred_count; i++) {
+        if (deferred_addresses[i] == address) {
+            return;
+        }
+    }
+    if (deferred_count < USB_HOST_MAX_CONSOLES) {
+        deferred_addresses[deferred_count++] = address;
+    }
+}
+
+/**
+ * @brief Open a newly attached device as a console if it is not a hub
+ */
+static void open_console(uint8_t address)
+{
+    usb_device_handle_t dev_hdl;
+    const usb_device_desc_t *desc;
+    
+    // Held open while the device is a console: it identifies the device and brings its DEV_GONE event
+    esp_err_t ret = usb_host_device_open(client_handle, address, &dev_hdl);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open USB device %d: %s", address, esp_err_to_name(ret));
+        return;
+    }
+    ret = usb_host_get_device_descriptor(dev_hdl, &desc);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read descriptor of USB device %d: %s", address, esp_err_to_name(ret));
+        usb_host_device_close(client_handle, dev_hdl);
+        return;
+    }
+    uint16_t vid = desc->idVendor;
+    uint16_t pid = desc->idProduct;
+    
+    if (desc->bDeviceClass == USB_CLASS_HUB) {
+        ESP_LOGI(TAG, "USB hub attached at address %d", address);
+        usb_host_device_close(client_handle, dev_hdl);
+        return;
+    }
+    
+    const console_profile_t *profile = console_profile_find(vid, pid);
+#if CONFIG_FDF_CONSOLE_ALLOWLIST_ONLY
+    if (!console_profile_is_known(vid, pid)) {
+        ESP_LOGW(TAG, "Device %04x:%04x is not a known console adapter, ignoring", vid, pid);
+        usb_host_device_close(client_handle, dev_hdl);
+        return;
+    }
+#endif
+    
+    // The CDC-ACM driver opens devices by VID/PID and would hand back an identical adapter
+    // that is already open: this one waits until that adapter is gone
+    usb_console_t *console = NULL;
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        if (consoles[i].usb_device != NULL && consoles[i].vid == vid && consoles[i].pid == pid) {
+            ESP_LOGW(TAG, "Console %d is an identical %04x:%04x adapter, device %d waits for it to go",
+                     consoles[i].id, vid, pid, address);
+            defer_device(address);
+            usb_host_device_close(client_handle, dev_hdl);
+            return;
+        }
+        if (console == NULL && consoles[i].usb_device == NULL) {
+            console = &consoles[i];
+        }
+    }
+    if (console == NULL) {
+        ESP_LOGW(TAG, "All %d console slots in use, ignoring device %04x:%04x",
+                 USB_HOST_MAX_CONSOLES, vid, pid);
+        usb_host_device_close(client_handle, dev_hdl);
+        return;
+    }
+    
+    console->usb_device = dev_hdl;
+    console->desc = desc;
+    console->address = address;
+    console->vid = vid;
+    console->pid = pid;
+    console->profile = profile;
+    
+    // A new session on this slot: its state is reset before the device can deliver data
+    if (open_callback != NULL) {
+        open_callback(console->id);
+    }
+    ret = open_cdc_device(console);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open CDC-ACM device %04x:%04x: %s", vid, pid, esp_err_to_name(ret));
+        console->usb_device = NULL;
+        console->desc = NULL;
+        usb_host_device_close(client_handle, dev_hdl);
+        host_status = USB_HOST_STATUS_ERROR;
+        return;
+    }
+    memset(&console->poll_stats, 0, sizeof(usb_poll_stats_t));
+    update_host_status();
+    fdf_supervisor_post(FDF_SUP_USB_CONNECTED, console->id);
+    
+    ESP_LOGI(TAG, "Console %d opened: %s (%04x:%04x) at address %d, %" PRIu32 " baud, %s",
+             console->id, profile->name, vid, pid, address, console_line_coding()->dwDTERate,
+             console_dialect() == CONSOLE_DIALECT_POLLED ? "polled" : "streaming");
+}
+
+/**
+ * @brief Free the slot of a device that is gone, then retry the devices waiting for it
+ */
+static void release_console(usb_device_handle_t dev_hdl)
+{
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        if (consoles[i].usb_device == dev_hdl) {
+            // The CDC-ACM disconnect event closed the console already
+            consoles[i].usb_device = NULL;
+            consoles[i].desc = NULL;
+        }
+    }
+    usb_host_device_close(client_handle, dev_hdl);
+    
+    // A waiting device that is gone too fails to open and is dropped
+    uint8_t waiting[USB_HOST_MAX_CONSOLES];
+    int count = deferred_count;
+    memcpy(waiting, deferred_addresses, sizeof(waiting));
+    deferred_count = 0;
+    for (int i = 0; i < count; i++) {
+        open_console(waiting[i]);
+    }
+}
+
+/**
+ * @brief USB Host library task: enumeration and device bookkeeping
+ */
+static void usb_lib_task(void *arg)
+{
+    ESP_LOGI(TAG, "USB Host library task started");
+    
+    while (1) {
+        uint32_t event_flags;
+        usb_host_lib_handle_events(portMAX_DELAY, &event_flags);
+        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
+            usb_host_device_free_all();
+        }
+    }
+}
 
 /**
  * @brief USB Host task to handle USB events
@@ -43,63 +365,43 @@ static void cdc_acm_event_callback(const cdc_acm_host_dev_event_data_t *event, v
 static void usb_host_task(void *arg)
 {
     usb_host_client_event_msg_t event_msg;
-    bool client_gone = false;
     
     ESP_LOGI(TAG, "USB Host task started");
     
     while (1) {
-        // Wait for USB events
-        if (xQueueReceive(usb_event_queue, &event_msg, portMAX_DELAY) == pdTRUE) {
+        // Dispatch client events to usb_event_callback, which queues them
+        usb_host_client_handle_events(client_handle, portMAX_DELAY);
+        
+        // Consoles are opened here, outside the client event dispatch
+        while (xQueueReceive(usb_event_queue, &event_msg, 0) == pdTRUE) {
             switch (event_msg.event) {
                 case USB_HOST_CLIENT_EVENT_NEW_DEV:
                     ESP_LOGI(TAG, "New USB device detected");
                     if (event_msg.new_dev.address != 0) {
-                        // Configure CDC-ACM device
-                        const cdc_acm_host_device_config_t dev_config = {
-                            .connection_timeout_ms = 5000,
-                            .out_buffer_size = CDC_ACM_TX_BUFFER_SIZE,
-                            .in_buffer_size = CDC_ACM_RX_BUFFER_SIZE,
-                            .event_cb = cdc_acm_event_callback,
-                            .data_cb = cdc_acm_data_callback,
-                            .user_arg = NULL,
-                        };
-                        
-                        // Try to open CDC-ACM device (using VID/PID 0 for any CDC-ACM device)
-                        esp_err_t ret = cdc_acm_host_open(CDC_HOST_ANY_VID, CDC_HOST_ANY_PID, 0, &dev_config, &cdc_acm_device);
-                        if (ret == ESP_OK) {
-                            ESP_LOGI(TAG, "CDC-ACM device opened successfully");
-                            host_status = USB_HOST_STATUS_CONNECTED;
-                        } else {
-                            ESP_LOGE(TAG, "Failed to open CDC-ACM device: %s", esp_err_to_name(ret));
-                            host_status = USB_HOST_STATUS_ERROR;
-                        }
+                        open_console(event_msg.new_dev.address);
                     }
                     break;
                     
                 case USB_HOST_CLIENT_EVENT_DEV_GONE:
+                    // Consoles are closed from their CDC-ACM disconnect event
                     ESP_LOGI(TAG, "USB device disconnected");
-                    if (cdc_acm_device != NULL) {
-                        cdc_acm_host_close(cdc_acm_device);
-                        cdc_acm_device = NULL;
-                    }
-                    host_status = USB_HOST_STATUS_DISCONNECTED;
-                    client_gone = true;
+                    release_console(event_msg.dev_gone.dev_hdl);
                     break;
                     
                 default:
                     ESP_LOGW(TAG, "Unhandled USB event: %d", event_msg.event);
                     break;
             }
-            
-            // If client is gone, exit the task
-            if (client_gone) {
-                break;
+        }
+        
+        // Recovery reopens, requested through usb_host_client_unblock()
+        uint32_t reopen = atomic_exchange(&reopen_requests, 0);
+        for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+            if (reopen & (1u << i)) {
+                reopen_console(&consoles[i]);
             }
         }
     }
-    
-    ESP_LOGI(TAG, "USB Host task ended");
-    vTaskDelete(NULL);
 }
 
 /**
@@ -117,9 +419,27 @@ static void usb_event_callback(const usb_host_client_event_msg_t *event_msg, voi
  */
 static bool cdc_acm_data_callback(const uint8_t *data, size_t data_len, void *user_arg)
 {
-    ESP_LOGD(TAG, "Received %d bytes from CDC-ACM", data_len);
+    // Timestamp first so the time reflects the transfer, not our processing
+    int64_t now = esp_timer_get_time();
+    usb_console_t *console = (usb_console_t *)user_arg;
+    
+    // Bytes received before the line coding was applied are garbage
+    if (!console->ready) {
+        console->stats.rx_discarded += data_len;
+        return true;
+    }
+    
+    ESP_LOGD(TAG, "Received %zu bytes from console %d", data_len, console->id);
+    console->stats.rx_chunks++;
+    console->stats.rx_bytes += data_len;
     if (data_callback != NULL) {
-        data_callback(data, data_len);
+        const usb_rx_chunk_t chunk = {
+            .console_id = console->id,
+            .timestamp_us = now,
+            .data = data,
+            .length = data_len,
+        };
+        data_callback(&chunk);
     }
     return true; // Data processed, flush RX buffer
 }
@@ -129,25 +449,39 @@ static bool cdc_acm_data_callback(const uint8_t *data, size_t data_len, void *us
  */
 static void cdc_acm_event_callback(const cdc_acm_host_dev_event_data_t *event, void *user_ctx)
 {
+    usb_console_t *console = (usb_console_t *)user_ctx;
+    
     switch (event->type) {
         case CDC_ACM_HOST_ERROR:
-            ESP_LOGE(TAG, "CDC-ACM error: %d", event->data.error);
+            ESP_LOGE(TAG, "Console %d CDC-ACM error: %d", console->id, event->data.error);
             host_status = USB_HOST_STATUS_ERROR;
             break;
             
         case CDC_ACM_HOST_SERIAL_STATE:
-            ESP_LOGI(TAG, "CDC-ACM serial state changed");
+            ESP_LOGI(TAG, "Console %d serial state changed", console->id);
             break;
             
         case CDC_ACM_HOST_NETWORK_CONNECTION:
-            ESP_LOGI(TAG, "CDC-ACM network connection: %s", event->data.network_connected ? "connected" : "disconnected");
+            ESP_LOGI(TAG, "Console %d network connection: %s", console->id,
+                     event->data.network_connected ? "connected" : "disconnected");
             break;
             
-        case CDC_ACM_HOST_DEVICE_DISCONNECTED:
-            ESP_LOGI(TAG, "CDC-ACM device disconnected");
-            cdc_acm_device = NULL;
-            host_status = USB_HOST_STATUS_DISCONNECTED;
+        case CDC_ACM_HOST_DEVICE_DISCONNECTED: {
+            ESP_LOGI(TAG, "Console %d disconnected", console->id);
+            cdc_acm_dev_hdl_t cdc_dev = console->device;
+            console->ready = false;
+            console->device = NULL;
+            poll_reset_pending(console);
+            if (cdc_dev != NULL) {
+                cdc_acm_host_close(cdc_dev);
+#if CONFIG_FDF_POWER_MANAGEMENT
+                fdf_power_release(FDF_POWER_STAGE_USB);
+#endif
+            }
+            update_host_status();
+            fdf_supervisor_post(FDF_SUP_USB_DISCONNECTED, console->id);
             break;
+        }
             
         default:
             ESP_LOGW(TAG, "Unhandled CDC-ACM event: %d", event->type);
@@ -155,25 +489,159 @@ static void cdc_acm_event_callback(const cdc_acm_host_dev_event_data_t *event, v
     }
 }
 
+/**
+ * @brief USB TX task draining the command queue
+ */
+static void usb_tx_task(void *arg)
+{
+    usb_tx_command_t cmd;
+
+    ESP_LOGI(TAG, "USB TX task started");
+
+    while (1) {
+        if (xQueueReceive(usb_tx_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        usb_console_t *console = &consoles[cmd.console_id];
+
+        if (cmd.is_poll) {
+            portENTER_CRITICAL(&poll_lock);
+            console->queued_polls--;
+            portEXIT_CRITICAL(&poll_lock);
+        }
+
+        cdc_acm_dev_hdl_t dev = console->device;
+        if (dev == NULL) {
+            continue;
+        }
+
+        // Timestamp before writing so the round trip includes the transfer
+        int64_t sent_us = esp_timer_get_time();
+        esp_err_t ret = cdc_acm_host_data_tx_blocking(dev, cmd.data, cmd.len, USB_TX_TIMEOUT_MS);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send data to console %d: %s", console->id, esp_err_to_name(ret));
+            console->stats.tx_errors++;
+            continue;
+        }
+        console->stats.tx_commands++;
+
+        if (cmd.is_poll) {
+            portENTER_CRITICAL(&poll_lock);
+            if (console->pending_count < USB_POLL_MAX_IN_FLIGHT) {
+                uint8_t slot = (console->pending_head + console->pending_count) % USB_POLL_MAX_IN_FLIGHT;
+                console->pending_sent_us[slot] = sent_us;
+                console->pending_count++;
+            }
+            console->poll_stats.requests_sent++;
+            portEXIT_CRITICAL(&poll_lock);
+        }
+    }
+}
+
+/**
+ * @brief Drop all outstanding requests of a console
+ */
+static void poll_reset_pending(usb_console_t *console)
+{
+    portENTER_CRITICAL(&poll_lock);
+    console->pending_head = 0;
+    console->pending_count = 0;
+    portEXIT_CRITICAL(&poll_lock);
+}
+
+/**
+ * @brief Poll timer callback, queues a status request to every connected
+ *        console whose pipeline has room
+ */
+static void poll_timer_callback(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        usb_console_t *console = &consoles[i];
+        bool has_room;
+        bool stalled = false;
+
+        if (console->device == NULL || !console->ready ||
+            console_dialect() != CONSOLE_DIALECT_POLLED) {
+            continue;
+        }
+
+        portENTER_CRITICAL(&poll_lock);
+        // Expire requests the console never answered
+        while (console->pending_count > 0 &&
+               now - console->pending_sent_us[console->pending_head] > poll_timeout_us) {
+            console->pending_head = (console->pending_head + 1) % USB_POLL_MAX_IN_FLIGHT;
+            console->pending_count--;
+            console->poll_stats.requests_timed_out++;
+            stalled = !console->stalled;
+            console->stalled = true;
+        }
+        has_room = (console->pending_count + console->queued_polls) < poll_max_in_flight;
+        if (has_room) {
+            console->queued_polls++;
+        } else {
+            console->poll_stats.polls_skipped++;
+        }
+        portEXIT_CRITICAL(&poll_lock);
+
+        // Report a console that stopped answering once, not every poll
+        if (stalled) {
+            fdf_supervisor_post(FDF_SUP_DATA_STALL, console->id);
+        }
+        if (!has_room) {
+            continue;
+        }
+
+        usb_tx_command_t cmd = poll_command;
+        cmd.console_id = console->id;
+        if (xQueueSend(usb_tx_queue, &cmd, 0) != pdTRUE) {
+            portENTER_CRITICAL(&poll_lock);
+            console->queued_polls--;
+            console->poll_stats.polls_skipped++;
+            portEXIT_CRITICAL(&poll_lock);
+        }
+    }
+}
+
 /**
  * @brief Initialize USB host and CDC-ACM driver
  */
 esp_err_t usb_host_init(usb_data_callback_t callback)
 {
     esp_err_t ret;
+    fdf_config_t config;
+    fdf_config_read(&config);
     
     ESP_LOGI(TAG, "Initializing USB Host");
     
     // Store callback
     data_callback = callback;
     
+    // Reset console slots
+    memset(consoles, 0, sizeof(consoles));
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        consoles[i].id = i;
+    }
+    
     // Create event queue
-    usb_event_queue = xQueueCreate(USB_HOST_EVENT_QUEUE_SIZE, sizeof(usb_host_client_event_msg_t));
+    usb_event_queue = xQueueCreateStatic(USB_HOST_EVENT_QUEUE_SIZE, sizeof(usb_host_client_event_msg_t),
+                                         usb_event_queue_storage, &usb_event_queue_buffer);
     if (usb_event_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create USB event queue");
         return ESP_ERR_NO_MEM;
     }
     
+    // Create TX command queue
+    usb_tx_queue = xQueueCreateStatic(USB_TX_QUEUE_SIZE, sizeof(usb_tx_command_t),
+                                      usb_tx_queue_storage, &usb_tx_queue_buffer);
+    if (usb_tx_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create USB TX queue");
+        vQueueDelete(usb_event_queue);
+        return ESP_ERR_NO_MEM;
+    }
+    
     // Initialize USB Host
     const usb_host_config_t host_config = {
         .intr_flags = ESP_INTR_FLAG_LEVEL1,
@@ -182,10 +650,17 @@ esp_err_t usb_host_init(usb_data_callback_t callback)
     ret = usb_host_install(&host_config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to install USB host: %s", esp_err_to_name(ret));
+        vQueueDelete(usb_tx_queue);
         vQueueDelete(usb_event_queue);
         return ret;
     }
     
+    // The library only enumerates devices while its events are handled
+    usb_lib_task_handle = xTaskCreateStatic(usb_lib_task, "usb_lib_task",
+                                            USB_LIB_TASK_STACK_SIZE, NULL,
+                                            config.usb_host_priority, usb_lib_task_stack,
+                                            &usb_lib_task_buffer);
+    
     // Install USB Host client
     const usb_host_client_config_t client_config = {
         .is_synchronous = false,
@@ -199,7 +674,10 @@ esp_err_t usb_host_init(usb_data_callback_t callback)
     ret = usb_host_client_register(&client_config, &client_handle);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register USB host client: %s", esp_err_to_name(ret));
+        vTaskDelete(usb_lib_task_handle);
+        usb_lib_task_handle = NULL;
         usb_host_uninstall();
+        vQueueDelete(usb_tx_queue);
         vQueueDelete(usb_event_queue);
         return ret;
     }
@@ -207,7 +685,7 @@ esp_err_t usb_host_init(usb_data_callback_t callback)
     // Initialize CDC-ACM host
     const cdc_acm_host_driver_config_t acm_config = {
         .driver_task_stack_size = 4096,
-        .driver_task_priority = 5,
+        .driver_task_priority = config.cdc_driver_priority,
         .xCoreID = 0,
         .new_dev_cb = NULL,
     };
@@ -216,28 +694,48 @@ esp_err_t usb_host_init(usb_data_callback_t callback)
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to install CDC-ACM host: %s", esp_err_to_name(ret));
         usb_host_client_deregister(client_handle);
+        vTaskDelete(usb_lib_task_handle);
+        usb_lib_task_handle = NULL;
         usb_host_uninstall();
+        vQueueDelete(usb_tx_queue);
         vQueueDelete(usb_event_queue);
         return ret;
     }
     
     // Create USB host task
-    BaseType_t task_ret = xTaskCreate(usb_host_task, "usb_host_task", 
-                                     USB_HOST_TASK_STACK_SIZE, NULL, 
-                                     USB_HOST_PRIORITY, &usb_host_task_handle);
-    if (task_ret != pdPASS) {
+    usb_host_task_handle = xTaskCreateStatic(usb_host_task, "usb_host_task",
+                                             USB_HOST_TASK_STACK_SIZE, NULL,
+                                             config.usb_host_priority, usb_host_task_stack,
+                                             &usb_host_task_buffer);
+    if (usb_host_task_handle == NULL) {
         ESP_LOGE(TAG, "Failed to create USB host task");
         cdc_acm_host_uninstall();
         usb_host_client_deregister(client_handle);
+        vTaskDelete(usb_lib_task_handle);
+        usb_lib_task_handle = NULL;
         usb_host_uninstall();
+        vQueueDelete(usb_tx_queue);
         vQueueDelete(usb_event_queue);
         return ESP_ERR_NO_MEM;
     }
     
-    // Start handling USB events
-    ret = usb_host_client_handle_events(client_handle, portMAX_DELAY);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to handle USB events: %s", esp_err_to_name(ret));
+    // Create USB TX task
+    usb_tx_task_handle = xTaskCreateStatic(usb_tx_task, "usb_tx_task",
+                                           USB_TX_TASK_STACK_SIZE, NULL,
+                                           config.usb_tx_priority, usb_tx_task_stack,
+                                           &usb_tx_task_buffer);
+    if (usb_tx_task_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create USB TX task");
+        vTaskDelete(usb_host_task_handle);
+        usb_host_task_handle = NULL;
+        cdc_acm_host_uninstall();
+        usb_host_client_deregister(client_handle);
+        vTaskDelete(usb_lib_task_handle);
+        usb_lib_task_handle = NULL;
+        usb_host_uninstall();
+        vQueueDelete(usb_tx_queue);
+        vQueueDelete(usb_event_queue);
+        return ESP_ERR_NO_MEM;
     }
     
     ESP_LOGI(TAG, "USB Host initialized successfully");
@@ -245,11 +743,38 @@ esp_err_t usb_host_init(usb_data_callback_t callback)
 }
 
 /**
- * @brief Check if FDF console is connected
+ * @brief Register the function called when a console is opened
+ */
+void usb_host_register_open_callback(usb_open_callback_t callback)
+{
+    open_callback = callback;
+}
+
+/**
+ * @brief Check if at least one FDF console is connected
  */
 bool usb_host_is_connected(void)
 {
-    return (host_status == USB_HOST_STATUS_CONNECTED) && (cdc_acm_device != NULL);
+    return host_status == USB_HOST_STATUS_CONNECTED;
+}
+
+/**
+ * @brief Check if a given FDF console is connected
+ */
+bool usb_host_console_is_connected(uint8_t console_id)
+{
+    return console_id < USB_HOST_MAX_CONSOLES && consoles[console_id].device != NULL;
+}
+
+/**
+ * @brief Get the profile applied to a console
+ */
+const console_profile_t *usb_host_get_console_profile(uint8_t console_id)
+{
+    if (!usb_host_console_is_connected(console_id)) {
+        return NULL;
+    }
+    return consoles[console_id].profile;
 }
 
 /**
@@ -261,23 +786,209 @@ usb_host_status_t usb_host_get_status(void)
 }
 
 /**
- * @brief Send data to USB device
+ * @brief Queue data for transmission to a console
  */
-esp_err_t usb_host_send_data(const uint8_t *data, size_t len)
+esp_err_t usb_host_send_data(uint8_t console_id, const uint8_t *data, size_t len)
 {
-    if (cdc_acm_device == NULL) {
-        ESP_LOGW(TAG, "CDC-ACM device not connected");
+    if (!usb_host_console_is_connected(console_id) || usb_tx_queue == NULL) {
+        ESP_LOGW(TAG, "Console %d not connected", console_id);
         return ESP_ERR_INVALID_STATE;
     }
     
-    esp_err_t ret = cdc_acm_host_data_tx_blocking(cdc_acm_device, data, len, 1000);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send data: %s", esp_err_to_name(ret));
+    if (data == NULL || len == 0 || len > USB_TX_MAX_COMMAND_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    usb_tx_command_t cmd = {
+        .len = (uint8_t)len,
+        .console_id = console_id,
+        .is_poll = false,
+    };
+    memcpy(cmd.data, data, len);
+    
+    if (xQueueSend(usb_tx_queue, &cmd, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "USB TX queue full, dropping command");
+        return ESP_ERR_NO_MEM;
+    }
+    
+    return ESP_OK;
+}
+
+/**
+ * @brief Pulse DTR away from the profile's level and back
+ */
+esp_err_t usb_host_toggle_dtr(uint8_t console_id)
+{
+    if (!usb_host_console_is_connected(console_id)) {
+        return ESP_ERR_INVALID_STATE;
     }
     
+    usb_console_t *console = &consoles[console_id];
+    cdc_acm_dev_hdl_t dev = console->device;
+    const console_profile_t *profile = console->profile;
+    esp_err_t ret = cdc_acm_host_set_control_line_state(dev, !profile->dtr, profile->rts);
+    if (ret == ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(USB_DTR_PULSE_MS));
+        ret = cdc_acm_host_set_control_line_state(dev, profile->dtr, profile->rts);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Console %d: failed to pulse DTR: %s", console_id, esp_err_to_name(ret));
+    }
     return ret;
 }
 
+/**
+ * @brief Have the USB host task close and reopen a console's device
+ */
+esp_err_t usb_host_reopen_console(uint8_t console_id)
+{
+    if (!usb_host_console_is_connected(console_id) || client_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    atomic_fetch_or(&reopen_requests, 1u << console_id);
+    return usb_host_client_unblock(client_handle);
+}
+
+/**
+ * @brief Start issuing periodic status requests to all connected consoles
+ */
+esp_err_t usb_host_start_polling(const usb_poll_config_t *config)
+{
+    if (config == NULL || config->request == NULL || config->request_len == 0 ||
+        config->request_len > USB_TX_MAX_COMMAND_SIZE ||
+        config->rate_hz == 0 || config->rate_hz > USB_POLL_MAX_RATE_HZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (usb_tx_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    usb_host_stop_polling();
+    
+    memcpy(poll_command.data, config->request, config->request_len);
+    poll_command.len = (uint8_t)config->request_len;
+    poll_command.is_poll = true;
+    
+    poll_max_in_flight = config->max_in_flight;
+    if (poll_max_in_flight == 0) {
+        poll_max_in_flight = 1;
+    } else if (poll_max_in_flight > USB_POLL_MAX_IN_FLIGHT) {
+        poll_max_in_flight = USB_POLL_MAX_IN_FLIGHT;
+    }
+    poll_timeout_us = (int64_t)config->response_timeout_ms * 1000;
+    
+    if (poll_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = poll_timer_callback,
+            .name = "usb_poll",
+        };
+        esp_err_t ret = esp_timer_create(&timer_args, &poll_timer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create poll timer: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    
+    esp_err_t ret = esp_timer_start_periodic(poll_timer, 1000000 / config->rate_hz);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start poll timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Polling consoles at %" PRIu32 " Hz, up to %d requests in flight",
+             config->rate_hz, poll_max_in_flight);
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop issuing periodic status requests
+ */
+void usb_host_stop_polling(void)
+{
+    if (poll_timer != NULL && esp_timer_is_active(poll_timer)) {
+        esp_timer_stop(poll_timer);
+    }
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        poll_reset_pending(&consoles[i]);
+    }
+}
+
+/**
+ * @brief Match a received response to the oldest outstanding request of a console
+ */
+bool usb_host_poll_response_received(uint8_t console_id, uint32_t *rtt_us)
+{
+    if (console_id >= USB_HOST_MAX_CONSOLES) {
+        return false;
+    }
+    
+    usb_console_t *console = &consoles[console_id];
+    int64_t now = esp_timer_get_time();
+    bool matched = false;
+    uint32_t rtt = 0;
+    
+    portENTER_CRITICAL(&poll_lock);
+    if (console->pending_count > 0) {
+        rtt = (uint32_t)(now - console->pending_sent_us[console->pending_head]);
+        console->pending_head = (console->pending_head + 1) % USB_POLL_MAX_IN_FLIGHT;
+        console->pending_count--;
+        console->poll_stats.responses_matched++;
+        console->stalled = false;
+        console->poll_stats.last_rtt_us = rtt;
+        if (rtt > console->poll_stats.max_rtt_us) {
+            console->poll_stats.max_rtt_us = rtt;
+        }
+        matched = true;
+    }
+    portEXIT_CRITICAL(&poll_lock);
+    
+    if (matched && rtt_us != NULL) {
+        *rtt_us = rtt;
+    }
+    return matched;
+}
+
+/**
+ * @brief Get poll scheduler statistics of a console
+ */
+void usb_host_get_poll_stats(uint8_t console_id, usb_poll_stats_t *stats)
+{
+    if (stats == NULL || console_id >= USB_HOST_MAX_CONSOLES) {
+        return;
+    }
+    
+    portENTER_CRITICAL(&poll_lock);
+    memcpy(stats, &consoles[console_id].poll_stats, sizeof(usb_poll_stats_t));
+    portEXIT_CRITICAL(&poll_lock);
+}
+
+/**
+ * @brief Get transfer counters of a console
+ */
+void usb_host_get_console_stats(uint8_t console_id, usb_console_stats_t *stats)
+{
+    if (stats == NULL || console_id >= USB_HOST_MAX_CONSOLES) {
+        return;
+    }
+    
+    memcpy(stats, &consoles[console_id].stats, sizeof(usb_console_stats_t));
+}
+
+/**
+ * @brief Clear the transfer and poll counters of every console
+ */
+void usb_host_reset_stats(void)
+{
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        memset(&consoles[i].stats, 0, sizeof(usb_console_stats_t));
+        portENTER_CRITICAL(&poll_lock);
+        memset(&consoles[i].poll_stats, 0, sizeof(usb_poll_stats_t));
+        portEXIT_CRITICAL(&poll_lock);
+    }
+}
+
 /**
  * @brief Deinitialize USB host
  */
@@ -285,17 +996,43 @@ void usb_host_deinit(void)
 {
     ESP_LOGI(TAG, "Deinitializing USB Host");
     
-    // Close CDC-ACM device if open
-    if (cdc_acm_device != NULL) {
-        cdc_acm_host_close(cdc_acm_device);
-        cdc_acm_device = NULL;
+    // Stop and delete poll timer
+    usb_host_stop_polling();
+    if (poll_timer != NULL) {
+        esp_timer_delete(poll_timer);
+        poll_timer = NULL;
+    }
+    
+    // Close CDC-ACM devices that are still open
+    for (int i = 0; i < USB_HOST_MAX_CONSOLES; i++) {
+        if (consoles[i].device != NULL) {
+            cdc_acm_host_close(consoles[i].device);
+            consoles[i].device = NULL;
+#if CONFIG_FDF_POWER_MANAGEMENT
+            fdf_power_release(FDF_POWER_STAGE_USB);
+#endif
+        }
+        if (consoles[i].usb_device != NULL) {
+            usb_host_device_close(client_handle, consoles[i].usb_device);
+            consoles[i].usb_device = NULL;
+            consoles[i].desc = NULL;
+        }
     }
+    deferred_count = 0;
     
-    // Delete USB host task
+    // Delete USB host and TX tasks
     if (usb_host_task_handle != NULL) {
         vTaskDelete(usb_host_task_handle);
         usb_host_task_handle = NULL;
     }
+    if (usb_tx_task_handle != NULL) {
+        vTaskDelete(usb_tx_task_handle);
+        usb_tx_task_handle = NULL;
+    }
+    if (usb_lib_task_handle != NULL) {
+        vTaskDelete(usb_lib_task_handle);
+        usb_lib_task_handle = NULL;
+    }
     
     // Uninstall CDC-ACM host
     cdc_acm_host_uninstall();
@@ -314,6 +1051,10 @@ void usb_host_deinit(void)
         vQueueDelete(usb_event_queue);
         usb_event_queue = NULL;
     }
+    if (usb_tx_queue != NULL) {
+        vQueueDelete(usb_tx_queue);
+        usb_tx_queue = NULL;
+    }
     
     host_status = USB_HOST_STATUS_DISCONNECTED;
     ESP_LOGI(TAG, "USB Host deinitialized");
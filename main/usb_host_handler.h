@@ -3,14 +3,31 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
 #include "esp_err.h"
+#include "console_profiles.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// USB Host callback function type for data received
-typedef void (*usb_data_callback_t)(const uint8_t *data, size_t length);
+// Maximum number of consoles served at once (behind a USB hub)
+#define USB_HOST_MAX_CONSOLES CONFIG_FDF_MAX_CONSOLES
+
+// Chunk of data received from a console
+typedef struct {
+    uint8_t console_id;       // Console slot the data came from
+    int64_t timestamp_us;     // esp_timer time at which the chunk was received
+    const uint8_t *data;      // Received bytes, valid only during the callback
+    size_t length;            // Number of received bytes
+} usb_rx_chunk_t;
+
+// USB Host callback function type for data received from a console
+typedef void (*usb_data_callback_t)(const usb_rx_chunk_t *chunk);
+
+// Called when a device is opened on a console slot, before any of its data is delivered
+typedef void (*usb_open_callback_t)(uint8_t console_id);
 
 // USB Host status
 typedef enum {
@@ -19,19 +36,79 @@ typedef enum {
     USB_HOST_STATUS_ERROR
 } usb_host_status_t;
 
+// Periodic status request configuration for consoles that only report when asked
+typedef struct {
+    const uint8_t *request;        // Request bytes sent on every poll
+    size_t request_len;            // Length of request (at most USB_TX_MAX_COMMAND_SIZE)
+    uint32_t rate_hz;              // Poll rate in Hz
+    uint8_t max_in_flight;         // Requests allowed to be outstanding at once
+    uint32_t response_timeout_ms;  // Outstanding requests older than this are dropped
+} usb_poll_config_t;
+
+// Poll scheduler statistics
+typedef struct {
+    uint32_t requests_sent;        // Requests written to the device
+    uint32_t responses_matched;    // Responses matched to an outstanding request
+    uint32_t requests_timed_out;   // Requests that never got a response
+    uint32_t polls_skipped;        // Poll ticks skipped because the pipeline was full
+    uint32_t last_rtt_us;          // Round-trip time of the last matched request
+    uint32_t max_rtt_us;           // Worst round-trip time seen
+} usb_poll_stats_t;
+
+// Transfer counters of a console slot
+typedef struct {
+    uint32_t rx_chunks;            // Chunks handed to the data callback
+    uint64_t rx_bytes;             // Bytes handed to the data callback
+    uint32_t rx_discarded;         // Bytes received before the line coding was applied
+    uint32_t tx_commands;          // Commands written to the device
+    uint32_t tx_errors;            // Commands the device did not take in time
+} usb_console_stats_t;
+
+// Maximum size of a single queued command
+#define USB_TX_MAX_COMMAND_SIZE 32
+
 /**
  * @brief Initialize USB host and CDC-ACM driver
+ *
+ * Returns once the drivers are installed and their tasks run; consoles are
+ * opened later, as they enumerate.
+ *
  * @param callback Function to call when data is received
  * @return ESP_OK if successful, error code otherwise
  */
 esp_err_t usb_host_init(usb_data_callback_t callback);
 
 /**
- * @brief Check if FDF console is connected
+ * @brief Register the function called when a console is opened
+ *
+ * Called by the USB host task, which also delivers the console's data
+ * afterwards, so the slot's session state can be reset without racing the
+ * new device. Reopens for recovery keep the session and are not reported.
+ *
+ * @param callback Function, NULL to remove; set before usb_host_init()
+ */
+void usb_host_register_open_callback(usb_open_callback_t callback);
+
+/**
+ * @brief Check if at least one FDF console is connected
  * @return true if connected, false otherwise
  */
 bool usb_host_is_connected(void);
 
+/**
+ * @brief Check if a given FDF console is connected
+ * @param console_id Console slot
+ * @return true if connected, false otherwise
+ */
+bool usb_host_console_is_connected(uint8_t console_id);
+
+/**
+ * @brief Get the adapter profile applied to a console
+ * @param console_id Console slot
+ * @return Profile, or NULL if the console is not connected
+ */
+const console_profile_t *usb_host_get_console_profile(uint8_t console_id);
+
 /**
  * @brief Get current USB host status
  * @return USB host status
@@ -39,12 +116,85 @@ bool usb_host_is_connected(void);
 usb_host_status_t usb_host_get_status(void);
 
 /**
- * @brief Send data to USB device (if needed)
+ * @brief Queue data for transmission to a console
+ *
+ * Never blocks: the data is copied into the TX queue and written to the
+ * device by the USB TX task.
+ *
+ * @param console_id Console slot
  * @param data Data to send
- * @param len Length of data
+ * @param len Length of data (at most USB_TX_MAX_COMMAND_SIZE)
+ * @return ESP_OK if queued, ESP_ERR_INVALID_STATE if the console is not connected,
+ *         ESP_ERR_INVALID_SIZE if too long, ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t usb_host_send_data(uint8_t console_id, const uint8_t *data, size_t len);
+
+/**
+ * @brief Pulse DTR away from the level of the console's profile and back
+ *
+ * Wakes consoles and adapters that reset their serial link on DTR. Blocks
+ * for the pulse (about 100 ms).
+ *
+ * @param console_id Console slot
+ * @return ESP_OK if both control requests succeeded, ESP_ERR_INVALID_STATE
+ *         if the console is not connected
+ */
+esp_err_t usb_host_toggle_dtr(uint8_t console_id);
+
+/**
+ * @brief Close and reopen the CDC-ACM device of a console
+ *
+ * Done by the USB host task; the slot keeps its console and session. If the
+ * device cannot be opened again it is reported as disconnected.
+ *
+ * @param console_id Console slot
+ * @return ESP_OK if the reopen was requested, ESP_ERR_INVALID_STATE if the
+ *         console is not connected
+ */
+esp_err_t usb_host_reopen_console(uint8_t console_id);
+
+/**
+ * @brief Start issuing periodic status requests to connected polled consoles
+ *
+ * Consoles are polled only while console_dialect() is CONSOLE_DIALECT_POLLED,
+ * which CONFIG_FDF_CONSOLE_POLL_ENABLE selects for every console.
+ *
+ * @param config Poll configuration (request bytes are copied)
  * @return ESP_OK if successful, error code otherwise
  */
-esp_err_t usb_host_send_data(const uint8_t *data, size_t len);
+esp_err_t usb_host_start_polling(const usb_poll_config_t *config);
+
+/**
+ * @brief Stop issuing periodic status requests
+ */
+void usb_host_stop_polling(void);
+
+/**
+ * @brief Match a received response to the oldest outstanding request of a console
+ * @param console_id Console slot
+ * @param rtt_us Optional pointer filled with the request round-trip time
+ * @return true if a pending request was matched, false if none was outstanding
+ */
+bool usb_host_poll_response_received(uint8_t console_id, uint32_t *rtt_us);
+
+/**
+ * @brief Get poll scheduler statistics of a console
+ * @param console_id Console slot
+ * @param stats Pointer to structure to fill
+ */
+void usb_host_get_poll_stats(uint8_t console_id, usb_poll_stats_t *stats);
+
+/**
+ * @brief Get transfer counters of a console
+ * @param console_id Console slot
+ * @param stats Pointer to structure to fill
+ */
+void usb_host_get_console_stats(uint8_t console_id, usb_console_stats_t *stats);
+
+/**
+ * @brief Clear the transfer and poll counters of every console
+ */
+void usb_host_reset_stats(void);
 
 /**
  * @brief Deinitialize USB host